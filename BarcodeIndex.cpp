@@ -0,0 +1,51 @@
+﻿#include "BarcodeIndex.h"
+#include <QDebug>
+
+void BarcodeIndex::build(const QVector<ProductBarcode>& barcodes, const QSet<int>& productIds)
+{
+    m_entries.clear();
+    m_entries.reserve(barcodes.size());
+
+    int duplicates = 0;
+    for (const ProductBarcode& barcode : barcodes) {
+        if (!productIds.isEmpty() && !productIds.contains(barcode.productId)) {
+            continue;
+        }
+        const QByteArray code = normalize(barcode.barcode.toLatin1());
+        if (code.isEmpty()) {
+            continue;
+        }
+        // Во всех локациях сразу один код есть у нескольких строк - берется первая
+        if (m_entries.contains(code)) {
+            ++duplicates;
+            continue;
+        }
+        Entry entry;
+        entry.productId = barcode.productId;
+        entry.packQuantity = qMax(1, barcode.packQuantity);
+        m_entries.insert(code, entry);
+    }
+
+    if (duplicates > 0) {
+        qWarning() << "⚠️ Barcodes shared by several products:" << duplicates;
+    }
+}
+
+QByteArray BarcodeIndex::normalize(const QByteArray& code)
+{
+    int first = 0;
+    int last = code.size();
+    while (first < last && quint8(code.at(first)) <= ' ') {
+        ++first;
+    }
+    while (last > first && quint8(code.at(last - 1)) <= ' ') {
+        --last;
+    }
+    return code.mid(first, last - first);
+}
+
+const BarcodeIndex::Entry* BarcodeIndex::find(const QByteArray& code) const
+{
+    auto it = m_entries.constFind(code);
+    return it != m_entries.cend() ? &it.value() : nullptr;
+}
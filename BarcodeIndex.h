@@ -0,0 +1,40 @@
+﻿#ifndef BARCODEINDEX_H
+#define BARCODEINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include "DatabaseManager.h"
+
+// Штрихкод -> строка продукта для сканера.
+//
+// Коды хранятся как ASCII-байты (QByteArray): поиск из потока чтения
+// сканера обходится без преобразования в QString. Индекс строится по
+// строкам загруженного каталога: код продукта из другой локации не
+// распознается.
+class BarcodeIndex
+{
+public:
+    struct Entry {
+        int productId = 0;
+        int packQuantity = 1;
+    };
+
+    BarcodeIndex() = default;
+
+    // productIds - продукты в каталоге терминала; пустой - без ограничения
+    void build(const QVector<ProductBarcode>& barcodes, const QSet<int>& productIds = QSet<int>());
+
+    // Пробелы и управляющие символы по краям отбрасываются
+    static QByteArray normalize(const QByteArray& code);
+
+    const Entry* find(const QByteArray& code) const;
+    int size() const { return m_entries.size(); }
+    bool isEmpty() const { return m_entries.isEmpty(); }
+
+private:
+    QHash<QByteArray, Entry> m_entries;
+};
+
+#endif // BARCODEINDEX_H
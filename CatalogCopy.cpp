@@ -0,0 +1,856 @@
+﻿#include "CatalogCopy.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QQueue>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QVariantList>
+#include <QWaitCondition>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <cstring>
+#include "DatabaseManager.h"
+#include "Money.h"
+#include "PgCopy.h"
+#include "ProtobufSerializer.h"
+#include "StockLedger.h"
+
+namespace {
+
+typedef QVector<ProductData> Batch;
+
+const int CatalogColumns = 6;
+const char* const CsvHeader = "id;name;current_quantity;norm_quantity;location_id;unit_cost";
+
+// Очередь между стадиями конвейера. push ждет, пока в очереди есть место,
+// pop - пока есть элемент или писатель не закрыл очередь. cancel будит
+// всех: после него push и pop сразу возвращают false.
+template<typename T>
+class StageChannel
+{
+public:
+    explicit StageChannel(int capacity) : m_capacity(capacity) {}
+
+    bool push(T value)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_queue.size() >= m_capacity && !m_cancelled) {
+            m_notFull.wait(&m_mutex);
+        }
+        if (m_cancelled) {
+            return false;
+        }
+        m_queue.enqueue(std::move(value));
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    // false - очередь закрыта и пуста или отменена
+    bool pop(T& value)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_queue.isEmpty() && !m_closed && !m_cancelled) {
+            m_notEmpty.wait(&m_mutex);
+        }
+        if (m_cancelled || m_queue.isEmpty()) {
+            return false;
+        }
+        value = m_queue.dequeue();
+        m_notFull.wakeOne();
+        return true;
+    }
+
+    void close()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+    }
+
+    void cancel()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_cancelled = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+    bool isCancelled()
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_cancelled;
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<T> m_queue;
+    int m_capacity;
+    bool m_closed = false;
+    bool m_cancelled = false;
+};
+
+// --- CSV ---
+
+QStringList splitCsv(const QString& line)
+{
+    QStringList fields;
+    QString field;
+    bool quoted = false;
+    for (int i = 0; i < line.size(); ++i) {
+        const QChar c = line.at(i);
+        if (quoted) {
+            if (c != '"') {
+                field += c;
+            }
+            else if (i + 1 < line.size() && line.at(i + 1) == '"') {
+                field += c;
+                ++i;
+            }
+            else {
+                quoted = false;
+            }
+        }
+        else if (c == '"') {
+            quoted = true;
+        }
+        else if (c == ';') {
+            fields << field;
+            field.clear();
+        }
+        else {
+            field += c;
+        }
+    }
+    fields << field;
+    return fields;
+}
+
+// id и location_id могут быть пустыми: новый продукт, локация по умолчанию
+bool parseCsv(const QStringList& fields, ProductData& product, QString& error)
+{
+    if (fields.size() < 4) {
+        error = QString("ожидается '%1'").arg(CsvHeader);
+        return false;
+    }
+
+    bool ok = true;
+    const QString id = fields.at(0).trimmed();
+    product = ProductData(id.isEmpty() ? 0 : id.toInt(&ok), fields.at(1).trimmed());
+    if (!ok || product.id < 0) {
+        error = "неверный id";
+        return false;
+    }
+    if (product.name.isEmpty()) {
+        error = "пустое название";
+        return false;
+    }
+
+    bool currentOk = false;
+    bool normOk = false;
+    product.currentQuantity = fields.at(2).trimmed().toInt(&currentOk);
+    product.normQuantity = fields.at(3).trimmed().toInt(&normOk);
+    if (!currentOk || !normOk || product.currentQuantity < 0 || product.normQuantity < 0) {
+        error = "количество должно быть неотрицательным целым";
+        return false;
+    }
+
+    const QString location = fields.value(4).trimmed();
+    if (!location.isEmpty()) {
+        product.locationId = location.toInt(&ok);
+        if (!ok || product.locationId < 0) {
+            error = "неверный location_id";
+            return false;
+        }
+        if (product.locationId == 0) {
+            product.locationId = DefaultLocationId;
+        }
+    }
+
+    const QString cost = fields.value(5).trimmed();
+    if (!cost.isEmpty() && !Money::parse(cost, product.unitCost)) {
+        error = "неверная цена";
+        return false;
+    }
+    return true;
+}
+
+// Переводы строк в названии заменяются пробелами: CSV читается построчно
+void appendCsv(QByteArray& out, const ProductData& product)
+{
+    QString name = product.name;
+    name.replace(QLatin1Char('\r'), QLatin1Char(' ')).replace(QLatin1Char('\n'), QLatin1Char(' '));
+    const bool quote = name.contains(';') || name.contains('"') || name != name.trimmed();
+
+    out.append(QByteArray::number(product.id)).append(';');
+    if (quote) {
+        out.append('"').append(name.replace("\"", "\"\"").toUtf8()).append('"');
+    }
+    else {
+        out.append(name.toUtf8());
+    }
+    out.append(';').append(QByteArray::number(product.currentQuantity))
+        .append(';').append(QByteArray::number(product.normQuantity))
+        .append(';').append(QByteArray::number(product.locationId))
+        .append(';').append(Money::format(product.unitCost).toLatin1())
+        .append('\n');
+}
+
+// --- Двоичный формат COPY (см. PgCopy::binaryHeader) ---
+
+template<typename T>
+void appendBigEndian(QByteArray& out, T value)
+{
+    char bytes[sizeof(T)];
+    qToBigEndian(value, bytes);
+    out.append(bytes, int(sizeof(T)));
+}
+
+void appendInt32Field(QByteArray& out, qint32 value)
+{
+    appendBigEndian<qint32>(out, 4);
+    appendBigEndian<qint32>(out, value);
+}
+
+// Столбцы catalog_import: id, name, current_quantity, norm_quantity, location_id, unit_cost
+void appendBinaryRow(QByteArray& out, const ProductData& product)
+{
+    appendBigEndian<qint16>(out, CatalogColumns);
+    if (product.id > 0) {
+        appendInt32Field(out, product.id);
+    }
+    else {
+        appendBigEndian<qint32>(out, -1);
+    }
+    const QByteArray name = product.name.toUtf8();
+    appendBigEndian<qint32>(out, name.size());
+    out.append(name);
+    appendInt32Field(out, product.currentQuantity);
+    appendInt32Field(out, product.normQuantity);
+    appendInt32Field(out, product.locationId > 0 ? product.locationId : DefaultLocationId);
+    appendBigEndian<qint32>(out, 8);
+    appendBigEndian<qint64>(out, product.unitCost);
+}
+
+// Разбор куска выгрузки: целые строки, в первом куске - заголовок.
+// finished - встретился конец потока (int16 -1).
+class BinaryDecoder
+{
+public:
+    bool decode(const QByteArray& chunk, Batch& rows, QString& error)
+    {
+        const char* data = chunk.constData();
+        const int size = chunk.size();
+        int pos = 0;
+
+        if (!m_headerSeen) {
+            if (size < PgCopy::BinaryHeaderSize
+                || memcmp(data, PgCopy::binaryHeader().constData(), 11) != 0) {
+                error = "COPY: неверный заголовок двоичного потока";
+                return false;
+            }
+            const qint32 extension = qFromBigEndian<qint32>(data + 15);
+            pos = PgCopy::BinaryHeaderSize + extension;
+            m_headerSeen = true;
+        }
+
+        while (pos < size) {
+            if (size - pos < 2) {
+                break;
+            }
+            const qint16 fields = qFromBigEndian<qint16>(data + pos);
+            pos += 2;
+            if (fields == -1) {
+                m_finished = true;
+                return true;
+            }
+            if (fields != CatalogColumns) {
+                break;
+            }
+
+            QByteArray values[CatalogColumns];
+            bool isNull[CatalogColumns] = {};
+            for (int i = 0; i < CatalogColumns; ++i) {
+                if (size - pos < 4) {
+                    error = "COPY: строка обрезана";
+                    return false;
+                }
+                const qint32 length = qFromBigEndian<qint32>(data + pos);
+                pos += 4;
+                if (length < 0) {
+                    isNull[i] = true;
+                    continue;
+                }
+                if (size - pos < length) {
+                    error = "COPY: строка обрезана";
+                    return false;
+                }
+                values[i] = QByteArray::fromRawData(data + pos, length);
+                pos += length;
+            }
+
+            auto int32At = [&](int column) {
+                return isNull[column] || values[column].size() != 4 ? 0 : qFromBigEndian<qint32>(values[column].constData());
+            };
+            ProductData product(int32At(0), QString::fromUtf8(values[1]), int32At(2), int32At(3), int32At(4));
+            product.unitCost = isNull[5] || values[5].size() != 8 ? 0 : qFromBigEndian<qint64>(values[5].constData());
+            rows.append(product);
+        }
+
+        if (pos != size) {
+            error = "COPY: неожиданный формат строки";
+            return false;
+        }
+        return true;
+    }
+
+    bool isFinished() const { return m_finished; }
+
+private:
+    bool m_headerSeen = false;
+    bool m_finished = false;
+};
+
+// --- Стадии конвейера ---
+
+// Чтение файла пачками по BatchRows; пустая строка - успех или отмена
+QString readStage(const QString& filePath, CatalogCopy::Format format, StageChannel<Batch>& out)
+{
+    Batch batch;
+    batch.reserve(CatalogCopy::BatchRows);
+    auto emitBatch = [&]() {
+        if (batch.isEmpty()) {
+            return true;
+        }
+        Batch full;
+        full.reserve(CatalogCopy::BatchRows);
+        full.swap(batch);
+        return out.push(std::move(full));
+    };
+
+    if (format == CatalogCopy::Format::Snapshot) {
+        ProductSnapshotReader reader;
+        if (!reader.open(filePath)) {
+            return reader.getLastError();
+        }
+        ProductData product;
+        while (reader.next(product)) {
+            batch.append(product);
+            if (batch.size() >= CatalogCopy::BatchRows && !emitBatch()) {
+                return QString();
+            }
+        }
+        if (!reader.getLastError().isEmpty()) {
+            return reader.getLastError();
+        }
+        emitBatch();
+        return QString();
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return "Не удалось открыть " + filePath;
+    }
+    QTextStream in(&file);
+    in.setCodec("UTF-8");
+
+    qint64 lineNumber = 0;
+    bool firstLine = true;
+    QString line;
+    ProductData product;
+    QString error;
+    while (in.readLineInto(&line)) {
+        ++lineNumber;
+        if (line.trimmed().isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        const QStringList fields = splitCsv(line);
+        if (firstLine) {
+            firstLine = false;
+            bool numeric = false;
+            fields.at(0).trimmed().toInt(&numeric);
+            if (!numeric && !fields.at(0).trimmed().isEmpty()) {
+                continue;   // заголовок
+            }
+        }
+        if (!parseCsv(fields, product, error)) {
+            return QString("Строка %1: %2").arg(lineNumber).arg(error);
+        }
+        batch.append(product);
+        if (batch.size() >= CatalogCopy::BatchRows && !emitBatch()) {
+            return QString();
+        }
+    }
+    emitBatch();
+    return QString();
+}
+
+// Запись пачек в файл; rows - сколько продуктов записано
+QString writeStage(const QString& filePath, CatalogCopy::Format format, StageChannel<Batch>& in, qint64& rows)
+{
+    Batch batch;
+    if (format == CatalogCopy::Format::Snapshot) {
+        ProductSnapshotWriter writer;
+        if (!writer.open(filePath)) {
+            return writer.getLastError();
+        }
+        while (in.pop(batch)) {
+            for (const ProductData& product : batch) {
+                if (!writer.write(product)) {
+                    return writer.getLastError();
+                }
+            }
+            rows += batch.size();
+        }
+        if (!writer.close()) {
+            return writer.getLastError();
+        }
+        return QString();
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return "Не удалось создать " + filePath;
+    }
+    QByteArray buffer(CsvHeader);
+    buffer.append('\n');
+    buffer.reserve(CatalogCopy::ChunkBytes + 4096);
+    while (in.pop(batch)) {
+        for (const ProductData& product : batch) {
+            appendCsv(buffer, product);
+        }
+        rows += batch.size();
+        if (buffer.size() >= CatalogCopy::ChunkBytes) {
+            if (file.write(buffer) != buffer.size()) {
+                return "Ошибка записи " + filePath;
+            }
+            buffer.clear();
+        }
+    }
+    if (file.write(buffer) != buffer.size()) {
+        return "Ошибка записи " + filePath;
+    }
+    return QString();
+}
+
+} // namespace
+
+CatalogCopy::CatalogCopy(const QSqlDatabase& db)
+    : m_db(db)
+{
+}
+
+CatalogCopy::Format CatalogCopy::formatFor(const QString& filePath)
+{
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    return suffix == "pb" || suffix == "bin" ? Format::Snapshot : Format::Csv;
+}
+
+bool CatalogCopy::stageTable()
+{
+    QSqlQuery query(m_db);
+    const bool postgres = m_db.driverName() == "QPSQL";
+    // Типы столбцов - ровно те, что кодирует appendBinaryRow
+    const QString create = QString("CREATE TEMP TABLE catalog_import (id INTEGER, name TEXT NOT NULL, "
+        "current_quantity INTEGER NOT NULL, norm_quantity INTEGER NOT NULL, "
+        "location_id INTEGER NOT NULL, unit_cost BIGINT NOT NULL)") + (postgres ? " ON COMMIT DROP" : "");
+    if (!query.exec("DROP TABLE IF EXISTS catalog_import") || !query.exec(create)) {
+        m_lastError = query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool CatalogCopy::merge()
+{
+    const bool postgres = m_db.driverName() == "QPSQL";
+    const QString correction = QString::number(StockLedger::Correction);
+    // Время движений - как у записей из буфера журнала (UTC, ISO)
+    const QString sqliteNow = "strftime('%Y-%m-%dT%H:%M:%fZ', 'now')";
+    // Прежний остаток - с учетом слотов шардированных счетчиков
+    const QString oldQuantity = "p.current_quantity + COALESCE((SELECT SUM(delta) FROM product_quantity_deltas "
+        "WHERE product_id = p.id), 0)";
+    const QString upsert = "INSERT INTO products (id, name, current_quantity, norm_quantity, location_id, unit_cost) "
+        "SELECT id, name, current_quantity, norm_quantity, location_id, unit_cost FROM catalog_import "
+        "WHERE id IS NOT NULL "
+        "ON CONFLICT (id) DO UPDATE SET name = excluded.name, current_quantity = excluded.current_quantity, "
+        "norm_quantity = excluded.norm_quantity, location_id = excluded.location_id, "
+        "unit_cost = excluded.unit_cost, version = products.version + 1";
+    const QString append = "INSERT INTO products (name, current_quantity, norm_quantity, location_id, unit_cost) "
+        "SELECT name, current_quantity, norm_quantity, location_id, unit_cost FROM catalog_import "
+        "WHERE id IS NULL";
+
+    QStringList statements;
+    if (postgres) {
+        // Строки блокируются заранее, отдельным оператором: в одном операторе
+        // со слиянием FOR UPDATE пропустил бы строки, уже измененные им самим.
+        // Дальше один оператор: прежние остатки, удаление слотов, слияние и
+        // разница в журнал - все по одному снимку
+        statements << "SELECT p.id FROM products p JOIN catalog_import c ON c.id = p.id ORDER BY p.id FOR UPDATE OF p";
+        QString merged = "WITH old AS (SELECT p.id, " + oldQuantity + " AS quantity FROM products p "
+            "JOIN catalog_import c ON c.id = p.id), "
+            "cleared AS (DELETE FROM product_quantity_deltas q USING catalog_import c WHERE q.product_id = c.id), "
+            "merged AS (" + upsert + " RETURNING id, current_quantity) ";
+        if (m_recordMovements) {
+            merged += "INSERT INTO stock_movements (product_id, delta, kind, created_at) "
+                "SELECT m.id, m.current_quantity - COALESCE(old.quantity, 0), " + correction + ", now() "
+                "FROM merged m LEFT JOIN old ON old.id = m.id "
+                "WHERE m.current_quantity <> COALESCE(old.quantity, 0)";
+        }
+        else {
+            merged += "SELECT COUNT(*) FROM merged";
+        }
+        statements << merged
+            // Явные id не двигают последовательность - догоняем до новых строк
+            << "SELECT setval(pg_get_serial_sequence('products', 'id'), MAX(id)) FROM products";
+        statements << (m_recordMovements
+            ? "WITH added AS (" + append + " RETURNING id, current_quantity) "
+              "INSERT INTO stock_movements (product_id, delta, kind, created_at) "
+              "SELECT id, current_quantity, " + correction + ", now() FROM added WHERE current_quantity <> 0"
+            : append);
+    }
+    else {
+        // SQLite без изменяющих CTE: движения по прежним остаткам - до
+        // слияния, в той же транзакции (писатель один)
+        if (m_recordMovements) {
+            statements << "INSERT INTO stock_movements (product_id, delta, kind, created_at) "
+                "SELECT c.id, c.current_quantity - COALESCE(" + oldQuantity + ", 0), " + correction + ", " + sqliteNow + " "
+                "FROM catalog_import c LEFT JOIN products p ON p.id = c.id "
+                "WHERE c.id IS NOT NULL AND c.current_quantity <> COALESCE(" + oldQuantity + ", 0)";
+        }
+        statements
+            << "DELETE FROM product_quantity_deltas WHERE product_id IN "
+               "(SELECT id FROM catalog_import WHERE id IS NOT NULL)"
+            << upsert;
+    }
+
+    QSqlQuery query(m_db);
+    for (const QString& sql : statements) {
+        if (!query.exec(sql)) {
+            m_lastError = query.lastError().text();
+            return false;
+        }
+    }
+    if (postgres) {
+        return true;
+    }
+
+    // SQLite: строки без id и их движения. Максимум берется после слияния
+    // строк с явными id (их движения уже записаны): новые id больше него
+    if (!query.exec("SELECT COALESCE(MAX(id), 0) FROM products") || !query.next()) {
+        m_lastError = query.lastError().text();
+        return false;
+    }
+    const qint64 lastId = query.value(0).toLongLong();
+    query.finish();
+    if (!query.exec(append)) {
+        m_lastError = query.lastError().text();
+        return false;
+    }
+    if (m_recordMovements) {
+        query.prepare("INSERT INTO stock_movements (product_id, delta, kind, created_at) "
+            "SELECT id, current_quantity, " + correction + ", " + sqliteNow + " "
+            "FROM products WHERE id > :last AND current_quantity <> 0");
+        query.bindValue(":last", lastId);
+        if (!query.exec()) {
+            m_lastError = query.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CatalogCopy::importFile(const QString& filePath, Stats* stats)
+{
+    m_lastError.clear();
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!QFileInfo::exists(filePath)) {
+        m_lastError = "Файл не найден: " + filePath;
+        return false;
+    }
+    if (!stageTable()) {
+        return false;
+    }
+
+    const bool binaryCopy = PgCopy::isSupported(m_db);
+    StageChannel<Batch> parsed(QueueDepth);
+    StageChannel<QByteArray> encoded(QueueDepth);
+    auto cancelAll = [&]() {
+        parsed.cancel();
+        encoded.cancel();
+    };
+
+    // Свой пул: стадии ждут друг друга, общий пул мог бы оказаться занят
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+
+    const Format format = formatFor(filePath);
+    QFuture<QString> reader = QtConcurrent::run(&pool, [&]() {
+        const QString error = readStage(filePath, format, parsed);
+        if (error.isEmpty()) {
+            parsed.close();
+        }
+        else {
+            cancelAll();
+        }
+        return error;
+    });
+
+    QFuture<void> encoder;
+    if (binaryCopy) {
+        encoder = QtConcurrent::run(&pool, [&]() {
+            QByteArray chunk = PgCopy::binaryHeader();
+            Batch batch;
+            while (parsed.pop(batch)) {
+                for (const ProductData& product : batch) {
+                    appendBinaryRow(chunk, product);
+                }
+                if (!encoded.push(std::move(chunk))) {
+                    return;
+                }
+                chunk = QByteArray();
+                chunk.reserve(ChunkBytes);
+            }
+            if (!parsed.isCancelled()) {
+                chunk.append(PgCopy::binaryTrailer());
+                encoded.push(std::move(chunk));
+                encoded.close();
+            }
+        });
+    }
+
+    qint64 rows = 0;
+    QString sendError;
+    if (binaryCopy) {
+        PgCopy copy(m_db);
+        if (copy.begin("COPY catalog_import (id, name, current_quantity, norm_quantity, location_id, unit_cost) "
+                "FROM STDIN (FORMAT binary)")) {
+            QByteArray chunk;
+            while (encoded.pop(chunk)) {
+                if (!copy.write(chunk)) {
+                    sendError = copy.getLastError();
+                    cancelAll();
+                    break;
+                }
+            }
+        }
+        else {
+            sendError = copy.getLastError();
+            cancelAll();
+        }
+
+        reader.waitForFinished();
+        encoder.waitForFinished();
+        const QString error = sendError.isEmpty() ? reader.result() : sendError;
+        if (!error.isEmpty()) {
+            copy.abort(error);
+            m_lastError = error;
+            return false;
+        }
+        if (!copy.finish(&rows)) {
+            m_lastError = copy.getLastError();
+            return false;
+        }
+    }
+    else {
+        QSqlQuery query(m_db);
+        query.prepare("INSERT INTO catalog_import (id, name, current_quantity, norm_quantity, location_id, unit_cost) "
+            "VALUES (?, ?, ?, ?, ?, ?)");
+        Batch batch;
+        while (parsed.pop(batch)) {
+            QVariantList columns[CatalogColumns];
+            for (const ProductData& product : batch) {
+                columns[0] << (product.id > 0 ? QVariant(product.id) : QVariant(QVariant::Int));
+                columns[1] << product.name;
+                columns[2] << product.currentQuantity;
+                columns[3] << product.normQuantity;
+                columns[4] << (product.locationId > 0 ? product.locationId : DefaultLocationId);
+                columns[5] << product.unitCost;
+            }
+            for (const QVariantList& column : columns) {
+                query.addBindValue(column);
+            }
+            if (!query.execBatch()) {
+                sendError = query.lastError().text();
+                cancelAll();
+                break;
+            }
+            rows += batch.size();
+        }
+
+        reader.waitForFinished();
+        const QString error = sendError.isEmpty() ? reader.result() : sendError;
+        if (!error.isEmpty()) {
+            m_lastError = error;
+            return false;
+        }
+    }
+
+    if (!merge()) {
+        return false;
+    }
+
+    if (stats) {
+        stats->rows = rows;
+        stats->elapsedMs = timer.elapsed();
+    }
+    return true;
+}
+
+bool CatalogCopy::exportFile(const QString& filePath, int locationId, Stats* stats)
+{
+    m_lastError.clear();
+    QElapsedTimer timer;
+    timer.start();
+
+    const bool binaryCopy = PgCopy::isSupported(m_db);
+    StageChannel<QByteArray> received(QueueDepth);
+    StageChannel<Batch> decoded(QueueDepth);
+    auto cancelAll = [&]() {
+        received.cancel();
+        decoded.cancel();
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+
+    qint64 rows = 0;
+    const Format format = formatFor(filePath);
+    QFuture<QString> writer = QtConcurrent::run(&pool, [&]() {
+        const QString error = writeStage(filePath, format, decoded, rows);
+        if (!error.isEmpty()) {
+            cancelAll();
+        }
+        return error;
+    });
+
+    QFuture<QString> decoder;
+    if (binaryCopy) {
+        decoder = QtConcurrent::run(&pool, [&]() {
+            BinaryDecoder binary;
+            QByteArray chunk;
+            QString error;
+            while (received.pop(chunk)) {
+                Batch batch;
+                batch.reserve(BatchRows);
+                if (!binary.decode(chunk, batch, error)) {
+                    cancelAll();
+                    return error;
+                }
+                if (!batch.isEmpty() && !decoded.push(std::move(batch))) {
+                    return QString();
+                }
+            }
+            if (!received.isCancelled()) {
+                if (!binary.isFinished()) {
+                    cancelAll();
+                    return QString("COPY: поток оборвался до конца");
+                }
+                decoded.close();
+            }
+            return QString();
+        });
+    }
+
+    // Остаток - с учетом слотов шардированных счетчиков, как у loadProducts
+    const QString select = "SELECT p.id, p.name, "
+        "CAST(p.current_quantity + COALESCE(s.delta, 0) AS INTEGER), p.norm_quantity, p.location_id, p.unit_cost "
+        "FROM products p LEFT JOIN (SELECT product_id, SUM(delta) AS delta FROM product_quantity_deltas "
+        "GROUP BY product_id) s ON s.product_id = p.id "
+        + (locationId > 0 ? QString("WHERE p.location_id = %1 ").arg(locationId) : QString())
+        + "ORDER BY p.id";
+
+    QString receiveError;
+    if (binaryCopy) {
+        // name - VARCHAR, в двоичном виде совпадает с TEXT
+        PgCopy copy(m_db);
+        if (copy.beginOut("COPY (" + select + ") TO STDOUT (FORMAT binary)")) {
+            // PQgetCopyData отдает по строке - складываем в куски побольше
+            QByteArray chunk;
+            chunk.reserve(ChunkBytes + 4096);
+            QByteArray row;
+            while (copy.read(row)) {
+                chunk.append(row);
+                if (chunk.size() >= ChunkBytes) {
+                    if (!received.push(std::move(chunk))) {
+                        copy.abort("export cancelled");
+                        break;
+                    }
+                    chunk = QByteArray();
+                    chunk.reserve(ChunkBytes + 4096);
+                }
+            }
+            if (!copy.getLastError().isEmpty()) {
+                receiveError = copy.getLastError();
+                cancelAll();
+            }
+            else if (!received.isCancelled()) {
+                received.push(std::move(chunk));
+                received.close();
+            }
+        }
+        else {
+            receiveError = copy.getLastError();
+            cancelAll();
+        }
+        decoder.waitForFinished();
+    }
+    else {
+        QSqlQuery query(m_db);
+        query.setForwardOnly(true);
+        if (query.exec(select)) {
+            Batch batch;
+            batch.reserve(BatchRows);
+            bool cancelled = false;
+            while (query.next()) {
+                ProductData product(query.value(0).toInt(), query.value(1).toString(), query.value(2).toInt(),
+                    query.value(3).toInt(), query.value(4).toInt());
+                product.unitCost = query.value(5).toLongLong();
+                batch.append(product);
+                if (batch.size() >= BatchRows) {
+                    if (!decoded.push(std::move(batch))) {
+                        cancelled = true;
+                        break;
+                    }
+                    batch = Batch();
+                    batch.reserve(BatchRows);
+                }
+            }
+            if (!cancelled && decoded.push(std::move(batch))) {
+                decoded.close();
+            }
+        }
+        else {
+            receiveError = query.lastError().text();
+            cancelAll();
+        }
+    }
+
+    writer.waitForFinished();
+    QString error = receiveError;
+    if (error.isEmpty() && binaryCopy) {
+        error = decoder.result();
+    }
+    if (error.isEmpty()) {
+        error = writer.result();
+    }
+    if (!error.isEmpty()) {
+        m_lastError = error;
+        QFile::remove(filePath);
+        return false;
+    }
+
+    if (stats) {
+        stats->rows = rows;
+        stats->elapsedMs = timer.elapsed();
+    }
+    return true;
+}
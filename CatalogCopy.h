@@ -0,0 +1,71 @@
+﻿#ifndef CATALOGCOPY_H
+#define CATALOGCOPY_H
+
+#include <QSqlDatabase>
+#include <QString>
+
+// Массовая загрузка и выгрузка каталога products: файл снимка
+// ProductListProto (.pb, .bin) или CSV <-> PostgreSQL через двоичный COPY.
+//
+// Загрузка - конвейер из трех стадий: файл читается и разбирается в одном
+// потоке, пачки продуктов кодируются в двоичный формат COPY в другом, а
+// вызывающий поток передает готовые куски в соединение. Стадии связаны
+// очередями ограниченной длины, поэтому файл читается, пока предыдущие
+// пачки кодируются и уходят в базу, а память не растет с размером
+// каталога. Выгрузка - тот же конвейер в обратную сторону.
+//
+// Строки сначала попадают во временную таблицу catalog_import, затем
+// сливаются в products: строки с id обновляют продукт с этим id (или
+// создают его), строки без id добавляются как новые. Остаток из файла -
+// полный, слоты шардированных счетчиков обновленных продуктов удаляются.
+// Изменение остатка пишется в журнал движением Correction теми же
+// операторами, что сливают строки (setRecordMovements).
+// Работает в текущей транзакции соединения; открывает и фиксирует ее
+// вызывающий (см. DatabaseManager::importCatalog).
+//
+// Без QPSQL (SQLite) стадия кодирования не нужна: пачки пишутся в
+// catalog_import через execBatch.
+class CatalogCopy
+{
+public:
+    enum class Format {
+        Snapshot,   // ProductListProto, как у ProtobufSerializer::exportProducts
+        Csv         // id;name;current_quantity;norm_quantity;location_id;unit_cost
+    };
+
+    static const int BatchRows = 4096;
+    static const int QueueDepth = 8;
+    static const int ChunkBytes = 256 * 1024;
+
+    struct Stats {
+        qint64 rows = 0;
+        qint64 elapsedMs = 0;
+    };
+
+    explicit CatalogCopy(const QSqlDatabase& db);
+
+    // .pb и .bin - снимок, остальное - CSV
+    static Format formatFor(const QString& filePath);
+
+    // Писать ли движения в stock_movements: только при готовом журнале
+    // (таблица и партиция текущего месяца есть)
+    void setRecordMovements(bool record) { m_recordMovements = record; }
+
+    bool importFile(const QString& filePath, Stats* stats = nullptr);
+
+    // Остатки - с учетом слотов счетчиков; locationId = 0 - все локации.
+    // При ошибке недописанный файл удаляется.
+    bool exportFile(const QString& filePath, int locationId = 0, Stats* stats = nullptr);
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    bool stageTable();
+    bool merge();
+
+    QSqlDatabase m_db;
+    QString m_lastError;
+    bool m_recordMovements = false;
+};
+
+#endif // CATALOGCOPY_H
@@ -0,0 +1,215 @@
+﻿#include "ConnectionMonitor.h"
+#include <QDebug>
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+
+// Проверочное соединение; живет и используется только в потоке монитора
+class HealthProbe : public QObject
+{
+public:
+    ~HealthProbe() { close(); }
+
+    // Номер первых подошедших параметров или -1; reopened - соединение
+    // пришлось открыть заново (например, сервер перезапускался)
+    int probe(const QVector<ConnectionSettings>& candidates, bool& reopened, QString& error)
+    {
+        reopened = false;
+        for (int i = 0; i < candidates.size(); ++i) {
+            if (ping(candidates.at(i), reopened, error)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void close()
+    {
+        const QString name = m_db.connectionName();
+        m_db = QSqlDatabase();
+        if (!name.isEmpty()) {
+            QSqlDatabase::removeDatabase(name);
+        }
+    }
+
+private:
+    static bool sameSettings(const ConnectionSettings& a, const ConnectionSettings& b)
+    {
+        return a.driver == b.driver && a.hostName == b.hostName && a.port == b.port
+            && a.databaseName == b.databaseName && a.userName == b.userName
+            && a.password == b.password && a.connectOptions == b.connectOptions;
+    }
+
+    bool ping(const ConnectionSettings& settings, bool& reopened, QString& error)
+    {
+        if (!m_db.isValid() || !sameSettings(settings, m_settings)) {
+            close();
+            m_db = QSqlDatabase::addDatabase(settings.driver, QString("fridge_health_%1").arg(quintptr(this), 0, 16));
+            m_db.setConnectOptions(settings.connectOptions);
+            m_db.setHostName(settings.hostName);
+            m_db.setPort(settings.port);
+            m_db.setDatabaseName(settings.databaseName);
+            m_db.setUserName(settings.userName);
+            m_db.setPassword(settings.password);
+            m_settings = settings;
+        }
+
+        if (!m_db.isOpen()) {
+            reopened = true;
+            if (!m_db.open()) {
+                error = m_db.lastError().text();
+                return false;
+            }
+        }
+
+        QSqlQuery query(m_db);
+        if (!query.exec("SELECT 1")) {
+            error = query.lastError().text();
+            m_db.close();
+            return false;
+        }
+        return true;
+    }
+
+    QSqlDatabase m_db;
+    ConnectionSettings m_settings;
+};
+
+ConnectionMonitor::ConnectionMonitor(DatabaseManager* database, QObject* parent)
+    : QObject(parent)
+    , m_database(database)
+    , m_probe(new HealthProbe)
+{
+    m_probe->moveToThread(&m_thread);
+    m_thread.setObjectName("fridge-health");
+    m_thread.start(QThread::LowPriority);
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &ConnectionMonitor::requestProbe);
+}
+
+ConnectionMonitor::~ConnectionMonitor()
+{
+    stop();
+
+    // Соединение проверки закрывается в своем потоке
+    HealthProbe* probe = m_probe;
+    QMetaObject::invokeMethod(m_probe, [probe]() { probe->close(); }, Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+    delete m_probe;
+}
+
+void ConnectionMonitor::start(int intervalMs)
+{
+    m_intervalMs = qMax(100, intervalMs);
+    m_running = true;
+    m_online = m_database->isConnected();
+    m_attempts = 0;
+    scheduleProbe(m_online ? m_intervalMs : 0);
+    qDebug() << "🩺 Connection monitor started, interval" << m_intervalMs << "ms";
+}
+
+void ConnectionMonitor::stop()
+{
+    m_running = false;
+    m_timer.stop();
+}
+
+void ConnectionMonitor::checkNow()
+{
+    if (m_running) {
+        scheduleProbe(0);
+    }
+}
+
+int ConnectionMonitor::backoffDelay(int attempt)
+{
+    const int exponent = qBound(0, attempt, 16);
+    const int delay = int(qMin<qint64>(MaxBackoffMs, qint64(MinBackoffMs) << exponent));
+    return delay / 2 + int(QRandomGenerator::global()->bounded(delay / 2 + 1));
+}
+
+void ConnectionMonitor::scheduleProbe(int delayMs)
+{
+    m_timer.start(delayMs);
+}
+
+void ConnectionMonitor::requestProbe()
+{
+    if (m_probing || !m_running) {
+        return;
+    }
+    m_probing = true;
+
+    // До первого подключения перебираются параметры по умолчанию
+    m_candidates = m_database->hasConnectionSettings()
+        ? QVector<ConnectionSettings>{ m_database->connectionSettings() }
+        : DatabaseManager::defaultConnectionCandidates();
+
+    HealthProbe* probe = m_probe;
+    const QVector<ConnectionSettings> candidates = m_candidates;
+    QMetaObject::invokeMethod(m_probe, [this, probe, candidates]() {
+        bool reopened = false;
+        QString error;
+        const int candidate = probe->probe(candidates, reopened, error);
+        QMetaObject::invokeMethod(this, [this, candidate, reopened, error]() {
+            onProbeFinished(candidate, reopened, error);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void ConnectionMonitor::onProbeFinished(int candidate, bool reopened, const QString& error)
+{
+    m_probing = false;
+    if (!m_running) {
+        return;
+    }
+
+    QString failure = error;
+    if (candidate >= 0) {
+        // Проверочное соединение переоткрыто - основное, скорее всего, тоже
+        // оборвано; на мертвом сокете ping() завершается сразу
+        if (reopened && m_database->isConnected()) {
+            m_database->ping();
+        }
+
+        if (m_database->isConnected()) {
+            // Очередь, не примененная из-за сбоя при восстановлении, - еще раз
+            if (m_database->queuedOperationCount() > 0) {
+                m_database->replayQueuedOperations();
+            }
+            m_online = true;
+            m_attempts = 0;
+            scheduleProbe(m_intervalMs);
+            return;
+        }
+
+        // Сервер отвечает - открываем основное соединение в потоке интерфейса
+        const bool restored = m_database->hasConnectionSettings()
+            ? m_database->reconnect()
+            : m_database->connectToDatabase(m_candidates.at(candidate));
+        if (restored) {
+            m_database->replayQueuedOperations();
+            m_online = true;
+            m_attempts = 0;
+            qDebug() << "🩺 Database connection restored";
+            emit connectionRestored();
+            scheduleProbe(m_intervalMs);
+            return;
+        }
+        failure = m_database->getLastError();
+    }
+
+    if (m_online || m_database->isConnected()) {
+        m_database->markConnectionLost(failure);
+        m_online = false;
+        emit connectionLost(failure);
+    }
+
+    const int delay = backoffDelay(m_attempts++);
+    qDebug() << "🩺 Database unavailable, retry" << m_attempts << "in" << delay << "ms";
+    emit reconnectScheduled(delay);
+    scheduleProbe(delay);
+}
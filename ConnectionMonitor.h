@@ -0,0 +1,69 @@
+﻿#ifndef CONNECTIONMONITOR_H
+#define CONNECTIONMONITOR_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include "DatabaseManager.h"
+
+class HealthProbe;
+
+// Фоновая проверка соединения с базой и переподключение.
+//
+// Проверка ("SELECT 1") идет в отдельном потоке по своему соединению,
+// поэтому зависший сервер не блокирует интерфейс. При обрыве основное
+// соединение помечается потерянным, а попытки восстановить его идут с
+// экспоненциальной задержкой со случайным разбросом - терминалы кухни не
+// переподключаются все разом после перезапуска PostgreSQL. Основное
+// соединение открывается заново только когда проверка уже прошла, затем
+// применяются операции, накопленные без соединения.
+class ConnectionMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int DefaultIntervalMs = 5000;
+    static const int MinBackoffMs = 500;
+    static const int MaxBackoffMs = 30000;
+
+    explicit ConnectionMonitor(DatabaseManager* database, QObject* parent = nullptr);
+    ~ConnectionMonitor();
+
+    // Если соединения еще не было, перебираются параметры по умолчанию
+    void start(int intervalMs = DefaultIntervalMs);
+    void stop();
+
+    // Внеочередная проверка, например после ошибки запроса
+    void checkNow();
+
+    bool isOnline() const { return m_online; }
+    int failedAttempts() const { return m_attempts; }
+
+    // Задержка перед попыткой attempt (с 0): случайная в [d/2, d],
+    // где d = min(MaxBackoffMs, MinBackoffMs * 2^attempt)
+    static int backoffDelay(int attempt);
+
+signals:
+    void connectionLost(const QString& error);
+    void connectionRestored();
+    void reconnectScheduled(int delayMs);
+
+private:
+    void scheduleProbe(int delayMs);
+    void requestProbe();
+    void onProbeFinished(int candidate, bool reopened, const QString& error);
+
+    DatabaseManager* m_database;
+    QThread m_thread;
+    HealthProbe* m_probe;
+    QVector<ConnectionSettings> m_candidates;
+    QTimer m_timer;
+    int m_intervalMs = DefaultIntervalMs;
+    bool m_online = false;
+    bool m_probing = false;
+    bool m_running = false;
+    int m_attempts = 0;
+};
+
+#endif // CONNECTIONMONITOR_H
@@ -0,0 +1,233 @@
+﻿#include "ConsumptionForecaster.h"
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <cmath>
+
+namespace {
+
+const double MsPerDay = 24.0 * 60.0 * 60.0 * 1000.0;
+
+} // namespace
+
+ConsumptionForecaster::ConsumptionForecaster()
+{
+}
+
+void ConsumptionForecaster::observe(int productId, int amount, qint64 nowMs)
+{
+    if (amount <= 0) {
+        return;
+    }
+
+    State& state = m_states[productId];
+    if (state.firstMs == 0) {
+        state.firstMs = nowMs;
+        state.lastMs = nowMs;
+    }
+
+    const double decay = decayFactor(state.lastMs, nowMs);
+    state.rate = state.rate * decay + amount / m_settings.smoothingDays;
+    state.unsaved = state.unsaved * decay + amount / m_settings.smoothingDays;
+    state.lastMs = qMax(state.lastMs, nowMs);
+
+    if (!state.dirty) {
+        state.dirty = true;
+        m_dirty.append(productId);
+    }
+}
+
+double ConsumptionForecaster::decayFactor(qint64 fromMs, qint64 toMs) const
+{
+    const double elapsedDays = qMax<qint64>(0, toMs - fromMs) / MsPerDay;
+    return std::exp(-elapsedDays / m_settings.smoothingDays);
+}
+
+double ConsumptionForecaster::decayedRate(const State& state, qint64 nowMs) const
+{
+    return state.rate * decayFactor(state.lastMs, nowMs);
+}
+
+ConsumptionForecaster::State ConsumptionForecaster::merged(const State& a, const State& b) const
+{
+    State state;
+    state.lastMs = qMax(a.lastMs, b.lastMs);
+    state.rate = a.rate * decayFactor(a.lastMs, state.lastMs) + b.rate * decayFactor(b.lastMs, state.lastMs);
+    state.firstMs = a.firstMs == 0 ? b.firstMs : (b.firstMs == 0 ? a.firstMs : qMin(a.firstMs, b.firstMs));
+    return state;
+}
+
+double ConsumptionForecaster::dailyRate(int productId, qint64 nowMs) const
+{
+    auto it = m_states.constFind(productId);
+    return it == m_states.cend() ? 0.0 : decayedRate(it.value(), nowMs);
+}
+
+ConsumptionForecaster::Suggestion ConsumptionForecaster::suggest(int productId, int currentQuantity,
+    int normQuantity, qint64 nowMs) const
+{
+    Suggestion suggestion;
+    suggestion.quantity = qMax(0, normQuantity - currentQuantity);
+
+    auto it = m_states.constFind(productId);
+    if (it == m_states.cend()) {
+        return suggestion;
+    }
+
+    const State& state = it.value();
+    suggestion.dailyRate = decayedRate(state, nowMs);
+
+    // Пока история короче окна сглаживания, оценка занижена - берем норму
+    const double observedDays = (nowMs - state.firstMs) / MsPerDay;
+    if (observedDays < m_settings.smoothingDays) {
+        return suggestion;
+    }
+
+    // Спрос до поставки и на период покрытия, с запасом
+    const double demand = suggestion.dailyRate
+        * (m_settings.leadTimeDays + m_settings.coverDays) * m_settings.safetyFactor;
+    suggestion.quantity = qMax(0, int(std::ceil(demand)) - currentQuantity);
+    suggestion.fromForecast = true;
+    return suggestion;
+}
+
+bool ConsumptionForecaster::load(QSqlDatabase& db)
+{
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT product_id, rate, updated_at, observed_since FROM product_forecast")) {
+        m_lastError = query.lastError().text();
+        qWarning() << "❌ Failed to load forecasts:" << m_lastError;
+        return false;
+    }
+
+    // Несохраненный прирост (например, после обрыва соединения) добавляется
+    // к записанной оценке и остается к сохранению
+    QHash<int, State> unsaved;
+    for (int productId : m_dirty) {
+        unsaved.insert(productId, m_states.value(productId));
+    }
+
+    m_states.clear();
+    while (query.next()) {
+        State state;
+        state.rate = query.value(1).toDouble();
+        state.lastMs = query.value(2).toLongLong();
+        state.firstMs = query.value(3).toLongLong();
+        m_states.insert(query.value(0).toInt(), state);
+    }
+
+    for (auto it = unsaved.cbegin(); it != unsaved.cend(); ++it) {
+        const State& local = it.value();
+        auto stored = m_states.find(it.key());
+        if (stored == m_states.end()) {
+            m_states.insert(it.key(), local);
+            continue;
+        }
+        State pending = local;
+        pending.rate = local.unsaved;
+        State state = merged(stored.value(), pending);
+        state.unsaved = local.unsaved;
+        state.dirty = true;
+        stored.value() = state;
+    }
+
+    qDebug() << "📈 Loaded forecasts for" << m_states.size() << "products";
+    return true;
+}
+
+bool ConsumptionForecaster::saveDirty(QSqlDatabase& db)
+{
+    if (m_dirty.isEmpty()) {
+        return true;
+    }
+
+    // PostgreSQL складывает оценки в самом upsert и возвращает сумму. В
+    // SQLite нет exp(): строка читается и складывается здесь, в той же
+    // транзакции (писатель в SQLite один)
+    const bool postgres = db.driverName() == "QPSQL";
+    QSqlQuery read(db);
+    QSqlQuery write(db);
+    if (postgres) {
+        write.prepare("INSERT INTO product_forecast AS f (product_id, rate, updated_at, observed_since) "
+            "VALUES (:id, :rate, :updated, :since) ON CONFLICT (product_id) DO UPDATE SET "
+            "rate = f.rate * exp(-GREATEST(excluded.updated_at - f.updated_at, 0) / CAST(:tau AS DOUBLE PRECISION)) "
+            "+ excluded.rate * exp(-GREATEST(f.updated_at - excluded.updated_at, 0) / CAST(:tau AS DOUBLE PRECISION)), "
+            "updated_at = GREATEST(f.updated_at, excluded.updated_at), "
+            "observed_since = LEAST(f.observed_since, excluded.observed_since) "
+            "RETURNING rate, updated_at, observed_since");
+    }
+    else {
+        read.prepare("SELECT rate, updated_at, observed_since FROM product_forecast WHERE product_id = :id");
+        write.prepare("INSERT INTO product_forecast (product_id, rate, updated_at, observed_since) "
+            "VALUES (:id, :rate, :updated, :since) ON CONFLICT (product_id) DO UPDATE SET "
+            "rate = excluded.rate, updated_at = excluded.updated_at, observed_since = excluded.observed_since");
+    }
+
+    if (!db.transaction()) {
+        m_lastError = db.lastError().text();
+        qWarning() << "❌ Failed to save forecasts:" << m_lastError;
+        return false;
+    }
+    auto fail = [this, &db](const QSqlQuery& query) {
+        m_lastError = query.lastError().text();
+        qWarning() << "❌ Failed to save forecasts:" << m_lastError;
+        db.rollback();
+        return false;
+    };
+
+    QHash<int, State> saved;
+    for (int productId : m_dirty) {
+        State state = m_states.value(productId);
+        state.rate = state.unsaved;
+        state.unsaved = 0.0;
+        state.dirty = false;
+
+        if (!postgres) {
+            read.bindValue(":id", productId);
+            if (!read.exec()) {
+                return fail(read);
+            }
+            if (read.next()) {
+                State stored;
+                stored.rate = read.value(0).toDouble();
+                stored.lastMs = read.value(1).toLongLong();
+                stored.firstMs = read.value(2).toLongLong();
+                state = merged(stored, state);
+            }
+            read.finish();
+        }
+
+        write.bindValue(":id", productId);
+        write.bindValue(":rate", state.rate);
+        write.bindValue(":updated", state.lastMs);
+        write.bindValue(":since", state.firstMs);
+        if (postgres) {
+            write.bindValue(":tau", m_settings.smoothingDays * MsPerDay);
+        }
+        if (!write.exec()) {
+            return fail(write);
+        }
+        if (postgres && write.next()) {
+            state.rate = write.value(0).toDouble();
+            state.lastMs = write.value(1).toLongLong();
+            state.firstMs = write.value(2).toLongLong();
+        }
+        write.finish();
+        saved.insert(productId, state);
+    }
+
+    if (!db.commit()) {
+        m_lastError = db.lastError().text();
+        qWarning() << "❌ Failed to save forecasts:" << m_lastError;
+        db.rollback();
+        return false;
+    }
+
+    // Оценка в памяти - общая по всем терминалам
+    for (auto it = saved.cbegin(); it != saved.cend(); ++it) {
+        m_states.insert(it.key(), it.value());
+    }
+    m_dirty.clear();
+    return true;
+}
@@ -0,0 +1,78 @@
+﻿#ifndef CONSUMPTIONFORECASTER_H
+#define CONSUMPTIONFORECASTER_H
+
+#include <QHash>
+#include <QSqlDatabase>
+#include <QVector>
+
+// Прогноз расхода: экспоненциально сглаженная скорость (упаковок в день)
+// для каждого продукта. Каждое списание обновляет оценку за O(1):
+//   rate = rate * exp(-dt / tau) + amount / tau
+// Пересчета по всему каталогу нет - сохраняются только измененные продукты.
+//
+// Списания одного продукта идут с нескольких терминалов, и каждый видит
+// только свои. Поэтому в базу пишется не оценка целиком, а прирост с
+// последнего сохранения: запрос приводит записанную скорость и прирост к
+// более позднему моменту и складывает их, а терминал получает общую оценку.
+class ConsumptionForecaster
+{
+public:
+    struct Settings {
+        double smoothingDays = 7.0;   // tau: окно сглаживания
+        double leadTimeDays = 2.0;    // срок поставки
+        double coverDays = 7.0;       // на сколько дней заказывать после поставки
+        double safetyFactor = 1.25;   // запас на колебания спроса
+    };
+
+    struct Suggestion {
+        int quantity = 0;             // сколько заказать
+        double dailyRate = 0.0;       // прогноз расхода, упаковок в день
+        bool fromForecast = false;    // false - мало истории, взята норма
+    };
+
+    ConsumptionForecaster();
+
+    void setSettings(const Settings& settings) { m_settings = settings; }
+    const Settings& settings() const { return m_settings; }
+
+    // Учет списания; nowMs - время события (мс от эпохи)
+    void observe(int productId, int amount, qint64 nowMs);
+
+    double dailyRate(int productId, qint64 nowMs) const;
+    Suggestion suggest(int productId, int currentQuantity, int normQuantity, qint64 nowMs) const;
+
+    int size() const { return m_states.size(); }
+
+    // Продукты с оценкой расхода. Для остальных suggest дает "норма -
+    // остаток", то есть заказ только ниже нормы.
+    QVector<int> trackedProducts() const { return m_states.keys().toVector(); }
+    int dirtyCount() const { return m_dirty.size(); }
+
+    // Хранение в таблице product_forecast (создается миграцией DatabaseManager).
+    // saveDirty - одна транзакция: при ошибке прирост остается несохраненным
+    bool load(QSqlDatabase& db);
+    bool saveDirty(QSqlDatabase& db);
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    struct State {
+        double rate = 0.0;            // упаковок в день на момент lastMs
+        qint64 lastMs = 0;
+        qint64 firstMs = 0;           // начало наблюдений, для прогрева
+        double unsaved = 0.0;         // часть rate, еще не записанная в базу
+        bool dirty = false;
+    };
+
+    double decayFactor(qint64 fromMs, qint64 toMs) const;
+    double decayedRate(const State& state, qint64 nowMs) const;
+    // Сумма двух оценок на момент более поздней из них
+    State merged(const State& a, const State& b) const;
+
+    Settings m_settings;
+    QHash<int, State> m_states;
+    QVector<int> m_dirty;
+    QString m_lastError;
+};
+
+#endif // CONSUMPTIONFORECASTER_H
@@ -1,345 +1,2487 @@
 ﻿#include "DatabaseManager.h"
+#include "CatalogCopy.h"
+#include "OperationTrace.h"
+#include "PgCopy.h"
+#include "StockLedger.h"
+#include <QDateTime>
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDebug>
 #include <QString>
+#include <QStringList>
 #include <QCoreApplication>  // ⭐ ДОБАВЬТЕ ЭТОТ INCLUDE
+#include <QRandomGenerator>
+#include <QSet>
+#include <QVariantList>
+#include <QTimer>
+#include <functional>
 
 class DatabaseManager::Impl
 {
 public:
     QSqlDatabase db;
     QString lastError;
+    QString lastErrorCode;
     bool connected = false;
+    // Последняя ошибка - отказ по данным (остатка не хватает, продукта нет),
+    // а не сбой запроса или соединения: повтор дал бы тот же результат
+    bool rejected = false;
+
+    void setError(const QString& message) {
+        lastError = message;
+        lastErrorCode.clear();
+        rejected = false;
+    }
+
+    // Для QPSQL nativeErrorCode() - это SQLSTATE (40P01, 40001, ...)
+    void setError(const QSqlError& error) {
+        lastError = error.text();
+        lastErrorCode = error.nativeErrorCode();
+        rejected = false;
+    }
+
+    void setRejected(const QString& message) {
+        setError(message);
+        rejected = true;
+    }
+
+    // ⭐ Режим шардированных счетчиков (counterShards > 0):
+    // остаток = products.current_quantity + SUM(product_quantity_deltas.delta).
+    // Каждый экземпляр пишет в свой слот, поэтому терминалы не ждут
+    // блокировку одной строки products. Все слагаемые неотрицательны,
+    // значит и сумма никогда не уходит ниже нуля.
+    int counterShards = 0;
+    int counterSlot = 0;
+    bool inTransaction = false;
+    QTimer foldTimer;
+
+    bool isPostgres() const { return db.driverName() == "QPSQL"; }
+
+    // Параметры успешного подключения и выбранная локация (0 - все)
+    ConnectionSettings settings;
+    bool hasSettings = false;
+    int locationId = 0;
+
+    // Операции, принятые без соединения; применяются после переподключения
+    QVector<StockOperation> offlineQueue;
+
+    // Версионированные миграции схемы, выполняются при подключении
+    int schemaVersion = 0;
+    bool migrate();
+
+    bool shardedAdd(int productId, int amount);
+    bool shardedRemove(int productId, int amount);
+    bool shardedSet(int productId, int quantity);
+    // Установка остатка (Set) вместе с остатком до нее для движения
+    // Correction: в PostgreSQL старое значение читается под блокировкой
+    // строки тем же оператором, в SQLite - в той же транзакции
+    bool setQuantity(int productId, int quantity, int& previousQuantity);
+    bool foldProduct(int productId);
+    bool guardedMainRemove(int productId, int amount, bool& removed);
+
+    // ⭐ Журнал движений: пишется пакетами по порогу или таймеру
+    static const int LedgerFlushThreshold = 500;
+    StockLedger ledger;
+    QTimer ledgerTimer;
+
+    // ⭐ Прогноз расхода: обновляется на каждом списании, хранится вместе с журналом
+    ConsumptionForecaster forecaster;
+    bool forecastReady = false;
+
+    // ⭐ Партии и сроки годности: списание FIFO по сроку, предупреждения по колесу таймеров
+    LotTracker lots;
+    bool lotsReady = false;
+    QTimer expiryTimer;
+
+    // Партии списываются в той же транзакции, что и остаток: takeLots
+    // вызывается после UPDATE остатка, до фиксации. Трекер в памяти
+    // меняется сразу, поэтому при откате затронутые продукты перечитываются
+    // (restoreLots), а после фиксации список сбрасывается (keepLots)
+    QSet<int> lotsTaken;
+    int lotAmount(const StockOperation& operation) const;
+    bool takeLots(const StockOperation& operation);
+    void restoreLots();
+    void keepLots() { lotsTaken.clear(); }
+    bool consumeLots(int productId, int amount);
+    // Одна операция и ее партии: без партий write - единственный оператор,
+    // с партиями обе записи идут одной транзакцией
+    bool writeWithLots(const StockOperation& operation, const std::function<bool()>& write);
+
+    bool flushPending();
+
+    // Пересчет инвентаризации во временной таблице stock_take_counts
+    static const int CopyChunkBytes = 256 * 1024;
+    bool stageCounts(const QVector<StockCount>& counts);
+
+    int readQuantity(int productId);
+    bool fetchProduct(int productId, ProductData& product);
+    void recordOperation(const StockOperation& operation, int previousQuantity = -1);
+    // Место в буфере журнала до изменения остатка: полный буфер сначала
+    // сбрасывается, и если это не удалось, изменение отклоняется
+    bool reserveLedger(int count);
+
+    // Запись вызовов API в трассу (см. OperationTrace), nullptr - выкл.
+    TraceRecorder* trace = nullptr;
+};
+
+namespace {
+
+// Строка продукта из запроса вида SELECT id, name, quantity, norm, location_id, version, unit_cost
+ProductData productFromQuery(const QSqlQuery& query)
+{
+    ProductData product(
+        query.value(0).toInt(),
+        query.value(1).toString(),
+        query.value(2).toInt(),
+        query.value(3).toInt(),
+        query.value(4).toInt(),
+        query.value(5).toInt()
+    );
+    product.unitCost = query.value(6).toLongLong();
+    return product;
+}
+
+} // namespace
+
+bool DatabaseManager::Impl::fetchProduct(int productId, ProductData& product)
+{
+    QSqlQuery query(db);
+    query.prepare(counterShards > 0
+        ? "SELECT p.id, p.name, p.current_quantity + COALESCE((SELECT SUM(delta) FROM product_quantity_deltas "
+          "WHERE product_id = p.id), 0), p.norm_quantity, p.location_id, p.version, p.unit_cost FROM products p WHERE p.id = :id"
+        : "SELECT id, name, current_quantity, norm_quantity, location_id, version, unit_cost FROM products WHERE id = :id");
+    query.bindValue(":id", productId);
+    if (!query.exec()) {
+        setError(query.lastError());
+        return false;
+    }
+    if (!query.next()) {
+        setError(QString("Product %1 not found").arg(productId));
+        return false;
+    }
+
+    product = productFromQuery(query);
+    return true;
+}
+
+int DatabaseManager::Impl::readQuantity(int productId)
+{
+    QSqlQuery query(db);
+    query.prepare(counterShards > 0
+        ? "SELECT p.current_quantity + COALESCE((SELECT SUM(delta) FROM product_quantity_deltas "
+          "WHERE product_id = p.id), 0) FROM products p WHERE p.id = :id"
+        : "SELECT current_quantity FROM products WHERE id = :id");
+    query.bindValue(":id", productId);
+    if (!query.exec() || !query.next()) {
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+void DatabaseManager::Impl::recordOperation(const StockOperation& operation, int previousQuantity)
+{
+    switch (operation.type) {
+    case StockOperation::Add:
+        ledger.record(operation.productId, operation.amount, StockLedger::Receipt);
+        break;
+    case StockOperation::Remove:
+        ledger.record(operation.productId, -operation.amount, StockLedger::Consumption);
+        forecaster.observe(operation.productId, operation.amount, QDateTime::currentMSecsSinceEpoch());
+        break;
+    case StockOperation::Set:
+        if (previousQuantity >= 0) {
+            ledger.record(operation.productId, operation.amount - previousQuantity, StockLedger::Correction);
+        }
+        break;
+    }
+
+    if (ledger.pendingCount() >= LedgerFlushThreshold && !inTransaction) {
+        flushPending();
+    }
+}
+
+bool DatabaseManager::Impl::reserveLedger(int count)
+{
+    if (!ledger.isReady() || ledger.hasRoom(count)) {
+        return true;
+    }
+    if (flushPending() && ledger.hasRoom(count)) {
+        return true;
+    }
+    setError("Stock ledger buffer is full: " + ledger.getLastError());
+    qWarning() << "❌ Stock change refused:" << lastError;
+    return false;
+}
+
+int DatabaseManager::Impl::lotAmount(const StockOperation& operation) const
+{
+    if (!lotsReady) {
+        return 0;
+    }
+    const int tracked = lots.trackedQuantity(operation.productId);
+    switch (operation.type) {
+    case StockOperation::Add:
+        return 0;
+    case StockOperation::Remove:
+        return tracked > 0 ? operation.amount : 0;
+    case StockOperation::Set:
+        // Инвентаризация нашла меньше, чем числится в партиях: недостача - из ближайших по сроку
+        return qMax(0, tracked - operation.amount);
+    }
+    return 0;
+}
+
+bool DatabaseManager::Impl::takeLots(const StockOperation& operation)
+{
+    const int amount = lotAmount(operation);
+    if (amount <= 0) {
+        return true;
+    }
+    lotsTaken.insert(operation.productId);
+    if (!consumeLots(operation.productId, amount)) {
+        setError(lots.getLastError());
+        qWarning() << "❌ Lots of product" << operation.productId << "not updated:" << lastError;
+        return false;
+    }
+    return true;
+}
+
+void DatabaseManager::Impl::restoreLots()
+{
+    const QList<int> products = lotsTaken.values();
+    lotsTaken.clear();
+    for (int productId : products) {
+        lots.reloadProduct(db, productId);
+    }
+}
+
+bool DatabaseManager::Impl::consumeLots(int productId, int amount)
+{
+    // Остаток продукта списан в этой же транзакции; партии - уточнение,
+    // откуда именно. Если партию успели списать с другого терминала,
+    // партии продукта перечитываются и недостающее берется из следующих по сроку.
+    for (int attempt = 0; attempt < 2 && amount > 0 && lotsReady; ++attempt) {
+        if (lots.trackedQuantity(productId) == 0) {
+            return true;
+        }
+
+        int missing = 0;
+        if (!lots.writeTakes(db, productId, lots.consume(productId, amount), missing)) {
+            return false;
+        }
+        if (missing > 0 && !lots.reloadProduct(db, productId)) {
+            return false;
+        }
+        amount = missing;
+    }
+    return true;
+}
+
+bool DatabaseManager::Impl::writeWithLots(const StockOperation& operation, const std::function<bool()>& write)
+{
+    if (lotAmount(operation) <= 0) {
+        return write();
+    }
+
+    if (!db.transaction()) {
+        setError(db.lastError());
+        return false;
+    }
+    inTransaction = true;
+    bool ok = write() && takeLots(operation);
+    inTransaction = false;
+    if (ok && !db.commit()) {
+        setError(db.lastError());
+        ok = false;
+    }
+    if (!ok) {
+        db.rollback();
+        restoreLots();
+        return false;
+    }
+    keepLots();
+    return true;
+}
+
+bool DatabaseManager::Impl::flushPending()
+{
+    bool ok = ledger.flush();
+    if (forecastReady && !forecaster.saveDirty(db)) {
+        ok = false;
+    }
+    return ok;
+}
+
+bool DatabaseManager::Impl::stageCounts(const QVector<StockCount>& counts)
+{
+    QSqlQuery query(db);
+    const QString create = isPostgres()
+        ? "CREATE TEMP TABLE stock_take_counts (product_id INTEGER, name TEXT, "
+          "counted INTEGER NOT NULL CHECK (counted >= 0)) ON COMMIT DROP"
+        : "CREATE TEMP TABLE stock_take_counts (product_id INTEGER, name TEXT, "
+          "counted INTEGER NOT NULL CHECK (counted >= 0))";
+    if (!query.exec("DROP TABLE IF EXISTS stock_take_counts") || !query.exec(create)) {
+        setError(query.lastError());
+        return false;
+    }
+
+    if (PgCopy::isSupported(db)) {
+        // Одним потоком COPY вместо строки на запрос; данные уходят кусками
+        PgCopy copy(db);
+        if (!copy.begin("COPY stock_take_counts (product_id, name, counted) FROM STDIN")) {
+            setError(copy.getLastError());
+            return false;
+        }
+        QByteArray chunk;
+        chunk.reserve(CopyChunkBytes + 256);
+        for (const StockCount& count : counts) {
+            if (count.productId > 0) {
+                chunk.append(QByteArray::number(count.productId));
+            }
+            else {
+                chunk.append("\\N");
+            }
+            chunk.append('\t');
+            PgCopy::appendText(chunk, count.name);
+            chunk.append('\t');
+            chunk.append(QByteArray::number(count.counted));
+            chunk.append('\n');
+            if (chunk.size() >= CopyChunkBytes) {
+                if (!copy.write(chunk)) {
+                    setError(copy.getLastError());
+                    copy.abort(lastError);
+                    return false;
+                }
+                chunk.clear();
+            }
+        }
+        if (!copy.write(chunk) || !copy.finish()) {
+            setError(copy.getLastError());
+            copy.abort(lastError);
+            return false;
+        }
+        return true;
+    }
+
+    QVariantList productIds;
+    QVariantList names;
+    QVariantList quantities;
+    for (const StockCount& count : counts) {
+        productIds << (count.productId > 0 ? QVariant(count.productId) : QVariant(QVariant::Int));
+        names << count.name;
+        quantities << count.counted;
+    }
+    query.prepare("INSERT INTO stock_take_counts (product_id, name, counted) VALUES (?, ?, ?)");
+    query.addBindValue(productIds);
+    query.addBindValue(names);
+    query.addBindValue(quantities);
+    if (!query.execBatch()) {
+        setError(query.lastError());
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+// Одна миграция схемы. Для SQLite свой текст нужен только там, где
+// диалекты расходятся; пустой список - те же команды, что и для PostgreSQL
+struct Migration {
+    int version;
+    const char* description;
+    QStringList postgres;
+    QStringList sqlite;
 };
 
+// ⭐ Миграции только добавляются в конец; примененные не редактируются
+const QVector<Migration>& schemaMigrations()
+{
+    static const QVector<Migration> migrations = {
+        { 1, "products table",
+          { "CREATE TABLE IF NOT EXISTS products (id SERIAL PRIMARY KEY, name VARCHAR(100) NOT NULL, "
+            "current_quantity INTEGER NOT NULL DEFAULT 0, norm_quantity INTEGER NOT NULL DEFAULT 0)" },
+          { "CREATE TABLE IF NOT EXISTS products (id INTEGER PRIMARY KEY, name VARCHAR(100) NOT NULL, "
+            "current_quantity INTEGER NOT NULL DEFAULT 0, norm_quantity INTEGER NOT NULL DEFAULT 0)" } },
+        { 2, "case-insensitive name lookup index",
+          { "CREATE INDEX IF NOT EXISTS products_name_idx ON products (lower(name))" }, {} },
+        // Частичный индекс по продуктам ниже нормы: в нем только строки,
+        // которые нужно заказать, поэтому заявка не читает весь каталог
+        { 3, "below-norm partial index and products_to_order view",
+          { "CREATE INDEX IF NOT EXISTS products_below_norm_idx ON products (id) "
+            "WHERE current_quantity < norm_quantity",
+            "CREATE OR REPLACE VIEW products_to_order AS "
+            "SELECT id, name, current_quantity, norm_quantity, norm_quantity - current_quantity AS order_quantity "
+            "FROM products WHERE current_quantity < norm_quantity" },
+          { "CREATE INDEX IF NOT EXISTS products_below_norm_idx ON products (id) "
+            "WHERE current_quantity < norm_quantity",
+            "CREATE VIEW IF NOT EXISTS products_to_order AS "
+            "SELECT id, name, current_quantity, norm_quantity, norm_quantity - current_quantity AS order_quantity "
+            "FROM products WHERE current_quantity < norm_quantity" } },
+        { 4, "row version column",
+          { "ALTER TABLE products ADD COLUMN IF NOT EXISTS version INTEGER NOT NULL DEFAULT 0" },
+          { "ALTER TABLE products ADD COLUMN version INTEGER NOT NULL DEFAULT 0" } },
+        { 5, "counter shard slots",
+          { "CREATE TABLE IF NOT EXISTS product_quantity_deltas ("
+            "product_id INTEGER NOT NULL REFERENCES products(id) ON DELETE CASCADE, "
+            "slot SMALLINT NOT NULL, delta INTEGER NOT NULL DEFAULT 0 CHECK (delta >= 0), "
+            "PRIMARY KEY (product_id, slot))" }, {} },
+        { 6, "consumption forecast state",
+          { "CREATE TABLE IF NOT EXISTS product_forecast (product_id INTEGER PRIMARY KEY, "
+            "rate DOUBLE PRECISION NOT NULL, updated_at BIGINT NOT NULL, observed_since BIGINT NOT NULL)" }, {} },
+        // Остатки разделены по локациям: location_id ведущий в индексах, поэтому
+        // выборка одной локации читает только ее диапазон
+        { 7, "locations",
+          { "CREATE TABLE IF NOT EXISTS locations (id SERIAL PRIMARY KEY, name VARCHAR(100) NOT NULL UNIQUE, "
+            "restaurant VARCHAR(100) NOT NULL DEFAULT 'Gourmet')",
+            "INSERT INTO locations (id, name) VALUES (1, 'Основной холодильник') ON CONFLICT (id) DO NOTHING",
+            "SELECT setval(pg_get_serial_sequence('locations', 'id'), (SELECT MAX(id) FROM locations))",
+            "ALTER TABLE products ADD COLUMN IF NOT EXISTS location_id INTEGER NOT NULL DEFAULT 1 REFERENCES locations(id)",
+            "CREATE INDEX IF NOT EXISTS products_location_idx ON products (location_id, id)",
+            "DROP INDEX IF EXISTS products_below_norm_idx",
+            "CREATE INDEX products_below_norm_idx ON products (location_id, id) WHERE current_quantity < norm_quantity",
+            "CREATE OR REPLACE VIEW products_to_order AS "
+            "SELECT id, name, current_quantity, norm_quantity, norm_quantity - current_quantity AS order_quantity, location_id "
+            "FROM products WHERE current_quantity < norm_quantity" },
+          { "CREATE TABLE IF NOT EXISTS locations (id INTEGER PRIMARY KEY, name VARCHAR(100) NOT NULL UNIQUE, "
+            "restaurant VARCHAR(100) NOT NULL DEFAULT 'Gourmet')",
+            "INSERT OR IGNORE INTO locations (id, name) VALUES (1, 'Основной холодильник')",
+            "ALTER TABLE products ADD COLUMN location_id INTEGER NOT NULL DEFAULT 1",
+            "CREATE INDEX IF NOT EXISTS products_location_idx ON products (location_id, id)",
+            "DROP INDEX IF EXISTS products_below_norm_idx",
+            "CREATE INDEX products_below_norm_idx ON products (location_id, id) WHERE current_quantity < norm_quantity",
+            "DROP VIEW IF EXISTS products_to_order",
+            "CREATE VIEW products_to_order AS "
+            "SELECT id, name, current_quantity, norm_quantity, norm_quantity - current_quantity AS order_quantity, location_id "
+            "FROM products WHERE current_quantity < norm_quantity" } },
+        { 8, "supplier catalog",
+          { "CREATE TABLE IF NOT EXISTS suppliers (id SERIAL PRIMARY KEY, name VARCHAR(100) NOT NULL UNIQUE)",
+            "CREATE TABLE IF NOT EXISTS product_suppliers (product_id INTEGER PRIMARY KEY REFERENCES products(id) ON DELETE CASCADE, "
+            "supplier_id INTEGER NOT NULL REFERENCES suppliers(id), "
+            "pack_size INTEGER NOT NULL DEFAULT 1 CHECK (pack_size > 0), "
+            "min_order INTEGER NOT NULL DEFAULT 0 CHECK (min_order >= 0))" },
+          { "CREATE TABLE IF NOT EXISTS suppliers (id INTEGER PRIMARY KEY, name VARCHAR(100) NOT NULL UNIQUE)",
+            "CREATE TABLE IF NOT EXISTS product_suppliers (product_id INTEGER PRIMARY KEY REFERENCES products(id) ON DELETE CASCADE, "
+            "supplier_id INTEGER NOT NULL REFERENCES suppliers(id), "
+            "pack_size INTEGER NOT NULL DEFAULT 1 CHECK (pack_size > 0), "
+            "min_order INTEGER NOT NULL DEFAULT 0 CHECK (min_order >= 0))" } },
+        // Партии: остаток продукта остается в products, здесь - из каких поставок он состоит.
+        // Индекс в порядке списания: ближайший срок, затем более ранний приход
+        { 9, "product lots with expiry",
+          { "CREATE TABLE IF NOT EXISTS product_lots (id BIGSERIAL PRIMARY KEY, "
+            "product_id INTEGER NOT NULL REFERENCES products(id) ON DELETE CASCADE, "
+            "quantity INTEGER NOT NULL CHECK (quantity >= 0), received_at BIGINT NOT NULL, expires_on DATE)",
+            "CREATE INDEX IF NOT EXISTS product_lots_fifo_idx ON product_lots (product_id, expires_on, received_at)" },
+          { "CREATE TABLE IF NOT EXISTS product_lots (id INTEGER PRIMARY KEY, "
+            "product_id INTEGER NOT NULL REFERENCES products(id) ON DELETE CASCADE, "
+            "quantity INTEGER NOT NULL CHECK (quantity >= 0), received_at BIGINT NOT NULL, expires_on DATE)",
+            "CREATE INDEX IF NOT EXISTS product_lots_fifo_idx ON product_lots (product_id, expires_on, received_at)" } },
+        // Цены в копейках (целые): цена упаковки продукта и цена прихода партии
+        { 10, "unit costs in kopecks",
+          { "ALTER TABLE products ADD COLUMN IF NOT EXISTS unit_cost BIGINT NOT NULL DEFAULT 0 CHECK (unit_cost >= 0)",
+            "ALTER TABLE product_lots ADD COLUMN IF NOT EXISTS unit_cost BIGINT CHECK (unit_cost >= 0)",
+            "CREATE OR REPLACE VIEW products_to_order AS "
+            "SELECT id, name, current_quantity, norm_quantity, norm_quantity - current_quantity AS order_quantity, "
+            "location_id, unit_cost FROM products WHERE current_quantity < norm_quantity" },
+          { "ALTER TABLE products ADD COLUMN unit_cost BIGINT NOT NULL DEFAULT 0 CHECK (unit_cost >= 0)",
+            "ALTER TABLE product_lots ADD COLUMN unit_cost BIGINT CHECK (unit_cost >= 0)",
+            "DROP VIEW IF EXISTS products_to_order",
+            "CREATE VIEW products_to_order AS "
+            "SELECT id, name, current_quantity, norm_quantity, norm_quantity - current_quantity AS order_quantity, "
+            "location_id, unit_cost FROM products WHERE current_quantity < norm_quantity" } },
+        // Штрихкоды: один код может быть у строк продукта в разных локациях,
+        // pack_quantity - упаковок в одном сканировании (код коробки)
+        { 11, "product barcodes",
+          { "CREATE TABLE IF NOT EXISTS product_barcodes (product_id INTEGER NOT NULL REFERENCES products(id) ON DELETE CASCADE, "
+            "barcode VARCHAR(48) NOT NULL, pack_quantity INTEGER NOT NULL DEFAULT 1 CHECK (pack_quantity > 0), "
+            "PRIMARY KEY (product_id, barcode))",
+            "CREATE INDEX IF NOT EXISTS product_barcodes_code_idx ON product_barcodes (barcode)" },
+          { "CREATE TABLE IF NOT EXISTS product_barcodes (product_id INTEGER NOT NULL REFERENCES products(id) ON DELETE CASCADE, "
+            "barcode VARCHAR(48) NOT NULL, pack_quantity INTEGER NOT NULL DEFAULT 1 CHECK (pack_quantity > 0), "
+            "PRIMARY KEY (product_id, barcode))",
+            "CREATE INDEX IF NOT EXISTS product_barcodes_code_idx ON product_barcodes (barcode)" } },
+    };
+    return migrations;
+}
+
+} // namespace
+
+bool DatabaseManager::Impl::migrate()
+{
+    QSqlQuery query(db);
+    if (!query.exec("CREATE TABLE IF NOT EXISTS schema_version (version INTEGER PRIMARY KEY, "
+        "description VARCHAR(200) NOT NULL, applied_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP)")) {
+        setError(query.lastError());
+        qWarning() << "❌ Failed to create schema_version table:" << lastError;
+        return false;
+    }
+
+    if (!db.transaction()) {
+        setError(db.lastError());
+        return false;
+    }
+
+    // Несколько терминалов могут подключиться одновременно: миграции
+    // выполняет тот, кто первым взял блокировку, остальные видят новую версию
+    if (isPostgres() && !query.exec("SELECT pg_advisory_xact_lock(hashtext('fridgemanager.schema'))")) {
+        setError(query.lastError());
+        db.rollback();
+        return false;
+    }
+
+    if (!query.exec("SELECT COALESCE(MAX(version), 0) FROM schema_version") || !query.next()) {
+        setError(query.lastError());
+        db.rollback();
+        return false;
+    }
+    schemaVersion = query.value(0).toInt();
+
+    for (const Migration& migration : schemaMigrations()) {
+        if (migration.version <= schemaVersion) {
+            continue;
+        }
+
+        qDebug() << "🛠️ Applying migration" << migration.version << ":" << migration.description;
+        const QStringList& statements = isPostgres() || migration.sqlite.isEmpty()
+            ? migration.postgres : migration.sqlite;
+        for (const QString& sql : statements) {
+            if (!query.exec(sql)) {
+                setError(query.lastError());
+                qWarning() << "❌ Migration" << migration.version << "failed:" << lastError;
+                db.rollback();
+                return false;
+            }
+        }
+
+        query.prepare("INSERT INTO schema_version (version, description) VALUES (:version, :description)");
+        query.bindValue(":version", migration.version);
+        query.bindValue(":description", QString::fromUtf8(migration.description));
+        if (!query.exec()) {
+            setError(query.lastError());
+            db.rollback();
+            return false;
+        }
+        schemaVersion = migration.version;
+    }
+
+    if (!db.commit()) {
+        setError(db.lastError());
+        return false;
+    }
+
+    if (schemaVersion > DatabaseManager::latestSchemaVersion()) {
+        qWarning() << "⚠️ Database schema" << schemaVersion << "is newer than this build ("
+            << DatabaseManager::latestSchemaVersion() << ")";
+    }
+    qDebug() << "✅ Schema version:" << schemaVersion;
+    return true;
+}
+
+bool DatabaseManager::Impl::shardedAdd(int productId, int amount)
+{
+    // Приход всегда в свой слот: блокируется только строка (product_id, slot)
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO product_quantity_deltas (product_id, slot, delta) VALUES (:id, :slot, :amount) "
+        "ON CONFLICT (product_id, slot) DO UPDATE SET delta = product_quantity_deltas.delta + excluded.delta");
+    query.bindValue(":id", productId);
+    query.bindValue(":slot", counterSlot);
+    query.bindValue(":amount", amount);
+
+    if (!query.exec()) {
+        setError(query.lastError());
+        qWarning() << "❌ Failed to add to counter slot:" << lastError;
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::Impl::guardedMainRemove(int productId, int amount, bool& removed)
+{
+    QSqlQuery query(db);
+    query.prepare("UPDATE products SET current_quantity = current_quantity - :amount, version = version + 1 "
+        "WHERE id = :id AND current_quantity >= :amount");
+    query.bindValue(":amount", amount);
+    query.bindValue(":id", productId);
+
+    if (!query.exec()) {
+        setError(query.lastError());
+        qWarning() << "❌ Failed to remove product quantity:" << lastError;
+        return false;
+    }
+    removed = query.numRowsAffected() > 0;
+    return true;
+}
+
+bool DatabaseManager::Impl::shardedRemove(int productId, int amount)
+{
+    // 1. Свой слот: расход того, что этот терминал сам принял
+    QSqlQuery slotQuery(db);
+    slotQuery.prepare("UPDATE product_quantity_deltas SET delta = delta - :amount "
+        "WHERE product_id = :id AND slot = :slot AND delta >= :amount");
+    slotQuery.bindValue(":amount", amount);
+    slotQuery.bindValue(":id", productId);
+    slotQuery.bindValue(":slot", counterSlot);
+
+    if (!slotQuery.exec()) {
+        setError(slotQuery.lastError());
+        qWarning() << "❌ Failed to remove from counter slot:" << lastError;
+        return false;
+    }
+    if (slotQuery.numRowsAffected() > 0) {
+        return true;
+    }
+
+    // 2. Основная строка с проверкой остатка в самом UPDATE
+    bool removed = false;
+    if (!guardedMainRemove(productId, amount, removed)) {
+        return false;
+    }
+    if (removed) {
+        return true;
+    }
+
+    // 3. Остаток разнесен по чужим слотам: сворачиваем их и пробуем еще раз
+    if (!foldProduct(productId) || !guardedMainRemove(productId, amount, removed)) {
+        return false;
+    }
+    if (!removed) {
+        setRejected("Not enough quantity available");
+        qWarning() << "❌ Not enough quantity for product" << productId << "requested" << amount;
+    }
+    return removed;
+}
+
+bool DatabaseManager::Impl::shardedSet(int productId, int quantity)
+{
+    QSqlQuery clearQuery(db);
+    clearQuery.prepare("DELETE FROM product_quantity_deltas WHERE product_id = :id");
+    clearQuery.bindValue(":id", productId);
+
+    QSqlQuery setQuery(db);
+    setQuery.prepare("UPDATE products SET current_quantity = :quantity, version = version + 1 WHERE id = :id");
+    setQuery.bindValue(":quantity", quantity);
+    setQuery.bindValue(":id", productId);
+
+    const bool ownTransaction = !inTransaction && db.transaction();
+    if (!clearQuery.exec() || !setQuery.exec()) {
+        setError(clearQuery.lastError().isValid() ? clearQuery.lastError() : setQuery.lastError());
+        qWarning() << "❌ Failed to set sharded quantity:" << lastError;
+        if (ownTransaction) {
+            db.rollback();
+        }
+        return false;
+    }
+    if (ownTransaction && !db.commit()) {
+        setError(db.lastError());
+        db.rollback();
+        return false;
+    }
+    if (setQuery.numRowsAffected() <= 0) {
+        setRejected(QString("Product %1 not found").arg(productId));
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::Impl::setQuantity(int productId, int quantity, int& previousQuantity)
+{
+    previousQuantity = -1;
+
+    if (isPostgres()) {
+        // Подзапрос FOR UPDATE возвращает последнюю зафиксированную строку и
+        // держит ее до конца транзакции; слоты удаляются тем же оператором,
+        // и в разницу попадают ровно удаленные дельты
+        QSqlQuery query(db);
+        query.prepare(counterShards > 0
+            ? "WITH old AS (SELECT id, current_quantity FROM products WHERE id = :id FOR UPDATE), "
+              "cleared AS (DELETE FROM product_quantity_deltas WHERE product_id = :id RETURNING delta) "
+              "UPDATE products p SET current_quantity = :quantity, version = p.version + 1 FROM old "
+              "WHERE p.id = old.id RETURNING old.current_quantity + (SELECT COALESCE(SUM(delta), 0) FROM cleared)"
+            : "UPDATE products p SET current_quantity = :quantity, version = p.version + 1 "
+              "FROM (SELECT id, current_quantity FROM products WHERE id = :id FOR UPDATE) old "
+              "WHERE p.id = old.id RETURNING old.current_quantity");
+        query.bindValue(":id", productId);
+        query.bindValue(":quantity", quantity);
+        if (!query.exec()) {
+            setError(query.lastError());
+            qWarning() << "❌ Failed to update product quantity:" << lastError;
+            return false;
+        }
+        if (!query.next()) {
+            setRejected(QString("Product %1 not found").arg(productId));
+            return false;
+        }
+        previousQuantity = query.value(0).toInt();
+        return true;
+    }
+
+    // В SQLite писатель один: чтение и запись в одной транзакции
+    const bool ownTransaction = !inTransaction;
+    if (ownTransaction && !db.transaction()) {
+        setError(db.lastError());
+        return false;
+    }
+    inTransaction = true;
+    const int quantityBefore = readQuantity(productId);
+    bool ok = false;
+    if (counterShards > 0) {
+        ok = shardedSet(productId, quantity);
+    }
+    else {
+        QSqlQuery query(db);
+        query.prepare("UPDATE products SET current_quantity = :quantity, version = version + 1 WHERE id = :id");
+        query.bindValue(":quantity", quantity);
+        query.bindValue(":id", productId);
+        if (!query.exec()) {
+            setError(query.lastError());
+            qWarning() << "❌ Failed to update product quantity:" << lastError;
+        }
+        else if (query.numRowsAffected() <= 0) {
+            setRejected(QString("Product %1 not found").arg(productId));
+        }
+        else {
+            ok = true;
+        }
+    }
+    if (!ownTransaction) {
+        previousQuantity = ok ? quantityBefore : -1;
+        return ok;
+    }
+    inTransaction = false;
+    if (ok && !db.commit()) {
+        setError(db.lastError());
+        ok = false;
+    }
+    if (!ok) {
+        db.rollback();
+        return false;
+    }
+    previousQuantity = quantityBefore;
+    return true;
+}
+
+bool DatabaseManager::Impl::foldProduct(int productId)
+{
+    if (isPostgres()) {
+        // Один оператор: DELETE ... RETURNING забирает ровно те дельты,
+        // что были удалены, так что параллельный приход не теряется
+        QSqlQuery query(db);
+        query.prepare("WITH moved AS (DELETE FROM product_quantity_deltas WHERE product_id = :id RETURNING delta) "
+            "UPDATE products SET current_quantity = current_quantity + (SELECT COALESCE(SUM(delta), 0) FROM moved) "
+            "WHERE id = :id");
+        query.bindValue(":id", productId);
+        if (!query.exec()) {
+            setError(query.lastError());
+            qWarning() << "❌ Failed to fold counter slots:" << lastError;
+            return false;
+        }
+        return true;
+    }
+
+    // Прочие драйверы (SQLite): два оператора в одной транзакции
+    QSqlQuery addQuery(db);
+    addQuery.prepare("UPDATE products SET current_quantity = current_quantity + "
+        "(SELECT COALESCE(SUM(delta), 0) FROM product_quantity_deltas WHERE product_id = :id) WHERE id = :id");
+    addQuery.bindValue(":id", productId);
+
+    QSqlQuery clearQuery(db);
+    clearQuery.prepare("DELETE FROM product_quantity_deltas WHERE product_id = :id");
+    clearQuery.bindValue(":id", productId);
+
+    const bool ownTransaction = !inTransaction && db.transaction();
+    if (!addQuery.exec() || !clearQuery.exec()) {
+        setError(addQuery.lastError().isValid() ? addQuery.lastError() : clearQuery.lastError());
+        qWarning() << "❌ Failed to fold counter slots:" << lastError;
+        if (ownTransaction) {
+            db.rollback();
+        }
+        return false;
+    }
+    if (ownTransaction && !db.commit()) {
+        setError(db.lastError());
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
 DatabaseManager::DatabaseManager(QObject* parent)
     : QObject(parent)
     , d(new Impl())
 {
+    connect(&d->foldTimer, &QTimer::timeout, this, [this]() {
+        if (isConnected() && d->counterShards > 0) {
+            foldCounterShards();
+        }
+    });
+
+    connect(&d->ledgerTimer, &QTimer::timeout, this, [this]() {
+        if (isConnected()) {
+            d->flushPending();
+        }
+    });
+    d->ledgerTimer.start(1000);
+
+    // Колесо таймеров продвигается раз в минуту: обычно это ноль тактов
+    connect(&d->expiryTimer, &QTimer::timeout, this, [this]() {
+        checkExpiringLots();
+    });
+    d->expiryTimer.start(60 * 1000);
 }
 
 DatabaseManager::~DatabaseManager()
 {
     disconnectFromDatabase();
+
+    const QString connectionName = d->db.connectionName();
+    d->db = QSqlDatabase();
+    if (!connectionName.isEmpty()) {
+        QSqlDatabase::removeDatabase(connectionName);
+    }
     delete d;
 }
 
+QVector<ConnectionSettings> DatabaseManager::defaultConnectionCandidates()
+{
+    // 🔄 Методы подключения в порядке приоритета
+    QString currentUser = qgetenv("USER");
+    if (currentUser.isEmpty()) {
+        currentUser = "postgres";
+    }
+
+    // Метод 1: Peer authentication с текущим системным пользователем (самый надежный)
+    ConnectionSettings peer;
+    peer.userName = currentUser;
+
+    // Метод 2: Peer authentication с пользователем postgres
+    ConnectionSettings postgresPeer;
+    postgresPeer.userName = "postgres";
+
+    // Метод 3: Localhost подключение
+    ConnectionSettings local;
+    local.hostName = "localhost";
+    local.port = 5432;
+    local.userName = "postgres";
+
+    return { peer, postgresPeer, local };
+}
+
 bool DatabaseManager::connectToDatabase()
 {
     disconnectFromDatabase();
 
     qDebug() << "🔌 Starting PostgreSQL connection attempts...";
 
-    // 🔄 Пробуем разные методы подключения в порядке приоритета
+    const QVector<ConnectionSettings> candidates = defaultConnectionCandidates();
+    for (int i = 0; i < candidates.size(); ++i) {
+        const ConnectionSettings& settings = candidates.at(i);
+        qDebug() << "🔄 Attempting connection as" << settings.userName << "via"
+            << (settings.hostName.isEmpty() ? QString("local socket") : settings.hostName);
+
+        if (openConnection(settings, QString("fridge_connection_%1").arg(i))) {
+            qDebug() << "✅ Connected as" << settings.userName;
+            return true;
+        }
+    }
+
+    qWarning() << "❌ All PostgreSQL connection attempts failed";
+    d->setError("Could not establish database connection");
+    d->connected = false;
+    return false;
+}
+
+bool DatabaseManager::connectToDatabase(const ConnectionSettings& settings)
+{
+    disconnectFromDatabase();
+
+    qDebug() << "🔄 Attempting" << settings.driver << "connection to"
+        << (settings.hostName.isEmpty() ? QString("local socket") : settings.hostName);
+
+    if (openConnection(settings, "fridge_connection_custom")) {
+        qDebug() << "✅ Connected with explicit settings";
+        return true;
+    }
+
+    d->lastError = "Could not establish database connection: " + d->lastError;
+    return false;
+}
+
+QSqlDatabase DatabaseManager::addConnection(const ConnectionSettings& settings, const QString& connectionName)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase(settings.driver, connectionName);
+    db.setConnectOptions(settings.connectOptions);
+    db.setHostName(settings.hostName);
+    db.setPort(settings.port);
+    db.setDatabaseName(settings.databaseName);
+    db.setUserName(settings.userName);
+    db.setPassword(settings.password);
+    return db;
+}
+
+bool DatabaseManager::openConnection(const ConnectionSettings& settings, const QString& connectionName)
+{
+    // Имя соединения уникально для экземпляра: несколько DatabaseManager
+    // (например, по одному на поток) не должны делить одно соединение
+    const QString uniqueName = connectionName + QString("_%1").arg(quintptr(this), 0, 16);
+
+    // Старое соединение с тем же именем нужно освободить до addDatabase
+    d->db = QSqlDatabase();
+    if (QSqlDatabase::contains(uniqueName)) {
+        QSqlDatabase::removeDatabase(uniqueName);
+    }
+
+    d->db = addConnection(settings, uniqueName);
+
+    if (d->db.open()) {
+        if (d->migrate() && verifyConnection()) {
+            d->connected = true;
+            d->settings = settings;
+            d->hasSettings = true;
+            d->ledger.attach(d->db);
+            if (!d->ledger.isReady()) {
+                qWarning() << "⚠️ Stock ledger disabled:" << d->ledger.getLastError();
+            }
+            d->forecastReady = d->forecaster.load(d->db);
+            if (!d->forecastReady) {
+                qWarning() << "⚠️ Consumption forecast not persisted:" << d->forecaster.getLastError();
+            }
+            d->lotsReady = d->lots.load(d->db);
+            if (!d->lotsReady) {
+                qWarning() << "⚠️ Lot tracking disabled:" << d->lots.getLastError();
+            }
+            return true;
+        }
+        d->db.close();
+    }
+    else {
+        d->setError(d->db.lastError());
+        qDebug() << "❌ Connection" << connectionName << "failed:" << d->lastError;
+    }
+
+    d->db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(uniqueName);
+    d->connected = false;
+    return false;
+}
+
+// ⭐ ВАЖНО: РЕАЛИЗАЦИЯ ФУНКЦИИ ДОЛЖНА БЫТЬ ПОСЛЕ connectToDatabase()
+bool DatabaseManager::verifyConnection()
+{
+    if (!d->db.isOpen()) {
+        qDebug() << "❌ Database not open in verifyConnection";
+        return false;
+    }
+
+    // ⭐ ВАЖНО: Используем простой и надежный запрос
+    // Не используем сложные запросы которые могут вызвать ошибки
+
+    // Простая проверка версии PostgreSQL
+    QSqlQuery testQuery(d->db);
+    if (!testQuery.exec("SELECT 1")) {
+        qWarning() << "❌ Simple test query failed:" << testQuery.lastError().text();
+        return false;
+    }
+
+    if (testQuery.next()) {
+        qDebug() << "✅ Basic connection test passed";
+    }
+    else {
+        qWarning() << "❌ No results from test query";
+        return false;
+    }
+
+    // Проверяем существование таблицы products (простой запрос)
+    QSqlQuery tableQuery(d->db);
+    if (!tableQuery.exec("SELECT COUNT(*) FROM products")) {
+        // После миграций таблица обязана быть: иначе схема повреждена
+        d->setError(tableQuery.lastError());
+        qWarning() << "❌ Products table check failed:" << d->lastError;
+        return false;
+    }
+
+    if (tableQuery.next()) {
+        int productCount = tableQuery.value(0).toInt();
+        qDebug() << "✅ Products table exists, count:" << productCount;
+    }
+
+    return true;
+}
+
+void DatabaseManager::disconnectFromDatabase()
+{
+    if (isConnected()) {
+        d->flushPending();
+    }
+    d->ledger.detach();
+    d->forecastReady = false;
+    d->lotsReady = false;
+
+    if (d->db.isValid() && d->db.isOpen()) {
+        d->db.close();
+        qDebug() << "🔌 Database connection closed";
+    }
+    d->connected = false;
+    // ⭐ УБЕРИТЕ ЭТУ СТРОКУ: QCoreApplication::processEvents();
+}
+
+bool DatabaseManager::isConnected() const
+{
+    return d->connected && d->db.isValid() && d->db.isOpen();
+}
+
+bool DatabaseManager::hasConnectionSettings() const
+{
+    return d->hasSettings;
+}
+
+bool DatabaseManager::ping()
+{
+    if (!isConnected()) {
+        return false;
+    }
+
+    QSqlQuery query(d->db);
+    if (!query.exec("SELECT 1")) {
+        markConnectionLost(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+void DatabaseManager::markConnectionLost(const QString& error)
+{
+    if (!d->connected) {
+        return;
+    }
+
+    // Без flushPending: соединения уже нет, журнал и прогноз остаются в памяти
+    d->setError(error);
+    d->connected = false;
+    d->ledger.detach();
+    d->forecastReady = false;
+    d->lotsReady = false;
+    if (d->db.isOpen()) {
+        d->db.close();
+    }
+    qWarning() << "📴 Database connection lost:" << error;
+}
+
+bool DatabaseManager::reconnect()
+{
+    if (!d->hasSettings) {
+        d->setError("No previous connection to restore");
+        return false;
+    }
+
+    if (d->connected) {
+        markConnectionLost("Reconnect requested");
+    }
+
+    // Новое соединение: запросы готовятся заново при первом выполнении,
+    // журнал и прогноз подключаются к нему в openConnection
+    if (!openConnection(d->settings, "fridge_connection_reconnect")) {
+        qWarning() << "❌ Reconnect failed:" << d->lastError;
+        return false;
+    }
+
+    qDebug() << "✅ Reconnected to database";
+    return true;
+}
+
+void DatabaseManager::enqueueOperations(const QVector<StockOperation>& operations)
+{
+    d->offlineQueue += operations;
+    qDebug() << "📥 Queued" << operations.size() << "operations while offline, total:" << d->offlineQueue.size();
+}
+
+int DatabaseManager::queuedOperationCount() const
+{
+    return d->offlineQueue.size();
+}
+
+bool DatabaseManager::replayQueuedOperations()
+{
+    if (d->offlineQueue.isEmpty()) {
+        return true;
+    }
+
+    // Обычно вся очередь проходит одной транзакцией; если пакет отклонен -
+    // по одной, чтобы одна отклоненная операция (например, остаток уже
+    // меньше) не задерживала остальные. Отбрасывается только отказ по
+    // данным; при сбое (соединение, блокировка) операция и все следующие
+    // остаются в очереди до следующей попытки
+    const QVector<StockOperation> queue = d->offlineQueue;
+    if (applyStockOperations(queue)) {
+        d->offlineQueue.clear();
+        qDebug() << "📤 Replayed" << queue.size() << "queued operations";
+        return true;
+    }
+
+    if (!d->rejected) {
+        ping();
+        qWarning() << "⚠️ Queued operations kept for the next attempt:" << d->lastError;
+        return false;
+    }
+
+    int rejected = 0;
+    QVector<StockOperation> remaining;
+    for (int i = 0; i < queue.size(); ++i) {
+        const StockOperation& operation = queue.at(i);
+        if (applyStockOperations({ operation })) {
+            continue;
+        }
+        if (!d->rejected) {
+            const QString error = d->lastError;
+            ping();
+            qWarning() << "⚠️ Queued operation for product" << operation.productId << "failed, kept in queue:" << error;
+            remaining = queue.mid(i);
+            break;
+        }
+        ++rejected;
+        qWarning() << "⚠️ Queued operation rejected for product" << operation.productId << ":" << d->lastError;
+    }
+    d->offlineQueue = remaining;
+    qDebug() << "📤 Replayed queued operations, rejected:" << rejected << "still queued:" << remaining.size();
+    return remaining.isEmpty();
+}
+
+QVector<ProductData> DatabaseManager::getAllProducts()
+{
+    TraceSpan span(d->trace, TraceEvent(TraceEvent::GetAllProducts));
+
+    QVector<ProductData> products;
+
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        qWarning() << "❌ Cannot get products: not connected to database";
+        return products;
+    }
+
+    QSqlQuery query(d->db);
+    const QString locationFilter = d->locationId > 0 ? "WHERE p.location_id = :location " : "";
+    QString sql = "SELECT p.id, p.name, p.current_quantity, p.norm_quantity, p.location_id, p.version, p.unit_cost FROM products p "
+        + locationFilter + "ORDER BY p.id";
+    if (d->counterShards > 0) {
+        // Свертка при чтении: к основному остатку прибавляются слоты
+        sql = "SELECT p.id, p.name, p.current_quantity + COALESCE(s.delta, 0), p.norm_quantity, p.location_id, p.version, p.unit_cost "
+            "FROM products p LEFT JOIN (SELECT product_id, SUM(delta) AS delta "
+            "FROM product_quantity_deltas GROUP BY product_id) s ON s.product_id = p.id "
+            + locationFilter + "ORDER BY p.id";
+    }
+
+    qDebug() << "📋 Executing SQL:" << sql;
+
+    query.prepare(sql);
+    if (d->locationId > 0) {
+        query.bindValue(":location", d->locationId);
+    }
+    if (!query.exec()) {
+        d->setError(query.lastError());
+        qWarning() << "❌ Failed to fetch products:" << d->lastError;
+        return products;
+    }
+
+    int count = 0;
+    while (query.next()) {
+        ProductData product = productFromQuery(query);
+        product.nextExpiry = d->lots.nextExpiry(product.id);
+        products.append(product);
+        count++;
+
+        qDebug() << "   Product:" << product.name
+            << "Qty:" << product.currentQuantity
+            << "Norm:" << product.normQuantity;
+    }
+
+    qDebug() << "✅ Loaded" << products.size() << "products from database";
+    span.done(true);
+    return products;
+}
+
+QVector<ProductData> DatabaseManager::getProductsToOrder(int* totalPacks)
+{
+    TraceSpan span(d->trace, TraceEvent(TraceEvent::GetProductsToOrder));
+
+    QVector<ProductData> products;
+    if (totalPacks) {
+        *totalPacks = 0;
+    }
+
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        qWarning() << "❌ Cannot get order: not connected to database";
+        return products;
+    }
+    d->setError(QString());   // пустой результат без ошибки - "заказывать нечего"
+
+    QSqlError error;
+    if (!queryProductsToOrder(d->db, d->locationId, d->counterShards, products, totalPacks, error)) {
+        d->setError(error);
+        qWarning() << "❌ Failed to fetch products to order:" << d->lastError;
+        return products;
+    }
+
+    qDebug() << "🛒" << products.size() << "products below norm";
+    span.done(true);
+    return products;
+}
+
+bool DatabaseManager::queryProductsToOrder(QSqlDatabase& db, int locationId, int counterShards,
+    QVector<ProductData>& products, int* totalPacks, QSqlError& error)
+{
+    products.clear();
+    if (totalPacks) {
+        *totalPacks = 0;
+    }
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    const QString locationFilter = locationId > 0 ? "AND location_id = :location " : "";
+    QString sql = "SELECT id, name, current_quantity, norm_quantity, order_quantity, location_id, unit_cost "
+        "FROM products_to_order WHERE TRUE " + locationFilter + "ORDER BY id";
+    if (counterShards > 0) {
+        // Слоты только увеличивают остаток, поэтому строки ниже нормы по
+        // основному счетчику - надмножество ответа: сначала частичный индекс,
+        // затем слоты досчитываются лишь для этих строк
+        sql = "SELECT id, name, quantity, norm_quantity, norm_quantity - quantity, location_id, unit_cost FROM ("
+            "SELECT p.id, p.name, p.norm_quantity, p.location_id, p.unit_cost, p.current_quantity + COALESCE(("
+            "SELECT SUM(delta) FROM product_quantity_deltas WHERE product_id = p.id), 0) AS quantity "
+            "FROM products p WHERE p.current_quantity < p.norm_quantity) t "
+            "WHERE quantity < norm_quantity " + locationFilter + "ORDER BY id";
+    }
+
+    query.prepare(sql);
+    if (locationId > 0) {
+        query.bindValue(":location", locationId);
+    }
+    if (!query.exec()) {
+        error = query.lastError();
+        return false;
+    }
+
+    while (query.next()) {
+        ProductData product(
+            query.value(0).toInt(),
+            query.value(1).toString(),
+            query.value(2).toInt(),
+            query.value(3).toInt(),
+            query.value(5).toInt()
+        );
+        product.unitCost = query.value(6).toLongLong();
+        products.append(product);
+        if (totalPacks) {
+            *totalPacks += query.value(4).toInt();
+        }
+    }
+    return true;
+}
+
+bool DatabaseManager::updateProductQuantity(int productId, int newQuantity)
+{
+    TraceSpan span(d->trace, TraceEvent::stock(TraceEvent::Stock, StockOperation::Set, productId, newQuantity));
+
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        qWarning() << "❌ Cannot update product: not connected to database";
+        return false;
+    }
+    if (!d->reserveLedger(1)) {
+        return false;
+    }
+
+    const StockOperation operation(StockOperation::Set, productId, newQuantity);
+    qDebug() << "🔄 Updating product" << productId << "to quantity" << newQuantity
+        << (d->counterShards > 0 ? "(sharded)" : "");
+
+    // Разница для журнала - от остатка, прочитанного самой записью, а не
+    // отдельным SELECT до нее
+    int previousQuantity = -1;
+    const bool written = d->writeWithLots(operation, [this, productId, newQuantity, &previousQuantity]() {
+        return d->setQuantity(productId, newQuantity, previousQuantity);
+    });
+
+    if (written) {
+        qDebug() << "✅ Product quantity updated successfully";
+        d->recordOperation(operation, previousQuantity);
+    }
+    else if (d->rejected) {
+        qDebug() << "⚠️ No rows affected - product might not exist";
+    }
+
+    return span.done(written);
+}
+
+bool DatabaseManager::addProductQuantity(int productId, int amount)
+{
+    TraceSpan span(d->trace, TraceEvent::stock(TraceEvent::Stock, StockOperation::Add, productId, amount));
+
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        qWarning() << "❌ Cannot add product quantity: not connected to database";
+        return false;
+    }
+    if (!d->reserveLedger(1)) {
+        return false;
+    }
+
+    const StockOperation operation(StockOperation::Add, productId, amount);
+
+    if (d->counterShards > 0) {
+        qDebug() << "➕ Adding" << amount << "to product" << productId << "slot" << d->counterSlot;
+        if (!d->shardedAdd(productId, amount)) {
+            return false;
+        }
+        d->recordOperation(operation);
+        return span.done(true);
+    }
+
+    QSqlQuery query(d->db);
+    query.prepare("UPDATE products SET current_quantity = current_quantity + :amount, version = version + 1 WHERE id = :id");
+    query.bindValue(":amount", amount);
+    query.bindValue(":id", productId);
+
+    qDebug() << "➕ Adding" << amount << "to product" << productId;
+
+    if (!query.exec()) {
+        d->setError(query.lastError());
+        qWarning() << "❌ Failed to add product quantity:" << d->lastError;
+        return false;
+    }
+
+    bool success = query.numRowsAffected() > 0;
+    if (success) {
+        qDebug() << "✅ Product quantity added successfully";
+        d->recordOperation(operation);
+    }
+    else {
+        qDebug() << "⚠️ No rows affected - product might not exist";
+    }
+
+    return span.done(success);
+}
+
+bool DatabaseManager::removeProductQuantity(int productId, int amount)
+{
+    TraceSpan span(d->trace, TraceEvent::stock(TraceEvent::Stock, StockOperation::Remove, productId, amount));
+
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        qWarning() << "❌ Cannot remove product quantity: not connected to database";
+        return false;
+    }
+    if (!d->reserveLedger(1)) {
+        return false;
+    }
+
+    const StockOperation operation(StockOperation::Remove, productId, amount);
+
+    if (d->counterShards > 0) {
+        qDebug() << "➖ Removing" << amount << "from product" << productId << "slot" << d->counterSlot;
+        if (!d->writeWithLots(operation, [this, productId, amount]() {
+                return d->shardedRemove(productId, amount);
+            })) {
+            return false;
+        }
+        d->recordOperation(operation);
+        return span.done(true);
+    }
+
+    // Проверка остатка прямо в UPDATE: без отдельного SELECT и без гонки
+    // между чтением и записью, когда списывают с двух терминалов сразу
+    qDebug() << "➖ Removing" << amount << "from product" << productId;
+
+    const bool written = d->writeWithLots(operation, [this, productId, amount]() {
+        bool removed = false;
+        if (!d->guardedMainRemove(productId, amount, removed)) {
+            return false;
+        }
+        if (!removed) {
+            // Строка не изменилась: продукта нет или остатка не хватает
+            d->setRejected(d->readQuantity(productId) < 0
+                ? QString("Product %1 not found").arg(productId)
+                : QString("Not enough quantity available"));
+            qWarning() << "❌ Cannot remove product quantity:" << d->lastError;
+        }
+        return removed;
+    });
+    if (!written) {
+        return false;
+    }
+
+    qDebug() << "✅ Product quantity removed successfully";
+    d->recordOperation(operation);
+    return span.done(true);
+}
+
+bool DatabaseManager::receiveLot(int productId, int amount, const QDate& expiresOn, qint64 unitCost,
+    ProductData* current)
+{
+    TraceSpan span(d->trace, TraceEvent::lot(TraceEvent::ReceiveLot, productId, amount, expiresOn, unitCost));
+
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        qWarning() << "❌ Cannot receive lot: not connected to database";
+        return false;
+    }
+    if (!d->reserveLedger(1)) {
+        return false;
+    }
+    if (!d->lotsReady) {
+        d->setError("Lot tracking is not available");
+        return false;
+    }
+    if (amount <= 0) {
+        d->setError("Lot quantity must be positive");
+        return false;
+    }
+
+    ProductLot lot;
+    lot.productId = productId;
+    lot.quantity = amount;
+    lot.receivedMs = QDateTime::currentMSecsSinceEpoch();
+    lot.expiresOn = expiresOn;
+    lot.unitCost = unitCost;
+
+    // С ценой партии цена продукта становится средневзвешенной по остатку и
+    // приходу; считается в копейках в самом UPDATE, с округлением до копейки
+    const QString quantity = d->counterShards > 0
+        ? "(current_quantity + COALESCE((SELECT SUM(delta) FROM product_quantity_deltas WHERE product_id = :id), 0))"
+        : "current_quantity";
+    const QString averageCost = QString("unit_cost = (%1 * unit_cost + CAST(:amount AS BIGINT) * CAST(:cost AS BIGINT) "
+        "+ (%1 + :amount) / 2) / (%1 + :amount)").arg(quantity);
+
+    // Партия и приход к остатку - в одной транзакции
+    if (!d->db.transaction()) {
+        d->setError(d->db.lastError());
+        return false;
+    }
+
+    bool ok = d->lots.insertLot(d->db, lot);
+    if (!ok) {
+        d->setError(d->lots.getLastError());
+    }
+    else if (d->counterShards > 0) {
+        // Цена - по остатку до прихода, поэтому раньше записи в слот
+        QSqlQuery costQuery(d->db);
+        if (unitCost >= 0) {
+            costQuery.prepare("UPDATE products SET " + averageCost + " WHERE id = :id");
+            costQuery.bindValue(":amount", amount);
+            costQuery.bindValue(":cost", unitCost);
+            costQuery.bindValue(":id", productId);
+            ok = costQuery.exec();
+            if (!ok) {
+                d->setError(costQuery.lastError());
+            }
+        }
+        if (ok) {
+            d->inTransaction = true;
+            ok = d->shardedAdd(productId, amount);
+            d->inTransaction = false;
+        }
+    }
+    else {
+        QSqlQuery query(d->db);
+        query.prepare("UPDATE products SET " + (unitCost >= 0 ? averageCost + ", " : QString())
+            + "current_quantity = current_quantity + :amount, version = version + 1 WHERE id = :id");
+        query.bindValue(":amount", amount);
+        query.bindValue(":id", productId);
+        if (unitCost >= 0) {
+            query.bindValue(":cost", unitCost);
+        }
+        ok = query.exec() && query.numRowsAffected() > 0;
+        if (!ok) {
+            if (query.lastError().isValid()) {
+                d->setError(query.lastError());
+            }
+            else {
+                d->setError(QString("Product %1 not found").arg(productId));
+            }
+        }
+    }
+
+    if (!ok || !d->db.commit()) {
+        if (ok) {
+            d->setError(d->db.lastError());
+        }
+        qWarning() << "❌ Failed to receive lot:" << d->lastError;
+        d->db.rollback();
+        return false;
+    }
+
+    d->lots.addLot(lot);
+    d->recordOperation(StockOperation(StockOperation::Add, productId, amount));
+    qDebug() << "📦 Received lot" << lot.id << "of product" << productId << ":" << amount
+        << "until" << expiresOn.toString(Qt::ISODate);
+
+    // Строка после прихода: остаток, версия и новая средняя цена для кэша клиента
+    if (current && d->fetchProduct(productId, *current)) {
+        current->nextExpiry = d->lots.nextExpiry(productId);
+    }
+    return span.done(true);
+}
+
+bool DatabaseManager::setUnitCosts(const QHash<int, qint64>& costs)
+{
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        return false;
+    }
+    if (costs.isEmpty()) {
+        return true;
+    }
+
+    QVariantList productIds;
+    QVariantList values;
+    for (auto it = costs.cbegin(); it != costs.cend(); ++it) {
+        if (it.value() < 0) {
+            d->setError(QString("Negative unit cost for product %1").arg(it.key()));
+            return false;
+        }
+        productIds << it.key();
+        values << it.value();
+    }
+
+    if (!d->db.transaction()) {
+        d->setError(d->db.lastError());
+        return false;
+    }
+
+    QSqlQuery query(d->db);
+    query.prepare("UPDATE products SET unit_cost = ? WHERE id = ?");
+    query.addBindValue(values);
+    query.addBindValue(productIds);
+    if (!query.execBatch() || !d->db.commit()) {
+        d->setError(query.lastError().isValid() ? query.lastError() : d->db.lastError());
+        qWarning() << "❌ Failed to save unit costs:" << d->lastError;
+        d->db.rollback();
+        return false;
+    }
+
+    qDebug() << "💰 Unit costs saved for" << costs.size() << "products";
+    return true;
+}
+
+QVector<ProductLot> DatabaseManager::getProductLots(int productId) const
+{
+    return d->lots.lots(productId);
+}
+
+QDate DatabaseManager::nextExpiry(int productId) const
+{
+    return d->lots.nextExpiry(productId);
+}
+
+void DatabaseManager::setExpiryWarningHours(int hours)
+{
+    d->lots.setWarningHours(hours);
+}
+
+QVector<ProductLot> DatabaseManager::checkExpiringLots()
+{
+    QVector<ProductLot> expiring;
+    if (!isConnected() || !d->lotsReady) {
+        return expiring;
+    }
+
+    // Партии, принятые другими терминалами: только новые id, без полного чтения
+    d->lots.loadNew(d->db);
+
+    const QVector<ProductLot> due = d->lots.advance(QDateTime::currentMSecsSinceEpoch());
+    if (due.isEmpty()) {
+        return expiring;
+    }
+
+    // Остаток сработавших партий мог уйти с другого терминала: перечитываются
+    // только их продукты
+    QSet<int> products;
+    for (const ProductLot& lot : due) {
+        if (!products.contains(lot.productId)) {
+            products.insert(lot.productId);
+            d->lots.reloadProduct(d->db, lot.productId);
+        }
+    }
+    for (const ProductLot& lot : due) {
+        ProductLot current;
+        if (d->lots.findLot(lot.id, current)) {
+            expiring.append(current);
+        }
+    }
+
+    if (!expiring.isEmpty()) {
+        qDebug() << "⏰" << expiring.size() << "lots are about to expire";
+        emit lotsExpiring(expiring);
+    }
+    return expiring;
+}
+
+bool DatabaseManager::applyStockOperations(const QVector<StockOperation>& operations)
+{
+    TraceEvent event(TraceEvent::Batch);
+    event.operations = operations;
+    TraceSpan span(d->trace, event);
+
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        qWarning() << "❌ Cannot apply operations: not connected to database";
+        return false;
+    }
+
+    if (operations.isEmpty()) {
+        return span.done(true);
+    }
+    if (!d->reserveLedger(operations.size())) {
+        return false;
+    }
+
+    if (!d->db.transaction()) {
+        d->setError(d->db.lastError());
+        qWarning() << "❌ Failed to start transaction:" << d->lastError;
+        return false;
+    }
+
+    // Остатки до установки (Set) - для записи разницы в журнал; читает их
+    // сама запись (setQuantity)
+    QVector<int> previousQuantities(operations.size(), -1);
+
+    if (d->counterShards > 0) {
+        d->inTransaction = true;
+        for (int i = 0; i < operations.size(); ++i) {
+            const StockOperation& operation = operations.at(i);
+            bool ok = false;
+            switch (operation.type) {
+            case StockOperation::Add:
+                ok = d->shardedAdd(operation.productId, operation.amount);
+                break;
+            case StockOperation::Remove:
+                ok = d->shardedRemove(operation.productId, operation.amount);
+                break;
+            case StockOperation::Set:
+                ok = d->setQuantity(operation.productId, operation.amount, previousQuantities[i]);
+                break;
+            }
+            if (!ok || !d->takeLots(operation)) {
+                qWarning() << "❌ Batch operation rejected:" << d->lastError;
+                d->inTransaction = false;
+                d->db.rollback();
+                d->restoreLots();
+                return false;
+            }
+        }
+        d->inTransaction = false;
+
+        if (!d->db.commit()) {
+            d->setError(d->db.lastError());
+            qWarning() << "❌ Failed to commit batch:" << d->lastError;
+            d->db.rollback();
+            d->restoreLots();
+            return false;
+        }
+        d->keepLots();
+        for (int i = 0; i < operations.size(); ++i) {
+            d->recordOperation(operations.at(i), previousQuantities.at(i));
+        }
+        qDebug() << "✅ Applied sharded batch of" << operations.size() << "operations";
+        return span.done(true);
+    }
+
+    // Запросы готовятся один раз на весь пакет
+    QSqlQuery addQuery(d->db);
+    addQuery.prepare("UPDATE products SET current_quantity = current_quantity + :amount, version = version + 1 WHERE id = :id");
+
+    // Проверка остатка прямо в UPDATE, без отдельного SELECT
+    QSqlQuery removeQuery(d->db);
+    removeQuery.prepare("UPDATE products SET current_quantity = current_quantity - :amount, version = version + 1 "
+        "WHERE id = :id AND current_quantity >= :amount");
+
+    d->inTransaction = true;
+    for (int i = 0; i < operations.size(); ++i) {
+        const StockOperation& operation = operations.at(i);
+
+        if (operation.type == StockOperation::Set) {
+            if (!d->setQuantity(operation.productId, operation.amount, previousQuantities[i])
+                || !d->takeLots(operation)) {
+                qWarning() << "❌ Batch operation rejected:" << d->lastError;
+                d->inTransaction = false;
+                d->db.rollback();
+                d->restoreLots();
+                return false;
+            }
+            continue;
+        }
+
+        QSqlQuery* query = operation.type == StockOperation::Add ? &addQuery : &removeQuery;
+        query->bindValue(":amount", operation.amount);
+        query->bindValue(":id", operation.productId);
+
+        if (!query->exec()) {
+            d->setError(query->lastError());
+            qWarning() << "❌ Batch operation failed for product" << operation.productId << ":" << d->lastError;
+            d->inTransaction = false;
+            d->db.rollback();
+            d->restoreLots();
+            return false;
+        }
+
+        if (query->numRowsAffected() <= 0) {
+            d->setRejected(operation.type == StockOperation::Remove
+                ? QString("Not enough quantity available for product %1").arg(operation.productId)
+                : QString("Product %1 not found").arg(operation.productId));
+            qWarning() << "❌ Batch operation rejected:" << d->lastError;
+            d->inTransaction = false;
+            d->db.rollback();
+            d->restoreLots();
+            return false;
+        }
+
+        // Партии - в той же транзакции: откат пакета возвращает и их
+        if (!d->takeLots(operation)) {
+            d->inTransaction = false;
+            d->db.rollback();
+            d->restoreLots();
+            return false;
+        }
+    }
+    d->inTransaction = false;
+
+    if (!d->db.commit()) {
+        d->setError(d->db.lastError());
+        qWarning() << "❌ Failed to commit batch:" << d->lastError;
+        d->db.rollback();
+        d->restoreLots();
+        return false;
+    }
+    d->keepLots();
+
+    for (int i = 0; i < operations.size(); ++i) {
+        d->recordOperation(operations.at(i), previousQuantities.at(i));
+    }
+    qDebug() << "✅ Applied batch of" << operations.size() << "operations";
+    return span.done(true);
+}
+
+DatabaseManager::WriteStatus DatabaseManager::applyVersioned(const StockOperation& operation, int expectedVersion,
+    ProductData& current)
+{
+    TraceSpan span(d->trace, TraceEvent::stock(TraceEvent::Versioned, operation.type, operation.productId,
+        operation.amount, expectedVersion));
+
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        return WriteStatus::Failed;
+    }
+    if (!d->reserveLedger(1)) {
+        return WriteStatus::Failed;
+    }
+
+    if (d->counterShards > 0) {
+        bool ok = false;
+        switch (operation.type) {
+        case StockOperation::Add:
+            ok = addProductQuantity(operation.productId, operation.amount);
+            break;
+        case StockOperation::Remove:
+            ok = removeProductQuantity(operation.productId, operation.amount);
+            break;
+        case StockOperation::Set:
+            ok = updateProductQuantity(operation.productId, operation.amount);
+            break;
+        }
+        const QString error = d->lastError;
+        if (!d->fetchProduct(operation.productId, current)) {
+            return WriteStatus::Failed;
+        }
+        d->lastError = error;
+        current.nextExpiry = d->lots.nextExpiry(current.id);
+        span.done(ok);
+        return ok ? WriteStatus::Applied : WriteStatus::Rejected;
+    }
+
+    QString assignment;
+    switch (operation.type) {
+    case StockOperation::Add:
+        assignment = "current_quantity = current_quantity + :amount";
+        break;
+    case StockOperation::Remove:
+        assignment = "current_quantity = current_quantity - :amount";
+        break;
+    case StockOperation::Set:
+        assignment = "current_quantity = :amount";
+        break;
+    }
+    const QString condition = operation.type == StockOperation::Remove
+        ? "WHERE id = :id AND version = :version AND current_quantity >= :amount"
+        : "WHERE id = :id AND version = :version";
+    const QString columns = "id, name, current_quantity, norm_quantity, location_id, version, unit_cost";
+
+    // Остаток до установки (Set) для движения Correction читает сама запись:
+    // в PostgreSQL - подзапрос FOR UPDATE того же UPDATE, в SQLite - SELECT
+    // в той же транзакции
+    const bool isSet = operation.type == StockOperation::Set;
+    const bool readBefore = isSet && !d->isPostgres();
+    int previousQuantity = -1;
+
+    // Списание из партий - в одной транзакции с остатком
+    const bool withLots = d->lotAmount(operation) > 0;
+    const bool ownTransaction = withLots || readBefore;
+    if (ownTransaction && !d->db.transaction()) {
+        d->setError(d->db.lastError());
+        return WriteStatus::Failed;
+    }
+    if (readBefore) {
+        previousQuantity = d->readQuantity(operation.productId);
+    }
+
+    QSqlQuery query(d->db);
+    bool applied = false;
+    if (isSet && d->isPostgres()) {
+        query.prepare("UPDATE products p SET current_quantity = :amount, version = p.version + 1 "
+            "FROM (SELECT id, current_quantity FROM products WHERE id = :id FOR UPDATE) old "
+            "WHERE p.id = old.id AND p.version = :version RETURNING p.id, p.name, p.current_quantity, "
+            "p.norm_quantity, p.location_id, p.version, p.unit_cost, old.current_quantity");
+    }
+    else {
+        query.prepare("UPDATE products SET " + assignment + ", version = version + 1 " + condition
+            + (d->isPostgres() ? " RETURNING " + columns : QString()));
+    }
+    query.bindValue(":amount", operation.amount);
+    query.bindValue(":id", operation.productId);
+    query.bindValue(":version", expectedVersion);
+    if (!query.exec()) {
+        d->setError(query.lastError());
+        qWarning() << "❌ Versioned update failed:" << d->lastError;
+        if (ownTransaction) {
+            d->db.rollback();
+        }
+        return WriteStatus::Failed;
+    }
+    if (d->isPostgres()) {
+        // Измененная строка приходит сразу, без второго запроса
+        applied = query.next();
+        if (applied) {
+            current = productFromQuery(query);
+            if (isSet) {
+                previousQuantity = query.value(7).toInt();
+            }
+        }
+    }
+    else {
+        applied = query.numRowsAffected() > 0;
+    }
+    query.finish();
+
+    if (ownTransaction) {
+        bool ok = !applied || d->takeLots(operation);
+        if (ok && !d->db.commit()) {
+            d->setError(d->db.lastError());
+            ok = false;
+        }
+        if (!ok) {
+            qWarning() << "❌ Versioned update failed:" << d->lastError;
+            d->db.rollback();
+            d->restoreLots();
+            return WriteStatus::Failed;
+        }
+        d->keepLots();
+    }
 
-    // 1. Peer authentication с текущим системным пользователем
-    QString currentUser = qgetenv("USER");
-    if (currentUser.isEmpty()) {
-        currentUser = "postgres";
+    // Строка, не прошедшая условие, перечитывается отдельным запросом. В
+    // READ COMMITTED у него свой снимок: если UPDATE ждал блокировку, пока
+    // другой терминал фиксировал изменение, новая версия видна только так -
+    // снимок самого UPDATE вернул бы старую строку с ожидаемой версией
+    if ((!applied || !d->isPostgres()) && !d->fetchProduct(operation.productId, current)) {
+        return WriteStatus::Failed;
     }
 
-    qDebug() << "👤 Current system user:" << currentUser;
+    if (applied) {
+        d->recordOperation(operation, previousQuantity);
+    }
+    current.nextExpiry = d->lots.nextExpiry(current.id);
+    if (applied) {
+        span.done(true);
+        return WriteStatus::Applied;
+    }
 
-    // Метод 1: Peer authentication (самый надежный)
-    d->db = QSqlDatabase::addDatabase("QPSQL", "fridge_connection_peer");
-    d->db.setConnectOptions("connect_timeout=3");
-    d->db.setHostName("");  // пустой для peer auth
-    d->db.setPort(-1);      // -1 для default порта
-    d->db.setDatabaseName("fridgemanager");
-    d->db.setUserName(currentUser);  // используем текущего системного пользователя
-    d->db.setPassword("");
+    // Версия совпала и остатка действительно мало - отказ; иначе строку
+    // изменили, и клиент повторит операцию по свежей версии
+    if (current.version == expectedVersion && operation.type == StockOperation::Remove
+        && current.currentQuantity < operation.amount) {
+        d->setError("Not enough quantity available");
+        return WriteStatus::Rejected;
+    }
 
-    qDebug() << "🔄 Attempting peer authentication as user:" << currentUser;
+    d->setError(QString("Product %1 was changed by another terminal").arg(operation.productId));
+    qDebug() << "🔁 Version conflict for product" << operation.productId
+        << "expected" << expectedVersion << "actual" << current.version;
+    return WriteStatus::Conflict;
+}
 
-    if (d->db.open()) {
-        if (verifyConnection()) {
-            qDebug() << "✅ Connected via peer authentication";
-            d->connected = true;
-            return true;
-        }
-        d->db.close();
-    }
-    else {
-        qDebug() << "❌ Peer auth failed:" << d->db.lastError().text();
-    }
-    QSqlDatabase::removeDatabase("fridge_connection_peer");
+void DatabaseManager::setCounterShards(int shards)
+{
+    d->counterShards = qMax(0, shards);
+    // Слот выбирается один раз на экземпляр (терминал)
+    d->counterSlot = d->counterShards > 0 ? int(QRandomGenerator::global()->bounded(d->counterShards)) : 0;
 
-    // Метод 2: Peer authentication с пользователем postgres
-    d->db = QSqlDatabase::addDatabase("QPSQL", "fridge_connection_postgres");
-    d->db.setConnectOptions("connect_timeout=3");
-    d->db.setHostName("");
-    d->db.setPort(-1);
-    d->db.setDatabaseName("fridgemanager");
-    d->db.setUserName("postgres");
-    d->db.setPassword("");
+    qDebug() << "🧮 Counter shards:" << d->counterShards << "slot:" << d->counterSlot;
+}
 
-    qDebug() << "🔄 Attempting peer authentication as user: postgres";
+int DatabaseManager::counterShards() const
+{
+    return d->counterShards;
+}
 
-    if (d->db.open()) {
-        if (verifyConnection()) {
-            qDebug() << "✅ Connected via peer authentication (postgres)";
-            d->connected = true;
-            return true;
-        }
-        d->db.close();
+void DatabaseManager::setCounterFoldInterval(int msec)
+{
+    if (msec > 0) {
+        d->foldTimer.start(msec);
     }
     else {
-        qDebug() << "❌ Peer auth (postgres) failed:" << d->db.lastError().text();
+        d->foldTimer.stop();
     }
-    QSqlDatabase::removeDatabase("fridge_connection_postgres");
-
-    // Метод 3: Localhost подключение
-    d->db = QSqlDatabase::addDatabase("QPSQL", "fridge_connection_local");
-    d->db.setConnectOptions("connect_timeout=3");
-    d->db.setHostName("localhost");
-    d->db.setPort(5432);
-    d->db.setDatabaseName("fridgemanager");
-    d->db.setUserName("postgres");
-    d->db.setPassword("");
+}
 
-    qDebug() << "🔄 Attempting localhost connection...";
+bool DatabaseManager::foldCounterShards()
+{
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        return false;
+    }
 
-    if (d->db.open()) {
-        if (verifyConnection()) {
-            qDebug() << "✅ Connected via localhost";
-            d->connected = true;
-            return true;
-        }
-        d->db.close();
+    QSqlQuery query(d->db);
+    bool ok = false;
+    if (d->isPostgres()) {
+        ok = query.exec("WITH moved AS (DELETE FROM product_quantity_deltas WHERE delta <> 0 RETURNING product_id, delta), "
+            "sums AS (SELECT product_id, SUM(delta) AS delta FROM moved GROUP BY product_id) "
+            "UPDATE products p SET current_quantity = p.current_quantity + sums.delta "
+            "FROM sums WHERE p.id = sums.product_id");
     }
     else {
-        qDebug() << "❌ Localhost connection failed:" << d->db.lastError().text();
+        // Прочие драйверы (SQLite): два оператора в одной транзакции
+        if (d->db.transaction()) {
+            ok = query.exec("UPDATE products SET current_quantity = current_quantity + "
+                    "(SELECT SUM(delta) FROM product_quantity_deltas WHERE product_id = products.id) "
+                    "WHERE id IN (SELECT product_id FROM product_quantity_deltas)")
+                && query.exec("DELETE FROM product_quantity_deltas")
+                && d->db.commit();
+            if (!ok) {
+                d->db.rollback();
+            }
+        }
     }
-    QSqlDatabase::removeDatabase("fridge_connection_local");
 
-    qWarning() << "❌ All PostgreSQL connection attempts failed";
-    d->lastError = "Could not establish database connection";
-    d->connected = false;
-    return false;
+    if (!ok) {
+        d->setError(query.lastError().isValid() ? query.lastError() : d->db.lastError());
+        qWarning() << "❌ Failed to fold counter shards:" << d->lastError;
+        return false;
+    }
+
+    qDebug() << "🧮 Counter shards folded into products";
+    return true;
 }
 
-// ⭐ ВАЖНО: РЕАЛИЗАЦИЯ ФУНКЦИИ ДОЛЖНА БЫТЬ ПОСЛЕ connectToDatabase()
-bool DatabaseManager::verifyConnection()
+bool DatabaseManager::flushLedger()
 {
-    if (!d->db.isOpen()) {
-        qDebug() << "❌ Database not open in verifyConnection";
+    if (!isConnected()) {
+        d->setError("Not connected to database");
         return false;
     }
-
-    // ⭐ ВАЖНО: Используем простой и надежный запрос
-    // Не используем сложные запросы которые могут вызвать ошибки
-
-    // Простая проверка версии PostgreSQL
-    QSqlQuery testQuery(d->db);
-    if (!testQuery.exec("SELECT 1")) {
-        qWarning() << "❌ Simple test query failed:" << testQuery.lastError().text();
+    if (!d->ledger.flush()) {
+        d->setError(d->ledger.getLastError());
         return false;
     }
+    if (d->forecastReady && !d->forecaster.saveDirty(d->db)) {
+        d->setError(d->forecaster.getLastError());
+        return false;
+    }
+    return true;
+}
 
-    if (testQuery.next()) {
-        qDebug() << "✅ Basic connection test passed";
+void DatabaseManager::setLedgerFlushInterval(int msec)
+{
+    if (msec > 0) {
+        d->ledgerTimer.start(msec);
     }
     else {
-        qWarning() << "❌ No results from test query";
-        return false;
+        d->ledgerTimer.stop();
     }
+}
 
-    // Проверяем существование таблицы products (простой запрос)
-    QSqlQuery tableQuery(d->db);
-    if (!tableQuery.exec("SELECT COUNT(*) FROM products")) {
-        qDebug() << "⚠️ Products table check failed (might not exist):" << tableQuery.lastError().text();
+int DatabaseManager::consumptionOverLastDays(int productId, int days)
+{
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        return -1;
+    }
 
-        // Если таблицы нет, это не критично - приложение создаст локальные данные
-        qDebug() << "📋 Will use local data mode";
-        return true; // Все равно возвращаем true, так как подключение работает
+    const int consumed = d->ledger.consumptionOverLastDays(productId, days);
+    if (consumed < 0) {
+        d->setError(d->ledger.getLastError());
     }
+    return consumed;
+}
 
-    if (tableQuery.next()) {
-        int productCount = tableQuery.value(0).toInt();
-        qDebug() << "✅ Products table exists, count:" << productCount;
+QVector<ConsumptionBucket> DatabaseManager::getConsumptionRollup(int productId, RollupPeriod period, int periods)
+{
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        return QVector<ConsumptionBucket>();
     }
+    return d->ledger.consumptionRollup(productId, period, periods);
+}
 
-    return true;
+void DatabaseManager::setForecastSettings(const ConsumptionForecaster::Settings& settings)
+{
+    d->forecaster.setSettings(settings);
 }
 
-void DatabaseManager::disconnectFromDatabase()
+const ConsumptionForecaster& DatabaseManager::forecaster() const
 {
-    if (d->db.isValid() && d->db.isOpen()) {
-        d->db.close();
-        qDebug() << "🔌 Database connection closed";
-    }
-    d->connected = false;
-    // ⭐ УБЕРИТЕ ЭТУ СТРОКУ: QCoreApplication::processEvents();
+    return d->forecaster;
 }
 
-bool DatabaseManager::isConnected() const
+ConsumptionForecaster::Suggestion DatabaseManager::suggestOrder(int productId, int currentQuantity, int normQuantity) const
 {
-    return d->connected && d->db.isValid() && d->db.isOpen();
+    return d->forecaster.suggest(productId, currentQuantity, normQuantity, QDateTime::currentMSecsSinceEpoch());
 }
 
-QVector<ProductData> DatabaseManager::getAllProducts()
+ConnectionSettings DatabaseManager::connectionSettings() const
 {
-    QVector<ProductData> products;
+    return d->settings;
+}
 
+QVector<LocationInfo> DatabaseManager::getLocations()
+{
+    QVector<LocationInfo> locations;
     if (!isConnected()) {
-        d->lastError = "Not connected to database";
-        qWarning() << "❌ Cannot get products: not connected to database";
-        return products;
+        d->setError("Not connected to database");
+        return locations;
     }
 
     QSqlQuery query(d->db);
-    QString sql = "SELECT id, name, current_quantity, norm_quantity FROM products ORDER BY id";
-
-    qDebug() << "📋 Executing SQL:" << sql;
-
-    if (!query.exec(sql)) {
-        d->lastError = query.lastError().text();
-        qWarning() << "❌ Failed to fetch products:" << d->lastError;
-        return products;
+    if (!query.exec("SELECT id, name, restaurant FROM locations ORDER BY id")) {
+        d->setError(query.lastError());
+        qWarning() << "❌ Failed to fetch locations:" << d->lastError;
+        return locations;
     }
 
-    int count = 0;
     while (query.next()) {
-        ProductData product(
-            query.value(0).toInt(),
-            query.value(1).toString(),
-            query.value(2).toInt(),
-            query.value(3).toInt()
-        );
-        products.append(product);
-        count++;
-
-        qDebug() << "   Product:" << product.name
-            << "Qty:" << product.currentQuantity
-            << "Norm:" << product.normQuantity;
+        locations.append(LocationInfo(query.value(0).toInt(), query.value(1).toString(), query.value(2).toString()));
     }
-
-    qDebug() << "✅ Loaded" << products.size() << "products from database";
-    return products;
+    return locations;
 }
 
-bool DatabaseManager::updateProductQuantity(int productId, int newQuantity)
+QVector<ProductBarcode> DatabaseManager::getBarcodes()
 {
+    QVector<ProductBarcode> barcodes;
     if (!isConnected()) {
-        d->lastError = "Not connected to database";
-        qWarning() << "❌ Cannot update product: not connected to database";
-        return false;
+        d->setError("Not connected to database");
+        return barcodes;
     }
 
     QSqlQuery query(d->db);
-    query.prepare("UPDATE products SET current_quantity = :quantity WHERE id = :id");
-    query.bindValue(":quantity", newQuantity);
-    query.bindValue(":id", productId);
+    QString sql = "SELECT b.barcode, b.product_id, b.pack_quantity FROM product_barcodes b";
+    if (d->locationId > 0) {
+        sql += " JOIN products p ON p.id = b.product_id WHERE p.location_id = :location";
+    }
+    query.prepare(sql + " ORDER BY b.product_id");
+    if (d->locationId > 0) {
+        query.bindValue(":location", d->locationId);
+    }
+    if (!query.exec()) {
+        d->setError(query.lastError());
+        qWarning() << "❌ Failed to fetch barcodes:" << d->lastError;
+        return barcodes;
+    }
 
-    qDebug() << "🔄 Updating product" << productId << "to quantity" << newQuantity;
+    while (query.next()) {
+        barcodes.append(ProductBarcode(query.value(0).toString(), query.value(1).toInt(), query.value(2).toInt()));
+    }
+    return barcodes;
+}
 
-    if (!query.exec()) {
-        d->lastError = query.lastError().text();
-        qWarning() << "❌ Failed to update product quantity:" << d->lastError;
+bool DatabaseManager::setBarcodes(const QVector<ProductBarcode>& barcodes)
+{
+    if (!isConnected()) {
+        d->setError("Not connected to database");
         return false;
     }
+    if (barcodes.isEmpty()) {
+        return true;
+    }
 
-    bool success = query.numRowsAffected() > 0;
-    if (success) {
-        qDebug() << "✅ Product quantity updated successfully";
+    QVariantList productIds;
+    QVariantList codes;
+    QVariantList packs;
+    for (const ProductBarcode& barcode : barcodes) {
+        if (barcode.barcode.isEmpty() || barcode.packQuantity <= 0) {
+            d->setError(QString("Invalid barcode for product %1").arg(barcode.productId));
+            return false;
+        }
+        productIds << barcode.productId;
+        codes << barcode.barcode;
+        packs << barcode.packQuantity;
     }
-    else {
-        qDebug() << "⚠️ No rows affected - product might not exist";
+
+    if (!d->db.transaction()) {
+        d->setError(d->db.lastError());
+        return false;
+    }
+
+    // Повторный импорт того же файла меняет только фасовку
+    QSqlQuery query(d->db);
+    query.prepare("INSERT INTO product_barcodes (product_id, barcode, pack_quantity) VALUES (?, ?, ?) "
+        "ON CONFLICT (product_id, barcode) DO UPDATE SET pack_quantity = excluded.pack_quantity");
+    query.addBindValue(productIds);
+    query.addBindValue(codes);
+    query.addBindValue(packs);
+    if (!query.execBatch() || !d->db.commit()) {
+        d->setError(query.lastError().isValid() ? query.lastError() : d->db.lastError());
+        qWarning() << "❌ Failed to save barcodes:" << d->lastError;
+        d->db.rollback();
+        return false;
     }
 
-    return success;
+    qDebug() << "🏷️ Barcodes saved:" << barcodes.size();
+    return true;
 }
 
-bool DatabaseManager::addProductQuantity(int productId, int amount)
+bool DatabaseManager::reconcileStockTake(const QVector<StockCount>& counts, bool apply, bool zeroMissing,
+    StockTakeResult& result)
 {
+    result = StockTakeResult();
     if (!isConnected()) {
-        d->lastError = "Not connected to database";
-        qWarning() << "❌ Cannot add product quantity: not connected to database";
+        d->setError("Not connected to database");
+        return false;
+    }
+
+    // Движения Correction пишет тот же запрос, что исправляет остатки
+    const bool writeMovements = apply && d->ledger.isReady();
+    if (writeMovements && !d->ledger.ensureCurrentPartition()) {
+        d->setError(d->ledger.getLastError());
+        return false;
+    }
+
+    if (!d->db.transaction()) {
+        d->setError(d->db.lastError());
         return false;
     }
+    auto fail = [this](const QSqlQuery& query) {
+        if (query.lastError().isValid()) {
+            d->setError(query.lastError());
+        }
+        qWarning() << "❌ Stock take failed:" << d->lastError;
+        d->db.rollback();
+        d->restoreLots();
+        return false;
+    };
 
     QSqlQuery query(d->db);
-    query.prepare("UPDATE products SET current_quantity = current_quantity + :amount WHERE id = :id");
-    query.bindValue(":amount", amount);
-    query.bindValue(":id", productId);
+    if (!d->stageCounts(counts)) {
+        return fail(query);
+    }
 
-    qDebug() << "➕ Adding" << amount << "to product" << productId;
+    // Строки без id - по названию, в пределах выбранной локации
+    const QString locationFilter = d->locationId > 0 ? "AND p.location_id = :location " : "";
+    query.prepare(d->isPostgres()
+        ? "UPDATE stock_take_counts c SET product_id = p.id FROM products p "
+          "WHERE c.product_id IS NULL AND lower(p.name) = lower(c.name) " + locationFilter
+        : "UPDATE stock_take_counts SET product_id = (SELECT p.id FROM products p "
+          "WHERE lower(p.name) = lower(stock_take_counts.name) " + locationFilter + "LIMIT 1) "
+          "WHERE product_id IS NULL");
+    if (d->locationId > 0) {
+        query.bindValue(":location", d->locationId);
+    }
+    if (!query.exec()) {
+        return fail(query);
+    }
 
+    query.prepare("SELECT COALESCE(NULLIF(c.name, ''), CAST(c.product_id AS TEXT)) FROM stock_take_counts c "
+        "LEFT JOIN products p ON p.id = c.product_id " + locationFilter + "WHERE p.id IS NULL");
+    if (d->locationId > 0) {
+        query.bindValue(":location", d->locationId);
+    }
     if (!query.exec()) {
-        d->lastError = query.lastError().text();
-        qWarning() << "❌ Failed to add product quantity:" << d->lastError;
-        return false;
+        return fail(query);
+    }
+    while (query.next()) {
+        result.unmatched << query.value(0).toString();
     }
 
-    bool success = query.numRowsAffected() > 0;
-    if (success) {
-        qDebug() << "✅ Product quantity added successfully";
+    // Расхождения: остаток с учетом слотов шардированных счетчиков против
+    // суммы пересчета (продукт могли считать на нескольких полках)
+    const QString locationWhere = d->locationId > 0 ? "WHERE p.location_id = :location " : "";
+    const QString diff =
+        "counted AS (SELECT product_id, SUM(counted) AS counted FROM stock_take_counts "
+        "WHERE product_id IS NOT NULL GROUP BY product_id), "
+        "diff AS (SELECT p.id, p.name, p.current_quantity + COALESCE(s.delta, 0) AS expected, "
+        "COALESCE(c.counted, 0) AS counted, p.unit_cost FROM products p "
+        + QString(zeroMissing ? "LEFT JOIN" : "JOIN") + " counted c ON c.product_id = p.id "
+        "LEFT JOIN (SELECT product_id, SUM(delta) AS delta FROM product_quantity_deltas GROUP BY product_id) s "
+        "ON s.product_id = p.id " + locationWhere;
+    // Число сверенных продуктов приходит и без расхождений: строка с id = NULL
+    const QString report = "SELECT diff.id, diff.name, diff.expected, diff.counted, diff.unit_cost, t.total "
+        "FROM (SELECT COUNT(*) AS total FROM diff) t LEFT JOIN diff ON diff.counted <> diff.expected "
+        "ORDER BY diff.id";
+
+    // Сводки расхода и прихода движения Correction не меняют (см.
+    // StockLedger::updateRollups), поэтому кроме журнала писать нечего
+    const QString correction = QString::number(StockLedger::Correction);
+    if (d->isPostgres()) {
+        // Сверка, исправление и движения - один оператор: строки продуктов
+        // блокируются до конца транзакции, слоты счетчиков сворачиваются
+        QString sql = "WITH " + diff;
+        if (apply) {
+            sql += "FOR UPDATE OF p), "
+                "cleared AS (DELETE FROM product_quantity_deltas q USING diff "
+                "WHERE q.product_id = diff.id AND diff.counted <> diff.expected), "
+                "updated AS (UPDATE products p SET current_quantity = diff.counted, version = p.version + 1 "
+                "FROM diff WHERE p.id = diff.id AND diff.counted <> diff.expected) ";
+            if (writeMovements) {
+                sql += ", moved AS (INSERT INTO stock_movements (product_id, delta, kind, created_at) "
+                    "SELECT id, counted - expected, " + correction + ", now() FROM diff "
+                    "WHERE counted <> expected) ";
+            }
+        }
+        else {
+            sql += ") ";
+        }
+        query.prepare(sql + report);
+        if (d->locationId > 0) {
+            query.bindValue(":location", d->locationId);
+        }
+        if (!query.exec()) {
+            return fail(query);
+        }
     }
     else {
-        qDebug() << "⚠️ No rows affected - product might not exist";
+        // SQLite без изменяющих CTE: расхождения во временную таблицу, затем
+        // исправление одним UPDATE по ней
+        if (!query.exec("DROP TABLE IF EXISTS stock_take_diff")) {
+            return fail(query);
+        }
+        query.prepare("CREATE TEMP TABLE stock_take_diff AS WITH " + diff + ") SELECT * FROM diff");
+        if (d->locationId > 0) {
+            query.bindValue(":location", d->locationId);
+        }
+        if (!query.exec()) {
+            return fail(query);
+        }
+        if (apply
+            && (!query.exec("DELETE FROM product_quantity_deltas WHERE product_id IN "
+                    "(SELECT id FROM stock_take_diff WHERE counted <> expected)")
+                || !query.exec("UPDATE products SET current_quantity = (SELECT counted FROM stock_take_diff d "
+                    "WHERE d.id = products.id), version = version + 1 "
+                    "WHERE id IN (SELECT id FROM stock_take_diff WHERE counted <> expected)"))) {
+            return fail(query);
+        }
+        // Время - в том же виде, что у движений из буфера журнала (UTC, ISO)
+        if (writeMovements
+            && !query.exec("INSERT INTO stock_movements (product_id, delta, kind, created_at) "
+                "SELECT id, counted - expected, " + correction + ", strftime('%Y-%m-%dT%H:%M:%fZ', 'now') "
+                "FROM stock_take_diff WHERE counted <> expected")) {
+            return fail(query);
+        }
+        if (!query.exec("WITH diff AS (SELECT * FROM stock_take_diff) " + report)) {
+            return fail(query);
+        }
+    }
+
+    while (query.next()) {
+        result.checked = query.value(5).toInt();
+        if (query.isNull(0)) {
+            continue;
+        }
+        StockVariance variance;
+        variance.productId = query.value(0).toInt();
+        variance.name = query.value(1).toString();
+        variance.expected = query.value(2).toInt();
+        variance.counted = query.value(3).toInt();
+        variance.unitCost = query.value(4).toLongLong();
+        result.variances.append(variance);
+    }
+    query.finish();
+
+    if (!apply) {
+        d->db.rollback();
+        qDebug() << "📋 Stock take report:" << result.variances.size() << "variances";
+        return true;
     }
 
-    return success;
+    // Недостача списывается и из партий - до фиксации, вместе с остатками
+    for (const StockVariance& variance : result.variances) {
+        if (!d->takeLots(StockOperation(StockOperation::Set, variance.productId, variance.counted))) {
+            return fail(query);
+        }
+    }
+    if (!d->db.commit()) {
+        d->setError(d->db.lastError());
+        d->db.rollback();
+        d->restoreLots();
+        return false;
+    }
+    d->keepLots();
+    result.applied = true;
+    qDebug() << "📋 Stock take applied:" << result.variances.size() << "products corrected";
+    return true;
 }
 
-bool DatabaseManager::removeProductQuantity(int productId, int amount)
+bool DatabaseManager::importCatalog(const QString& filePath, qint64* rows)
 {
     if (!isConnected()) {
-        d->lastError = "Not connected to database";
-        qWarning() << "❌ Cannot remove product quantity: not connected to database";
+        d->setError("Not connected to database");
+        return false;
+    }
+    // Движения Correction пишет само слияние, как при инвентаризации
+    const bool writeMovements = d->ledger.isReady();
+    if (writeMovements && !d->ledger.ensureCurrentPartition()) {
+        d->setError(d->ledger.getLastError());
+        return false;
+    }
+    if (!d->db.transaction()) {
+        d->setError(d->db.lastError());
         return false;
     }
 
-    // Сначала проверим, достаточно ли товара
-    QSqlQuery checkQuery(d->db);
-    checkQuery.prepare("SELECT current_quantity FROM products WHERE id = :id");
-    checkQuery.bindValue(":id", productId);
+    CatalogCopy copy(d->db);
+    copy.setRecordMovements(writeMovements);
+    CatalogCopy::Stats stats;
+    bool ok = copy.importFile(filePath, &stats);
+    if (!ok) {
+        d->setError(copy.getLastError());
+    }
 
-    qDebug() << "🔍 Checking current quantity for product" << productId;
+    // Остаток из файла меньше, чем числится в партиях: недостача списывается
+    // из партий в той же транзакции
+    if (ok && d->lotsReady) {
+        QSqlQuery query(d->db);
+        ok = query.exec("SELECT c.id, c.current_quantity FROM catalog_import c "
+            "JOIN (SELECT product_id, SUM(quantity) AS total FROM product_lots GROUP BY product_id) l "
+            "ON l.product_id = c.id WHERE c.current_quantity < l.total");
+        QVector<StockOperation> shortages;
+        while (ok && query.next()) {
+            shortages.append(StockOperation(StockOperation::Set, query.value(0).toInt(), query.value(1).toInt()));
+        }
+        if (!ok) {
+            d->setError(query.lastError());
+        }
+        for (int i = 0; ok && i < shortages.size(); ++i) {
+            ok = d->takeLots(shortages.at(i));
+        }
+    }
 
-    if (!checkQuery.exec() || !checkQuery.next()) {
-        d->lastError = checkQuery.lastError().text();
-        qWarning() << "❌ Failed to check product quantity:" << d->lastError;
+    if (ok && !d->db.commit()) {
+        d->setError(d->db.lastError());
+        ok = false;
+    }
+    if (!ok) {
+        qWarning() << "❌ Catalog import failed:" << d->lastError;
+        d->db.rollback();
+        d->restoreLots();
         return false;
     }
+    d->keepLots();
 
-    int currentQty = checkQuery.value(0).toInt();
-    qDebug() << "   Current quantity:" << currentQty << "Requested to remove:" << amount;
+    // Остатки сменились целиком: партии и прогноз перечитываются из базы
+    if (d->lotsReady) {
+        d->lotsReady = d->lots.load(d->db);
+    }
+    if (d->forecastReady) {
+        d->forecastReady = d->forecaster.load(d->db);
+    }
+
+    if (rows) {
+        *rows = stats.rows;
+    }
+    qDebug() << "📦 Catalog imported:" << stats.rows << "products in" << stats.elapsedMs << "ms";
+    return true;
+}
+
+bool DatabaseManager::exportCatalog(const QString& filePath, qint64* rows)
+{
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        return false;
+    }
 
-    if (currentQty < amount) {
-        d->lastError = "Not enough quantity available";
-        qWarning() << "❌ Not enough quantity: available" << currentQty << "requested" << amount;
+    CatalogCopy copy(d->db);
+    CatalogCopy::Stats stats;
+    if (!copy.exportFile(filePath, d->locationId, &stats)) {
+        d->setError(copy.getLastError());
+        qWarning() << "❌ Catalog export failed:" << d->lastError;
         return false;
     }
 
-    // Обновляем количество
-    QSqlQuery updateQuery(d->db);
-    updateQuery.prepare("UPDATE products SET current_quantity = current_quantity - :amount WHERE id = :id");
-    updateQuery.bindValue(":amount", amount);
-    updateQuery.bindValue(":id", productId);
+    if (rows) {
+        *rows = stats.rows;
+    }
+    qDebug() << "📦 Catalog exported:" << stats.rows << "products in" << stats.elapsedMs << "ms";
+    return true;
+}
 
-    qDebug() << "➖ Removing" << amount << "from product" << productId;
+void DatabaseManager::setTraceRecorder(TraceRecorder* recorder)
+{
+    d->trace = recorder;
+}
+
+void DatabaseManager::setLocation(int locationId)
+{
+    TraceEvent event(TraceEvent::SetLocation);
+    event.value = locationId;
+    TraceSpan span(d->trace, event);
+    span.done(true);
+
+    d->locationId = qMax(0, locationId);
+    qDebug() << "📍 Location filter:" << (d->locationId > 0 ? QString::number(d->locationId) : QString("all"));
+}
+
+int DatabaseManager::location() const
+{
+    return d->locationId;
+}
 
-    if (!updateQuery.exec()) {
-        d->lastError = updateQuery.lastError().text();
-        qWarning() << "❌ Failed to remove product quantity:" << d->lastError;
+bool DatabaseManager::loadSupplierCatalog(SupplierCatalog& catalog)
+{
+    if (!isConnected()) {
+        d->setError("Not connected to database");
         return false;
     }
 
-    bool success = updateQuery.numRowsAffected() > 0;
-    if (success) {
-        qDebug() << "✅ Product quantity removed successfully";
+    if (!catalog.load(d->db)) {
+        d->setError(catalog.getLastError());
+        return false;
     }
-    else {
-        qDebug() << "⚠️ No rows affected - product might not exist";
+    return true;
+}
+
+bool DatabaseManager::saveSupplierCatalog(const SupplierCatalog& catalog)
+{
+    if (!isConnected()) {
+        d->setError("Not connected to database");
+        return false;
     }
 
-    return success;
+    if (!catalog.save(d->db)) {
+        d->setError(catalog.getLastError());
+        return false;
+    }
+    return true;
+}
+
+int DatabaseManager::schemaVersion() const
+{
+    return d->schemaVersion;
+}
+
+int DatabaseManager::latestSchemaVersion()
+{
+    return schemaMigrations().last().version;
 }
 
 QString DatabaseManager::getLastError() const
 {
     return d->lastError;
+}
+
+QString DatabaseManager::getLastErrorCode() const
+{
+    return d->lastErrorCode;
 }
\ No newline at end of file
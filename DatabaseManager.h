@@ -1,18 +1,128 @@
 ﻿#ifndef DATABASEMANAGER_H
 #define DATABASEMANAGER_H
 
+#include <QDate>
+#include <QHash>
 #include <QObject>
 #include <QVector>
 #include <QString>
+#include "ConsumptionForecaster.h"
+#include "LotTracker.h"
+#include "SupplierCatalog.h"
+
+class QSqlError;
+class TraceRecorder;
+
+// Локация по умолчанию: в нее попадают продукты, созданные до появления локаций
+const int DefaultLocationId = 1;
 
 struct ProductData {
     int id;
     QString name;
     int currentQuantity;
     int normQuantity;
+    int locationId;
+    int version;            // products.version: растет при каждом изменении остатка
+    QDate nextExpiry;       // срок ближайшей партии; недействительная дата - партий со сроком нет
+    qint64 unitCost = 0;    // цена упаковки в копейках (см. Money)
+
+    ProductData(int id = 0, const QString& name = "", int currentQty = 0, int normQty = 0,
+        int locationId = DefaultLocationId, int version = 0)
+        : id(id), name(name), currentQuantity(currentQty), normQuantity(normQty), locationId(locationId),
+          version(version) {
+    }
+};
+
+// Холодильник или холодная комната; у каждой свои остатки
+struct LocationInfo {
+    int id;
+    QString name;
+    QString restaurant;
+
+    LocationInfo(int id = DefaultLocationId, const QString& name = "", const QString& restaurant = "")
+        : id(id), name(name), restaurant(restaurant) {
+    }
+};
+
+// Период сводки расхода
+enum class RollupPeriod { Day, Week };
+
+// Расход и приход продукта за один день или неделю
+struct ConsumptionBucket {
+    QDate periodStart;
+    int consumed;
+    int received;
+
+    ConsumptionBucket(const QDate& start = QDate(), int consumed = 0, int received = 0)
+        : periodStart(start), consumed(consumed), received(received) {
+    }
+};
+
+// Штрихкод строки продукта; одно сканирование - packQuantity упаковок
+struct ProductBarcode {
+    QString barcode;
+    int productId;
+    int packQuantity;
+
+    ProductBarcode(const QString& barcode = QString(), int productId = 0, int packQuantity = 1)
+        : barcode(barcode), productId(productId), packQuantity(packQuantity) {
+    }
+};
+
+// Строка пересчета при инвентаризации: продукт по id или, если id = 0, по названию
+struct StockCount {
+    int productId;
+    QString name;
+    int counted;
+
+    StockCount(int productId = 0, const QString& name = QString(), int counted = 0)
+        : productId(productId), name(name), counted(counted) {
+    }
+};
+
+// Расхождение учета и пересчета по одному продукту
+struct StockVariance {
+    int productId = 0;
+    QString name;
+    int expected = 0;
+    int counted = 0;
+    qint64 unitCost = 0;
+
+    int delta() const { return counted - expected; }
+    qint64 costDelta() const { return qint64(delta()) * unitCost; }
+};
+
+// Итог сверки: только продукты с расхождением
+struct StockTakeResult {
+    QVector<StockVariance> variances;
+    int checked = 0;            // продуктов сверено
+    QStringList unmatched;      // строки пересчета, для которых нет продукта
+    bool applied = false;
+};
+
+// Параметры одного способа подключения
+struct ConnectionSettings {
+    QString driver = "QPSQL";
+    QString hostName;          // пустой для peer auth
+    int port = -1;             // -1 для default порта
+    QString databaseName = "fridgemanager";
+    QString userName;
+    QString password;
+    // keepalive: полуоткрытое соединение (сервер перезапущен, сеть пропала)
+    // обнаруживается за ~1 минуту, а не по таймауту TCP в несколько часов
+    QString connectOptions = "connect_timeout=3;keepalives=1;keepalives_idle=30;keepalives_interval=10;keepalives_count=3";
+};
+
+// Одна складская операция для пакетного применения
+struct StockOperation {
+    enum Type { Add, Remove, Set };
+
+    Type type;
+    int productId;
+    int amount;
 
-    ProductData(int id = 0, const QString& name = "", int currentQty = 0, int normQty = 0)
-        : id(id), name(name), currentQuantity(currentQty), normQuantity(normQty) {
+    StockOperation(Type type = Add, int productId = 0, int amount = 0)
+        : type(type), productId(productId), amount(amount) {
     }
 };
 
@@ -26,20 +136,149 @@ public:
 
     // Подключение к базе данных
     bool connectToDatabase();
+    bool connectToDatabase(const ConnectionSettings& settings);
     void disconnectFromDatabase();
     bool isConnected() const;
 
+    // Параметры текущего подключения - для дополнительных соединений из
+    // рабочих потоков (QSqlDatabase нельзя делить между потоками)
+    ConnectionSettings connectionSettings() const;
+    bool hasConnectionSettings() const;     // было ли успешное подключение
+
+    // Соединение с этими параметрами, еще не открытое. Без миграций,
+    // журнала и загрузки партий: схему уже подготовило основное подключение
+    static QSqlDatabase addConnection(const ConnectionSettings& settings, const QString& connectionName);
+
+    // Параметры, которые перебирает connectToDatabase() без аргументов
+    static QVector<ConnectionSettings> defaultConnectionCandidates();
+
+    // Обрыв соединения и восстановление (см. ConnectionMonitor).
+    // ping() выполняет запрос в текущем потоке; при ошибке соединение
+    // помечается потерянным, как и markConnectionLost()
+    bool ping();
+    void markConnectionLost(const QString& error);
+    bool reconnect();
+
+    // Операции, не дошедшие до базы из-за обрыва: копятся в памяти и
+    // применяются replayQueuedOperations() после переподключения
+    void enqueueOperations(const QVector<StockOperation>& operations);
+    int queuedOperationCount() const;
+    bool replayQueuedOperations();
+
+    // Локации; setLocation ограничивает выборки продуктов одной локацией,
+    // 0 - все локации
+    QVector<LocationInfo> getLocations();
+    void setLocation(int locationId);
+    int location() const;
+
+    // Каталог поставщиков: поставщик, фасовка и минимальный заказ продукта
+    bool loadSupplierCatalog(SupplierCatalog& catalog);
+    bool saveSupplierCatalog(const SupplierCatalog& catalog);
+
+    // Инвентаризация: пересчет загружается во временную таблицу (в
+    // PostgreSQL - COPY), расхождения с учетом и исправление остатков
+    // считаются одним запросом на стороне базы. apply = false - только отчет.
+    // zeroMissing - продукты локации, которых нет в пересчете, считаются
+    // нулевыми. Движения Correction пишет в журнал тот же запрос, что
+    // исправляет остатки, в той же транзакции.
+    bool reconcileStockTake(const QVector<StockCount>& counts, bool apply, bool zeroMissing, StockTakeResult& result);
+
+    // Массовая загрузка и выгрузка каталога (см. CatalogCopy): .pb и .bin -
+    // снимок ProductListProto, остальное - CSV. Загрузка - одной
+    // транзакцией; выгрузка - продукты выбранной локации (0 - все).
+    bool importCatalog(const QString& filePath, qint64* rows = nullptr);
+    bool exportCatalog(const QString& filePath, qint64* rows = nullptr);
+
+    // Штрихкоды продуктов выбранной локации; setBarcodes добавляет или
+    // обновляет фасовку одной транзакцией
+    QVector<ProductBarcode> getBarcodes();
+    bool setBarcodes(const QVector<ProductBarcode>& barcodes);
+
+    // Схема создается и обновляется при подключении (таблица schema_version)
+    int schemaVersion() const;
+    static int latestSchemaVersion();
+
     // Операции с продуктами
     QVector<ProductData> getAllProducts();
+    // Только продукты ниже нормы (частичный индекс products_below_norm_idx);
+    // totalPacks - суммарное количество к заказу
+    QVector<ProductData> getProductsToOrder(int* totalPacks = nullptr);
+    // Тот же запрос по любому открытому соединению (locationId = 0 - все
+    // локации): рабочим потокам не нужен весь DatabaseManager
+    static bool queryProductsToOrder(QSqlDatabase& db, int locationId, int counterShards,
+        QVector<ProductData>& products, int* totalPacks, QSqlError& error);
     bool updateProductQuantity(int productId, int newQuantity);
     bool addProductQuantity(int productId, int amount);
     bool removeProductQuantity(int productId, int amount);
 
+    // Приход партией со сроком годности (таблица product_lots). Остаток
+    // продукта растет как при addProductQuantity; расход и инвентаризация
+    // списывают партии FIFO по сроку годности. С ценой партии (копейки,
+    // -1 - без цены) цена продукта пересчитывается как средневзвешенная.
+    // current - строка продукта после прихода.
+    bool receiveLot(int productId, int amount, const QDate& expiresOn, qint64 unitCost = -1,
+        ProductData* current = nullptr);
+    QVector<ProductLot> getProductLots(int productId) const;   // в порядке списания
+    QDate nextExpiry(int productId) const;
+
+    // Предупреждения о сроке: за warningHours до конца срока партии
+    // (по умолчанию 24 ч) приходит lotsExpiring. Проверка раз в минуту,
+    // checkExpiringLots() - вне очереди, например сразу после подключения.
+    void setExpiryWarningHours(int hours);
+    QVector<ProductLot> checkExpiringLots();
+
+    // Цены упаковок в копейках (product id -> цена), одной транзакцией
+    bool setUnitCosts(const QHash<int, qint64>& costs);
+
+    // Пакет операций в одной транзакции: либо применяются все, либо ни одной
+    bool applyStockOperations(const QVector<StockOperation>& operations);
+
+    // Условное изменение (optimistic concurrency): операция проходит, только
+    // если версия строки в базе равна expectedVersion. В ответе всегда
+    // актуальная строка - после операции или, при конфликте, текущая, так что
+    // кэш клиента обновляется без перечитывания каталога. В PostgreSQL
+    // успешная запись - один запрос; при отказе строка перечитывается
+    // отдельно, чтобы увидеть версию, зафиксированную другим терминалом, пока
+    // UPDATE ждал блокировку. С шардированными счетчиками версия не проверяется:
+    // приход и расход по слотам коммутативны.
+    enum class WriteStatus { Applied, Conflict, Rejected, Failed };
+    WriteStatus applyVersioned(const StockOperation& operation, int expectedVersion, ProductData& current);
+
+    // Шардированные счетчики для популярных продуктов: 0 - обычный режим,
+    // N > 0 - записи идут в один из N слотов product_quantity_deltas.
+    // API чтения/записи не меняется, остаток по-прежнему не бывает < 0.
+    void setCounterShards(int shards);
+    int counterShards() const;
+    void setCounterFoldInterval(int msec);  // периодическая свертка, 0 - выкл.
+    bool foldCounterShards();
+
+    // Журнал движений: каждое изменение остатка пишется пакетами в
+    // stock_movements, сводки по дням/неделям обновляются инкрементально
+    bool flushLedger();
+    void setLedgerFlushInterval(int msec);  // по умолчанию 1000 мс
+    int consumptionOverLastDays(int productId, int days);   // -1 при ошибке
+    QVector<ConsumptionBucket> getConsumptionRollup(int productId, RollupPeriod period, int periods);
+
+    // Прогноз расхода по списаниям и рекомендуемый заказ с учетом срока поставки.
+    // Пока истории мало, рекомендация совпадает с "норма - остаток".
+    void setForecastSettings(const ConsumptionForecaster::Settings& settings);
+    const ConsumptionForecaster& forecaster() const;
+    ConsumptionForecaster::Suggestion suggestOrder(int productId, int currentQuantity, int normQuantity) const;
+
+    // Запись вызовов в трассу для воспроизведения (fridge_replay); nullptr - выкл.
+    // Вложенные вызовы (applyVersioned внутри действия терминала) не пишутся.
+    void setTraceRecorder(TraceRecorder* recorder);
+
     // Информация об ошибках
     QString getLastError() const;
+    QString getLastErrorCode() const;   // SQLSTATE для QPSQL, пусто для ошибок приложения
+
+signals:
+    void lotsExpiring(const QVector<ProductLot>& lots);
 
 private:
    
+    bool openConnection(const ConnectionSettings& settings, const QString& connectionName);
     bool verifyConnection();
 
     class Impl;
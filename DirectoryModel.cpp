@@ -0,0 +1,231 @@
+﻿#include "DirectoryModel.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+#include <QtConcurrent/QtConcurrentRun>
+
+DirectoryModel::DirectoryModel(QObject* parent)
+    : QAbstractListModel(parent)
+{
+    connect(&m_probeWatcher, &QFutureWatcher<QVector<DirectoryState>>::finished,
+        this, &DirectoryModel::onProbeFinished);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged,
+        this, &DirectoryModel::onPathChanged);
+}
+
+DirectoryModel::~DirectoryModel()
+{
+    m_probeWatcher.waitForFinished();
+}
+
+int DirectoryModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_states.size();
+}
+
+QVariant DirectoryModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_states.size()) {
+        return QVariant();
+    }
+
+    const DirectoryState& state = m_states.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case PathRole:
+        return state.path;
+    case NameRole: {
+        QString name = QFileInfo(state.path).fileName();
+        return name.isEmpty() ? QStringLiteral("Корневая папка") : name;
+    }
+    case ExistsRole:
+        return state.exists;
+    case WritableRole:
+        return state.writable;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> DirectoryModel::roleNames() const
+{
+    return {
+        { PathRole, "path" },
+        { NameRole, "name" },
+        { ExistsRole, "exists" },
+        { WritableRole, "writable" }
+    };
+}
+
+void DirectoryModel::setCandidates(const QStringList& paths)
+{
+    m_candidates = paths;
+    m_createMissing = true;
+    refresh();
+}
+
+QStringList DirectoryModel::availablePaths() const
+{
+    QStringList paths;
+    for (const DirectoryState& state : m_states) {
+        if (state.exists) {
+            paths << state.path;
+        }
+    }
+    return paths;
+}
+
+QString DirectoryModel::pathAt(int row) const
+{
+    return (row >= 0 && row < m_states.size()) ? m_states.at(row).path : QString();
+}
+
+bool DirectoryModel::existsAt(int row) const
+{
+    return row >= 0 && row < m_states.size() && m_states.at(row).exists;
+}
+
+bool DirectoryModel::writableAt(int row) const
+{
+    return row >= 0 && row < m_states.size() && m_states.at(row).writable;
+}
+
+bool DirectoryModel::isKnownDirectory(const QString& path) const
+{
+    for (const DirectoryState& state : m_states) {
+        if (state.path == path) {
+            return state.exists;
+        }
+    }
+    return false;
+}
+
+void DirectoryModel::refresh()
+{
+    // Один опрос за раз: если он уже идет, повторим после завершения
+    if (m_probeWatcher.isRunning()) {
+        m_refreshPending = true;
+        return;
+    }
+
+    const bool createMissing = m_createMissing;
+    m_createMissing = false;
+    m_probeWatcher.setFuture(QtConcurrent::run(&DirectoryModel::probe, m_candidates, createMissing));
+}
+
+void DirectoryModel::addDirectory(const QString& path)
+{
+    if (!m_candidates.contains(path)) {
+        m_candidates << path;
+    }
+    refresh();
+}
+
+void DirectoryModel::onProbeFinished()
+{
+    applyStates(m_probeWatcher.result());
+
+    if (!m_ready) {
+        m_ready = true;
+        emit readyChanged();
+    }
+
+    if (m_refreshPending) {
+        m_refreshPending = false;
+        refresh();
+    }
+}
+
+void DirectoryModel::onPathChanged(const QString& path)
+{
+    qDebug() << "📂 Directory changed:" << path;
+    refresh();
+}
+
+QVector<DirectoryState> DirectoryModel::probe(const QStringList& paths, bool createMissing)
+{
+    // Выполняется в пуле потоков: здесь можно ждать медленный сетевой диск
+    QVector<DirectoryState> states;
+    states.reserve(paths.size());
+
+    for (const QString& path : paths) {
+        DirectoryState state;
+        state.path = path;
+
+        QFileInfo info(path);
+        state.exists = info.isDir();
+        if (!state.exists && createMissing) {
+            state.exists = QDir().mkpath(path);
+            info.refresh();
+        }
+        state.writable = state.exists && info.isWritable();
+        states.append(state);
+    }
+
+    return states;
+}
+
+void DirectoryModel::applyStates(const QVector<DirectoryState>& states)
+{
+    bool samePaths = states.size() == m_states.size();
+    for (int i = 0; samePaths && i < states.size(); ++i) {
+        samePaths = states.at(i).path == m_states.at(i).path;
+    }
+
+    if (!samePaths) {
+        const int oldCount = m_states.size();
+        beginResetModel();
+        m_states = states;
+        endResetModel();
+        if (oldCount != m_states.size()) {
+            emit countChanged();
+        }
+    }
+    else {
+        for (int i = 0; i < states.size(); ++i) {
+            const DirectoryState& oldState = m_states.at(i);
+            const DirectoryState& newState = states.at(i);
+            if (oldState.exists != newState.exists || oldState.writable != newState.writable) {
+                m_states[i] = newState;
+                QModelIndex idx = index(i);
+                emit dataChanged(idx, idx, { ExistsRole, WritableRole });
+            }
+        }
+    }
+
+    updateWatchedPaths();
+}
+
+void DirectoryModel::updateWatchedPaths()
+{
+    // Следим за существующими папками и за родителями отсутствующих,
+    // чтобы заметить как удаление, так и появление папки
+    QStringList wanted;
+    for (const DirectoryState& state : m_states) {
+        QString watchPath = state.exists ? state.path : QFileInfo(state.path).absolutePath();
+        if (!wanted.contains(watchPath)) {
+            wanted << watchPath;
+        }
+    }
+
+    QStringList current = m_watcher.directories();
+    QStringList toRemove;
+    for (const QString& path : current) {
+        if (!wanted.contains(path)) {
+            toRemove << path;
+        }
+    }
+    if (!toRemove.isEmpty()) {
+        m_watcher.removePaths(toRemove);
+    }
+
+    QStringList toAdd;
+    for (const QString& path : wanted) {
+        if (!current.contains(path)) {
+            toAdd << path;
+        }
+    }
+    if (!toAdd.isEmpty()) {
+        m_watcher.addPaths(toAdd);
+    }
+}
@@ -0,0 +1,80 @@
+﻿#ifndef DIRECTORYMODEL_H
+#define DIRECTORYMODEL_H
+
+#include <QAbstractListModel>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QStringList>
+#include <QVector>
+
+struct DirectoryState {
+    QString path;
+    bool exists = false;
+    bool writable = false;
+};
+
+// Кэшированное состояние папок для сохранения заявок.
+// Файловая система опрашивается один раз в рабочем потоке, дальше
+// модель обновляется только по сигналам QFileSystemWatcher, поэтому
+// привязки QML никогда не обращаются к диску синхронно.
+class DirectoryModel : public QAbstractListModel
+{
+    Q_OBJECT
+        Q_PROPERTY(int count READ count NOTIFY countChanged)
+        Q_PROPERTY(bool ready READ isReady NOTIFY readyChanged)
+
+public:
+    enum Roles {
+        PathRole = Qt::UserRole + 1,
+        NameRole,
+        ExistsRole,
+        WritableRole
+    };
+
+    explicit DirectoryModel(QObject* parent = nullptr);
+    ~DirectoryModel();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    int count() const { return m_states.size(); }
+    bool isReady() const { return m_ready; }
+
+    // Список путей-кандидатов (создаются при первом опросе, если их нет)
+    void setCandidates(const QStringList& paths);
+    QStringList availablePaths() const;
+
+    // Значения из кэша, без обращения к файловой системе
+    Q_INVOKABLE QString pathAt(int row) const;
+    Q_INVOKABLE bool existsAt(int row) const;
+    Q_INVOKABLE bool writableAt(int row) const;
+    Q_INVOKABLE bool isKnownDirectory(const QString& path) const;
+
+    // Асинхронный повторный опрос (например, после создания папки)
+    Q_INVOKABLE void refresh();
+    void addDirectory(const QString& path);
+
+signals:
+    void countChanged();
+    void readyChanged();
+
+private slots:
+    void onProbeFinished();
+    void onPathChanged(const QString& path);
+
+private:
+    static QVector<DirectoryState> probe(const QStringList& paths, bool createMissing);
+    void applyStates(const QVector<DirectoryState>& states);
+    void updateWatchedPaths();
+
+    QStringList m_candidates;
+    QVector<DirectoryState> m_states;
+    QFileSystemWatcher m_watcher;
+    QFutureWatcher<QVector<DirectoryState>> m_probeWatcher;
+    bool m_ready = false;
+    bool m_createMissing = true;
+    bool m_refreshPending = false;
+};
+
+#endif // DIRECTORYMODEL_H
@@ -0,0 +1,101 @@
+﻿#include "ExpiryWheel.h"
+
+ExpiryWheel::ExpiryWheel(qint64 tickMs)
+    : m_tickMs(qMax<qint64>(1, tickMs))
+    , m_slots(Levels * SlotsPerLevel)
+{
+}
+
+void ExpiryWheel::reset(qint64 nowMs)
+{
+    for (QVector<Entry>& slot : m_slots) {
+        slot.clear();
+    }
+    m_ready.clear();
+    m_due.clear();
+    m_currentTick = nowMs / m_tickMs;
+}
+
+void ExpiryWheel::schedule(qint64 id, qint64 dueMs)
+{
+    // Такт округляется вверх: предупреждение не приходит раньше срока
+    const Entry entry { id, (dueMs + m_tickMs - 1) / m_tickMs };
+    m_due.insert(id, entry.dueTick);
+    place(entry);
+}
+
+void ExpiryWheel::cancel(qint64 id)
+{
+    m_due.remove(id);
+}
+
+void ExpiryWheel::place(const Entry& entry)
+{
+    const qint64 delta = entry.dueTick - m_currentTick;
+    if (delta <= 0) {
+        m_ready.append(entry);
+        return;
+    }
+
+    // Уровень, на котором до срока меньше одного оборота
+    int level = 0;
+    while (level < Levels - 1 && delta >= (qint64(1) << (SlotBits * (level + 1)))) {
+        ++level;
+    }
+    const int slot = int((entry.dueTick >> (SlotBits * level)) & (SlotsPerLevel - 1));
+    m_slots[level * SlotsPerLevel + slot].append(entry);
+}
+
+void ExpiryWheel::cascade(int level)
+{
+    const int slot = int((m_currentTick >> (SlotBits * level)) & (SlotsPerLevel - 1));
+    QVector<Entry> entries;
+    entries.swap(m_slots[level * SlotsPerLevel + slot]);
+    for (const Entry& entry : entries) {
+        if (m_due.value(entry.id, -1) == entry.dueTick) {
+            place(entry);
+        }
+    }
+}
+
+void ExpiryWheel::fire(QVector<Entry>& slot, QVector<qint64>& fired)
+{
+    QVector<Entry> entries;
+    entries.swap(slot);
+    for (const Entry& entry : entries) {
+        auto it = m_due.find(entry.id);
+        if (it != m_due.end() && it.value() == entry.dueTick) {
+            m_due.erase(it);
+            fired.append(entry.id);
+        }
+    }
+}
+
+QVector<qint64> ExpiryWheel::advance(qint64 nowMs)
+{
+    QVector<qint64> fired;
+    fire(m_ready, fired);
+
+    const qint64 targetTick = nowMs / m_tickMs;
+    while (m_currentTick < targetTick) {
+        // Пустое колесо перематывается сразу (например, после долгого простоя)
+        if (m_due.isEmpty()) {
+            m_currentTick = targetTick;
+            break;
+        }
+
+        ++m_currentTick;
+
+        // Начало оборота нижнего уровня: записи старших уровней спускаются
+        // ниже, начиная с самого грубого
+        for (int level = Levels - 1; level > 0; --level) {
+            if ((m_currentTick & ((qint64(1) << (SlotBits * level)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+
+        fire(m_slots[int(m_currentTick & (SlotsPerLevel - 1))], fired);
+        fire(m_ready, fired);
+    }
+    return fired;
+}
@@ -0,0 +1,52 @@
+﻿#ifndef EXPIRYWHEEL_H
+#define EXPIRYWHEEL_H
+
+#include <QHash>
+#include <QVector>
+
+// Иерархическое колесо таймеров для сроков годности. Время делится на
+// такты (по умолчанию час); уровень 0 - ближайшие 64 такта, каждый
+// следующий уровень в 64 раза грубее. Постановка и отмена - O(1), продвижение
+// обрабатывает только наступившие такты: партии не перебираются целиком.
+class ExpiryWheel
+{
+public:
+    static const int SlotBits = 6;
+    static const int SlotsPerLevel = 1 << SlotBits;
+    static const int Levels = 3;                    // 64^3 часов - около 30 лет
+    static const qint64 DefaultTickMs = 60 * 60 * 1000;
+
+    explicit ExpiryWheel(qint64 tickMs = DefaultTickMs);
+
+    // Текущее время колеса; все поставленные таймеры сбрасываются
+    void reset(qint64 nowMs);
+
+    // Повторная постановка того же id переносит таймер
+    void schedule(qint64 id, qint64 dueMs);
+    void cancel(qint64 id);
+    bool isScheduled(qint64 id) const { return m_due.contains(id); }
+
+    // Продвигает колесо до nowMs и возвращает сработавшие id
+    QVector<qint64> advance(qint64 nowMs);
+
+    int size() const { return m_due.size(); }
+    qint64 tickMs() const { return m_tickMs; }
+
+private:
+    struct Entry {
+        qint64 id;
+        qint64 dueTick;
+    };
+
+    void place(const Entry& entry);
+    void cascade(int level);
+    void fire(QVector<Entry>& slot, QVector<qint64>& fired);
+
+    qint64 m_tickMs;
+    qint64 m_currentTick = 0;
+    QVector<QVector<Entry>> m_slots;    // Levels * SlotsPerLevel
+    QVector<Entry> m_ready;             // срок уже наступил при постановке
+    QHash<qint64, qint64> m_due;        // id -> такт; отмененные записи в слотах пропускаются
+};
+
+#endif // EXPIRYWHEEL_H
@@ -0,0 +1,201 @@
+﻿#include "InventoryClient.h"
+#include "ProtobufSerializer.h"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QLocalSocket>
+#include <QTcpSocket>
+
+InventoryClient::InventoryClient(QObject* parent)
+    : QObject(parent)
+{
+}
+
+InventoryClient::~InventoryClient()
+{
+    disconnectFromServer();
+}
+
+bool InventoryClient::connectToServer(const QString& address, int timeoutMs)
+{
+    disconnectFromServer();
+
+    const int colon = address.lastIndexOf(':');
+    bool isPort = false;
+    const quint16 port = colon >= 0 ? address.mid(colon + 1).toUShort(&isPort) : 0;
+
+    bool connected = false;
+    if (isPort) {
+        QTcpSocket* socket = new QTcpSocket(this);
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        socket->connectToHost(colon > 0 ? address.left(colon) : QString("127.0.0.1"), port);
+        connected = socket->waitForConnected(timeoutMs);
+        if (!connected) {
+            m_lastError = socket->errorString();
+        }
+        connect(socket, &QTcpSocket::disconnected, this, &InventoryClient::disconnected);
+        m_socket = socket;
+    }
+    else {
+        QLocalSocket* socket = new QLocalSocket(this);
+        socket->connectToServer(address);
+        connected = socket->waitForConnected(timeoutMs);
+        if (!connected) {
+            m_lastError = socket->errorString();
+        }
+        connect(socket, &QLocalSocket::disconnected, this, &InventoryClient::disconnected);
+        m_socket = socket;
+    }
+
+    if (!connected) {
+        qWarning() << "❌ Inventory server" << address << "unavailable:" << m_lastError;
+        disconnectFromServer();
+        return false;
+    }
+
+    connect(m_socket, &QIODevice::readyRead, this, &InventoryClient::readServer);
+    qDebug() << "🛰️ Connected to inventory server" << address;
+    return true;
+}
+
+void InventoryClient::disconnectFromServer()
+{
+    if (m_socket) {
+        m_socket->disconnect(this);
+        m_socket->close();
+        m_socket->deleteLater();
+        m_socket = nullptr;
+    }
+    m_reader.clear();
+}
+
+bool InventoryClient::isConnected() const
+{
+    return m_socket && m_socket->isOpen();
+}
+
+bool InventoryClient::subscribe(QVector<ProductData>& products, int timeoutMs)
+{
+    fridgemanager::RequestProto request;
+    request.set_kind(fridgemanager::RequestProto::SUBSCRIBE);
+    const quint32 requestId = send(request);
+
+    fridgemanager::ResponseProto response;
+    if (requestId == 0 || !waitForResponse(requestId, response, timeoutMs)) {
+        return false;
+    }
+    if (!response.ok()) {
+        m_lastError = QString::fromStdString(response.error());
+        return false;
+    }
+
+    products = toProducts(response.products());
+    return true;
+}
+
+quint32 InventoryClient::applyOperations(const QVector<StockOperation>& operations)
+{
+    fridgemanager::RequestProto request;
+    request.set_kind(fridgemanager::RequestProto::APPLY_OPERATIONS);
+    for (const StockOperation& operation : operations) {
+        fridgemanager::StockOperationProto* proto = request.add_operations();
+        proto->set_product_id(operation.productId);
+        proto->set_amount(operation.amount);
+        switch (operation.type) {
+        case StockOperation::Remove:
+            proto->set_type(fridgemanager::StockOperationProto::REMOVE);
+            break;
+        case StockOperation::Set:
+            proto->set_type(fridgemanager::StockOperationProto::SET);
+            break;
+        default:
+            proto->set_type(fridgemanager::StockOperationProto::ADD);
+            break;
+        }
+    }
+    return send(request);
+}
+
+quint32 InventoryClient::send(fridgemanager::RequestProto& request)
+{
+    if (!isConnected()) {
+        m_lastError = "Not connected to inventory server";
+        return 0;
+    }
+
+    const quint32 requestId = m_nextRequestId++;
+    request.set_request_id(requestId);
+    m_socket->write(WireProtocol::frame(request));
+    return requestId;
+}
+
+bool InventoryClient::waitForResponse(quint32 requestId, fridgemanager::ResponseProto& response, int timeoutMs)
+{
+    m_awaitedId = requestId;
+    m_awaitedReceived = false;
+
+    QElapsedTimer timer;
+    timer.start();
+    readServer();
+    while (!m_awaitedReceived) {
+        const int remaining = timeoutMs - int(timer.elapsed());
+        if (remaining <= 0 || !m_socket || !m_socket->waitForReadyRead(remaining)) {
+            m_lastError = "Inventory server did not respond";
+            m_awaitedId = 0;
+            return false;
+        }
+    }
+
+    m_awaitedId = 0;
+    response.Swap(&m_awaited);
+    return true;
+}
+
+void InventoryClient::readServer()
+{
+    if (!m_socket) {
+        return;
+    }
+
+    m_reader.append(m_socket->readAll());
+    QByteArray payload;
+    while (m_reader.next(payload)) {
+        fridgemanager::ServerMessageProto message;
+        if (message.ParseFromArray(payload.constData(), payload.size())) {
+            handleMessage(message);
+        }
+    }
+
+    if (m_reader.hasError()) {
+        m_lastError = "Invalid frame from inventory server";
+        qWarning() << "⚠️" << m_lastError;
+        disconnectFromServer();
+        emit disconnected();
+    }
+}
+
+void InventoryClient::handleMessage(const fridgemanager::ServerMessageProto& message)
+{
+    if (message.has_changes()) {
+        emit productsChanged(toProducts(message.changes()));
+        return;
+    }
+
+    const fridgemanager::ResponseProto& response = message.response();
+    if (m_awaitedId != 0 && response.request_id() == m_awaitedId) {
+        m_awaited = response;
+        m_awaitedReceived = true;
+        return;
+    }
+
+    emit operationsFinished(response.request_id(), response.ok(), QString::fromStdString(response.error()));
+}
+
+QVector<ProductData> InventoryClient::toProducts(const fridgemanager::ProductListProto& list)
+{
+    QVector<ProductData> products;
+    products.reserve(list.products_size());
+    for (const fridgemanager::ProductProto& proto : list.products()) {
+        products.append(ProtobufSerializer::protoToProduct(proto));
+    }
+    return products;
+}
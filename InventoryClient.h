@@ -0,0 +1,63 @@
+﻿#ifndef INVENTORYCLIENT_H
+#define INVENTORYCLIENT_H
+
+#include <QHash>
+#include <QObject>
+#include <QVector>
+#include "DatabaseManager.h"
+#include "WireProtocol.h"
+#include "product.pb.h"
+
+class QIODevice;
+
+// Тонкий клиент сервера остатков: терминал без своего подключения к базе.
+// Каталог читается один раз, дальше сервер присылает только изменения -
+// чтение идет из памяти. Операции отправляются пачками без ожидания ответа.
+class InventoryClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InventoryClient(QObject* parent = nullptr);
+    ~InventoryClient();
+
+    // Адрес как у InventoryServer::listen: "host:port" или имя локального сокета
+    bool connectToServer(const QString& address, int timeoutMs = 3000);
+    void disconnectFromServer();
+    bool isConnected() const;
+
+    // Подписка на изменения; ответ со снимком каталога ожидается синхронно
+    bool subscribe(QVector<ProductData>& products, int timeoutMs = 3000);
+
+    // Операции одной транзакцией на сервере; результат - сигналом
+    // operationsFinished с возвращенным номером запроса. 0 - не отправлено.
+    quint32 applyOperations(const QVector<StockOperation>& operations);
+
+    QString getLastError() const { return m_lastError; }
+
+signals:
+    void operationsFinished(quint32 requestId, bool ok, const QString& error);
+    void productsChanged(const QVector<ProductData>& products);
+    void disconnected();
+
+private:
+    quint32 send(fridgemanager::RequestProto& request);
+    void readServer();
+    bool waitForResponse(quint32 requestId, fridgemanager::ResponseProto& response, int timeoutMs);
+    void handleMessage(const fridgemanager::ServerMessageProto& message);
+
+    static QVector<ProductData> toProducts(const fridgemanager::ProductListProto& list);
+
+    QIODevice* m_socket = nullptr;
+    WireProtocol::FrameReader m_reader;
+    quint32 m_nextRequestId = 1;
+
+    // Ответ, которого ждет синхронный вызов
+    quint32 m_awaitedId = 0;
+    bool m_awaitedReceived = false;
+    fridgemanager::ResponseProto m_awaited;
+
+    QString m_lastError;
+};
+
+#endif // INVENTORYCLIENT_H
@@ -0,0 +1,310 @@
+﻿#include "InventoryServer.h"
+#include "DatabaseManager.h"
+#include "ProductStore.h"
+#include "ProtobufSerializer.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QTimer>
+#include <numeric>
+
+namespace {
+
+void fillProducts(fridgemanager::ProductListProto& list, const ProductStore& store, const QVector<int>& rows)
+{
+    list.set_timestamp(QDateTime::currentDateTime().toString(Qt::ISODate).toStdString());
+    for (int row : rows) {
+        *list.add_products() = ProtobufSerializer::productToProto(store.at(row));
+    }
+}
+
+} // namespace
+
+InventoryServer::InventoryServer(DatabaseManager* database, ProductStore* store, QObject* parent)
+    : QObject(parent)
+    , m_database(database)
+    , m_store(store)
+{
+    connect(&m_tcpServer, &QTcpServer::newConnection, this, &InventoryServer::onNewTcpConnection);
+    connect(&m_localServer, &QLocalServer::newConnection, this, &InventoryServer::onNewLocalConnection);
+}
+
+InventoryServer::~InventoryServer()
+{
+    close();
+}
+
+bool InventoryServer::listen(const QString& address)
+{
+    close();
+
+    const int colon = address.lastIndexOf(':');
+    bool isPort = false;
+    const quint16 port = colon >= 0 ? address.mid(colon + 1).toUShort(&isPort) : 0;
+
+    bool listening = false;
+    if (isPort) {
+        const QString host = address.left(colon);
+        const QHostAddress hostAddress = host.isEmpty() ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(host);
+        listening = m_tcpServer.listen(hostAddress, port);
+        if (!listening) {
+            m_lastError = m_tcpServer.errorString();
+        }
+    }
+    else {
+        // Сокет мог остаться от упавшего процесса
+        QLocalServer::removeServer(address);
+        listening = m_localServer.listen(address);
+        if (!listening) {
+            m_lastError = m_localServer.errorString();
+        }
+    }
+
+    if (!listening) {
+        qWarning() << "❌ Inventory server failed to listen on" << address << ":" << m_lastError;
+        return false;
+    }
+
+    qDebug() << "🛰️ Inventory server listening on" << address;
+    return true;
+}
+
+void InventoryServer::close()
+{
+    m_tcpServer.close();
+    m_localServer.close();
+
+    const QList<QIODevice*> sockets = m_clients.keys();
+    m_clients.clear();
+    for (QIODevice* socket : sockets) {
+        socket->disconnect(this);
+        socket->close();
+        socket->deleteLater();
+    }
+}
+
+void InventoryServer::onNewTcpConnection()
+{
+    while (QTcpSocket* socket = m_tcpServer.nextPendingConnection()) {
+        // Ответы маленькие - без алгоритма Нейгла
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { removeClient(socket); });
+        addClient(socket);
+    }
+}
+
+void InventoryServer::onNewLocalConnection()
+{
+    while (QLocalSocket* socket = m_localServer.nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { removeClient(socket); });
+        addClient(socket);
+    }
+}
+
+void InventoryServer::addClient(QIODevice* socket)
+{
+    m_clients.insert(socket, Client());
+    connect(socket, &QIODevice::readyRead, this, [this, socket]() { readClient(socket); });
+    qDebug() << "🔌 Client connected, total:" << m_clients.size();
+}
+
+void InventoryServer::removeClient(QIODevice* socket)
+{
+    if (m_clients.remove(socket) > 0) {
+        socket->deleteLater();
+        qDebug() << "🔌 Client disconnected, total:" << m_clients.size();
+    }
+}
+
+void InventoryServer::readClient(QIODevice* socket)
+{
+    auto it = m_clients.find(socket);
+    if (it == m_clients.end()) {
+        return;
+    }
+
+    Client& client = it.value();
+    client.reader.append(socket->readAll());
+
+    // Все пришедшие запросы - по порядку, ответы одной записью
+    QByteArray replies;
+    QByteArray payload;
+    while (client.reader.next(payload)) {
+        fridgemanager::RequestProto request;
+        fridgemanager::ServerMessageProto message;
+        fridgemanager::ResponseProto* response = message.mutable_response();
+        if (request.ParseFromArray(payload.constData(), payload.size())) {
+            handleRequest(client, request, *response);
+        }
+        else {
+            response->set_ok(false);
+            response->set_error("Malformed request");
+        }
+        WireProtocol::appendFrame(replies, message);
+    }
+
+    if (!replies.isEmpty()) {
+        socket->write(replies);
+    }
+
+    if (client.reader.hasError()) {
+        qWarning() << "⚠️ Invalid frame from client, closing connection";
+        socket->close();
+    }
+}
+
+void InventoryServer::handleRequest(Client& client, const fridgemanager::RequestProto& request,
+    fridgemanager::ResponseProto& response)
+{
+    response.set_request_id(request.request_id());
+    response.set_ok(true);
+
+    switch (request.kind()) {
+    case fridgemanager::RequestProto::SUBSCRIBE:
+        client.subscribed = true;
+        // Снимок каталога в том же ответе: дальше приходят только изменения
+        Q_FALLTHROUGH();
+    case fridgemanager::RequestProto::LIST_PRODUCTS: {
+        QVector<int> rows(m_store->count());
+        std::iota(rows.begin(), rows.end(), 0);
+        fillProducts(*response.mutable_products(), *m_store, rows);
+        break;
+    }
+    case fridgemanager::RequestProto::APPLY_OPERATIONS:
+        applyOperations(request, response);
+        break;
+    case fridgemanager::RequestProto::GET_ORDER:
+        fillOrder(*response.mutable_order());
+        break;
+    default:
+        response.set_ok(false);
+        response.set_error("Unknown request");
+        break;
+    }
+}
+
+void InventoryServer::applyOperations(const fridgemanager::RequestProto& request, fridgemanager::ResponseProto& response)
+{
+    QVector<StockOperation> batch;
+    QVector<QPair<int, int>> undo;  // (строка, прежнее количество)
+    batch.reserve(request.operations_size());
+    undo.reserve(request.operations_size());
+
+    auto rollback = [this, &undo]() {
+        for (int i = undo.size() - 1; i >= 0; --i) {
+            m_store->setCurrentQuantity(undo.at(i).first, undo.at(i).second);
+        }
+    };
+
+    // Пачка применяется целиком или не применяется: сначала память, потом база
+    for (const fridgemanager::StockOperationProto& proto : request.operations()) {
+        const int row = m_store->rowForId(proto.product_id());
+        if (row < 0) {
+            rollback();
+            response.set_ok(false);
+            response.set_error(QString("Product %1 not found").arg(proto.product_id()).toStdString());
+            return;
+        }
+
+        StockOperation operation(StockOperation::Add, proto.product_id(), proto.amount());
+        const int previous = m_store->at(row).currentQuantity;
+        bool ok = false;
+        switch (proto.type()) {
+        case fridgemanager::StockOperationProto::REMOVE:
+            operation.type = StockOperation::Remove;
+            ok = m_store->removeQuantity(row, proto.amount());
+            break;
+        case fridgemanager::StockOperationProto::SET:
+            operation.type = StockOperation::Set;
+            ok = m_store->setCurrentQuantity(row, proto.amount());
+            break;
+        default:
+            ok = m_store->addQuantity(row, proto.amount());
+            break;
+        }
+
+        if (!ok) {
+            rollback();
+            response.set_ok(false);
+            response.set_error(QString("Not enough %1").arg(m_store->at(row).name).toStdString());
+            return;
+        }
+
+        undo.append(qMakePair(row, previous));
+        batch.append(operation);
+    }
+
+    // Без соединения с базой пачка ждет переподключения (ConnectionMonitor)
+    if (m_database && m_database->hasConnectionSettings()) {
+        if (!m_database->isConnected()) {
+            m_database->enqueueOperations(batch);
+        }
+        else if (!m_database->applyStockOperations(batch)) {
+            if (m_database->ping()) {
+                rollback();
+                response.set_ok(false);
+                response.set_error(m_database->getLastError().toStdString());
+                return;
+            }
+            m_database->enqueueOperations(batch);
+        }
+    }
+
+    QVector<int> rows;
+    rows.reserve(undo.size());
+    for (const auto& change : undo) {
+        rows.append(change.first);
+        markChanged(change.first);
+    }
+    fillProducts(*response.mutable_products(), *m_store, rows);
+}
+
+void InventoryServer::fillOrder(fridgemanager::OrderProto& order) const
+{
+    const ReorderScan::Result scan = m_store->scanBelowNorm();
+    order.set_order_date(QDateTime::currentDateTime().toString("dd.MM.yyyy HH:mm").toStdString());
+    order.set_total_packs(int(scan.totalPacks));
+    for (int row : scan.rows) {
+        *order.add_products_to_order() = ProtobufSerializer::productToProto(m_store->at(row));
+    }
+}
+
+void InventoryServer::markChanged(int row)
+{
+    if (m_changedMask.size() < m_store->count()) {
+        m_changedMask.resize(m_store->count());
+    }
+    if (!m_changedMask.at(row)) {
+        m_changedMask[row] = true;
+        m_changedRows.append(row);
+    }
+
+    if (!m_publishScheduled) {
+        m_publishScheduled = true;
+        QTimer::singleShot(0, this, &InventoryServer::publishChanges);
+    }
+}
+
+void InventoryServer::publishChanges()
+{
+    m_publishScheduled = false;
+    if (m_changedRows.isEmpty()) {
+        return;
+    }
+
+    fridgemanager::ServerMessageProto message;
+    fillProducts(*message.mutable_changes(), *m_store, m_changedRows);
+    const QByteArray frame = WireProtocol::frame(message);
+
+    for (int row : m_changedRows) {
+        m_changedMask[row] = false;
+    }
+    m_changedRows.clear();
+
+    for (auto it = m_clients.cbegin(); it != m_clients.cend(); ++it) {
+        if (it.value().subscribed) {
+            it.key()->write(frame);
+        }
+    }
+}
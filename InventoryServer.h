@@ -0,0 +1,72 @@
+﻿#ifndef INVENTORYSERVER_H
+#define INVENTORYSERVER_H
+
+#include <QHash>
+#include <QLocalServer>
+#include <QObject>
+#include <QTcpServer>
+#include <QVector>
+#include "WireProtocol.h"
+#include "product.pb.h"
+
+class DatabaseManager;
+class ProductStore;
+
+// Сервер остатков (fridgectl --server): один процесс держит подключение к
+// базе и каталог в памяти, терминалы работают с ним через сокет.
+//
+// Запросы можно слать не дожидаясь ответов: все кадры, пришедшие одним
+// чтением, обрабатываются по порядку, а ответы уходят одной записью.
+// Изменения остатков копятся до конца итерации цикла событий и рассылаются
+// подписчикам одним кадром.
+class InventoryServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // database может быть nullptr - тогда остатки живут только в памяти
+    InventoryServer(DatabaseManager* database, ProductStore* store, QObject* parent = nullptr);
+    ~InventoryServer();
+
+    // "host:port" или ":port" - TCP, иначе имя локального сокета
+    bool listen(const QString& address);
+    void close();
+
+    int clientCount() const { return m_clients.size(); }
+    QString getLastError() const { return m_lastError; }
+
+private slots:
+    void onNewTcpConnection();
+    void onNewLocalConnection();
+
+private:
+    struct Client {
+        WireProtocol::FrameReader reader;
+        bool subscribed = false;
+    };
+
+    void addClient(QIODevice* socket);
+    void removeClient(QIODevice* socket);
+    void readClient(QIODevice* socket);
+
+    void handleRequest(Client& client, const fridgemanager::RequestProto& request,
+        fridgemanager::ResponseProto& response);
+    void applyOperations(const fridgemanager::RequestProto& request, fridgemanager::ResponseProto& response);
+    void fillOrder(fridgemanager::OrderProto& order) const;
+
+    void markChanged(int row);
+    void publishChanges();
+
+    DatabaseManager* m_database;
+    ProductStore* m_store;
+    QTcpServer m_tcpServer;
+    QLocalServer m_localServer;
+    QHash<QIODevice*, Client> m_clients;
+
+    QVector<int> m_changedRows;
+    QVector<bool> m_changedMask;
+    bool m_publishScheduled = false;
+    QString m_lastError;
+};
+
+#endif // INVENTORYSERVER_H
@@ -0,0 +1,274 @@
+﻿#include "LotTracker.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <algorithm>
+
+LotTracker::LotTracker()
+{
+    m_wheel.reset(QDateTime::currentMSecsSinceEpoch());
+}
+
+bool LotTracker::consumedLater(const ProductLot& a, const ProductLot& b)
+{
+    // Сначала ближайший срок, партии без срока - последними; затем по приходу
+    if (a.expiresOn != b.expiresOn) {
+        if (!a.expiresOn.isValid()) {
+            return true;
+        }
+        if (!b.expiresOn.isValid()) {
+            return false;
+        }
+        return a.expiresOn > b.expiresOn;
+    }
+    if (a.receivedMs != b.receivedMs) {
+        return a.receivedMs > b.receivedMs;
+    }
+    return a.id > b.id;
+}
+
+qint64 LotTracker::warningTime(const ProductLot& lot) const
+{
+    // "Годен до" включает сам день: срок истекает в полночь после него
+    const QDateTime expires(lot.expiresOn.addDays(1), QTime(0, 0));
+    return expires.toMSecsSinceEpoch() - qint64(m_warningHours) * 60 * 60 * 1000;
+}
+
+void LotTracker::clear()
+{
+    // Уже выданные предупреждения помнятся: после переподключения не повторяются
+    m_products.clear();
+    m_productByLot.clear();
+    m_wheel.reset(QDateTime::currentMSecsSinceEpoch());
+    m_maxLotId = 0;
+}
+
+void LotTracker::addLot(const ProductLot& lot)
+{
+    if (lot.quantity <= 0 || m_productByLot.contains(lot.id)) {
+        return;
+    }
+
+    ProductLots& product = m_products[lot.productId];
+    product.heap.push_back(lot);
+    std::push_heap(product.heap.begin(), product.heap.end(), consumedLater);
+    product.total += lot.quantity;
+
+    m_productByLot.insert(lot.id, lot.productId);
+    m_maxLotId = qMax(m_maxLotId, lot.id);
+    if (lot.expiresOn.isValid() && !m_warned.contains(lot.id)) {
+        m_wheel.schedule(lot.id, warningTime(lot));
+    }
+}
+
+QVector<LotTracker::Take> LotTracker::consume(int productId, int amount)
+{
+    QVector<Take> takes;
+    auto it = m_products.find(productId);
+    if (it == m_products.end()) {
+        return takes;
+    }
+
+    ProductLots& product = it.value();
+    while (amount > 0 && !product.heap.empty()) {
+        // Частичное списание не меняет ключ кучи - вершина остается на месте
+        ProductLot& first = product.heap.front();
+        const int take = qMin(amount, first.quantity);
+        takes.append({ first.id, take });
+        first.quantity -= take;
+        product.total -= take;
+        amount -= take;
+
+        if (first.quantity == 0) {
+            m_wheel.cancel(first.id);
+            m_productByLot.remove(first.id);
+            std::pop_heap(product.heap.begin(), product.heap.end(), consumedLater);
+            product.heap.pop_back();
+        }
+    }
+
+    if (product.heap.empty()) {
+        m_products.erase(it);
+    }
+    return takes;
+}
+
+QDate LotTracker::nextExpiry(int productId) const
+{
+    auto it = m_products.constFind(productId);
+    if (it == m_products.cend() || it.value().heap.empty()) {
+        return QDate();
+    }
+    return it.value().heap.front().expiresOn;
+}
+
+QVector<ProductLot> LotTracker::lots(int productId) const
+{
+    auto it = m_products.constFind(productId);
+    if (it == m_products.cend()) {
+        return QVector<ProductLot>();
+    }
+
+    QVector<ProductLot> result;
+    result.reserve(int(it.value().heap.size()));
+    for (const ProductLot& lot : it.value().heap) {
+        result.append(lot);
+    }
+    std::sort(result.begin(), result.end(), [](const ProductLot& a, const ProductLot& b) {
+        return consumedLater(b, a);
+    });
+    return result;
+}
+
+bool LotTracker::findLot(qint64 lotId, ProductLot& lot) const
+{
+    auto product = m_products.constFind(m_productByLot.value(lotId, -1));
+    if (product == m_products.cend()) {
+        return false;
+    }
+
+    for (const ProductLot& candidate : product.value().heap) {
+        if (candidate.id == lotId) {
+            lot = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+QVector<ProductLot> LotTracker::advance(qint64 nowMs)
+{
+    QVector<ProductLot> due;
+    for (qint64 lotId : m_wheel.advance(nowMs)) {
+        m_warned.insert(lotId);
+        ProductLot lot;
+        if (findLot(lotId, lot)) {
+            due.append(lot);
+        }
+    }
+    return due;
+}
+
+void LotTracker::removeProduct(int productId)
+{
+    auto it = m_products.find(productId);
+    if (it == m_products.end()) {
+        return;
+    }
+
+    for (const ProductLot& lot : it.value().heap) {
+        m_wheel.cancel(lot.id);
+        m_productByLot.remove(lot.id);
+    }
+    m_products.erase(it);
+}
+
+bool LotTracker::loadWhere(QSqlDatabase& db, const QString& condition, const QVariant& value)
+{
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT id, product_id, quantity, received_at, expires_on, unit_cost FROM product_lots WHERE quantity > 0"
+        + (condition.isEmpty() ? QString() : " AND " + condition));
+    if (value.isValid()) {
+        query.bindValue(":value", value);
+    }
+    if (!query.exec()) {
+        m_lastError = query.lastError().text();
+        qWarning() << "❌ Failed to load product lots:" << m_lastError;
+        return false;
+    }
+
+    while (query.next()) {
+        ProductLot lot;
+        lot.id = query.value(0).toLongLong();
+        lot.productId = query.value(1).toInt();
+        lot.quantity = query.value(2).toInt();
+        lot.receivedMs = query.value(3).toLongLong();
+        lot.expiresOn = query.value(4).toDate();
+        lot.unitCost = query.isNull(5) ? -1 : query.value(5).toLongLong();
+        addLot(lot);
+    }
+
+    m_lastError.clear();
+    return true;
+}
+
+bool LotTracker::load(QSqlDatabase& db)
+{
+    clear();
+    if (!loadWhere(db, QString(), QVariant())) {
+        return false;
+    }
+
+    qDebug() << "📦 Product lots loaded:" << m_productByLot.size() << "lots of" << m_products.size() << "products";
+    return true;
+}
+
+bool LotTracker::loadNew(QSqlDatabase& db)
+{
+    return loadWhere(db, "id > :value", m_maxLotId);
+}
+
+bool LotTracker::reloadProduct(QSqlDatabase& db, int productId)
+{
+    removeProduct(productId);
+    return loadWhere(db, "product_id = :value", productId);
+}
+
+bool LotTracker::insertLot(QSqlDatabase& db, ProductLot& lot)
+{
+    // QPSQL не отдает SERIAL через lastInsertId()
+    const bool postgres = db.driverName() == "QPSQL";
+
+    QSqlQuery query(db);
+    query.prepare(QString("INSERT INTO product_lots (product_id, quantity, received_at, expires_on, unit_cost) "
+        "VALUES (:product, :quantity, :received, :expires, :cost)") + (postgres ? " RETURNING id" : ""));
+    query.bindValue(":product", lot.productId);
+    query.bindValue(":quantity", lot.quantity);
+    query.bindValue(":received", lot.receivedMs);
+    query.bindValue(":expires", lot.expiresOn.isValid() ? QVariant(lot.expiresOn) : QVariant(QVariant::Date));
+    query.bindValue(":cost", lot.unitCost >= 0 ? QVariant(lot.unitCost) : QVariant(QVariant::LongLong));
+
+    if (!query.exec() || (postgres && !query.next())) {
+        m_lastError = query.lastError().text();
+        qWarning() << "❌ Failed to insert product lot:" << m_lastError;
+        return false;
+    }
+
+    lot.id = postgres ? query.value(0).toLongLong() : query.lastInsertId().toLongLong();
+    return true;
+}
+
+bool LotTracker::writeTakes(QSqlDatabase& db, int productId, const QVector<Take>& takes, int& missing)
+{
+    missing = 0;
+    if (takes.isEmpty()) {
+        return true;
+    }
+
+    // Проверка остатка партии в самом UPDATE: партию могли списать с другого терминала
+    QSqlQuery query(db);
+    query.prepare("UPDATE product_lots SET quantity = quantity - :take WHERE id = :id AND quantity >= :take");
+    for (const Take& take : takes) {
+        query.bindValue(":take", take.quantity);
+        query.bindValue(":id", take.lotId);
+        if (!query.exec()) {
+            m_lastError = query.lastError().text();
+            qWarning() << "❌ Failed to consume product lot:" << m_lastError;
+            return false;
+        }
+        if (query.numRowsAffected() <= 0) {
+            missing += take.quantity;
+        }
+    }
+
+    QSqlQuery cleanup(db);
+    cleanup.prepare("DELETE FROM product_lots WHERE product_id = :product AND quantity = 0");
+    cleanup.bindValue(":product", productId);
+    if (!cleanup.exec()) {
+        m_lastError = cleanup.lastError().text();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+﻿#ifndef LOTTRACKER_H
+#define LOTTRACKER_H
+
+#include <QDate>
+#include <QHash>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QVariant>
+#include <QVector>
+#include <vector>
+#include "ExpiryWheel.h"
+
+// Партия продукта: сколько упаковок пришло одной поставкой и до какого числа годны
+struct ProductLot {
+    qint64 id = 0;
+    int productId = 0;
+    int quantity = 0;
+    qint64 receivedMs = 0;
+    QDate expiresOn;                  // недействительная дата - без срока годности
+    qint64 unitCost = -1;             // цена прихода в копейках, -1 - не указана
+};
+
+// Партии в памяти. У каждого продукта своя min-куча по сроку годности
+// (затем по дате прихода): первая на списание партия всегда на вершине,
+// расход снимает вершину за O(log n). Предупреждения о сроке ставятся в
+// ExpiryWheel и приходят без просмотра всех партий.
+//
+// Остаток продукта по-прежнему хранится одним числом (products.current_quantity);
+// партии его не заменяют. Упаковки без партии (приход без срока, остатки до
+// учета партий) списываются после всех партий со сроком.
+class LotTracker
+{
+public:
+    struct Take {
+        qint64 lotId;
+        int quantity;
+    };
+
+    static const int DefaultWarningHours = 24;
+
+    LotTracker();
+
+    // За сколько часов до конца срока предупреждать; действует на новые партии
+    void setWarningHours(int hours) { m_warningHours = qMax(0, hours); }
+    int warningHours() const { return m_warningHours; }
+
+    void clear();
+    void addLot(const ProductLot& lot);
+
+    // Списание FIFO по сроку годности: какие партии и сколько из них взято.
+    // Если партий не хватает, остаток списывается с упаковок без партии.
+    QVector<Take> consume(int productId, int amount);
+
+    int trackedQuantity(int productId) const { return m_products.value(productId).total; }
+    QDate nextExpiry(int productId) const;
+    QVector<ProductLot> lots(int productId) const;      // в порядке списания
+    bool findLot(qint64 lotId, ProductLot& lot) const;
+    int size() const { return m_productByLot.size(); }
+
+    // Партии, у которых наступил срок предупреждения; каждая - один раз
+    QVector<ProductLot> advance(qint64 nowMs);
+
+    // Хранение в таблице product_lots (миграция 9)
+    bool load(QSqlDatabase& db);
+    bool loadNew(QSqlDatabase& db);                     // принятые после последней загрузки
+    bool reloadProduct(QSqlDatabase& db, int productId);
+    bool insertLot(QSqlDatabase& db, ProductLot& lot);  // id назначает база, в память не добавляет
+    // Расход из партий; missing - сколько не нашлось в базе (партию списал другой терминал)
+    bool writeTakes(QSqlDatabase& db, int productId, const QVector<Take>& takes, int& missing);
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    struct ProductLots {
+        std::vector<ProductLot> heap;
+        int total = 0;
+    };
+
+    static bool consumedLater(const ProductLot& a, const ProductLot& b);
+    qint64 warningTime(const ProductLot& lot) const;
+    void removeProduct(int productId);
+    bool loadWhere(QSqlDatabase& db, const QString& condition, const QVariant& value);
+
+    QHash<int, ProductLots> m_products;
+    QHash<qint64, int> m_productByLot;
+    QSet<qint64> m_warned;
+    ExpiryWheel m_wheel;
+    int m_warningHours = DefaultWarningHours;
+    qint64 m_maxLotId = 0;
+    QString m_lastError;
+};
+
+#endif // LOTTRACKER_H
@@ -1,4 +1,4 @@
-import QtQuick 2.15
+﻿import QtQuick 2.15
 import QtQuick.Window 2.15
 import QtQuick.Controls 2.15
 import QtQuick.Layouts 1.15
@@ -51,7 +51,7 @@ ApplicationWindow {
                     spacing: 5
                     
                     Repeater {
-                        model: fridgeManager.getAvailableDirectories()
+                        model: fridgeManager.directories
                         
                         Rectangle {
                             width: parent.width
@@ -76,33 +76,30 @@ ApplicationWindow {
                                     spacing: 2
                                     
                                     Label {
-                                        text: {
-                                            var path = modelData;
-                                            var parts = path.split('/');
-                                            return parts[parts.length - 1] || "Корневая папка";
-                                        }
+                                        text: model.name
                                         font.bold: true
                                         color: "#2c3e50"
                                     }
                                     
                                     Label {
-                                        text: modelData
+                                        text: model.path
                                         font.pixelSize: 10
                                         color: "#7f8c8d"
                                         elide: Text.ElideLeft
                                     }
                                     
                                     Label {
-                                        text: "Директория " + (fridgeManager.directoryExists(modelData) ? "существует" : "не существует")
+                                        text: "Директория " + (model.exists ? "существует" : "не существует")
+                                              + (model.exists && !model.writable ? " (только чтение)" : "")
                                         font.pixelSize: 10
-                                        color: fridgeManager.directoryExists(modelData) ? "#27ae60" : "#e74c3c"
+                                        color: model.exists && model.writable ? "#27ae60" : "#e74c3c"
                                     }
                                 }
                                 
                                 Button {
                                     text: "Выбрать"
                                     onClicked: {
-                                        var result = fridgeManager.saveOrderToPath(modelData);
+                                        var result = fridgeManager.saveOrderToPath(model.path);
                                         dialogMessage.text = result;
                                         directoryDialog.close();
                                         resultDialog.open();
@@ -115,7 +112,7 @@ ApplicationWindow {
                                 anchors.fill: parent
                                 hoverEnabled: true
                                 onClicked: {
-                                    var result = fridgeManager.saveOrderToPath(modelData);
+                                    var result = fridgeManager.saveOrderToPath(model.path);
                                     dialogMessage.text = result;
                                     directoryDialog.close();
                                     resultDialog.open();
@@ -199,8 +196,6 @@ ApplicationWindow {
                                 newFolderName.text = "";
                                 createFolderDialog.close();
                                 resultDialog.open();
-                                // Обновляем список директорий
-                                directoryCombo.model = fridgeManager.getAvailableDirectories();
                             } else {
                                 dialogMessage.text = "❌ Не удалось создать папку: " + newPath;
                                 resultDialog.open();
@@ -217,6 +212,319 @@ ApplicationWindow {
         }
     }
 
+    // Приход партией со сроком годности
+    Popup {
+        id: lotDialog
+        property int productRow: -1
+        property string productName: ""
+        width: 400
+        height: 290
+        modal: true
+        focus: true
+        anchors.centerIn: parent
+
+        background: Rectangle {
+            color: "white"
+            border.color: "#3498db"
+            border.width: 2
+            radius: 10
+        }
+
+        ColumnLayout {
+            anchors.fill: parent
+            anchors.margins: 20
+            spacing: 15
+
+            Label {
+                text: "📦 Партия: " + lotDialog.productName
+                font.bold: true
+                font.pixelSize: 16
+                Layout.alignment: Qt.AlignHCenter
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                SpinBox {
+                    id: lotAmount
+                    from: 1
+                    to: 9999
+                    value: 1
+                    editable: true
+                }
+
+                TextField {
+                    id: lotExpiry
+                    Layout.fillWidth: true
+                    placeholderText: "Годен до (ДД.ММ.ГГГГ)"
+                    inputMask: "99.99.9999"
+                }
+            }
+
+            TextField {
+                id: lotPrice
+                Layout.fillWidth: true
+                placeholderText: "Цена упаковки, ₽ (необязательно)"
+                inputMethodHints: Qt.ImhFormattedNumbersOnly
+            }
+
+            Row {
+                spacing: 10
+                Layout.alignment: Qt.AlignHCenter
+
+                Button {
+                    text: "Принять"
+                    onClicked: {
+                        if (fridgeManager.receiveLot(lotDialog.productRow, lotAmount.value, lotExpiry.text, lotPrice.text)) {
+                            lotDialog.close();
+                        } else {
+                            dialogMessage.text = "❌ Партия не принята: проверьте дату, цену и подключение к БД";
+                            resultDialog.open();
+                        }
+                    }
+                }
+
+                Button {
+                    text: "Отмена"
+                    onClicked: lotDialog.close()
+                }
+            }
+        }
+    }
+
+    // График остатков продукта по снимкам истории
+    Popup {
+        id: historyDialog
+        property int productRow: -1
+        property string productName: ""
+        property int days: 7
+        property var points: []
+        width: 560
+        height: 360
+        modal: true
+        focus: true
+        anchors.centerIn: parent
+
+        function reload() {
+            points = fridgeManager.stockHistory(productRow, days);
+            historyCanvas.requestPaint();
+        }
+
+        background: Rectangle {
+            color: "white"
+            border.color: "#3498db"
+            border.width: 2
+            radius: 10
+        }
+
+        ColumnLayout {
+            anchors.fill: parent
+            anchors.margins: 20
+            spacing: 10
+
+            Label {
+                text: "📈 " + historyDialog.productName
+                font.bold: true
+                font.pixelSize: 16
+                Layout.alignment: Qt.AlignHCenter
+            }
+
+            Canvas {
+                id: historyCanvas
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+
+                onPaint: {
+                    var ctx = getContext("2d");
+                    ctx.reset();
+                    var points = historyDialog.points;
+                    if (points.length < 2) {
+                        return;
+                    }
+                    var minT = points[0].t, maxT = points[points.length - 1].t;
+                    var maxQ = 1;
+                    for (var i = 0; i < points.length; ++i) {
+                        maxQ = Math.max(maxQ, points[i].q);
+                    }
+                    ctx.strokeStyle = "#bdc3c7";
+                    ctx.beginPath();
+                    ctx.moveTo(0, height - 1);
+                    ctx.lineTo(width, height - 1);
+                    ctx.stroke();
+
+                    // Остаток меняется ступенькой между снимками
+                    ctx.strokeStyle = "#3498db";
+                    ctx.lineWidth = 2;
+                    ctx.beginPath();
+                    var lastY = 0;
+                    for (var j = 0; j < points.length; ++j) {
+                        var x = (points[j].t - minT) / Math.max(1, maxT - minT) * width;
+                        var y = height - 1 - points[j].q / maxQ * (height - 10);
+                        if (j === 0) {
+                            ctx.moveTo(x, y);
+                        } else {
+                            ctx.lineTo(x, lastY);
+                            ctx.lineTo(x, y);
+                        }
+                        lastY = y;
+                    }
+                    ctx.stroke();
+                }
+            }
+
+            Label {
+                text: historyDialog.points.length < 2
+                    ? "Снимков остатков за период еще нет"
+                    : "Максимум: " + Math.max.apply(null, historyDialog.points.map(function(p) { return p.q; })) + " уп."
+                color: "#7f8c8d"
+                Layout.alignment: Qt.AlignHCenter
+            }
+
+            Row {
+                spacing: 10
+                Layout.alignment: Qt.AlignHCenter
+
+                Repeater {
+                    model: [1, 7, 30, 90]
+                    Button {
+                        text: modelData + " дн."
+                        highlighted: historyDialog.days === modelData
+                        onClicked: {
+                            historyDialog.days = modelData;
+                            historyDialog.reload();
+                        }
+                    }
+                }
+
+                Button {
+                    text: "Закрыть"
+                    onClicked: historyDialog.close()
+                }
+            }
+        }
+    }
+
+    // Инвентаризация: сверка файла пересчета с учетом, затем применение
+    Popup {
+        id: stockTakeDialog
+        property var report: ({ rows: [], summary: "", unmatched: [] })
+        width: 640
+        height: 480
+        modal: true
+        focus: true
+        anchors.centerIn: parent
+
+        function run(apply) {
+            var result = fridgeManager.stockTake(stockTakePath.text, apply, stockTakeZero.checked);
+            if (!result.ok) {
+                dialogMessage.text = "❌ Инвентаризация: " + result.error;
+                resultDialog.open();
+                return;
+            }
+            report = result;
+        }
+
+        background: Rectangle {
+            color: "white"
+            border.color: "#3498db"
+            border.width: 2
+            radius: 10
+        }
+
+        ColumnLayout {
+            anchors.fill: parent
+            anchors.margins: 20
+            spacing: 10
+
+            Label {
+                text: "📋 Инвентаризация"
+                font.bold: true
+                font.pixelSize: 16
+                Layout.alignment: Qt.AlignHCenter
+            }
+
+            TextField {
+                id: stockTakePath
+                Layout.fillWidth: true
+                placeholderText: "Файл пересчета (.csv или .pb)"
+                selectByMouse: true
+            }
+
+            CheckBox {
+                id: stockTakeZero
+                text: "Продукты, которых нет в файле, - ноль"
+            }
+
+            Label {
+                text: stockTakeDialog.report.summary
+                visible: text !== ""
+                wrapMode: Text.Wrap
+                Layout.fillWidth: true
+            }
+
+            ListView {
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+                clip: true
+                model: stockTakeDialog.report.rows
+
+                delegate: RowLayout {
+                    width: ListView.view.width
+                    spacing: 10
+
+                    Label {
+                        text: modelData.name
+                        elide: Text.ElideRight
+                        Layout.fillWidth: true
+                    }
+                    Label {
+                        text: modelData.expected + " → " + modelData.counted
+                    }
+                    Label {
+                        text: (modelData.delta > 0 ? "+" : "") + modelData.delta
+                        color: modelData.delta < 0 ? "#c0392b" : "#27ae60"
+                        Layout.preferredWidth: 50
+                    }
+                    Label {
+                        text: modelData.cost + " ₽"
+                        Layout.preferredWidth: 100
+                        horizontalAlignment: Text.AlignRight
+                    }
+                }
+            }
+
+            Label {
+                text: "Не найдено: " + stockTakeDialog.report.unmatched.join(", ")
+                visible: stockTakeDialog.report.unmatched.length > 0
+                color: "#c0392b"
+                elide: Text.ElideRight
+                Layout.fillWidth: true
+            }
+
+            Row {
+                spacing: 10
+                Layout.alignment: Qt.AlignHCenter
+
+                Button {
+                    text: "Сверить"
+                    onClicked: stockTakeDialog.run(false)
+                }
+
+                Button {
+                    text: "Применить"
+                    enabled: stockTakeDialog.report.rows.length > 0 && !stockTakeDialog.report.applied
+                    onClicked: stockTakeDialog.run(true)
+                }
+
+                Button {
+                    text: "Закрыть"
+                    onClicked: stockTakeDialog.close()
+                }
+            }
+        }
+    }
+
     // Диалог результата
     Popup {
         id: resultDialog
@@ -305,6 +613,53 @@ ApplicationWindow {
                 }
             }
 
+            // Стоимость остатков и заявки
+            Label {
+                text: fridgeManager.valuation
+                font.pixelSize: 14
+                color: "#2c3e50"
+                Layout.alignment: Qt.AlignHCenter
+            }
+
+            // Последний пакет сканирований
+            Label {
+                text: fridgeManager.scanStatus
+                visible: text !== ""
+                font.pixelSize: 12
+                color: "#2c3e50"
+                elide: Text.ElideRight
+                Layout.fillWidth: true
+            }
+
+            // Партии, у которых подходит срок годности
+            Rectangle {
+                Layout.fillWidth: true
+                height: 30
+                visible: fridgeManager.expiryWarnings.length > 0
+                color: "#fff3cd"
+                radius: 5
+                border.color: "#ffeeba"
+
+                RowLayout {
+                    anchors.fill: parent
+                    anchors.leftMargin: 10
+                    anchors.rightMargin: 5
+
+                    Label {
+                        text: "⏰ Истекает срок: " + fridgeManager.expiryWarnings.join(", ")
+                        font.pixelSize: 12
+                        color: "#856404"
+                        elide: Text.ElideRight
+                        Layout.fillWidth: true
+                    }
+
+                    ToolButton {
+                        text: "✖"
+                        onClicked: fridgeManager.dismissExpiryWarnings()
+                    }
+                }
+            }
+
             // Информация о последнем сохранении
             Rectangle {
                 Layout.fillWidth: true
@@ -328,6 +683,66 @@ ApplicationWindow {
                 }
             }
 
+            // Локация, поиск, сортировка и фильтр списка
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                ComboBox {
+                    id: locationCombo
+                    Layout.preferredWidth: 200
+                    model: fridgeManager.locationNames
+                    currentIndex: fridgeManager.currentLocationIndex
+                    onActivated: fridgeManager.currentLocationIndex = currentIndex
+                }
+
+                TextField {
+                    id: searchField
+                    Layout.fillWidth: true
+                    placeholderText: "🔍 Поиск продукта..."
+                    selectByMouse: true
+                    onTextChanged: fridgeManager.productView.query = text
+                }
+
+                // Сканер в режиме клавиатуры: код и Enter приходят в это поле
+                TextField {
+                    id: scanField
+                    Layout.preferredWidth: 180
+                    placeholderText: "🏷️ Штрихкод"
+                    selectByMouse: true
+                    onAccepted: {
+                        fridgeManager.submitScan(text);
+                        text = "";
+                    }
+                }
+
+                ComboBox {
+                    id: sortCombo
+                    Layout.preferredWidth: 200
+                    textRole: "text"
+                    model: [
+                        { text: "По порядку", mode: ProductFilterModel.SourceOrder },
+                        { text: "По названию", mode: ProductFilterModel.ByName },
+                        { text: "По нехватке", mode: ProductFilterModel.ByShortage },
+                        { text: "По размеру заказа", mode: ProductFilterModel.ByOrderQuantity }
+                    ]
+                    onActivated: fridgeManager.productView.sortMode = model[currentIndex].mode
+                }
+
+                CheckBox {
+                    text: "Только ниже нормы"
+                    checked: fridgeManager.productView.belowNormOnly
+                    onToggled: fridgeManager.productView.belowNormOnly = checked
+                }
+
+                BusyIndicator {
+                    running: fridgeManager.productView.sorting
+                    visible: running
+                    Layout.preferredWidth: 24
+                    Layout.preferredHeight: 24
+                }
+            }
+
             // Список продуктов
             Rectangle {
                 Layout.fillWidth: true
@@ -343,7 +758,7 @@ ApplicationWindow {
 
                     ListView {
                         id: productList
-                        model: fridgeManager.products
+                        model: fridgeManager.productView
                         spacing: 2
 
                         delegate: Rectangle {
@@ -358,7 +773,7 @@ ApplicationWindow {
 
                                 // Название продукта
                                 Label {
-                                    text: modelData.name
+                                    text: model.name
                                     font.bold: true
                                     font.pixelSize: 16
                                     color: "#2c3e50"
@@ -371,32 +786,39 @@ ApplicationWindow {
                                     spacing: 2
 
                                     Label {
-                                        text: "В наличии: " + modelData.currentQuantity
+                                        text: "В наличии: " + model.currentQuantity
                                         font.pixelSize: 12
                                         color: "#495057"
                                     }
 
                                     Label {
-                                        text: "Норма: " + modelData.normQuantity
+                                        text: "Норма: " + model.normQuantity
                                         font.pixelSize: 12
                                         color: "#6c757d"
                                     }
+
+                                    Label {
+                                        visible: !isNaN(model.nextExpiry)
+                                        text: "Годен до: " + Qt.formatDate(model.nextExpiry, "dd.MM.yyyy")
+                                        font.pixelSize: 12
+                                        color: "#856404"
+                                    }
                                 }
 
                                 // Статус заказа
                                 Rectangle {
                                     Layout.fillWidth: true
                                     height: 40
-                                    color: modelData.needsOrder ? "#ffeaa7" : "#d1ecf1"
+                                    color: model.needsOrder ? "#ffeaa7" : "#d1ecf1"
                                     radius: 5
-                                    border.color: modelData.needsOrder ? "#fdcb6e" : "#bee5eb"
+                                    border.color: model.needsOrder ? "#fdcb6e" : "#bee5eb"
 
                                     Label {
-                                        text: modelData.needsOrder ? 
-                                              "⚠️ Нужен заказ: " + modelData.orderQuantity + " упаковок" : 
+                                        text: model.needsOrder ? 
+                                              "⚠️ Нужен заказ: " + model.orderQuantity + " упаковок" : 
                                               "✅ Достаточно"
-                                        color: modelData.needsOrder ? "#e17055" : "#0c5460"
-                                        font.bold: modelData.needsOrder
+                                        color: model.needsOrder ? "#e17055" : "#0c5460"
+                                        font.bold: model.needsOrder
                                         anchors.centerIn: parent
                                     }
                                 }
@@ -410,14 +832,41 @@ ApplicationWindow {
                                         text: "+"
                                         width: 40
                                         height: 30
-                                        onClicked: fridgeManager.addProductQuantity(index, 1)
+                                        onClicked: fridgeManager.addProductQuantity(fridgeManager.productView.sourceRow(index), 1)
                                     }
 
                                     Button {
                                         text: "-"
                                         width: 40
                                         height: 30
-                                        onClicked: fridgeManager.removeProductQuantity(index, 1)
+                                        onClicked: fridgeManager.removeProductQuantity(fridgeManager.productView.sourceRow(index), 1)
+                                    }
+
+                                    Button {
+                                        text: "📦"
+                                        width: 40
+                                        height: 30
+                                        enabled: fridgeManager.databaseConnected
+                                        onClicked: {
+                                            lotDialog.productRow = fridgeManager.productView.sourceRow(index);
+                                            lotDialog.productName = model.name;
+                                            lotExpiry.text = "";
+                                            lotPrice.text = "";
+                                            lotAmount.value = 1;
+                                            lotDialog.open();
+                                        }
+                                    }
+
+                                    Button {
+                                        text: "📈"
+                                        width: 40
+                                        height: 30
+                                        onClicked: {
+                                            historyDialog.productRow = fridgeManager.productView.sourceRow(index);
+                                            historyDialog.productName = model.name;
+                                            historyDialog.reload();
+                                            historyDialog.open();
+                                        }
                                     }
                                 }
                             }
@@ -445,11 +894,18 @@ ApplicationWindow {
                     ComboBox {
                         id: directoryCombo
                         width: 300
-                        model: fridgeManager.getAvailableDirectories()
+                        model: fridgeManager.directories
+                        textRole: "path"
                         onCurrentTextChanged: {
                             if (currentText) {
                                 directoryInfo.text = "Выбрано: " + currentText + 
-                                    "\nСуществует: " + (fridgeManager.directoryExists(currentText) ? "✅ Да" : "❌ Нет")
+                                    "\nСуществует: " + (fridgeManager.directories.existsAt(currentIndex) ? "✅ Да" : "❌ Нет")
+                            }
+                        }
+                        onCountChanged: {
+                            // Список папок заполняется асинхронно
+                            if (currentIndex < 0 && count > 0) {
+                                currentIndex = 0;
                             }
                         }
                     }
@@ -497,6 +953,40 @@ ApplicationWindow {
                         }
                     }
 
+                    Button {
+                        text: "🚚 По поставщикам"
+                        onClicked: {
+                            if (directoryCombo.currentText) {
+                                var result = fridgeManager.saveSupplierOrdersToPath(directoryCombo.currentText);
+                                dialogMessage.text = result;
+                                resultDialog.open();
+                            } else {
+                                dialogMessage.text = "❌ Сначала выберите папку из списка";
+                                resultDialog.open();
+                            }
+                        }
+                    }
+
+                    Button {
+                        text: "🧾 Сводная по локациям"
+                        onClicked: {
+                            if (directoryCombo.currentText) {
+                                var result = fridgeManager.saveConsolidatedOrderToPath(directoryCombo.currentText);
+                                dialogMessage.text = result;
+                                resultDialog.open();
+                            } else {
+                                dialogMessage.text = "❌ Сначала выберите папку из списка";
+                                resultDialog.open();
+                            }
+                        }
+                    }
+
+                    Button {
+                        text: "📋 Инвентаризация"
+                        enabled: fridgeManager.databaseConnected
+                        onClicked: stockTakeDialog.open()
+                    }
+
                     Button {
                         text: "📁 Создать папку"
                         onClicked: {
@@ -512,7 +1002,7 @@ ApplicationWindow {
         console.log("✅ FridgeManager loaded successfully!");
         console.log("Home path:", fridgeManager.getDefaultHomePath());
         console.log("Documents path:", fridgeManager.getDefaultDocumentsPath());
-        console.log("Available directories:", fridgeManager.getAvailableDirectories());
+        console.log("Available directories:", fridgeManager.directories.count);
         
         // Автоматически выбираем первую доступную директорию
         if (directoryCombo.count > 0) {
@@ -0,0 +1,61 @@
+﻿#include "Money.h"
+#include <limits>
+
+namespace Money {
+
+QString format(qint64 kopecks, QChar decimalPoint)
+{
+    const bool negative = kopecks < 0;
+    const quint64 absolute = negative ? quint64(-(kopecks + 1)) + 1 : quint64(kopecks);
+    return QString("%1%2%3%4")
+        .arg(negative ? "-" : "")
+        .arg(absolute / 100)
+        .arg(decimalPoint)
+        .arg(int(absolute % 100), 2, 10, QLatin1Char('0'));
+}
+
+bool parse(const QString& text, qint64& kopecks)
+{
+    QString normalized = text.trimmed();
+    normalized.remove(QLatin1Char(' '));
+    normalized.remove(QChar(0x00A0));
+    normalized.replace(QLatin1Char(','), QLatin1Char('.'));
+    if (normalized.isEmpty()) {
+        return false;
+    }
+
+    const int point = normalized.indexOf(QLatin1Char('.'));
+    const QString whole = point < 0 ? normalized : normalized.left(point);
+    const QString fraction = point < 0 ? QString() : normalized.mid(point + 1);
+    if (fraction.size() > 2 || (whole.isEmpty() && fraction.isEmpty())) {
+        return false;
+    }
+    for (const QChar ch : whole + fraction) {
+        if (!ch.isDigit()) {
+            return false;
+        }
+    }
+
+    bool ok = true;
+    const qint64 rubles = whole.isEmpty() ? 0 : whole.toLongLong(&ok);
+    if (!ok || rubles > std::numeric_limits<qint64>::max() / 100 - 1) {
+        return false;
+    }
+    const int cents = fraction.isEmpty() ? 0 : (fraction + QLatin1Char('0')).left(2).toInt();
+
+    kopecks = rubles * 100 + cents;
+    return true;
+}
+
+qint64 weightedAverage(qint64 quantityA, qint64 costA, qint64 quantityB, qint64 costB)
+{
+    quantityA = qMax<qint64>(0, quantityA);
+    quantityB = qMax<qint64>(0, quantityB);
+    const qint64 total = quantityA + quantityB;
+    if (total == 0) {
+        return costB;
+    }
+    return (quantityA * costA + quantityB * costB + total / 2) / total;
+}
+
+} // namespace Money
@@ -0,0 +1,24 @@
+﻿#ifndef MONEY_H
+#define MONEY_H
+
+#include <QString>
+#include <QtGlobal>
+
+// Деньги в копейках (qint64). Цены, стоимость остатков и заявки считаются
+// в целых числах: сумма не зависит от порядка сложения и не накапливает
+// ошибку округления, как double.
+namespace Money {
+
+// 123456 -> "1234.56"; decimalPoint - разделитель копеек
+QString format(qint64 kopecks, QChar decimalPoint = QLatin1Char('.'));
+
+// "1234.56", "1 234,5", "12" -> копейки; не больше двух знаков после
+// разделителя, отрицательные суммы не принимаются
+bool parse(const QString& text, qint64& kopecks);
+
+// Средняя цена после прихода (средневзвешенная, с округлением до копейки)
+qint64 weightedAverage(qint64 quantityA, qint64 costA, qint64 quantityB, qint64 costB);
+
+} // namespace Money
+
+#endif // MONEY_H
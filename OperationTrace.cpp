@@ -0,0 +1,356 @@
+﻿#include "OperationTrace.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QMutexLocker>
+
+namespace {
+
+const char TraceMagic[] = "FTRC";
+const quint8 TraceFormatVersion = 1;
+
+// Вложенность замеров в текущем потоке: пишется только внешний
+thread_local int spanDepth = 0;
+
+void appendVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char(quint8(value) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(quint8(value)));
+}
+
+// zigzag: небольшие отрицательные числа тоже занимают один-два байта
+void appendSigned(QByteArray& out, qint64 value)
+{
+    appendVarint(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+bool isKnownKind(quint8 kind)
+{
+    return (kind >= TraceEvent::Stock && kind <= TraceEvent::SetLocation)
+        || (kind >= TraceEvent::UiTap && kind <= TraceEvent::UiReceiveLot);
+}
+
+bool hasStockFields(TraceEvent::Kind kind)
+{
+    return kind == TraceEvent::Stock || kind == TraceEvent::Versioned || kind == TraceEvent::UiTap;
+}
+
+bool hasLotFields(TraceEvent::Kind kind)
+{
+    return kind == TraceEvent::ReceiveLot || kind == TraceEvent::UiReceiveLot;
+}
+
+bool hasValue(TraceEvent::Kind kind)
+{
+    return kind == TraceEvent::Versioned || kind == TraceEvent::SetLocation
+        || kind == TraceEvent::UiSelectLocation || kind == TraceEvent::UiExportOrder;
+}
+
+} // namespace
+
+TraceEvent TraceEvent::stock(Kind kind, StockOperation::Type type, int productId, int amount, qint64 value)
+{
+    TraceEvent event(kind);
+    event.type = type;
+    event.productId = productId;
+    event.amount = amount;
+    event.value = value;
+    return event;
+}
+
+TraceEvent TraceEvent::lot(Kind kind, int productId, int amount, const QDate& expiresOn, qint64 unitCost)
+{
+    TraceEvent event(kind);
+    event.productId = productId;
+    event.amount = amount;
+    event.value = unitCost;
+    event.expiresOn = expiresOn;
+    return event;
+}
+
+QString TraceEvent::kindName(Kind kind)
+{
+    switch (kind) {
+    case Stock: return "stock";
+    case Batch: return "batch";
+    case Versioned: return "versioned";
+    case GetAllProducts: return "get_all";
+    case GetProductsToOrder: return "get_to_order";
+    case ReceiveLot: return "receive_lot";
+    case SetLocation: return "set_location";
+    case UiTap: return "ui_tap";
+    case UiSelectLocation: return "ui_location";
+    case UiExportOrder: return "ui_export";
+    case UiReceiveLot: return "ui_receive_lot";
+    }
+    return QString("kind_%1").arg(int(kind));
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    close();
+}
+
+bool TraceRecorder::open(const QString& filePath)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_file.isOpen()) {
+        m_lastError = "Trace is already open: " + m_file.fileName();
+        return false;
+    }
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_lastError = "Cannot create trace " + filePath + ": " + m_file.errorString();
+        return false;
+    }
+
+    m_buffer.clear();
+    m_buffer.reserve(FlushBytes + 1024);
+    m_buffer.append(TraceMagic, 4);
+    m_buffer.append(char(TraceFormatVersion));
+    appendSigned(m_buffer, QDateTime::currentMSecsSinceEpoch());
+    m_clock.start();
+    m_lastStartUs = 0;
+    m_events = 0;
+
+    qDebug() << "🎬 Recording operation trace to" << filePath;
+    return true;
+}
+
+void TraceRecorder::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    flushBuffer();
+    m_file.close();
+    qDebug() << "🎬 Trace closed:" << m_events << "events";
+}
+
+void TraceRecorder::write(const TraceEvent& event)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    m_buffer.append(char(quint8(event.kind) | (event.ok ? 0x80 : 0)));
+    appendSigned(m_buffer, event.startUs - m_lastStartUs);
+    appendVarint(m_buffer, quint64(qMax<qint64>(0, event.durationUs)));
+    m_lastStartUs = event.startUs;
+
+    if (hasStockFields(event.kind)) {
+        m_buffer.append(char(event.type));
+        appendSigned(m_buffer, event.productId);
+        appendSigned(m_buffer, event.amount);
+    }
+    if (hasLotFields(event.kind)) {
+        appendSigned(m_buffer, event.productId);
+        appendSigned(m_buffer, event.amount);
+        appendSigned(m_buffer, event.value);
+        appendSigned(m_buffer, event.expiresOn.isValid() ? event.expiresOn.toJulianDay() : 0);
+    }
+    if (hasValue(event.kind)) {
+        appendSigned(m_buffer, event.value);
+    }
+    if (event.kind == TraceEvent::Batch) {
+        appendVarint(m_buffer, quint64(event.operations.size()));
+        for (const StockOperation& operation : event.operations) {
+            m_buffer.append(char(operation.type));
+            appendSigned(m_buffer, operation.productId);
+            appendSigned(m_buffer, operation.amount);
+        }
+    }
+
+    ++m_events;
+    if (m_buffer.size() >= FlushBytes) {
+        flushBuffer();
+    }
+}
+
+void TraceRecorder::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return;
+    }
+    flushBuffer();
+    m_file.flush();
+}
+
+void TraceRecorder::flushBuffer()
+{
+    if (m_buffer.isEmpty()) {
+        return;
+    }
+    if (m_file.write(m_buffer) != m_buffer.size()) {
+        m_lastError = "Trace write failed: " + m_file.errorString();
+        qWarning() << "❌" << m_lastError;
+    }
+    m_buffer.clear();
+}
+
+TraceSpan::TraceSpan(TraceRecorder* recorder, const TraceEvent& event)
+{
+    if (!recorder || !recorder->isOpen()) {
+        return;
+    }
+
+    m_outermost = spanDepth == 0;
+    ++spanDepth;
+    m_recorder = recorder;
+    if (m_outermost) {
+        m_event = event;
+        m_event.startUs = recorder->elapsedUs();
+    }
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (!m_recorder) {
+        return;
+    }
+
+    --spanDepth;
+    if (m_outermost) {
+        m_event.durationUs = m_recorder->elapsedUs() - m_event.startUs;
+        m_recorder->write(m_event);
+    }
+}
+
+bool TraceReader::open(const QString& filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_lastError = "Cannot open trace " + filePath + ": " + file.errorString();
+        return false;
+    }
+
+    m_data = file.readAll();
+    m_pos = 0;
+    m_lastStartUs = 0;
+    if (m_data.size() < 5 || !m_data.startsWith(QByteArray(TraceMagic, 4))) {
+        m_lastError = filePath + " is not an operation trace";
+        return false;
+    }
+    if (quint8(m_data.at(4)) != TraceFormatVersion) {
+        m_lastError = QString("Unsupported trace format version %1").arg(quint8(m_data.at(4)));
+        return false;
+    }
+
+    m_pos = 5;
+    if (!readSigned(m_startedAtMs)) {
+        m_lastError = "Truncated trace header";
+        return false;
+    }
+
+    m_lastError.clear();
+    return true;
+}
+
+bool TraceReader::readVarint(quint64& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (m_pos >= m_data.size()) {
+            return false;
+        }
+        const quint8 byte = quint8(m_data.at(m_pos++));
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceReader::readSigned(qint64& value)
+{
+    quint64 raw = 0;
+    if (!readVarint(raw)) {
+        return false;
+    }
+    value = qint64(raw >> 1) ^ -qint64(raw & 1);
+    return true;
+}
+
+bool TraceReader::next(TraceEvent& event)
+{
+    if (atEnd()) {
+        return false;
+    }
+
+    // Оборванный хвост (процесс завершился аварийно) - конец трассы
+    auto truncated = [this]() {
+        m_lastError = QString("Truncated trace event at byte %1").arg(m_pos);
+        m_pos = m_data.size();
+        return false;
+    };
+
+    const quint8 head = quint8(m_data.at(m_pos++));
+    if (!isKnownKind(head & 0x7f)) {
+        m_lastError = QString("Unknown trace event %1 at byte %2").arg(head & 0x7f).arg(m_pos - 1);
+        m_pos = m_data.size();
+        return false;
+    }
+    event = TraceEvent(TraceEvent::Kind(head & 0x7f));
+    event.ok = (head & 0x80) != 0;
+
+    qint64 delta = 0;
+    quint64 duration = 0;
+    if (!readSigned(delta) || !readVarint(duration)) {
+        return truncated();
+    }
+    event.startUs = m_lastStartUs + delta;
+    event.durationUs = qint64(duration);
+    m_lastStartUs = event.startUs;
+
+    qint64 productId = 0;
+    qint64 amount = 0;
+    if (hasStockFields(event.kind)) {
+        if (m_pos >= m_data.size()) {
+            return truncated();
+        }
+        event.type = StockOperation::Type(quint8(m_data.at(m_pos++)));
+        if (!readSigned(productId) || !readSigned(amount)) {
+            return truncated();
+        }
+        event.productId = int(productId);
+        event.amount = int(amount);
+    }
+    if (hasLotFields(event.kind)) {
+        qint64 julianDay = 0;
+        if (!readSigned(productId) || !readSigned(amount) || !readSigned(event.value) || !readSigned(julianDay)) {
+            return truncated();
+        }
+        event.productId = int(productId);
+        event.amount = int(amount);
+        event.expiresOn = julianDay != 0 ? QDate::fromJulianDay(julianDay) : QDate();
+    }
+    if (hasValue(event.kind) && !readSigned(event.value)) {
+        return truncated();
+    }
+    if (event.kind == TraceEvent::Batch) {
+        quint64 count = 0;
+        if (!readVarint(count) || count > quint64(m_data.size() - m_pos)) {
+            return truncated();
+        }
+        event.operations.reserve(int(count));
+        for (quint64 i = 0; i < count; ++i) {
+            if (m_pos >= m_data.size()) {
+                return truncated();
+            }
+            const StockOperation::Type type = StockOperation::Type(quint8(m_data.at(m_pos++)));
+            if (!readSigned(productId) || !readSigned(amount)) {
+                return truncated();
+            }
+            event.operations.append(StockOperation(type, int(productId), int(amount)));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,134 @@
+﻿#ifndef OPERATIONTRACE_H
+#define OPERATIONTRACE_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include "DatabaseManager.h"
+
+// Одно событие трассы: вызов API DatabaseManager или действие на терминале
+// (Q_INVOKABLE FridgeManager). Поля заполняются по виду события.
+struct TraceEvent {
+    enum Kind : quint8 {
+        // DatabaseManager
+        Stock = 1,              // add/remove/set: type, productId, amount
+        Batch = 2,              // applyStockOperations: operations
+        Versioned = 3,          // applyVersioned: type, productId, amount, value = ожидаемая версия
+        GetAllProducts = 4,
+        GetProductsToOrder = 5,
+        ReceiveLot = 6,         // productId, amount, value = цена (-1 без цены), expiresOn
+        SetLocation = 7,        // value = id локации
+        // Терминал
+        UiTap = 16,             // "+"/"-": type, productId, amount
+        UiSelectLocation = 17,  // value = id локации, каталог перечитывается
+        UiExportOrder = 18,     // value - ExportKind
+        UiReceiveLot = 19       // как ReceiveLot
+    };
+
+    enum ExportKind { OrderExport = 0, SupplierExport = 1, ConsolidatedExport = 2 };
+
+    Kind kind = Stock;
+    bool ok = false;
+    qint64 startUs = 0;         // от начала трассы
+    qint64 durationUs = 0;
+    StockOperation::Type type = StockOperation::Add;
+    int productId = 0;
+    int amount = 0;
+    qint64 value = 0;
+    QDate expiresOn;
+    QVector<StockOperation> operations;
+
+    TraceEvent(Kind kind = Stock) : kind(kind) {}
+
+    static TraceEvent stock(Kind kind, StockOperation::Type type, int productId, int amount, qint64 value = 0);
+    static TraceEvent lot(Kind kind, int productId, int amount, const QDate& expiresOn, qint64 unitCost);
+    static QString kindName(Kind kind);
+    bool isUiAction() const { return kind >= UiTap; }
+};
+
+// Запись трассы в компактный двоичный файл: заголовок "FTRC", затем события
+// varint'ами - вид, смещение от предыдущего события и длительность в
+// микросекундах, поля события. Запись идет через буфер в памяти, файл
+// дописывается блоками по FlushBytes или по flush(); потокобезопасна.
+class TraceRecorder
+{
+public:
+    static const int FlushBytes = 64 * 1024;
+    static const int FlushIntervalMs = 2000;   // как часто владелец зовет flush()
+
+    TraceRecorder() = default;
+    ~TraceRecorder();
+
+    bool open(const QString& filePath);
+    void close();
+    bool isOpen() const { return m_file.isOpen(); }
+    qint64 eventCount() const { return m_events; }
+
+    qint64 elapsedUs() const { return m_clock.nsecsElapsed() / 1000; }
+    void write(const TraceEvent& event);
+
+    // Дописать буфер в файл, не дожидаясь FlushBytes: при аварийном
+    // завершении теряется только то, что записано после последнего вызова
+    void flush();
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    void flushBuffer();
+
+    QMutex m_mutex;
+    QFile m_file;
+    QByteArray m_buffer;
+    QElapsedTimer m_clock;
+    qint64 m_lastStartUs = 0;
+    qint64 m_events = 0;
+    QString m_lastError;
+};
+
+// Замер одного вызова. Пишется только внешний вызов: операции базы внутри
+// действия терминала (нажатие "+" -> applyVersioned) в трассу не попадают,
+// при воспроизведении их повторит само действие. Без открытого
+// TraceRecorder ничего не делает.
+class TraceSpan
+{
+public:
+    TraceSpan(TraceRecorder* recorder, const TraceEvent& event);
+    ~TraceSpan();
+
+    // Результат вызова; если не задан - событие записывается как ошибка
+    bool done(bool ok) { m_event.ok = ok; return ok; }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    TraceRecorder* m_recorder = nullptr;
+    TraceEvent m_event;
+    bool m_outermost = false;
+};
+
+// Чтение трассы целиком в память
+class TraceReader
+{
+public:
+    bool open(const QString& filePath);
+    bool next(TraceEvent& event);
+    bool atEnd() const { return m_pos >= m_data.size(); }
+
+    qint64 startedAtMs() const { return m_startedAtMs; }
+    QString getLastError() const { return m_lastError; }
+
+private:
+    bool readVarint(quint64& value);
+    bool readSigned(qint64& value);
+
+    QByteArray m_data;
+    int m_pos = 0;
+    qint64 m_startedAtMs = 0;
+    qint64 m_lastStartUs = 0;
+    QString m_lastError;
+};
+
+#endif // OPERATIONTRACE_H
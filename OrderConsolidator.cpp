@@ -0,0 +1,106 @@
+﻿#include "OrderConsolidator.h"
+#include "ProductStore.h"
+#include <QDebug>
+#include <QHash>
+#include <QSqlError>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <functional>
+
+ConsolidatedOrder OrderConsolidator::fromDatabase(const ConnectionSettings& settings,
+    const QVector<LocationInfo>& locations, int counterShards)
+{
+    // Qt5 blockingMapped берет тип результата из result_type - лямбда в std::function
+    const std::function<LocationOrder(const LocationInfo&)> loadLocation =
+        [settings, counterShards](const LocationInfo& location) {
+            LocationOrder order;
+            order.locationId = location.id;
+
+            // Только запрос заявки: без DatabaseManager с его миграциями,
+            // журналом, загрузкой партий и таймерами
+            const QString connectionName = QString("fridge_order_%1_%2")
+                .arg(location.id).arg(quintptr(QThread::currentThreadId()), 0, 16);
+            {
+                QSqlDatabase db = DatabaseManager::addConnection(settings, connectionName);
+                QSqlError error;
+                if (!db.open()) {
+                    order.error = location.name + ": " + db.lastError().text();
+                }
+                else if (!DatabaseManager::queryProductsToOrder(db, location.id, counterShards,
+                             order.products, nullptr, error)) {
+                    order.error = location.name + ": " + error.text();
+                }
+                db.close();
+            }
+            QSqlDatabase::removeDatabase(connectionName);
+            return order;
+        };
+    const QVector<LocationOrder> orders = QtConcurrent::blockingMapped<QVector<LocationOrder>>(locations, loadLocation);
+
+    return merge(locations, orders);
+}
+
+ConsolidatedOrder OrderConsolidator::fromProducts(const QVector<ProductData>& products,
+    const QVector<LocationInfo>& locations)
+{
+    const std::function<LocationOrder(const LocationInfo&)> filterLocation =
+        [&products](const LocationInfo& location) {
+            LocationOrder order;
+            order.locationId = location.id;
+            for (const ProductData& product : products) {
+                if (product.locationId == location.id && ProductStore::needsOrder(product)) {
+                    order.products.append(product);
+                }
+            }
+            return order;
+        };
+    const QVector<LocationOrder> orders = QtConcurrent::blockingMapped<QVector<LocationOrder>>(locations, filterLocation);
+
+    return merge(locations, orders);
+}
+
+ConsolidatedOrder OrderConsolidator::merge(const QVector<LocationInfo>& locations, const QVector<LocationOrder>& orders)
+{
+    ConsolidatedOrder result;
+    result.locations = locations;
+
+    // Один и тот же продукт в разных локациях - разные строки products,
+    // поэтому позиции сводятся по названию
+    QHash<QString, int> lineByName;
+    for (const LocationOrder& order : orders) {
+        if (!order.error.isEmpty()) {
+            result.errors.append(order.error);
+            qWarning() << "⚠️ Location order failed:" << order.error;
+        }
+
+        for (const ProductData& product : order.products) {
+            const int quantity = ProductStore::orderQuantity(product);
+            if (quantity <= 0) {
+                continue;
+            }
+
+            const QString key = product.name.toCaseFolded();
+            auto it = lineByName.constFind(key);
+            if (it == lineByName.cend()) {
+                it = lineByName.insert(key, result.lines.size());
+                ConsolidatedLine line;
+                line.productName = product.name;
+                result.lines.append(line);
+            }
+
+            ConsolidatedLine& line = result.lines[it.value()];
+            line.totalQuantity += quantity;
+            line.perLocation.append(qMakePair(order.locationId, quantity));
+            result.totalPacks += quantity;
+        }
+    }
+
+    std::sort(result.lines.begin(), result.lines.end(), [](const ConsolidatedLine& a, const ConsolidatedLine& b) {
+        return QString::compare(a.productName, b.productName, Qt::CaseInsensitive) < 0;
+    });
+
+    qDebug() << "🧾 Consolidated order:" << result.lines.size() << "products from"
+        << locations.size() << "locations," << result.totalPacks << "packs";
+    return result;
+}
@@ -0,0 +1,51 @@
+﻿#ifndef ORDERCONSOLIDATOR_H
+#define ORDERCONSOLIDATOR_H
+
+#include <QPair>
+#include <QStringList>
+#include <QVector>
+#include "DatabaseManager.h"
+
+// Позиция сводной заявки: один продукт по всем локациям
+struct ConsolidatedLine {
+    QString productName;
+    int totalQuantity = 0;
+    QVector<QPair<int, int>> perLocation;   // (id локации, количество)
+};
+
+struct ConsolidatedOrder {
+    QVector<LocationInfo> locations;
+    QVector<ConsolidatedLine> lines;        // по названию продукта
+    qint64 totalPacks = 0;
+    QStringList errors;                     // локации, по которым заявка не посчитана
+};
+
+// Сводная заявка по нескольким локациям.
+//
+// Заявка каждой локации считается в пуле потоков (QThreadPool) независимо,
+// затем позиции с одинаковым названием складываются, а разбивка по
+// локациям сохраняется для раскладки поставки.
+class OrderConsolidator
+{
+public:
+    // Из базы: у каждой локации свое легкое подключение с теми же
+    // параметрами, только запрос заявки. Схему должно подготовить основное
+    // подключение (DatabaseManager::connectToDatabase)
+    static ConsolidatedOrder fromDatabase(const ConnectionSettings& settings,
+        const QVector<LocationInfo>& locations, int counterShards = 0);
+
+    // Из памяти: продукты уже загружены со всех локаций
+    static ConsolidatedOrder fromProducts(const QVector<ProductData>& products,
+        const QVector<LocationInfo>& locations);
+
+    // Заявка одной локации, уже посчитанная
+    struct LocationOrder {
+        int locationId = 0;
+        QVector<ProductData> products;      // только ниже нормы
+        QString error;
+    };
+
+    static ConsolidatedOrder merge(const QVector<LocationInfo>& locations, const QVector<LocationOrder>& orders);
+};
+
+#endif // ORDERCONSOLIDATOR_H
@@ -0,0 +1,436 @@
+﻿#include "OrderExporter.h"
+#include "Money.h"
+#include "OrderConsolidator.h"
+#include "ProductStore.h"
+#include "SupplierCatalog.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <algorithm>
+#include <numeric>
+
+OrderExporter::OrderExporter()
+    : m_restaurantName("Gourmet")
+{
+}
+
+bool OrderExporter::saveOrderToFile(const QString& filePath, const QVector<ProductData>& products)
+{
+    return writeFile(filePath, [this, &products](QTextStream& stream) { writeOrder(stream, products); });
+}
+
+bool OrderExporter::saveOrderToFile(const QString& filePath, const ProductStore& store)
+{
+    return writeFile(filePath, [this, &store](QTextStream& stream) { writeOrder(stream, store); });
+}
+
+bool OrderExporter::saveConsolidatedOrderToFile(const QString& filePath, const ConsolidatedOrder& order)
+{
+    return writeFile(filePath, [this, &order](QTextStream& stream) { writeConsolidatedOrder(stream, order); });
+}
+
+bool OrderExporter::writeFile(const QString& filePath, const std::function<void(QTextStream&)>& write)
+{
+    return writeTextFile(filePath, write, m_lastError);
+}
+
+bool OrderExporter::writeTextFile(const QString& filePath, const std::function<void(QTextStream&)>& write, QString& error)
+{
+    QFileInfo fileInfo(filePath);
+    QDir dir = fileInfo.dir();
+    if (!dir.exists()) {
+        if (!dir.mkpath(".")) {
+            error = "Cannot create directory " + dir.absolutePath();
+            return false;
+        }
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        error = "Cannot create file " + filePath;
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    write(stream);
+    stream.flush();
+    file.close();
+
+    if (file.error() != QFileDevice::NoError || QFileInfo(filePath).size() == 0) {
+        error = "File created but empty";
+        return false;
+    }
+
+    qDebug() << "File saved:" << filePath;
+    return true;
+}
+
+bool OrderExporter::saveSupplierOrders(const QString& directoryPath, const QVector<ProductData>& products,
+    QStringList* files)
+{
+    QVector<OrderLine> lines = m_forecaster ? forecastLines(products) : normLines(products);
+    roundToSupplierTerms(products, lines);
+    return saveSupplierOrders(directoryPath, products, lines, files);
+}
+
+bool OrderExporter::saveSupplierOrders(const QString& directoryPath, const ProductStore& store, QStringList* files)
+{
+    return saveSupplierOrders(directoryPath, store.products(), storeLines(store), files);
+}
+
+bool OrderExporter::saveSupplierOrders(const QString& directoryPath, const QVector<ProductData>& products,
+    const QVector<OrderLine>& lines, QStringList* files)
+{
+    const QVector<SupplierOrder> orders = groupBySupplier(products, lines);
+
+    // Имена файлов заранее: разные поставщики могут дать одинаковое имя
+    QStringList paths;
+    for (const SupplierOrder& order : orders) {
+        QString path = supplierOrderFileName(directoryPath, order.supplier);
+        for (int copy = 2; paths.contains(path); ++copy) {
+            path = supplierOrderFileName(directoryPath, order.supplier + QString("_%1").arg(copy));
+        }
+        paths.append(path);
+    }
+
+    // Файлы независимы - пишем их в пуле потоков. blockingMapped в Qt5
+    // берет тип результата из result_type, поэтому лямбда - в std::function
+    QVector<int> indexes(orders.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    const std::function<QString(int)> writeOne = [this, &products, &orders, &paths](int index) {
+        QString error;
+        writeTextFile(paths.at(index), [this, &products, &orders, index](QTextStream& stream) {
+            writeSupplierOrder(stream, products, orders.at(index));
+        }, error);
+        return error;
+    };
+    const QVector<QString> errors = QtConcurrent::blockingMapped<QVector<QString>>(indexes, writeOne);
+
+    if (files) {
+        files->clear();
+    }
+
+    QStringList failed;
+    for (int i = 0; i < orders.size(); ++i) {
+        if (errors.at(i).isEmpty()) {
+            if (files) {
+                files->append(paths.at(i));
+            }
+        }
+        else {
+            failed.append(errors.at(i));
+        }
+    }
+
+    if (!failed.isEmpty()) {
+        m_lastError = failed.join("; ");
+        return false;
+    }
+
+    qDebug() << "🚚 Supplier orders saved:" << orders.size() << "files";
+    return true;
+}
+
+void OrderExporter::writeOrder(QTextStream& stream, const QVector<ProductData>& products) const
+{
+    QVector<OrderLine> lines = m_forecaster ? forecastLines(products) : normLines(products);
+    roundToSupplierTerms(products, lines);
+    writeLines(stream, products, lines, m_stockValue, linesCost(products, lines));
+}
+
+void OrderExporter::writeOrder(QTextStream& stream, const ProductStore& store) const
+{
+    qint64 normPacks = 0;
+    const QVector<OrderLine> lines = storeLines(store, &normPacks);
+
+    // Без прогноза и фасовки заявка - это "норма - остаток": ее стоимость
+    // хранилище уже держит, число упаковок посчитал ReorderScan; иначе
+    // суммируются позиции заявки
+    const bool plainNorm = !m_forecaster && (!m_catalog || m_catalog->isEmpty());
+    writeLines(stream, store.products(), lines, store.stockValue(),
+        plainNorm ? store.orderCost() : linesCost(store.products(), lines), plainNorm ? normPacks : -1);
+}
+
+qint64 OrderExporter::linesCost(const QVector<ProductData>& products, const QVector<OrderLine>& lines)
+{
+    qint64 cost = 0;
+    for (const OrderLine& line : lines) {
+        cost += qint64(line.suggestion.quantity) * products.at(line.row).unitCost;
+    }
+    return cost;
+}
+
+QVector<OrderExporter::OrderLine> OrderExporter::storeLines(const ProductStore& store, qint64* normPacks) const
+{
+    const ReorderScan::Result scan = store.scanBelowNorm();
+    if (normPacks) {
+        *normPacks = scan.totalPacks;
+    }
+
+    QVector<OrderLine> lines;
+    if (m_forecaster) {
+        // Без оценки расхода прогноз совпадает с "норма - остаток", поэтому
+        // кроме строк ниже нормы проверяются только продукты с оценкой -
+        // результат тот же, что у прохода по всему каталогу
+        QVector<int> rows = scan.rows;
+        for (int productId : m_forecaster->trackedProducts()) {
+            const int row = store.rowForId(productId);
+            if (row >= 0) {
+                rows.append(row);
+            }
+        }
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+        const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+        lines.reserve(rows.size());
+        for (int row : rows) {
+            const ProductData& product = store.at(row);
+            const ConsumptionForecaster::Suggestion suggestion =
+                m_forecaster->suggest(product.id, product.currentQuantity, product.normQuantity, nowMs);
+            if (suggestion.quantity > 0) {
+                lines.append({ row, suggestion });
+            }
+        }
+    }
+    else {
+        lines.reserve(scan.rows.size());
+        for (int row : scan.rows) {
+            ConsumptionForecaster::Suggestion suggestion;
+            suggestion.quantity = ProductStore::orderQuantity(store.at(row));
+            lines.append({ row, suggestion });
+        }
+    }
+
+    roundToSupplierTerms(store.products(), lines);
+    return lines;
+}
+
+void OrderExporter::roundToSupplierTerms(const QVector<ProductData>& products, QVector<OrderLine>& lines) const
+{
+    if (!m_catalog || m_catalog->isEmpty()) {
+        return;
+    }
+
+    for (OrderLine& line : lines) {
+        line.suggestion.quantity = m_catalog->roundQuantity(products.at(line.row).id, line.suggestion.quantity);
+    }
+}
+
+QVector<OrderExporter::SupplierOrder> OrderExporter::groupBySupplier(const QVector<ProductData>& products,
+    const QVector<OrderLine>& lines) const
+{
+    QVector<SupplierOrder> orders;
+    QHash<QString, int> orderBySupplier;
+    for (const OrderLine& line : lines) {
+        const QString supplier = m_catalog ? m_catalog->terms(products.at(line.row).id).supplier : QString();
+        auto it = orderBySupplier.constFind(supplier);
+        if (it == orderBySupplier.cend()) {
+            it = orderBySupplier.insert(supplier, orders.size());
+            orders.append({ supplier, {} });
+        }
+        orders[it.value()].lines.append(line);
+    }
+
+    // По имени поставщика, позиции без поставщика - в конце
+    std::sort(orders.begin(), orders.end(), [](const SupplierOrder& a, const SupplierOrder& b) {
+        if (a.supplier.isEmpty() != b.supplier.isEmpty()) {
+            return b.supplier.isEmpty();
+        }
+        return QString::compare(a.supplier, b.supplier, Qt::CaseInsensitive) < 0;
+    });
+    return orders;
+}
+
+void OrderExporter::writeSupplierOrder(QTextStream& stream, const QVector<ProductData>& products,
+    const SupplierOrder& order) const
+{
+    writeHeader(stream, "SUPPLIER ORDER", m_restaurantName);
+    stream << "Supplier: " << (order.supplier.isEmpty() ? QString("(not assigned)") : order.supplier) << "\n\n";
+
+    stream << "PRODUCTS TO ORDER:\n";
+    stream << "-----------------------------------------\n";
+
+    qint64 totalPacks = 0;
+    for (const OrderLine& line : order.lines) {
+        const ProductData& product = products.at(line.row);
+        stream << "- " << product.name << ": " << line.suggestion.quantity << " packs";
+
+        const SupplierCatalog::Terms terms = m_catalog ? m_catalog->terms(product.id) : SupplierCatalog::Terms();
+        if (terms.packSize > 1 || terms.minOrder > 0) {
+            stream << " (pack " << terms.packSize << ", min " << terms.minOrder << ")";
+        }
+        stream << "\n";
+        totalPacks += line.suggestion.quantity;
+    }
+
+    stream << "\n-----------------------------------------\n";
+    stream << "TOTAL TO ORDER: " << totalPacks << " packs\n";
+}
+
+QVector<OrderExporter::OrderLine> OrderExporter::forecastLines(const QVector<ProductData>& products) const
+{
+    const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+    QVector<OrderLine> lines;
+    for (int row = 0; row < products.size(); ++row) {
+        const ProductData& product = products.at(row);
+        const ConsumptionForecaster::Suggestion suggestion =
+            m_forecaster->suggest(product.id, product.currentQuantity, product.normQuantity, nowMs);
+        if (suggestion.quantity > 0) {
+            lines.append({ row, suggestion });
+        }
+    }
+    return lines;
+}
+
+QVector<OrderExporter::OrderLine> OrderExporter::normLines(const QVector<ProductData>& products) const
+{
+    QVector<OrderLine> lines;
+    for (int row = 0; row < products.size(); ++row) {
+        if (ProductStore::needsOrder(products.at(row))) {
+            ConsumptionForecaster::Suggestion suggestion;
+            suggestion.quantity = ProductStore::orderQuantity(products.at(row));
+            lines.append({ row, suggestion });
+        }
+    }
+    return lines;
+}
+
+void OrderExporter::writeHeader(QTextStream& stream, const QString& title, const QString& restaurant,
+    qint64 stockValue, qint64 orderCost) const
+{
+    stream << "=========================================\n";
+    stream << "           " << title << "\n";
+    stream << "=========================================\n";
+    stream << "Restaurant: '" << restaurant << "'\n";
+    stream << "Date: " << QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm") << "\n";
+    stream << "DB Status: " << (m_databaseConnected ? "Connected" : "Local mode") << "\n";
+    if (stockValue >= 0) {
+        stream << "Stock value: " << Money::format(stockValue) << " RUB\n";
+    }
+    if (orderCost >= 0) {
+        stream << "Order cost: " << Money::format(orderCost) << " RUB\n";
+    }
+    stream << "=========================================\n\n";
+}
+
+void OrderExporter::writeLines(QTextStream& stream, const QVector<ProductData>& products,
+    const QVector<OrderLine>& lines, qint64 stockValue, qint64 orderCost, qint64 totalPacks) const
+{
+    writeHeader(stream, "SUPPLIER ORDER", m_restaurantName, stockValue, orderCost);
+
+    // totalPacks < 0 - итог не посчитан заранее, складываем по строкам
+    const bool sumLines = totalPacks < 0;
+    if (sumLines) {
+        totalPacks = 0;
+    }
+
+    stream << "PRODUCTS TO ORDER:\n";
+    stream << "-----------------------------------------\n";
+
+    for (const OrderLine& line : lines) {
+        stream << "- " << products.at(line.row).name << ": " << line.suggestion.quantity << " packs";
+        if (line.suggestion.fromForecast) {
+            stream << " (forecast " << QString::number(line.suggestion.dailyRate, 'f', 1) << "/day)";
+        }
+        stream << "\n";
+        if (sumLines) {
+            totalPacks += line.suggestion.quantity;
+        }
+    }
+
+    if (lines.isEmpty()) {
+        stream << "All products are in sufficient quantity.\n";
+    }
+    else {
+        stream << "\n-----------------------------------------\n";
+        stream << "TOTAL TO ORDER: " << totalPacks << " packs\n";
+    }
+
+    // Current stock
+    stream << "\n=========================================\n";
+    stream << "           CURRENT STOCK\n";
+    stream << "=========================================\n";
+
+    // Позиции заявки идут по возрастанию строки - сливаем со списком за один проход
+    int next = 0;
+    for (int row = 0; row < products.size(); ++row) {
+        const ProductData& product = products.at(row);
+        stream << "- " << product.name << ": " << product.currentQuantity
+            << " / " << product.normQuantity << " packs";
+        if (next < lines.size() && lines.at(next).row == row) {
+            stream << " (NEED " << lines.at(next).suggestion.quantity << ")";
+            ++next;
+        }
+        stream << "\n";
+    }
+}
+
+void OrderExporter::writeConsolidatedOrder(QTextStream& stream, const ConsolidatedOrder& order) const
+{
+    QStringList restaurants;
+    QHash<int, QString> locationNames;
+    for (const LocationInfo& location : order.locations) {
+        if (!location.restaurant.isEmpty() && !restaurants.contains(location.restaurant)) {
+            restaurants.append(location.restaurant);
+        }
+        locationNames.insert(location.id, location.name);
+    }
+    writeHeader(stream, "CONSOLIDATED SUPPLIER ORDER",
+        restaurants.isEmpty() ? m_restaurantName : restaurants.join("', '"));
+
+    stream << "LOCATIONS:\n";
+    for (const LocationInfo& location : order.locations) {
+        stream << "- " << location.name << "\n";
+    }
+    for (const QString& error : order.errors) {
+        stream << "! NOT INCLUDED: " << error << "\n";
+    }
+
+    stream << "\nPRODUCTS TO ORDER:\n";
+    stream << "-----------------------------------------\n";
+
+    for (const ConsolidatedLine& line : order.lines) {
+        stream << "- " << line.productName << ": " << line.totalQuantity << " packs\n";
+        for (const auto& part : line.perLocation) {
+            stream << "    " << locationNames.value(part.first, QString::number(part.first))
+                << ": " << part.second << "\n";
+        }
+    }
+
+    if (order.lines.isEmpty()) {
+        stream << "All products are in sufficient quantity.\n";
+    }
+    else {
+        stream << "\n-----------------------------------------\n";
+        stream << "TOTAL TO ORDER: " << order.totalPacks << " packs\n";
+    }
+}
+
+QString OrderExporter::orderFileName(const QString& directoryPath)
+{
+    return directoryPath + "/заявка_поставщику_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss") + ".txt";
+}
+
+QString OrderExporter::supplierOrderFileName(const QString& directoryPath, const QString& supplier)
+{
+    // В имени файла только буквы, цифры и '_'
+    QString name = supplier.isEmpty() ? QString("без_поставщика") : supplier;
+    for (QChar& ch : name) {
+        if (!ch.isLetterOrNumber()) {
+            ch = '_';
+        }
+    }
+    return directoryPath + "/заявка_" + name + "_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss") + ".txt";
+}
+
+QString OrderExporter::getLastError() const
+{
+    return m_lastError;
+}
@@ -0,0 +1,99 @@
+﻿#ifndef ORDEREXPORTER_H
+#define ORDEREXPORTER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+#include "DatabaseManager.h"
+
+struct ConsolidatedOrder;
+class ProductStore;
+class SupplierCatalog;
+class QTextStream;
+
+// Текстовая заявка поставщику (формат заявка_поставщику_*.txt)
+class OrderExporter
+{
+public:
+    OrderExporter();
+
+    void setRestaurantName(const QString& name) { m_restaurantName = name; }
+    void setDatabaseConnected(bool connected) { m_databaseConnected = connected; }
+
+    // С прогнозом количество считается по расходу и сроку поставки,
+    // без него (или пока истории мало) - как "норма - остаток"
+    void setForecaster(const ConsumptionForecaster* forecaster) { m_forecaster = forecaster; }
+
+    // С каталогом количество округляется до минимального заказа и фасовки
+    // поставщика, а заявку можно разбить по поставщикам
+    void setSupplierCatalog(const SupplierCatalog* catalog) { m_catalog = catalog; }
+
+    // Стоимость остатков в копейках для заголовка заявки по списку продуктов
+    // (-1 - не печатать). Заявка по хранилищу берет ее из ProductStore.
+    void setStockValue(qint64 kopecks) { m_stockValue = kopecks; }
+
+    // Запись заявки и текущих остатков в файл
+    bool saveOrderToFile(const QString& filePath, const QVector<ProductData>& products);
+    void writeOrder(QTextStream& stream, const QVector<ProductData>& products) const;
+
+    // То же по хранилищу: строки ниже нормы находит векторный проход по
+    // массивам остатков (ReorderScan); прогноз проверяет только их и
+    // продукты, по которым есть оценка расхода
+    bool saveOrderToFile(const QString& filePath, const ProductStore& store);
+    void writeOrder(QTextStream& stream, const ProductStore& store) const;
+
+    // Отдельный файл на каждого поставщика в папке directoryPath. Позиции
+    // группируются за один проход, файлы пишутся параллельно.
+    bool saveSupplierOrders(const QString& directoryPath, const QVector<ProductData>& products,
+        QStringList* files = nullptr);
+    bool saveSupplierOrders(const QString& directoryPath, const ProductStore& store, QStringList* files = nullptr);
+
+    // Сводная заявка по нескольким локациям с разбивкой по каждой
+    bool saveConsolidatedOrderToFile(const QString& filePath, const ConsolidatedOrder& order);
+    void writeConsolidatedOrder(QTextStream& stream, const ConsolidatedOrder& order) const;
+
+    // Имя файла заявки с текущей датой в указанной папке
+    static QString orderFileName(const QString& directoryPath);
+    static QString supplierOrderFileName(const QString& directoryPath, const QString& supplier);
+
+    QString getLastError() const;
+
+private:
+    // Одна позиция заявки: строка в списке продуктов и количество
+    struct OrderLine {
+        int row;
+        ConsumptionForecaster::Suggestion suggestion;
+    };
+
+    // Заявка поставщику: его позиции из общего списка
+    struct SupplierOrder {
+        QString supplier;
+        QVector<OrderLine> lines;
+    };
+
+    QVector<OrderLine> forecastLines(const QVector<ProductData>& products) const;
+    QVector<OrderLine> normLines(const QVector<ProductData>& products) const;
+    QVector<OrderLine> storeLines(const ProductStore& store, qint64* normPacks = nullptr) const;
+    void roundToSupplierTerms(const QVector<ProductData>& products, QVector<OrderLine>& lines) const;
+    QVector<SupplierOrder> groupBySupplier(const QVector<ProductData>& products, const QVector<OrderLine>& lines) const;
+    bool saveSupplierOrders(const QString& directoryPath, const QVector<ProductData>& products,
+        const QVector<OrderLine>& lines, QStringList* files);
+    void writeSupplierOrder(QTextStream& stream, const QVector<ProductData>& products, const SupplierOrder& order) const;
+    void writeHeader(QTextStream& stream, const QString& title, const QString& restaurant,
+        qint64 stockValue = -1, qint64 orderCost = -1) const;
+    void writeLines(QTextStream& stream, const QVector<ProductData>& products, const QVector<OrderLine>& lines,
+        qint64 stockValue, qint64 orderCost, qint64 totalPacks = -1) const;
+    static qint64 linesCost(const QVector<ProductData>& products, const QVector<OrderLine>& lines);
+    bool writeFile(const QString& filePath, const std::function<void(QTextStream&)>& write);
+    static bool writeTextFile(const QString& filePath, const std::function<void(QTextStream&)>& write, QString& error);
+
+    const ConsumptionForecaster* m_forecaster = nullptr;
+    const SupplierCatalog* m_catalog = nullptr;
+    QString m_restaurantName;
+    bool m_databaseConnected = false;
+    qint64 m_stockValue = -1;
+    QString m_lastError;
+};
+
+#endif // ORDEREXPORTER_H
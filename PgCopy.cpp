@@ -0,0 +1,203 @@
+﻿#include "PgCopy.h"
+#include <QDebug>
+#include <QSqlDriver>
+#include <QVariant>
+#include <libpq-fe.h>
+
+namespace {
+
+PGconn* connectionOf(const QSqlDatabase& db)
+{
+    if (db.driverName() != "QPSQL" || !db.isOpen()) {
+        return nullptr;
+    }
+    const QVariant handle = db.driver()->handle();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "PGconn*") != 0) {
+        return nullptr;
+    }
+    return *static_cast<PGconn* const*>(handle.constData());
+}
+
+QString connectionError(PGconn* conn)
+{
+    return QString::fromUtf8(PQerrorMessage(conn)).trimmed();
+}
+
+} // namespace
+
+PgCopy::PgCopy(const QSqlDatabase& db)
+    : m_conn(connectionOf(db))
+{
+}
+
+PgCopy::~PgCopy()
+{
+    if (m_active) {
+        abort("copy abandoned");
+    }
+}
+
+bool PgCopy::isSupported(const QSqlDatabase& db)
+{
+    return connectionOf(db) != nullptr;
+}
+
+bool PgCopy::begin(const QString& sql)
+{
+    if (!m_conn) {
+        m_lastError = "COPY needs an open QPSQL connection";
+        return false;
+    }
+
+    PGresult* result = PQexec(m_conn, sql.toUtf8().constData());
+    const bool started = PQresultStatus(result) == PGRES_COPY_IN;
+    if (!started) {
+        m_lastError = QString::fromUtf8(PQresultErrorMessage(result)).trimmed();
+    }
+    PQclear(result);
+    m_active = started;
+    m_out = false;
+    return started;
+}
+
+bool PgCopy::beginOut(const QString& sql)
+{
+    if (!m_conn) {
+        m_lastError = "COPY needs an open QPSQL connection";
+        return false;
+    }
+
+    PGresult* result = PQexec(m_conn, sql.toUtf8().constData());
+    const bool started = PQresultStatus(result) == PGRES_COPY_OUT;
+    if (!started) {
+        m_lastError = QString::fromUtf8(PQresultErrorMessage(result)).trimmed();
+    }
+    PQclear(result);
+    m_active = started;
+    m_out = true;
+    return started;
+}
+
+bool PgCopy::read(QByteArray& data)
+{
+    data.clear();
+    if (!m_active || !m_out) {
+        return false;
+    }
+
+    char* buffer = nullptr;
+    const int size = PQgetCopyData(m_conn, &buffer, 0);
+    if (size > 0) {
+        data = QByteArray(buffer, size);
+        PQfreemem(buffer);
+        return true;
+    }
+
+    // -1 - поток закончен, -2 - ошибка; итог команды - в PQgetResult
+    m_active = false;
+    m_lastError.clear();
+    const QString streamError = size == -2 ? connectionError(m_conn) : QString();
+    finishResults(nullptr);
+    if (m_lastError.isEmpty()) {
+        m_lastError = streamError;
+    }
+    return false;
+}
+
+bool PgCopy::write(const QByteArray& data)
+{
+    if (!m_active) {
+        m_lastError = "COPY is not active";
+        return false;
+    }
+    if (data.isEmpty()) {
+        return true;
+    }
+    if (PQputCopyData(m_conn, data.constData(), data.size()) != 1) {
+        m_lastError = connectionError(m_conn);
+        return false;
+    }
+    return true;
+}
+
+bool PgCopy::finish(qint64* rows)
+{
+    if (!m_active) {
+        m_lastError = "COPY is not active";
+        return false;
+    }
+    m_active = false;
+    if (PQputCopyEnd(m_conn, nullptr) != 1) {
+        m_lastError = connectionError(m_conn);
+        return false;
+    }
+    return finishResults(rows);
+}
+
+bool PgCopy::finishResults(qint64* rows)
+{
+    bool ok = true;
+    while (PGresult* result = PQgetResult(m_conn)) {
+        if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+            m_lastError = QString::fromUtf8(PQresultErrorMessage(result)).trimmed();
+            ok = false;
+        }
+        else if (rows) {
+            *rows = QByteArray(PQcmdTuples(result)).toLongLong();
+        }
+        PQclear(result);
+    }
+    return ok;
+}
+
+void PgCopy::abort(const QString& reason)
+{
+    if (!m_active) {
+        return;
+    }
+    m_active = false;
+    if (m_out) {
+        // Выгрузку прервать нельзя, оставшиеся строки дочитываются впустую
+        char* buffer = nullptr;
+        while (PQgetCopyData(m_conn, &buffer, 0) > 0) {
+            PQfreemem(buffer);
+        }
+    }
+    else {
+        PQputCopyEnd(m_conn, reason.toUtf8().constData());
+    }
+    while (PGresult* result = PQgetResult(m_conn)) {
+        PQclear(result);
+    }
+    qWarning() << "⚠️ COPY aborted:" << reason;
+}
+
+void PgCopy::appendText(QByteArray& row, const QString& value)
+{
+    const QByteArray utf8 = value.toUtf8();
+    row.reserve(row.size() + utf8.size());
+    for (char c : utf8) {
+        switch (c) {
+        case '\\': row.append("\\\\"); break;
+        case '\t': row.append("\\t"); break;
+        case '\n': row.append("\\n"); break;
+        case '\r': row.append("\\r"); break;
+        default: row.append(c); break;
+        }
+    }
+}
+
+QByteArray PgCopy::binaryHeader()
+{
+    static const char header[BinaryHeaderSize] = {
+        'P', 'G', 'C', 'O', 'P', 'Y', '\n', '\xff', '\r', '\n', '\0',
+        0, 0, 0, 0,     // флаги
+        0, 0, 0, 0      // длина расширения заголовка
+    };
+    return QByteArray(header, BinaryHeaderSize);
+}
+
+QByteArray PgCopy::binaryTrailer()
+{
+    return QByteArray("\xff\xff", 2);
+}
@@ -0,0 +1,60 @@
+﻿#ifndef PGCOPY_H
+#define PGCOPY_H
+
+#include <QByteArray>
+#include <QSqlDatabase>
+#include <QString>
+
+typedef struct pg_conn PGconn;
+
+// COPY ... FROM STDIN и COPY ... TO STDOUT через libpq соединения QPSQL.
+//
+// QSqlQuery не передает данные COPY, поэтому поток идет напрямую в PGconn,
+// взятый у драйвера. Соединение то же, что у QSqlDatabase, так что COPY
+// выполняется в ее текущей транзакции (например, во временную таблицу
+// ON COMMIT DROP).
+class PgCopy
+{
+public:
+    explicit PgCopy(const QSqlDatabase& db);
+    ~PgCopy();
+
+    static bool isSupported(const QSqlDatabase& db);
+
+    // FROM STDIN: begin, любое число write, затем finish; abort отменяет COPY
+    bool begin(const QString& sql);
+    bool write(const QByteArray& data);
+    bool finish(qint64* rows = nullptr);
+    void abort(const QString& reason);
+    bool isActive() const { return m_active; }
+
+    // TO STDOUT: beginOut, затем read до false. Каждый кусок - целые строки
+    // (в двоичном формате первый начинается с заголовка). После false
+    // пустой getLastError() - поток дочитан.
+    bool beginOut(const QString& sql);
+    bool read(QByteArray& data);
+
+    // Значение в текстовом формате COPY: \t, \n, \r и \ экранируются
+    static void appendText(QByteArray& row, const QString& value);
+
+    // Двоичный формат COPY: сигнатура, флаги и расширение заголовка, затем
+    // строки (число полей int16, у каждого поля длина int32 и значение в
+    // сетевом порядке байт; -1 - NULL), в конце int16 -1
+    static QByteArray binaryHeader();
+    static QByteArray binaryTrailer();
+    static const int BinaryHeaderSize = 19;
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    Q_DISABLE_COPY(PgCopy)
+
+    bool finishResults(qint64* rows);
+
+    PGconn* m_conn = nullptr;
+    bool m_active = false;
+    bool m_out = false;
+    QString m_lastError;
+};
+
+#endif // PGCOPY_H
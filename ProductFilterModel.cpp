@@ -0,0 +1,361 @@
+﻿#include "ProductFilterModel.h"
+#include "ProductStore.h"
+#include <QtConcurrent>
+#include <algorithm>
+
+ProductFilterModel::ProductFilterModel(ProductStore* store, QObject* parent)
+    : QAbstractListModel(parent)
+    , m_store(store)
+{
+    connect(m_store, &QAbstractItemModel::modelReset, this, &ProductFilterModel::rebuildIndex);
+    connect(m_store, &QAbstractItemModel::rowsInserted, this, &ProductFilterModel::rebuildIndex);
+    connect(m_store, &QAbstractItemModel::rowsRemoved, this, &ProductFilterModel::rebuildIndex);
+    connect(m_store, &QAbstractItemModel::dataChanged, this, &ProductFilterModel::onSourceDataChanged);
+    connect(&m_sortWatcher, &QFutureWatcher<SortResult>::finished, this, &ProductFilterModel::onSortFinished);
+
+    rebuildIndex();
+}
+
+int ProductFilterModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_rows.size();
+}
+
+QVariant ProductFilterModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.size()) {
+        return QVariant();
+    }
+    return m_store->data(m_store->index(m_rows.at(index.row())), role);
+}
+
+QHash<int, QByteArray> ProductFilterModel::roleNames() const
+{
+    return m_store->roleNames();
+}
+
+void ProductFilterModel::setQuery(const QString& query)
+{
+    if (query == m_query) {
+        return;
+    }
+
+    // Набор текста обычно дописывает запрос: тогда фильтруем прошлый
+    // результат, а не обращаемся к индексу заново
+    const bool refining = ProductSearchIndex::canRefine(m_query, query);
+    m_matches = refining ? m_index.refine(m_matches, query) : m_index.search(query);
+    m_query = query;
+
+    if (refining && !isSorting()) {
+        // Подмножество уже отсортированных строк: порядок сохраняется
+        QVector<int> rows;
+        rows.reserve(m_rows.size());
+        for (int row : m_rows) {
+            if (accepts(row)) {
+                rows.append(row);
+            }
+        }
+        applyRows(rows, m_snapshot);
+    }
+    else {
+        refilter();
+    }
+    emit queryChanged();
+}
+
+void ProductFilterModel::setSortMode(SortMode mode)
+{
+    if (mode == m_sortMode) {
+        return;
+    }
+    m_sortMode = mode;
+    refilter();
+    emit sortModeChanged();
+}
+
+void ProductFilterModel::setBelowNormOnly(bool enabled)
+{
+    if (enabled == m_belowNormOnly) {
+        return;
+    }
+    m_belowNormOnly = enabled;
+    refilter();
+    emit belowNormOnlyChanged();
+}
+
+int ProductFilterModel::sourceRow(int row) const
+{
+    return row >= 0 && row < m_rows.size() ? m_rows.at(row) : -1;
+}
+
+bool ProductFilterModel::lessThan(const QVector<ProductData>& products, SortMode mode, int left, int right)
+{
+    const ProductData& a = products.at(left);
+    const ProductData& b = products.at(right);
+
+    switch (mode) {
+    case ByName: {
+        const int result = QString::compare(a.name, b.name, Qt::CaseInsensitive);
+        if (result != 0) {
+            return result < 0;
+        }
+        break;
+    }
+    case ByShortage: {
+        const int shortageA = a.normQuantity - a.currentQuantity;
+        const int shortageB = b.normQuantity - b.currentQuantity;
+        if (shortageA != shortageB) {
+            return shortageA > shortageB;
+        }
+        break;
+    }
+    case ByOrderQuantity: {
+        const int orderA = ProductStore::orderQuantity(a);
+        const int orderB = ProductStore::orderQuantity(b);
+        if (orderA != orderB) {
+            return orderA > orderB;
+        }
+        break;
+    }
+    case SourceOrder:
+        break;
+    }
+
+    // Строка исходной модели делает порядок строгим, а бинарный поиск - однозначным
+    return left < right;
+}
+
+QVector<int> ProductFilterModel::sortedRows(const QVector<ProductData>& products, QVector<int> rows, SortMode mode)
+{
+    std::sort(rows.begin(), rows.end(), [&products, mode](int left, int right) {
+        return lessThan(products, mode, left, right);
+    });
+    return rows;
+}
+
+bool ProductFilterModel::accepts(int sourceRow) const
+{
+    const ProductData& product = m_store->at(sourceRow);
+    if (m_belowNormOnly && !ProductStore::needsOrder(product)) {
+        return false;
+    }
+    return std::binary_search(m_matches.cbegin(), m_matches.cend(), product.id);
+}
+
+void ProductFilterModel::rebuildIndex()
+{
+    QVector<QPair<int, QString>> names;
+    names.reserve(m_store->count());
+    for (const ProductData& product : m_store->products()) {
+        names.append(qMakePair(product.id, product.name));
+    }
+    m_index.assign(names);
+    m_matches = m_index.search(m_query);
+    refilter();
+}
+
+void ProductFilterModel::refilter()
+{
+    QVector<int> rows;
+    rows.reserve(m_matches.size());
+    for (int productId : m_matches) {
+        const int row = m_store->rowForId(productId);
+        if (row >= 0 && (!m_belowNormOnly || ProductStore::needsOrder(m_store->at(row)))) {
+            rows.append(row);
+        }
+    }
+
+    if (m_sortMode != SourceOrder) {
+        requestSort(rows);
+        return;
+    }
+
+    // Исходный порядок - просто сортировка номеров, поток не нужен
+    const bool wasSorting = isSorting();
+    m_appliedGeneration = ++m_sortGeneration;
+    std::sort(rows.begin(), rows.end());
+    applyRows(rows, m_store->products());
+    if (wasSorting) {
+        emit sortingChanged();
+    }
+}
+
+void ProductFilterModel::requestSort(const QVector<int>& rows)
+{
+    const bool wasSorting = isSorting();
+    const int generation = ++m_sortGeneration;
+    const QVector<ProductData> products = m_store->products();   // общий буфер, без копирования
+    const SortMode mode = m_sortMode;
+    m_changedDuringSort.clear();
+
+    m_sortWatcher.setFuture(QtConcurrent::run([generation, products, rows, mode]() {
+        SortResult result;
+        result.generation = generation;
+        result.rows = sortedRows(products, rows, mode);
+        result.snapshot = products;
+        return result;
+    }));
+
+    if (!wasSorting) {
+        emit sortingChanged();
+    }
+}
+
+void ProductFilterModel::onSortFinished()
+{
+    const SortResult result = m_sortWatcher.result();
+    if (result.generation != m_sortGeneration) {
+        return;
+    }
+
+    m_appliedGeneration = result.generation;
+    applyRows(result.rows, result.snapshot);
+
+    // Остатки, изменившиеся пока шла сортировка, досортировываем по одной строке
+    const QSet<int> changed = m_changedDuringSort;
+    m_changedDuringSort.clear();
+    for (int row : changed) {
+        if (m_store->isValidRow(row)) {
+            repositionRow(row);
+        }
+    }
+    emit sortingChanged();
+}
+
+void ProductFilterModel::applyRows(const QVector<int>& rows, const QVector<ProductData>& snapshot)
+{
+    const int oldCount = m_rows.size();
+
+    beginResetModel();
+    m_rows = rows;
+    m_snapshot = snapshot;
+    m_proxyRows.fill(-1, m_store->count());
+    updateProxyRows(0, m_rows.size() - 1);
+    endResetModel();
+
+    if (oldCount != m_rows.size()) {
+        emit countChanged();
+    }
+}
+
+void ProductFilterModel::updateProxyRows(int first, int last)
+{
+    for (int i = first; i <= last; ++i) {
+        m_proxyRows[m_rows.at(i)] = i;
+    }
+}
+
+void ProductFilterModel::repositionRow(int sourceRow)
+{
+    if (sourceRow >= m_snapshot.size()) {
+        return;
+    }
+    const int current = m_proxyRows.value(sourceRow, -1);
+    m_snapshot[sourceRow] = m_store->at(sourceRow);
+    const QVector<ProductData>& products = m_snapshot;
+    const SortMode mode = m_sortMode;
+    auto less = [&products, mode](int left, int right) { return lessThan(products, mode, left, right); };
+
+    if (!accepts(sourceRow)) {
+        if (current >= 0) {
+            beginRemoveRows(QModelIndex(), current, current);
+            m_rows.remove(current);
+            m_proxyRows[sourceRow] = -1;
+            updateProxyRows(current, m_rows.size() - 1);
+            endRemoveRows();
+            emit countChanged();
+        }
+        return;
+    }
+
+    if (current < 0) {
+        const int position = int(std::lower_bound(m_rows.begin(), m_rows.end(), sourceRow, less) - m_rows.begin());
+        beginInsertRows(QModelIndex(), position, position);
+        m_rows.insert(position, sourceRow);
+        updateProxyRows(position, m_rows.size() - 1);
+        endInsertRows();
+        emit countChanged();
+        return;
+    }
+
+    // Строка на месте, если не нарушает порядок с соседями
+    if (current > 0 && less(sourceRow, m_rows.at(current - 1))) {
+        const int position = int(std::lower_bound(m_rows.begin(), m_rows.begin() + current, sourceRow, less) - m_rows.begin());
+        beginMoveRows(QModelIndex(), current, current, QModelIndex(), position);
+        m_rows.move(current, position);
+        updateProxyRows(position, current);
+        endMoveRows();
+    }
+    else if (current + 1 < m_rows.size() && less(m_rows.at(current + 1), sourceRow)) {
+        const int position = int(std::lower_bound(m_rows.begin() + current + 1, m_rows.end(), sourceRow, less) - m_rows.begin());
+        // Для beginMoveRows позиция считается до удаления строки
+        beginMoveRows(QModelIndex(), current, current, QModelIndex(), position);
+        m_rows.move(current, position - 1);
+        updateProxyRows(current, position - 1);
+        endMoveRows();
+    }
+}
+
+void ProductFilterModel::onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight,
+    const QVector<int>& roles)
+{
+    const int first = topLeft.row();
+    const int last = bottomRight.row();
+
+    if (roles.isEmpty() || roles.contains(ProductStore::NameRole)) {
+        for (int row = first; row <= last; ++row) {
+            const ProductData& product = m_store->at(row);
+            m_index.update(product.id, product.name);
+
+            // Новое название могло войти в текущий запрос или выйти из него;
+            // строку вставит или уберет repositionRow ниже
+            auto it = std::lower_bound(m_matches.begin(), m_matches.end(), product.id);
+            const bool listed = it != m_matches.end() && *it == product.id;
+            const bool matches = m_index.matches(product.id, m_query);
+            if (matches && !listed) {
+                m_matches.insert(it, product.id);
+            }
+            else if (!matches && listed) {
+                m_matches.erase(it);
+            }
+        }
+    }
+
+    const bool affectsOrder = roles.isEmpty()
+        || roles.contains(ProductStore::NameRole)
+        || roles.contains(ProductStore::CurrentQuantityRole)
+        || roles.contains(ProductStore::NormQuantityRole);
+
+    if (affectsOrder) {
+        if (last - first + 1 > IncrementalLimit) {
+            refilter();
+            return;
+        }
+        for (int row = first; row <= last; ++row) {
+            if (isSorting()) {
+                m_changedDuringSort.insert(row);
+            }
+            else {
+                repositionRow(row);
+            }
+        }
+    }
+
+    // Видимые строки могут идти не подряд - собираем непрерывные диапазоны
+    QVector<int> proxyRows;
+    for (int row = first; row <= last && row < m_proxyRows.size(); ++row) {
+        if (m_proxyRows.at(row) >= 0) {
+            proxyRows.append(m_proxyRows.at(row));
+        }
+    }
+    std::sort(proxyRows.begin(), proxyRows.end());
+
+    for (int i = 0; i < proxyRows.size();) {
+        int j = i;
+        while (j + 1 < proxyRows.size() && proxyRows.at(j + 1) == proxyRows.at(j) + 1) {
+            ++j;
+        }
+        emit dataChanged(index(proxyRows.at(i)), index(proxyRows.at(j)), roles);
+        i = j + 1;
+    }
+}
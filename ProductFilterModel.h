@@ -0,0 +1,112 @@
+﻿#ifndef PRODUCTFILTERMODEL_H
+#define PRODUCTFILTERMODEL_H
+
+#include <QAbstractListModel>
+#include <QFutureWatcher>
+#include <QSet>
+#include <QVector>
+#include "DatabaseManager.h"
+#include "ProductSearchIndex.h"
+
+class ProductStore;
+
+// Отфильтрованное и отсортированное представление ProductStore для QML.
+//
+// Строки отбираются по поисковому запросу (ProductSearchIndex) и флагу
+// "только ниже нормы". Полная сортировка считается в рабочем потоке и
+// применяется целиком; изменение остатка одного продукта не пересортировывает
+// список - строка переставляется бинарным поиском одним beginMoveRows.
+class ProductFilterModel : public QAbstractListModel
+{
+    Q_OBJECT
+        Q_PROPERTY(QString query READ query WRITE setQuery NOTIFY queryChanged)
+        Q_PROPERTY(SortMode sortMode READ sortMode WRITE setSortMode NOTIFY sortModeChanged)
+        Q_PROPERTY(bool belowNormOnly READ belowNormOnly WRITE setBelowNormOnly NOTIFY belowNormOnlyChanged)
+        Q_PROPERTY(bool sorting READ isSorting NOTIFY sortingChanged)
+        Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    enum SortMode {
+        SourceOrder,        // как в ProductStore
+        ByName,
+        ByShortage,         // сначала самая большая нехватка (норма - остаток)
+        ByOrderQuantity     // сначала самый большой заказ
+    };
+    Q_ENUM(SortMode)
+
+    // Больше строк в одном dataChanged - дешевле пересортировать целиком
+    static const int IncrementalLimit = 256;
+
+    explicit ProductFilterModel(ProductStore* store, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    int count() const { return m_rows.size(); }
+
+    QString query() const { return m_query; }
+    void setQuery(const QString& query);
+
+    SortMode sortMode() const { return m_sortMode; }
+    void setSortMode(SortMode mode);
+
+    bool belowNormOnly() const { return m_belowNormOnly; }
+    void setBelowNormOnly(bool enabled);
+
+    bool isSorting() const { return m_sortGeneration != m_appliedGeneration; }
+
+    // Строка исходной модели для операций с остатком
+    Q_INVOKABLE int sourceRow(int row) const;
+
+    // Порядок строк для снимка данных; вызывается в рабочем потоке
+    static QVector<int> sortedRows(const QVector<ProductData>& products, QVector<int> rows, SortMode mode);
+    static bool lessThan(const QVector<ProductData>& products, SortMode mode, int left, int right);
+
+signals:
+    void queryChanged();
+    void sortModeChanged();
+    void belowNormOnlyChanged();
+    void sortingChanged();
+    void countChanged();
+
+private:
+    void rebuildIndex();
+    void refilter();
+    void requestSort(const QVector<int>& rows);
+    void onSortFinished();
+    void applyRows(const QVector<int>& rows, const QVector<ProductData>& snapshot);
+    void repositionRow(int sourceRow);
+    void updateProxyRows(int first, int last);
+    bool accepts(int sourceRow) const;
+    void onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles);
+
+    ProductStore* m_store;
+    ProductSearchIndex m_index;
+    QString m_query;
+    SortMode m_sortMode = SourceOrder;
+    bool m_belowNormOnly = false;
+
+    QVector<int> m_matches;       // id продуктов по текущему запросу, по возрастанию
+    QVector<int> m_rows;          // строка фильтра -> строка ProductStore
+    QVector<int> m_proxyRows;     // строка ProductStore -> строка фильтра или -1
+
+    // Ключи, по которым упорядочен m_rows. Изменения приходят с задержкой и
+    // диапазонами, поэтому сравнение идет со снимком, а не с живыми данными:
+    // иначе еще не переставленные строки ломали бы бинарный поиск
+    QVector<ProductData> m_snapshot;
+
+    // Фоновая сортировка: устаревшие результаты отбрасываются по номеру,
+    // а строки, изменившиеся за время сортировки, доставляются после нее
+    struct SortResult {
+        int generation = 0;
+        QVector<int> rows;
+        QVector<ProductData> snapshot;
+    };
+    QFutureWatcher<SortResult> m_sortWatcher;
+    int m_sortGeneration = 0;
+    int m_appliedGeneration = 0;
+    QSet<int> m_changedDuringSort;
+};
+
+#endif // PRODUCTFILTERMODEL_H
@@ -0,0 +1,276 @@
+﻿#include "ProductSearchIndex.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+const int TrigramLength = 3;
+
+void insertSorted(QVector<int>& list, int value)
+{
+    // Обычно id приходят по возрастанию - тогда это просто append
+    if (list.isEmpty() || list.last() < value) {
+        list.append(value);
+        return;
+    }
+    auto it = std::lower_bound(list.begin(), list.end(), value);
+    if (it == list.end() || *it != value) {
+        list.insert(it, value);
+    }
+}
+
+void removeSorted(QVector<int>& list, int value)
+{
+    auto it = std::lower_bound(list.begin(), list.end(), value);
+    if (it != list.end() && *it == value) {
+        list.erase(it);
+    }
+}
+
+} // namespace
+
+ProductSearchIndex::ProductSearchIndex()
+{
+}
+
+QString ProductSearchIndex::normalize(const QString& text)
+{
+    QString normalized = text.simplified().toCaseFolded();
+    normalized.replace(QChar(0x0451), QChar(0x0435));   // ё -> е
+    return normalized;
+}
+
+quint64 ProductSearchIndex::trigramKey(const QChar* chars)
+{
+    return (quint64(chars[0].unicode()) << 32) | (quint64(chars[1].unicode()) << 16) | chars[2].unicode();
+}
+
+QVector<quint64> ProductSearchIndex::trigramsOf(const QString& normalized)
+{
+    QVector<quint64> keys;
+    if (normalized.size() < TrigramLength) {
+        return keys;
+    }
+
+    keys.reserve(normalized.size() - TrigramLength + 1);
+    for (int i = 0; i + TrigramLength <= normalized.size(); ++i) {
+        keys.append(trigramKey(normalized.constData() + i));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+QStringList ProductSearchIndex::wordsOf(const QString& normalized)
+{
+    QStringList words;
+    int start = -1;
+    for (int i = 0; i <= normalized.size(); ++i) {
+        const bool wordChar = i < normalized.size() && normalized.at(i).isLetterOrNumber();
+        if (wordChar && start < 0) {
+            start = i;
+        }
+        else if (!wordChar && start >= 0) {
+            words.append(normalized.mid(start, i - start));
+            start = -1;
+        }
+    }
+    return words;
+}
+
+bool ProductSearchIndex::matches(const QString& name, const QString& normalized)
+{
+    if (normalized.size() >= TrigramLength) {
+        return name.contains(normalized);
+    }
+    for (const QString& word : wordsOf(name)) {
+        if (word.startsWith(normalized)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ProductSearchIndex::clear()
+{
+    m_names.clear();
+    m_postings.clear();
+    m_words.clear();
+}
+
+void ProductSearchIndex::insert(int productId, const QString& name)
+{
+    if (m_names.contains(productId)) {
+        remove(productId);
+    }
+
+    const QString normalized = normalize(name);
+    m_names.insert(productId, normalized);
+
+    for (quint64 key : trigramsOf(normalized)) {
+        insertSorted(m_postings[key], productId);
+    }
+    for (const QString& word : wordsOf(normalized)) {
+        const WordEntry entry{ word, productId };
+        m_words.insert(std::lower_bound(m_words.begin(), m_words.end(), entry), entry);
+    }
+}
+
+void ProductSearchIndex::remove(int productId)
+{
+    auto it = m_names.find(productId);
+    if (it == m_names.end()) {
+        return;
+    }
+
+    const QString normalized = it.value();
+    m_names.erase(it);
+
+    for (quint64 key : trigramsOf(normalized)) {
+        auto posting = m_postings.find(key);
+        if (posting != m_postings.end()) {
+            removeSorted(posting.value(), productId);
+            if (posting.value().isEmpty()) {
+                m_postings.erase(posting);
+            }
+        }
+    }
+    for (const QString& word : wordsOf(normalized)) {
+        const WordEntry entry{ word, productId };
+        auto pos = std::lower_bound(m_words.begin(), m_words.end(), entry);
+        if (pos != m_words.end() && pos->word == word && pos->productId == productId) {
+            m_words.erase(pos);
+        }
+    }
+}
+
+void ProductSearchIndex::update(int productId, const QString& name)
+{
+    auto it = m_names.constFind(productId);
+    if (it != m_names.cend() && it.value() == normalize(name)) {
+        return;
+    }
+    insert(productId, name);
+}
+
+void ProductSearchIndex::assign(const QVector<QPair<int, QString>>& products)
+{
+    clear();
+    m_names.reserve(products.size());
+    m_words.reserve(products.size() * 2);
+
+    for (const auto& product : products) {
+        const QString normalized = normalize(product.second);
+        m_names.insert(product.first, normalized);
+        for (quint64 key : trigramsOf(normalized)) {
+            m_postings[key].append(product.first);
+        }
+        for (const QString& word : wordsOf(normalized)) {
+            m_words.append({ word, product.first });
+        }
+    }
+
+    for (auto it = m_postings.begin(); it != m_postings.end(); ++it) {
+        QVector<int>& list = it.value();
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+    }
+    std::sort(m_words.begin(), m_words.end());
+}
+
+QVector<int> ProductSearchIndex::search(const QString& query) const
+{
+    const QString normalized = normalize(query);
+    if (normalized.isEmpty()) {
+        QVector<int> all;
+        all.reserve(m_names.size());
+        for (auto it = m_names.cbegin(); it != m_names.cend(); ++it) {
+            all.append(it.key());
+        }
+        std::sort(all.begin(), all.end());
+        return all;
+    }
+
+    return normalized.size() < TrigramLength ? searchPrefix(normalized) : searchTrigrams(normalized);
+}
+
+QVector<int> ProductSearchIndex::searchPrefix(const QString& normalized) const
+{
+    QVector<int> ids;
+    const WordEntry first{ normalized, std::numeric_limits<int>::min() };
+    for (auto it = std::lower_bound(m_words.cbegin(), m_words.cend(), first);
+        it != m_words.cend() && it->word.startsWith(normalized); ++it) {
+        ids.append(it->productId);
+    }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+QVector<int> ProductSearchIndex::searchTrigrams(const QString& normalized) const
+{
+    QVector<const QVector<int>*> lists;
+    for (quint64 key : trigramsOf(normalized)) {
+        auto it = m_postings.constFind(key);
+        if (it == m_postings.cend()) {
+            return QVector<int>();
+        }
+        lists.append(&it.value());
+    }
+
+    // Пересечение от самого короткого списка
+    std::sort(lists.begin(), lists.end(), [](const QVector<int>* a, const QVector<int>* b) {
+        return a->size() < b->size();
+    });
+
+    QVector<int> candidates = *lists.first();
+    for (int i = 1; i < lists.size() && !candidates.isEmpty(); ++i) {
+        QVector<int> intersection;
+        intersection.reserve(candidates.size());
+        std::set_intersection(candidates.cbegin(), candidates.cend(),
+            lists.at(i)->cbegin(), lists.at(i)->cend(), std::back_inserter(intersection));
+        candidates.swap(intersection);
+    }
+
+    // Триграммы не учитывают порядок - подстроку проверяем явно
+    QVector<int> ids;
+    ids.reserve(candidates.size());
+    for (int productId : candidates) {
+        if (m_names.value(productId).contains(normalized)) {
+            ids.append(productId);
+        }
+    }
+    return ids;
+}
+
+bool ProductSearchIndex::canRefine(const QString& previousQuery, const QString& query)
+{
+    const QString previous = normalize(previousQuery);
+    return previous.size() >= TrigramLength && normalize(query).startsWith(previous);
+}
+
+bool ProductSearchIndex::matches(int productId, const QString& query) const
+{
+    auto it = m_names.constFind(productId);
+    if (it == m_names.cend()) {
+        return false;
+    }
+    const QString normalized = normalize(query);
+    return normalized.isEmpty() || matches(it.value(), normalized);
+}
+
+QVector<int> ProductSearchIndex::refine(const QVector<int>& previous, const QString& query) const
+{
+    const QString normalized = normalize(query);
+    QVector<int> ids;
+    ids.reserve(previous.size());
+    for (int productId : previous) {
+        auto it = m_names.constFind(productId);
+        if (it != m_names.cend() && matches(it.value(), normalized)) {
+            ids.append(productId);
+        }
+    }
+    return ids;
+}
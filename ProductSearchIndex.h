@@ -0,0 +1,69 @@
+﻿#ifndef PRODUCTSEARCHINDEX_H
+#define PRODUCTSEARCHINDEX_H
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Индекс для поиска по мере ввода.
+//
+// Названия нормализуются (toCaseFolded, "ё" -> "е"), поэтому поиск не
+// зависит от регистра и работает с кириллицей. Запросы короче трех
+// символов ищутся по началу слов (отсортированный словарь + бинарный
+// поиск), более длинные - пересечением списков триграмм с проверкой
+// подстроки. Продукты добавляются и удаляются по одному, без перестройки.
+class ProductSearchIndex
+{
+public:
+    ProductSearchIndex();
+
+    void clear();
+    void insert(int productId, const QString& name);
+    void remove(int productId);
+    void update(int productId, const QString& name);
+
+    // Полная загрузка: списки сортируются один раз, а не на каждой вставке
+    void assign(const QVector<QPair<int, QString>>& products);
+
+    int size() const { return m_names.size(); }
+
+    // id найденных продуктов, отсортированные по возрастанию; пустой запрос - все
+    QVector<int> search(const QString& query) const;
+
+    // Уточнение: если новый запрос продолжает предыдущий (оба не короче
+    // трех символов), достаточно отфильтровать прошлый результат
+    static bool canRefine(const QString& previousQuery, const QString& query);
+    QVector<int> refine(const QVector<int>& previous, const QString& query) const;
+
+    // Попадает ли продукт в результат search(query) - например, после
+    // переименования, без поиска по всему индексу
+    bool matches(int productId, const QString& query) const;
+
+    static QString normalize(const QString& text);
+
+private:
+    struct WordEntry {
+        QString word;
+        int productId;
+
+        bool operator<(const WordEntry& other) const {
+            return word < other.word || (word == other.word && productId < other.productId);
+        }
+    };
+
+    static quint64 trigramKey(const QChar* chars);
+    static QVector<quint64> trigramsOf(const QString& normalized);
+    static QStringList wordsOf(const QString& normalized);
+    static bool matches(const QString& name, const QString& normalized);
+
+    QVector<int> searchPrefix(const QString& normalized) const;
+    QVector<int> searchTrigrams(const QString& normalized) const;
+
+    QHash<int, QString> m_names;                    // id -> нормализованное название
+    QHash<quint64, QVector<int>> m_postings;        // триграмма -> отсортированные id
+    QVector<WordEntry> m_words;                     // словарь для префиксного поиска
+};
+
+#endif // PRODUCTSEARCHINDEX_H
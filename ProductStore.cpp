@@ -0,0 +1,235 @@
+﻿#include "ProductStore.h"
+
+ProductStore::ProductStore(QObject* parent)
+    : QAbstractListModel(parent)
+{
+    connect(&m_changes, &RowChangeBatcher::rangeChanged, this, [this](int first, int last) {
+        if (isValidRow(first) && isValidRow(last)) {
+            emit dataChanged(index(first), index(last),
+                { CurrentQuantityRole, NeedsOrderRole, OrderQuantityRole, NextExpiryRole, UnitCostRole });
+        }
+        if (m_valuationDirty) {
+            m_valuationDirty = false;
+            emit valuationChanged();
+        }
+    });
+}
+
+int ProductStore::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_products.size();
+}
+
+QVariant ProductStore::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || !isValidRow(index.row())) {
+        return QVariant();
+    }
+
+    const ProductData& product = m_products.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case NameRole:
+        return product.name;
+    case IdRole:
+        return product.id;
+    case CurrentQuantityRole:
+        return product.currentQuantity;
+    case NormQuantityRole:
+        return product.normQuantity;
+    case NeedsOrderRole:
+        return needsOrder(product);
+    case OrderQuantityRole:
+        return orderQuantity(product);
+    case LocationRole:
+        return product.locationId;
+    case NextExpiryRole:
+        return product.nextExpiry;
+    case UnitCostRole:
+        return product.unitCost;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> ProductStore::roleNames() const
+{
+    return {
+        { IdRole, "productId" },
+        { NameRole, "name" },
+        { CurrentQuantityRole, "currentQuantity" },
+        { NormQuantityRole, "normQuantity" },
+        { NeedsOrderRole, "needsOrder" },
+        { OrderQuantityRole, "orderQuantity" },
+        { LocationRole, "locationId" },
+        { NextExpiryRole, "nextExpiry" },
+        { UnitCostRole, "unitCost" }
+    };
+}
+
+void ProductStore::setProducts(const QVector<ProductData>& products)
+{
+    const int oldCount = m_products.size();
+
+    beginResetModel();
+    m_products = products;
+    rebuildIndexes();
+    m_changes.reset(m_products.size());
+    endResetModel();
+
+    if (oldCount != m_products.size()) {
+        emit countChanged();
+    }
+    m_valuationDirty = false;
+    emit valuationChanged();
+}
+
+int ProductStore::rowForId(int productId) const
+{
+    return m_rowById.value(productId, -1);
+}
+
+int ProductStore::rowForName(const QString& name, int locationId) const
+{
+    return locationId > 0
+        ? m_rowByName.value(qMakePair(locationId, name.toCaseFolded()), -1)
+        : m_rowByAnyName.value(name.toCaseFolded(), -1);
+}
+
+bool ProductStore::setCurrentQuantity(int row, int quantity)
+{
+    if (!isValidRow(row) || quantity < 0) {
+        return false;
+    }
+
+    ProductData& product = m_products[row];
+    if (product.currentQuantity != quantity) {
+        const int oldQuantity = product.currentQuantity;
+        product.currentQuantity = quantity;
+        m_currentQuantities[row] = quantity;
+        adjustValuation(row, oldQuantity, product.unitCost);
+        m_changes.markDirty(row);
+        emit quantityChanged(row);
+    }
+    return true;
+}
+
+bool ProductStore::setUnitCost(int row, qint64 kopecks)
+{
+    if (!isValidRow(row) || kopecks < 0) {
+        return false;
+    }
+
+    ProductData& product = m_products[row];
+    if (product.unitCost != kopecks) {
+        const qint64 oldCost = product.unitCost;
+        product.unitCost = kopecks;
+        m_unitCosts[row] = kopecks;
+        adjustValuation(row, product.currentQuantity, oldCost);
+        m_changes.markDirty(row);
+    }
+    return true;
+}
+
+void ProductStore::adjustValuation(int row, int oldQuantity, qint64 oldCost)
+{
+    const ProductData& product = m_products.at(row);
+    m_stockValue += qint64(product.currentQuantity) * product.unitCost - qint64(oldQuantity) * oldCost;
+    m_orderCost += qint64(qMax(0, product.normQuantity - product.currentQuantity)) * product.unitCost
+        - qint64(qMax(0, product.normQuantity - oldQuantity)) * oldCost;
+
+    // Сигнал уйдет вместе с dataChanged; без накопления - сразу
+    if (m_changes.interval() == 0) {
+        emit valuationChanged();
+    }
+    else {
+        m_valuationDirty = true;
+    }
+}
+
+bool ProductStore::refreshProduct(const ProductData& product)
+{
+    const int row = rowForId(product.id);
+    if (row < 0) {
+        return false;
+    }
+
+    m_products[row].version = product.version;
+    setNextExpiry(row, product.nextExpiry);
+    setUnitCost(row, product.unitCost);
+    return setCurrentQuantity(row, product.currentQuantity);
+}
+
+bool ProductStore::setNextExpiry(int row, const QDate& date)
+{
+    if (!isValidRow(row)) {
+        return false;
+    }
+
+    ProductData& product = m_products[row];
+    if (product.nextExpiry != date) {
+        product.nextExpiry = date;
+        m_changes.markDirty(row);
+    }
+    return true;
+}
+
+bool ProductStore::addQuantity(int row, int amount)
+{
+    if (!isValidRow(row)) {
+        return false;
+    }
+    return setCurrentQuantity(row, m_products.at(row).currentQuantity + amount);
+}
+
+bool ProductStore::removeQuantity(int row, int amount)
+{
+    if (!isValidRow(row) || m_products.at(row).currentQuantity < amount) {
+        return false;
+    }
+    return setCurrentQuantity(row, m_products.at(row).currentQuantity - amount);
+}
+
+void ProductStore::rebuildIndexes()
+{
+    m_rowById.clear();
+    m_rowByName.clear();
+    m_rowByAnyName.clear();
+    m_rowById.reserve(m_products.size());
+    m_rowByName.reserve(m_products.size());
+    m_rowByAnyName.reserve(m_products.size());
+    m_currentQuantities.resize(m_products.size());
+    m_normQuantities.resize(m_products.size());
+    m_unitCosts.resize(m_products.size());
+
+    for (int row = 0; row < m_products.size(); ++row) {
+        const ProductData& product = m_products.at(row);
+        m_rowById.insert(product.id, row);
+        const QString name = product.name.toCaseFolded();
+        const QPair<int, QString> key(product.locationId, name);
+        m_rowByName.insert(key, m_rowByName.contains(key) ? AmbiguousRow : row);
+        m_rowByAnyName.insert(name, m_rowByAnyName.contains(name) ? AmbiguousRow : row);
+        m_currentQuantities[row] = product.currentQuantity;
+        m_normQuantities[row] = product.normQuantity;
+        m_unitCosts[row] = product.unitCost;
+    }
+
+    // Полный пересчет - только при загрузке; проход по трем непрерывным
+    // массивам целых без ветвлений, компилятор его векторизует
+    const qint32* current = m_currentQuantities.constData();
+    const qint32* norm = m_normQuantities.constData();
+    const qint64* cost = m_unitCosts.constData();
+    qint64 stockValue = 0;
+    qint64 orderCost = 0;
+    for (int row = 0; row < m_currentQuantities.size(); ++row) {
+        stockValue += qint64(current[row]) * cost[row];
+        orderCost += qint64(qMax(0, norm[row] - current[row])) * cost[row];
+    }
+    m_stockValue = stockValue;
+    m_orderCost = orderCost;
+}
+
+ReorderScan::Result ProductStore::scanBelowNorm() const
+{
+    return ReorderScan::scan(m_currentQuantities.constData(), m_normQuantities.constData(), m_currentQuantities.size());
+}
@@ -0,0 +1,114 @@
+﻿#ifndef PRODUCTSTORE_H
+#define PRODUCTSTORE_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include "DatabaseManager.h"
+#include "ReorderScan.h"
+#include "RowChangeBatcher.h"
+
+// Остатки продуктов в памяти: общее хранилище для GUI и fridgectl.
+// Модель отдает роли в QML, а индексы по id и названию позволяют
+// находить продукт без линейного поиска.
+class ProductStore : public QAbstractListModel
+{
+    Q_OBJECT
+        Q_PROPERTY(int count READ count NOTIFY countChanged)
+        Q_PROPERTY(qint64 stockValue READ stockValue NOTIFY valuationChanged)
+        Q_PROPERTY(qint64 orderCost READ orderCost NOTIFY valuationChanged)
+
+public:
+    enum Roles {
+        IdRole = Qt::UserRole + 1,
+        NameRole,
+        CurrentQuantityRole,
+        NormQuantityRole,
+        NeedsOrderRole,
+        OrderQuantityRole,
+        LocationRole,
+        NextExpiryRole,
+        UnitCostRole
+    };
+
+    explicit ProductStore(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    int count() const { return m_products.size(); }
+
+    // Полная замена содержимого (загрузка из БД или локальные данные)
+    void setProducts(const QVector<ProductData>& products);
+    const QVector<ProductData>& products() const { return m_products; }
+    const ProductData& at(int row) const { return m_products.at(row); }
+
+    bool isValidRow(int row) const { return row >= 0 && row < m_products.size(); }
+    int rowForId(int productId) const;
+
+    // Строка по названию без учета регистра в локации locationId (0 - в
+    // любой). -1 - не найдено, AmbiguousRow - таких строк несколько
+    // (одно название в разных локациях): выбирать любую из них нельзя
+    static const int AmbiguousRow = -2;
+    int rowForName(const QString& name, int locationId = 0) const;
+
+    // Изменение остатка; расход не может увести количество ниже нуля
+    bool setCurrentQuantity(int row, int quantity);
+    bool addQuantity(int row, int amount);
+    bool removeQuantity(int row, int amount);
+
+    // Строка из ответа базы (после записи или при конфликте версий):
+    // остаток, версия и ближайший срок заменяются, остальной кэш не трогается
+    bool refreshProduct(const ProductData& product);
+
+    // Срок ближайшей партии (после прихода партией или списания)
+    bool setNextExpiry(int row, const QDate& date);
+
+    // Стоимость в копейках: остатки (остаток * цена) и заявка по норме
+    // ((норма - остаток) * цена для строк ниже нормы). Суммы считаются
+    // целиком только в setProducts, дальше каждое изменение остатка или цены
+    // поправляет их на разницу. valuationChanged - вместе с dataChanged, раз в интервал.
+    bool setUnitCost(int row, qint64 kopecks);
+    qint64 stockValue() const { return m_stockValue; }
+    qint64 orderCost() const { return m_orderCost; }
+
+    // dataChanged по остаткам копится и отдается диапазонами раз в msec
+    // (GUI - раз в кадр); 0 - сразу, как в консольном клиенте
+    void setNotificationInterval(int msec) { m_changes.setInterval(msec); }
+    void flushNotifications() { m_changes.flush(); }
+
+    // Остатки и нормы в непрерывных массивах (строка -> значение) для
+    // векторного поиска продуктов ниже нормы
+    const QVector<qint32>& currentQuantities() const { return m_currentQuantities; }
+    const QVector<qint32>& normQuantities() const { return m_normQuantities; }
+    const QVector<qint64>& unitCosts() const { return m_unitCosts; }
+    ReorderScan::Result scanBelowNorm() const;
+
+    static bool needsOrder(const ProductData& product) { return product.currentQuantity < product.normQuantity; }
+    static int orderQuantity(const ProductData& product) { return qMax(0, product.normQuantity - product.currentQuantity); }
+
+signals:
+    void countChanged();
+    void quantityChanged(int row);
+    void valuationChanged();
+
+private:
+    void rebuildIndexes();
+    void adjustValuation(int row, int oldQuantity, qint64 oldCost);
+
+    QVector<ProductData> m_products;
+    QHash<int, int> m_rowById;
+    QHash<QPair<int, QString>, int> m_rowByName;     // (локация, название)
+    QHash<QString, int> m_rowByAnyName;              // название во всех локациях
+    QVector<qint32> m_currentQuantities;
+    QVector<qint32> m_normQuantities;
+    QVector<qint64> m_unitCosts;
+    qint64 m_stockValue = 0;
+    qint64 m_orderCost = 0;
+    bool m_valuationDirty = false;
+    RowChangeBatcher m_changes;
+};
+
+#endif // PRODUCTSTORE_H
@@ -1,7 +1,8 @@
-#include "ProtobufSerializer.h"
+﻿#include "ProtobufSerializer.h"
 #include <QFile>
 #include <QDebug>
 #include <QDateTime>
+#include <limits>
 
 ProtobufSerializer::ProtobufSerializer(QObject* parent)
     : QObject(parent)
@@ -13,11 +14,11 @@ QByteArray ProtobufSerializer::serializeProducts(const QVector<ProductData>& pro
     try {
         fridgemanager::ProductListProto productList;
 
-        //  
+        // Устанавливаем метаданные
         productList.set_timestamp(QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss").toStdString());
         productList.set_version("1.0");
 
-        //  
+        // Добавляем продукты
         for (const auto& product : products) {
             auto* protoProduct = productList.add_products();
             protoProduct->set_id(product.id);
@@ -26,7 +27,7 @@ QByteArray ProtobufSerializer::serializeProducts(const QVector<ProductData>& pro
             protoProduct->set_norm_quantity(product.normQuantity);
         }
 
-        //   
+        // Сериализуем в строку
         std::string serialized = productList.SerializeAsString();
         return QByteArray(serialized.data(), serialized.size());
 
@@ -51,15 +52,10 @@ QVector<ProductData> ProtobufSerializer::deserializeProducts(const QByteArray& d
             return products;
         }
 
-        //  
+        // Извлекаем продукты
         for (int i = 0; i < productList.products_size(); ++i) {
             const auto& protoProduct = productList.products(i);
-            products.append(ProductData(
-                protoProduct.id(),
-                QString::fromStdString(protoProduct.name()),
-                protoProduct.current_quantity(),
-                protoProduct.norm_quantity()
-            ));
+            products.append(protoToProduct(protoProduct));
         }
 
         qDebug() << "Deserialized" << products.size() << "products from protobuf";
@@ -79,12 +75,13 @@ QByteArray ProtobufSerializer::serializeOrder(const QVector<ProductData>& produc
     try {
         fridgemanager::OrderProto order;
 
-        //   
+        // Устанавливаем метаданные заявки
         order.set_order_date(QDateTime::currentDateTime().toString("dd.MM.yyyy HH:mm").toStdString());
         order.set_restaurant_name(restaurantName.toStdString());
 
-        //    
+        // Добавляем продукты для заказа
         int totalPacks = 0;
+        qint64 totalCost = 0;
         for (const auto& product : productsToOrder) {
             if (product.currentQuantity < product.normQuantity) {
                 auto* protoProduct = order.add_products_to_order();
@@ -92,14 +89,17 @@ QByteArray ProtobufSerializer::serializeOrder(const QVector<ProductData>& produc
                 protoProduct->set_name(product.name.toStdString());
                 protoProduct->set_current_quantity(product.currentQuantity);
                 protoProduct->set_norm_quantity(product.normQuantity);
+                protoProduct->set_unit_cost(product.unitCost);
 
                 totalPacks += (product.normQuantity - product.currentQuantity);
+                totalCost += qint64(product.normQuantity - product.currentQuantity) * product.unitCost;
             }
         }
 
         order.set_total_packs(totalPacks);
+        order.set_total_cost(totalCost);
 
-        // 
+        // Сериализуем
         std::string serialized = order.SerializeAsString();
         return QByteArray(serialized.data(), serialized.size());
 
@@ -185,20 +185,218 @@ fridgemanager::ProductProto ProtobufSerializer::productToProto(const ProductData
     proto.set_name(product.name.toStdString());
     proto.set_current_quantity(product.currentQuantity);
     proto.set_norm_quantity(product.normQuantity);
+    proto.set_location_id(product.locationId);
+    proto.set_unit_cost(product.unitCost);
     return proto;
 }
 
 ProductData ProtobufSerializer::protoToProduct(const fridgemanager::ProductProto& proto)
 {
-    return ProductData(
+    ProductData product(
         proto.id(),
         QString::fromStdString(proto.name()),
         proto.current_quantity(),
-        proto.norm_quantity()
+        proto.norm_quantity(),
+        proto.location_id() > 0 ? proto.location_id() : DefaultLocationId
     );
+    product.unitCost = proto.unit_cost();
+    return product;
 }
 
 QString ProtobufSerializer::getLastError() const
 {
     return m_lastError;
-}
\ No newline at end of file
+}
+
+namespace {
+
+// Номера полей и типы из product.proto (ProductListProto)
+const quint32 ProductsTag = (1 << 3) | 2;
+const quint32 TimestampTag = (2 << 3) | 2;
+const quint32 VersionTag = (3 << 3) | 2;
+
+void appendVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+void appendString(QByteArray& out, quint32 tag, const std::string& value)
+{
+    appendVarint(out, tag);
+    appendVarint(out, value.size());
+    out.append(value.data(), int(value.size()));
+}
+
+} // namespace
+
+bool ProductSnapshotReader::open(const QString& filePath)
+{
+    m_file.setFileName(filePath);
+    m_buffer.clear();
+    m_pos = 0;
+    m_lastError.clear();
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_lastError = QString("Cannot open file for reading: %1").arg(filePath);
+        return false;
+    }
+    return true;
+}
+
+bool ProductSnapshotReader::fill(int bytes)
+{
+    if (m_buffer.size() - m_pos >= bytes) {
+        return true;
+    }
+    m_buffer.remove(0, m_pos);
+    m_pos = 0;
+    while (m_buffer.size() < bytes) {
+        const QByteArray chunk = m_file.read(qMax(BufferBytes, bytes - m_buffer.size()));
+        if (chunk.isEmpty()) {
+            return false;
+        }
+        m_buffer.append(chunk);
+    }
+    return true;
+}
+
+bool ProductSnapshotReader::readVarint(quint64& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (!fill(1)) {
+            return false;
+        }
+        const quint8 byte = quint8(m_buffer.at(m_pos++));
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    m_lastError = "Malformed varint in snapshot";
+    return false;
+}
+
+bool ProductSnapshotReader::skip(quint64 bytes)
+{
+    while (bytes > 0) {
+        if (!fill(1)) {
+            return false;
+        }
+        const int step = int(qMin<quint64>(bytes, quint64(m_buffer.size() - m_pos)));
+        m_pos += step;
+        bytes -= step;
+    }
+    return true;
+}
+
+bool ProductSnapshotReader::next(ProductData& product)
+{
+    for (;;) {
+        quint64 tag = 0;
+        if (!fill(1)) {
+            return false;   // конец файла на границе поля
+        }
+        if (!readVarint(tag)) {
+            break;
+        }
+
+        quint64 length = 0;
+        switch (tag & 7) {
+        case 0:
+            if (!readVarint(length)) {
+                break;
+            }
+            continue;
+        case 1:
+            if (!skip(8)) {
+                break;
+            }
+            continue;
+        case 5:
+            if (!skip(4)) {
+                break;
+            }
+            continue;
+        case 2:
+            if (!readVarint(length) || length > quint64(std::numeric_limits<int>::max())) {
+                break;
+            }
+            if (tag != ProductsTag) {
+                if (!skip(length)) {
+                    break;
+                }
+                continue;
+            }
+            if (!fill(int(length))) {
+                break;
+            }
+            {
+                fridgemanager::ProductProto proto;
+                if (!proto.ParseFromArray(m_buffer.constData() + m_pos, int(length))) {
+                    m_lastError = "Failed to parse product in snapshot";
+                    return false;
+                }
+                m_pos += int(length);
+                product = ProtobufSerializer::protoToProduct(proto);
+            }
+            return true;
+        default:
+            m_lastError = QString("Unsupported wire type %1 in snapshot").arg(tag & 7);
+            return false;
+        }
+        break;
+    }
+
+    if (m_lastError.isEmpty()) {
+        m_lastError = "Snapshot is truncated";
+    }
+    return false;
+}
+
+bool ProductSnapshotWriter::open(const QString& filePath)
+{
+    m_file.setFileName(filePath);
+    m_buffer.clear();
+    m_lastError.clear();
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_lastError = QString("Cannot open file for writing: %1").arg(filePath);
+        return false;
+    }
+
+    // Метаданные - в начало: порядок полей в сообщении protobuf не важен
+    appendString(m_buffer, TimestampTag,
+        QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss").toStdString());
+    appendString(m_buffer, VersionTag, "1.0");
+    return true;
+}
+
+bool ProductSnapshotWriter::write(const ProductData& product)
+{
+    if (!ProtobufSerializer::productToProto(product).SerializeToString(&m_message)) {
+        m_lastError = QString("Serialization error: product %1").arg(product.id);
+        return false;
+    }
+    appendString(m_buffer, ProductsTag, m_message);
+    return m_buffer.size() < BufferBytes || flush();
+}
+
+bool ProductSnapshotWriter::flush()
+{
+    if (m_file.write(m_buffer) != m_buffer.size()) {
+        m_lastError = "Failed to write all data to file";
+        return false;
+    }
+    m_buffer.clear();
+    return true;
+}
+
+bool ProductSnapshotWriter::close()
+{
+    const bool ok = flush();
+    m_file.close();
+    return ok;
+}
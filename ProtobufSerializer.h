@@ -1,22 +1,13 @@
-#ifndef PROTOBUFSERIALIZER_H
+﻿#ifndef PROTOBUFSERIALIZER_H
 #define PROTOBUFSERIALIZER_H
 
+#include <QFile>
 #include <QObject>
 #include <QString>
 #include <QVector>
+#include "DatabaseManager.h"
 #include "product.pb.h"
 
-struct ProductData {
-    int id;
-    QString name;
-    int currentQuantity;
-    int normQuantity;
-
-    ProductData(int i = 0, const QString& n = "", int curr = 0, int norm = 0)
-        : id(i), name(n), currentQuantity(curr), normQuantity(norm) {
-    }
-};
-
 class ProtobufSerializer : public QObject
 {
     Q_OBJECT
@@ -24,41 +15,88 @@ class ProtobufSerializer : public QObject
 public:
     explicit ProtobufSerializer(QObject* parent = nullptr);
 
-    //     protobuf
+    // Сериализация списка продуктов в protobuf
     QByteArray serializeProducts(const QVector<ProductData>& products);
 
-    //     protobuf
+    // Десериализация списка продуктов из protobuf
     QVector<ProductData> deserializeProducts(const QByteArray& data);
 
-    //    protobuf
+    // Сериализация заявки в protobuf
     QByteArray serializeOrder(const QVector<ProductData>& productsToOrder,
-        const QString& restaurantName = "");
+        const QString& restaurantName = "Гурман");
 
-    //  protobuf  
+    // Сохранение protobuf в файл
     bool saveToFile(const QByteArray& data, const QString& filePath);
 
-    //  protobuf  
+    // Загрузка protobuf из файла
     QByteArray loadFromFile(const QString& filePath);
 
-    //    protobuf 
+    // Экспорт продуктов в protobuf файл
     bool exportProducts(const QVector<ProductData>& products, const QString& filePath);
 
-    //    protobuf 
+    // Импорт продуктов из protobuf файла
     QVector<ProductData> importProducts(const QString& filePath);
 
-    //    protobuf 
+    // Экспорт заявки в protobuf файл
     bool exportOrder(const QVector<ProductData>& productsToOrder,
         const QString& filePath,
-        const QString& restaurantName = "");
+        const QString& restaurantName = "Гурман");
 
     QString getLastError() const;
 
+    // Конвертация между нашими структурами и protobuf
+    static fridgemanager::ProductProto productToProto(const ProductData& product);
+    static ProductData protoToProduct(const fridgemanager::ProductProto& proto);
+
+private:
+    QString m_lastError;
+};
+
+// Потоковое чтение снимка ProductListProto (формат exportProducts) без
+// загрузки файла целиком: поле products - последовательность
+// "тег, длина, ProductProto", продукты разбираются по одному.
+class ProductSnapshotReader
+{
+public:
+    static const int BufferBytes = 256 * 1024;
+
+    bool open(const QString& filePath);
+
+    // false - конец файла или ошибка (тогда getLastError() не пуст)
+    bool next(ProductData& product);
+
+    QString getLastError() const { return m_lastError; }
+
 private:
+    bool fill(int bytes);
+    bool readVarint(quint64& value);
+    bool skip(quint64 bytes);
+
+    QFile m_file;
+    QByteArray m_buffer;
+    int m_pos = 0;
     QString m_lastError;
+};
+
+// Потоковая запись снимка в том же формате, что у exportProducts
+class ProductSnapshotWriter
+{
+public:
+    static const int BufferBytes = 256 * 1024;
+
+    bool open(const QString& filePath);
+    bool write(const ProductData& product);
+    bool close();
+
+    QString getLastError() const { return m_lastError; }
 
-    //      protobuf
-    fridgemanager::ProductProto productToProto(const ProductData& product);
-    ProductData protoToProduct(const fridgemanager::ProductProto& proto);
+private:
+    bool flush();
+
+    QFile m_file;
+    QByteArray m_buffer;
+    std::string m_message;
+    QString m_lastError;
 };
 
-#endif
\ No newline at end of file
+#endif
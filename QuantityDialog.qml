@@ -1,14 +1,15 @@
-import QtQuick 2.15
+﻿import QtQuick 2.15
 import QtQuick.Controls 2.15
 import QtQuick.Layouts 1.15
 
 Dialog {
     id: dialog
-    title: " "
+    title: "Изменение количества"
     standardButtons: Dialog.Ok | Dialog.Cancel
     anchors.centerIn: parent
     width: 300
 
+    // Строка в ProductStore (fridgeManager.productView.sourceRow)
     property int productIndex: -1
     property bool isAdd: true
 
@@ -24,13 +25,13 @@ Dialog {
         spacing: 10
 
         Label {
-            text: isAdd ? " :" : " :"
+            text: isAdd ? "Добавить количество:" : "Израсходовать количество:"
             wrapMode: Text.Wrap
         }
 
         TextField {
             id: quantityField
-            placeholderText: " "
+            placeholderText: "Введите количество"
             validator: IntValidator { bottom: 1; top: 1000 }
             Layout.fillWidth: true
         }
@@ -40,10 +41,10 @@ Dialog {
         var amount = parseInt(quantityField.text)
         if (amount > 0) {
             if (isAdd) {
-                bridge.addProductQuantity(productIndex, amount)
+                fridgeManager.addProductQuantity(productIndex, amount)
             } else {
-                bridge.removeProductQuantity(productIndex, amount)
+                fridgeManager.removeProductQuantity(productIndex, amount)
             }
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,230 @@
+﻿#include "ReorderScan.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define REORDERSCAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang собирают AVX2/SSE4.1 только для отдельных функций, без флагов
+// на весь проект; MSVC разрешает intrinsics и так
+#if defined(REORDERSCAN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define REORDERSCAN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define REORDERSCAN_TARGET(isa)
+#endif
+
+namespace ReorderScan {
+
+namespace {
+
+int countTrailingZeros(unsigned mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+void scanScalarTail(const qint32* current, const qint32* norm, int from, int count, Result& result)
+{
+    for (int i = from; i < count; ++i) {
+        if (current[i] < norm[i]) {
+            result.rows.append(i);
+            result.totalPacks += norm[i] - current[i];
+        }
+    }
+}
+
+// Номера установленных битов маски - строки ниже нормы в блоке
+void appendRows(unsigned mask, int base, QVector<int>& rows)
+{
+    while (mask) {
+        rows.append(base + countTrailingZeros(mask));
+        mask &= mask - 1;
+    }
+}
+
+Result scanScalar(const qint32* current, const qint32* norm, int count)
+{
+    Result result;
+    scanScalarTail(current, norm, 0, count, result);
+    return result;
+}
+
+#ifdef REORDERSCAN_X86
+
+REORDERSCAN_TARGET("sse4.1")
+Result scanSse41(const qint32* current, const qint32* norm, int count)
+{
+    Result result;
+    __m128i total = _mm_setzero_si128();   // два 64-битных счетчика
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + i));
+        const __m128i nrm = _mm_loadu_si128(reinterpret_cast<const __m128i*>(norm + i));
+        const __m128i below = _mm_cmpgt_epi32(nrm, cur);
+        const unsigned mask = unsigned(_mm_movemask_ps(_mm_castsi128_ps(below)));
+        if (!mask) {
+            continue;
+        }
+
+        const __m128i shortage = _mm_and_si128(_mm_sub_epi32(nrm, cur), below);
+        total = _mm_add_epi64(total, _mm_cvtepi32_epi64(shortage));
+        total = _mm_add_epi64(total, _mm_cvtepi32_epi64(_mm_srli_si128(shortage, 8)));
+        appendRows(mask, i, result.rows);
+    }
+
+    alignas(16) qint64 lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), total);
+    result.totalPacks = lanes[0] + lanes[1];
+
+    scanScalarTail(current, norm, i, count, result);
+    return result;
+}
+
+REORDERSCAN_TARGET("avx2")
+Result scanAvx2(const qint32* current, const qint32* norm, int count)
+{
+    Result result;
+    __m256i total = _mm256_setzero_si256();   // четыре 64-битных счетчика
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        const __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + i));
+        const __m256i nrm = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(norm + i));
+        const __m256i below = _mm256_cmpgt_epi32(nrm, cur);
+        const unsigned mask = unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(below)));
+        if (!mask) {
+            continue;
+        }
+
+        const __m256i shortage = _mm256_and_si256(_mm256_sub_epi32(nrm, cur), below);
+        total = _mm256_add_epi64(total, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(shortage)));
+        total = _mm256_add_epi64(total, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(shortage, 1)));
+        appendRows(mask, i, result.rows);
+    }
+
+    alignas(32) qint64 lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), total);
+    result.totalPacks = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    scanScalarTail(current, norm, i, count, result);
+    return result;
+}
+
+bool detectSse41()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 19)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+bool detectAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // AVX2 нужна и поддержка ОС (сохранение YMM-регистров)
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool cpuHasSse41()
+{
+    static const bool supported = detectSse41();
+    return supported;
+}
+
+bool cpuHasAvx2()
+{
+    static const bool supported = detectAvx2();
+    return supported;
+}
+
+#endif // REORDERSCAN_X86
+
+} // namespace
+
+bool isSupported(Isa isa)
+{
+    switch (isa) {
+    case Isa::Scalar:
+        return true;
+#ifdef REORDERSCAN_X86
+    case Isa::Sse41:
+        return cpuHasSse41();
+    case Isa::Avx2:
+        return cpuHasAvx2();
+#endif
+    default:
+        return false;
+    }
+}
+
+Isa bestIsa()
+{
+    static const Isa best = isSupported(Isa::Avx2) ? Isa::Avx2
+        : isSupported(Isa::Sse41) ? Isa::Sse41
+        : Isa::Scalar;
+    return best;
+}
+
+const char* isaName(Isa isa)
+{
+    switch (isa) {
+    case Isa::Avx2:
+        return "avx2";
+    case Isa::Sse41:
+        return "sse4.1";
+    case Isa::Scalar:
+        break;
+    }
+    return "scalar";
+}
+
+Result scanWith(Isa isa, const qint32* current, const qint32* norm, int count)
+{
+    if (!isSupported(isa)) {
+        isa = Isa::Scalar;
+    }
+
+    switch (isa) {
+#ifdef REORDERSCAN_X86
+    case Isa::Avx2:
+        return scanAvx2(current, norm, count);
+    case Isa::Sse41:
+        return scanSse41(current, norm, count);
+#endif
+    default:
+        return scanScalar(current, norm, count);
+    }
+}
+
+Result scan(const qint32* current, const qint32* norm, int count)
+{
+    return scanWith(bestIsa(), current, norm, count);
+}
+
+} // namespace ReorderScan
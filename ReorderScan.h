@@ -0,0 +1,34 @@
+﻿#ifndef REORDERSCAN_H
+#define REORDERSCAN_H
+
+#include <QVector>
+#include <QtGlobal>
+
+// Поиск продуктов ниже нормы по двум непрерывным массивам остатков.
+//
+// За один проход собираются номера строк с current < norm и сумма
+// (norm - current) по ним. Реализация выбирается один раз при запуске по
+// возможностям процессора: AVX2, SSE4.1 или обычный цикл.
+namespace ReorderScan {
+
+enum class Isa { Scalar, Sse41, Avx2 };
+
+struct Result {
+    QVector<int> rows;
+    qint64 totalPacks = 0;
+};
+
+// Лучшая доступная реализация
+Result scan(const qint32* current, const qint32* norm, int count);
+
+// Конкретная реализация (для бенчмарков и сверки); если процессор ее не
+// поддерживает, используется обычный цикл
+Result scanWith(Isa isa, const qint32* current, const qint32* norm, int count);
+
+Isa bestIsa();
+bool isSupported(Isa isa);
+const char* isaName(Isa isa);
+
+} // namespace ReorderScan
+
+#endif // REORDERSCAN_H
@@ -0,0 +1,82 @@
+﻿#include "RowChangeBatcher.h"
+#include <algorithm>
+
+RowChangeBatcher::RowChangeBatcher(QObject* parent)
+    : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &RowChangeBatcher::flush);
+}
+
+void RowChangeBatcher::setInterval(int msec)
+{
+    m_interval = qMax(0, msec);
+    m_timer.setInterval(m_interval);
+    if (m_interval == 0) {
+        flush();
+    }
+}
+
+void RowChangeBatcher::markDirty(int row)
+{
+    if (m_interval == 0) {
+        emit rangeChanged(row, row);
+        return;
+    }
+
+    if (row >= m_dirty.size()) {
+        m_dirty.resize(row + 1);
+    }
+    if (!m_dirty.testBit(row)) {
+        m_dirty.setBit(row);
+        m_rows.append(row);
+    }
+
+    // Таймер запускается первым изменением и не продлевается следующими,
+    // поэтому поток изменений не может отложить отрисовку навсегда
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+void RowChangeBatcher::reset(int rowCount)
+{
+    m_timer.stop();
+    m_rows.clear();
+    m_dirty.fill(false, rowCount);
+}
+
+void RowChangeBatcher::flush()
+{
+    m_timer.stop();
+    if (m_rows.isEmpty()) {
+        return;
+    }
+
+    QVector<int> rows;
+    rows.swap(m_rows);
+    for (int row : rows) {
+        m_dirty.clearBit(row);
+    }
+    std::sort(rows.begin(), rows.end());
+
+    QVector<QPair<int, int>> ranges;
+    for (int i = 0; i < rows.size();) {
+        int j = i;
+        while (j + 1 < rows.size() && rows.at(j + 1) == rows.at(j) + 1) {
+            ++j;
+        }
+        ranges.append(qMakePair(rows.at(i), rows.at(j)));
+        i = j + 1;
+    }
+
+    // Слишком раздробленно - один охватывающий диапазон дешевле для QML
+    if (ranges.size() > MaxRangesPerFlush) {
+        emit rangeChanged(rows.first(), rows.last());
+        return;
+    }
+    for (const auto& range : ranges) {
+        emit rangeChanged(range.first, range.second);
+    }
+}
@@ -0,0 +1,48 @@
+﻿#ifndef ROWCHANGEBATCHER_H
+#define ROWCHANGEBATCHER_H
+
+#include <QBitArray>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+// Сборщик изменений строк модели.
+//
+// Вместо dataChanged на каждое изменение строки помечаются грязными, а раз
+// в интервал (по умолчанию - кадр при 60 Гц) отдаются непрерывными
+// диапазонами. Сколько бы изменений ни пришло между кадрами, QML получает
+// не больше MaxRangesPerFlush сигналов.
+class RowChangeBatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int FrameIntervalMs = 16;
+    static const int MaxRangesPerFlush = 32;
+
+    explicit RowChangeBatcher(QObject* parent = nullptr);
+
+    // 0 - без накопления: rangeChanged сразу из markDirty
+    void setInterval(int msec);
+    int interval() const { return m_interval; }
+
+    void markDirty(int row);
+    bool hasPending() const { return !m_rows.isEmpty(); }
+
+    // Сброс при полной перезагрузке модели: ожидающие изменения не нужны
+    void reset(int rowCount);
+
+public slots:
+    void flush();
+
+signals:
+    void rangeChanged(int first, int last);
+
+private:
+    int m_interval = 0;
+    QTimer m_timer;
+    QBitArray m_dirty;
+    QVector<int> m_rows;
+};
+
+#endif // ROWCHANGEBATCHER_H
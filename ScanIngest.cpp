@@ -0,0 +1,288 @@
+﻿#include "ScanIngest.h"
+#include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace {
+
+#ifdef Q_OS_LINUX
+// Раскладка US по кодам клавиш evdev (KEY_1 = 2 ... KEY_SLASH = 53):
+// сканеры-клавиатуры шлют коды так, будто раскладка английская
+const char KeyChars[] =
+    "\0\0" "1234567890-=" "\0\0" "qwertyuiop[]" "\0\0" "asdfghjkl;'`" "\0\\" "zxcvbnm,./";
+
+char keyChar(int code, bool shift)
+{
+    if (code < 0 || code >= int(sizeof(KeyChars)) - 1) {
+        return 0;
+    }
+    const char c = KeyChars[code];
+    return shift && c >= 'a' && c <= 'z' ? char(c - 'a' + 'A') : c;
+}
+#endif
+
+} // namespace
+
+ScanIngest::ScanIngest(QObject* parent)
+    : QObject(parent)
+    , m_index(new BarcodeIndex())
+{
+    m_clock.start();
+    connect(&m_drainTimer, &QTimer::timeout, this, &ScanIngest::drain);
+    m_drainTimer.start(DefaultDrainIntervalMs);
+}
+
+ScanIngest::~ScanIngest()
+{
+    stop();
+}
+
+void ScanIngest::setIndex(const BarcodeIndex& index)
+{
+    QSharedPointer<const BarcodeIndex> copy(new BarcodeIndex(index));
+    QMutexLocker locker(&m_indexMutex);
+    m_index = copy;
+}
+
+void ScanIngest::setDrainInterval(int msec)
+{
+    m_drainTimer.start(qMax(1, msec));
+}
+
+bool ScanIngest::start(const QString& source)
+{
+    stop();
+
+#ifdef Q_OS_UNIX
+    const bool evdev = source.startsWith("evdev:");
+    const QString path = evdev ? source.mid(6) : source;
+#ifndef Q_OS_LINUX
+    if (evdev) {
+        m_lastError = "evdev scanner input is supported on Linux only";
+        return false;
+    }
+#endif
+
+    // O_NONBLOCK: открытие FIFO не ждет пишущего
+    m_fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_NONBLOCK);
+    if (m_fd < 0) {
+        m_lastError = QString("Cannot open scanner input %1: %2").arg(path, QString::fromLocal8Bit(std::strerror(errno)));
+        return false;
+    }
+
+#ifdef Q_OS_LINUX
+    if (evdev && ::ioctl(m_fd, EVIOCGRAB, 1) != 0) {
+        qWarning() << "⚠️ Scanner device not grabbed, keystrokes also reach the window:" << path;
+    }
+#endif
+
+    m_stop.store(false);
+    const int fd = m_fd;
+    m_reader = QThread::create([this, fd, evdev]() { readLoop(fd, evdev); });
+    m_reader->start();
+    qDebug() << "🏷️ Scanner input started:" << source;
+    return true;
+#else
+    m_lastError = "Scanner input " + source + " is not supported on this platform, use keyboard-wedge mode";
+    return false;
+#endif
+}
+
+void ScanIngest::stop()
+{
+    if (!m_reader) {
+        return;
+    }
+
+    m_stop.store(true);
+    m_reader->wait();
+    delete m_reader;
+    m_reader = nullptr;
+#ifdef Q_OS_UNIX
+    ::close(m_fd);
+#endif
+    m_fd = -1;
+    drain();
+}
+
+bool ScanIngest::submit(const QString& code)
+{
+    return accept(code.toLatin1(), m_submitDebounce);
+}
+
+bool ScanIngest::accept(const QByteArray& code, Debounce& debounce)
+{
+    const QByteArray normalized = BarcodeIndex::normalize(code);
+    if (normalized.isEmpty() || normalized.size() > MaxCodeLength) {
+        return false;
+    }
+
+    const qint64 nowMs = m_clock.elapsed();
+    if (normalized == debounce.code && debounce.atMs >= 0 && nowMs - debounce.atMs < m_debounceMs.load()) {
+        ++m_duplicates;
+        return false;
+    }
+
+    QSharedPointer<const BarcodeIndex> index;
+    {
+        QMutexLocker locker(&m_indexMutex);
+        index = m_index;
+    }
+    const BarcodeIndex::Entry* entry = index->find(normalized);
+    if (!entry) {
+        ++m_unknown;
+        emit unknownBarcode(QString::fromLatin1(normalized));
+        return false;
+    }
+
+    ScanEvent event;
+    event.productId = entry->productId;
+    event.amount = entry->packQuantity;
+    if (!m_queue.tryPush(event)) {
+        ++m_dropped;
+        qWarning() << "❌ Scan queue full, scan dropped:" << normalized;
+        return false;
+    }
+
+    debounce.code = normalized;
+    debounce.atMs = nowMs;
+    ++m_accepted;
+    return true;
+}
+
+void ScanIngest::drain()
+{
+    // Сканирования одного продукта за интервал - одна операция
+    QVector<StockOperation> operations;
+    QHash<int, int> rowForProduct;
+    ScanEvent event;
+    while (m_queue.tryPop(event)) {
+        auto it = rowForProduct.constFind(event.productId);
+        if (it != rowForProduct.cend()) {
+            operations[it.value()].amount += event.amount;
+        }
+        else {
+            rowForProduct.insert(event.productId, operations.size());
+            operations.append(StockOperation(StockOperation::Add, event.productId, event.amount));
+        }
+    }
+
+    if (!operations.isEmpty()) {
+        emit scansReady(operations);
+    }
+}
+
+void ScanIngest::readLoop(int fd, bool evdev)
+{
+#ifdef Q_OS_UNIX
+    Debounce debounce;
+    QByteArray code;
+    bool shift = false;
+    bool overlong = false;
+
+    auto endOfCode = [&]() {
+        if (!overlong) {
+            accept(code, debounce);
+        }
+        code.clear();
+        overlong = false;
+    };
+    auto appendChar = [&](char c) {
+        if (code.size() >= MaxCodeLength) {
+            overlong = true;   // не штрихкод: строка целиком отбрасывается
+        }
+        else {
+            code.append(c);
+        }
+    };
+
+    while (!m_stop.load()) {
+        pollfd request;
+        request.fd = fd;
+        request.events = POLLIN;
+        request.revents = 0;
+        const int ready = ::poll(&request, 1, PollIntervalMs);
+        if (ready < 0 && errno != EINTR) {
+            qWarning() << "❌ Scanner input failed:" << std::strerror(errno);
+            return;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        if (request.revents & (POLLERR | POLLNVAL)) {
+            qWarning() << "❌ Scanner input closed";
+            return;
+        }
+
+#ifdef Q_OS_LINUX
+        if (evdev) {
+            input_event events[64];
+            const ssize_t size = ::read(fd, events, sizeof(events));
+            if (size < 0 && errno != EAGAIN && errno != EINTR) {
+                qWarning() << "❌ Scanner device read failed:" << std::strerror(errno);
+                return;
+            }
+            for (int i = 0; i < int(qMax<ssize_t>(size, 0) / ssize_t(sizeof(input_event))); ++i) {
+                const input_event& key = events[i];
+                if (key.type != EV_KEY) {
+                    continue;
+                }
+                if (key.code == KEY_LEFTSHIFT || key.code == KEY_RIGHTSHIFT) {
+                    shift = key.value != 0;
+                }
+                else if (key.value == 1 && (key.code == KEY_ENTER || key.code == KEY_KPENTER)) {
+                    endOfCode();
+                }
+                else if (key.value == 1) {
+                    const char c = keyChar(key.code, shift);
+                    if (c) {
+                        appendChar(c);
+                    }
+                }
+            }
+            continue;
+        }
+#else
+        Q_UNUSED(evdev);
+        Q_UNUSED(shift);
+#endif
+
+        char buffer[4096];
+        const ssize_t size = ::read(fd, buffer, sizeof(buffer));
+        if (size < 0 && errno != EAGAIN && errno != EINTR) {
+            qWarning() << "❌ Scanner input read failed:" << std::strerror(errno);
+            return;
+        }
+        if (size <= 0) {
+            // Конец файла или у FIFO нет пишущего: ждем новых строк
+            QThread::msleep(PollIntervalMs);
+            continue;
+        }
+        for (ssize_t i = 0; i < size; ++i) {
+            const char c = buffer[i];
+            if (c == '\n' || c == '\r') {
+                endOfCode();
+            }
+            else {
+                appendChar(c);
+            }
+        }
+    }
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(evdev);
+#endif
+}
@@ -0,0 +1,105 @@
+﻿#ifndef SCANINGEST_H
+#define SCANINGEST_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include "BarcodeIndex.h"
+#include "DatabaseManager.h"
+#include "ScanQueue.h"
+
+// Распознанное сканирование: продукт и сколько упаковок добавить
+struct ScanEvent {
+    int productId = 0;
+    int amount = 0;
+};
+
+// Прием штрихкодов при разгрузке поставки.
+//
+// Коды приходят из источника в отдельном потоке (сканер-клавиатура через
+// evdev или файл/FIFO с кодом на строку) или из интерфейса через
+// submit() - сканер в режиме клавиатуры печатает в поле ввода. Каждый код
+// ищется в BarcodeIndex, повтор того же кода быстрее debounceMs
+// отбрасывается (двойное срабатывание курка). Распознанные сканирования
+// идут в ScanQueue без блокировок; раз в интервал очередь разбирается в
+// потоке владельца, сканирования одного продукта складываются, и
+// scansReady отдает пакет операций для одной транзакции.
+class ScanIngest : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int DefaultDebounceMs = 500;
+    static const int DefaultDrainIntervalMs = 100;
+    static const int QueueCapacity = 4096;
+    static const int MaxCodeLength = 48;
+    static const int PollIntervalMs = 100;
+
+    explicit ScanIngest(QObject* parent = nullptr);
+    ~ScanIngest();
+
+    // "evdev:/dev/input/eventN" - сканер-клавиатура напрямую (Linux, устройство
+    // захватывается, нажатия не попадают в окно); любой другой путь - файл или
+    // FIFO, по коду на строку. Файл дочитывается по мере дописывания.
+    bool start(const QString& source);
+    void stop();
+    bool isRunning() const { return m_reader != nullptr; }
+
+    // Можно вызывать из любого потока: поток чтения подхватит новый индекс
+    void setIndex(const BarcodeIndex& index);
+    void setDebounceMs(int msec) { m_debounceMs.store(msec); }
+    void setDrainInterval(int msec);
+
+    // Код из интерфейса; false - код не распознан или отброшен
+    bool submit(const QString& code);
+
+    // Разобрать очередь сейчас, не дожидаясь таймера
+    void drain();
+
+    quint64 acceptedCount() const { return m_accepted.load(); }
+    quint64 duplicateCount() const { return m_duplicates.load(); }
+    quint64 unknownCount() const { return m_unknown.load(); }
+    quint64 droppedCount() const { return m_dropped.load(); }
+
+    QString getLastError() const { return m_lastError; }
+
+signals:
+    // Сложенные по продукту приходы (StockOperation::Add)
+    void scansReady(const QVector<StockOperation>& operations);
+    void unknownBarcode(const QString& code);
+
+private:
+    // Последний принятый код источника; у каждого писателя свой
+    struct Debounce {
+        QByteArray code;
+        qint64 atMs = -1;
+    };
+
+    bool accept(const QByteArray& code, Debounce& debounce);
+    void readLoop(int fd, bool evdev);
+
+    ScanQueue<ScanEvent> m_queue { QueueCapacity };
+    QMutex m_indexMutex;
+    QSharedPointer<const BarcodeIndex> m_index;
+    QElapsedTimer m_clock;
+    QTimer m_drainTimer;
+    Debounce m_submitDebounce;
+
+    QThread* m_reader = nullptr;
+    int m_fd = -1;
+    std::atomic<bool> m_stop { false };
+    std::atomic<int> m_debounceMs { DefaultDebounceMs };
+
+    std::atomic<quint64> m_accepted { 0 };
+    std::atomic<quint64> m_duplicates { 0 };
+    std::atomic<quint64> m_unknown { 0 };
+    std::atomic<quint64> m_dropped { 0 };
+    QString m_lastError;
+};
+
+#endif // SCANINGEST_H
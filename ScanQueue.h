@@ -0,0 +1,94 @@
+﻿#ifndef SCANQUEUE_H
+#define SCANQUEUE_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <memory>
+
+// Ограниченная очередь без блокировок (кольцо с номерами ячеек): несколько
+// писателей - поток чтения сканера и интерфейс, один или несколько
+// читателей. Писатель и читатель захватывают ячейку сравнением с обменом
+// счетчика, готовность ячейки передается ее номером, так что ни
+// tryPush, ни tryPop не ждут друг друга. Емкость округляется вверх до
+// степени двойки; в полной очереди tryPush возвращает false.
+template<typename T>
+class ScanQueue
+{
+public:
+    explicit ScanQueue(int capacity)
+    {
+        int size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        m_mask = quint64(size - 1);
+        m_cells.reset(new Cell[size]);
+        for (int i = 0; i < size; ++i) {
+            m_cells[i].sequence.store(quint64(i), std::memory_order_relaxed);
+        }
+    }
+
+    int capacity() const { return int(m_mask + 1); }
+
+    bool tryPush(const T& value)
+    {
+        quint64 position = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[position & m_mask];
+            const quint64 sequence = cell.sequence.load(std::memory_order_acquire);
+            const qint64 difference = qint64(sequence) - qint64(position);
+            if (difference == 0) {
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;   // полная: ячейку еще не освободил читатель
+            }
+            else {
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value)
+    {
+        quint64 position = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[position & m_mask];
+            const quint64 sequence = cell.sequence.load(std::memory_order_acquire);
+            const qint64 difference = qint64(sequence) - qint64(position + 1);
+            if (difference == 0) {
+                if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;   // пустая
+            }
+            else {
+                position = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(ScanQueue)
+
+    struct Cell {
+        std::atomic<quint64> sequence;
+        T value;
+    };
+
+    // Счетчики писателей и читателей в разных строках кэша
+    alignas(64) std::atomic<quint64> m_tail { 0 };
+    alignas(64) std::atomic<quint64> m_head { 0 };
+    alignas(64) std::unique_ptr<Cell[]> m_cells;
+    quint64 m_mask = 0;
+};
+
+#endif // SCANQUEUE_H
@@ -0,0 +1,614 @@
+﻿#include "StockHistory.h"
+#include <QDebug>
+#include <QPair>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+const char HistoryMagic[] = "FSHI";
+const quint8 HistoryFormatVersion = 1;
+const int FileHeaderSize = 8;              // магия, версия, резерв
+const int RecordHeaderSize = 5;            // вид записи, длина (LE)
+const int BlockHeaderSize = 32;            // firstMs, lastMs, снимков, строк каталога, байт времен, резерв
+const int DirectoryEntrySize = 8;          // id, смещение цепочки (LE)
+
+const char SnapshotRecord = 'S';
+const char BlockRecord = 'B';
+
+// Файл перепаковки рядом с историей: смещение хвоста (LE) и запись блока
+const char CompactionSuffix[] = ".compact";
+const int CompactionHeaderSize = 8;
+
+void appendVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char(quint8(value) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(quint8(value)));
+}
+
+void appendSigned(QByteArray& out, qint64 value)
+{
+    appendVarint(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+template<typename T>
+void appendFixed(QByteArray& out, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+// Чтение varint'ов из буфера; при выходе за границу ok становится false
+class VarintReader
+{
+public:
+    VarintReader(const QByteArray& data, int pos = 0) : m_data(data), m_pos(pos) {}
+
+    quint64 next() {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (m_pos >= m_data.size()) {
+                m_ok = false;
+                return 0;
+            }
+            const quint8 byte = quint8(m_data.at(m_pos++));
+            value |= quint64(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        m_ok = false;
+        return 0;
+    }
+
+    qint64 nextSigned() {
+        const quint64 raw = next();
+        return qint64(raw >> 1) ^ -qint64(raw & 1);
+    }
+
+    bool ok() const { return m_ok; }
+    bool atEnd() const { return m_pos >= m_data.size(); }
+
+private:
+    const QByteArray& m_data;
+    int m_pos;
+    bool m_ok = true;
+};
+
+QByteArray recordBytes(char type, const QByteArray& payload)
+{
+    QByteArray record;
+    record.reserve(RecordHeaderSize + payload.size());
+    record.append(type);
+    appendFixed<quint32>(record, quint32(payload.size()));
+    record.append(payload);
+    return record;
+}
+
+} // namespace
+
+StockHistory::~StockHistory()
+{
+    close();
+}
+
+bool StockHistory::open(const QString& filePath)
+{
+    close();
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        m_lastError = "Cannot open stock history " + filePath + ": " + m_file.errorString();
+        return false;
+    }
+
+    if (m_file.size() == 0) {
+        QByteArray header(HistoryMagic, 4);
+        header.append(char(HistoryFormatVersion));
+        header.append(3, '\0');
+        if (m_file.write(header) != header.size() || !m_file.flush()) {
+            m_lastError = "Cannot write stock history header: " + m_file.errorString();
+            m_file.close();
+            return false;
+        }
+    }
+
+    if (!finishCompaction() || !scan()) {
+        m_file.close();
+        return false;
+    }
+
+    qDebug() << "📈 Stock history opened:" << snapshotCount() << "snapshots in" << m_blocks.size() << "blocks";
+    return true;
+}
+
+void StockHistory::close()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_blocks.clear();
+    m_tail.clear();
+    m_tailOffset = 0;
+}
+
+bool StockHistory::scan()
+{
+    QByteArray header;
+    if (!readAt(0, FileHeaderSize, header) || !header.startsWith(QByteArray(HistoryMagic, 4))) {
+        m_lastError = m_file.fileName() + " is not a stock history file";
+        return false;
+    }
+    if (quint8(header.at(4)) != HistoryFormatVersion) {
+        m_lastError = QString("Unsupported stock history version %1").arg(quint8(header.at(4)));
+        return false;
+    }
+
+    // По заголовкам записей: у блоков читается только их заголовок,
+    // хвостовые снимки декодируются целиком (их не больше SnapshotsPerBlock)
+    qint64 pos = FileHeaderSize;
+    m_tailOffset = -1;
+    const qint64 fileSize = m_file.size();
+    while (pos < fileSize) {
+        QByteArray recordHeader;
+        if (!readAt(pos, RecordHeaderSize, recordHeader)) {
+            break;
+        }
+        const char type = recordHeader.at(0);
+        const qint64 length = qFromLittleEndian<quint32>(recordHeader.constData() + 1);
+        const qint64 payloadOffset = pos + RecordHeaderSize;
+        if (payloadOffset + length > fileSize) {
+            break;
+        }
+
+        bool valid = false;
+        if (type == BlockRecord && m_tailOffset < 0) {
+            QByteArray blockHeader;
+            if (length >= BlockHeaderSize && readAt(payloadOffset, BlockHeaderSize, blockHeader)) {
+                const char* data = blockHeader.constData();
+                Block block;
+                block.offset = payloadOffset;
+                block.length = length;
+                block.firstMs = qFromLittleEndian<qint64>(data);
+                block.lastMs = qFromLittleEndian<qint64>(data + 8);
+                block.snapshots = qFromLittleEndian<qint32>(data + 16);
+                block.entries = qFromLittleEndian<qint32>(data + 20);
+                block.timesBytes = qFromLittleEndian<qint32>(data + 24);
+                valid = BlockHeaderSize + block.timesBytes + qint64(block.entries) * DirectoryEntrySize <= length;
+                if (valid) {
+                    m_blocks.append(block);
+                }
+            }
+        }
+        else if (type == SnapshotRecord) {
+            QByteArray payload;
+            Snapshot snapshot;
+            if (readAt(payloadOffset, length, payload) && decodeSnapshot(payload, snapshot)) {
+                if (m_tailOffset < 0) {
+                    m_tailOffset = pos;
+                }
+                m_tail.append(snapshot);
+                valid = true;
+            }
+        }
+
+        if (!valid) {
+            break;
+        }
+        pos = payloadOffset + length;
+    }
+
+    // Недописанная запись (процесс упал во время записи) отрезается
+    if (pos < fileSize) {
+        qWarning() << "⚠️ Stock history truncated at byte" << pos << "of" << fileSize;
+        if (!m_file.resize(pos)) {
+            m_lastError = "Cannot repair stock history: " + m_file.errorString();
+            return false;
+        }
+    }
+    if (m_tailOffset < 0) {
+        m_tailOffset = pos;
+    }
+    return true;
+}
+
+bool StockHistory::decodeSnapshot(const QByteArray& payload, Snapshot& snapshot) const
+{
+    // Первый снимок хвоста - абсолютные значения, остальные - разность с предыдущим
+    const Snapshot* previous = m_tail.isEmpty() ? nullptr : &m_tail.last();
+
+    VarintReader reader(payload);
+    snapshot.timeMs = reader.nextSigned();
+    const quint64 count = reader.next();
+    if (!reader.ok() || count > quint64(payload.size())) {
+        return false;
+    }
+
+    snapshot.ids.resize(int(count));
+    snapshot.quantities.resize(int(count));
+    int id = 0;
+    int previousRow = 0;
+    for (int i = 0; i < int(count); ++i) {
+        id += int(reader.next());
+        qint64 base = 0;
+        if (previous) {
+            // id идут по возрастанию в обоих снимках - слияние за один проход
+            while (previousRow < previous->ids.size() && previous->ids.at(previousRow) < id) {
+                ++previousRow;
+            }
+            if (previousRow < previous->ids.size() && previous->ids.at(previousRow) == id) {
+                base = previous->quantities.at(previousRow);
+            }
+        }
+        snapshot.ids[i] = id;
+        snapshot.quantities[i] = qint32(base + reader.nextSigned());
+    }
+    return reader.ok() && reader.atEnd();
+}
+
+bool StockHistory::append(qint64 timeMs, const QVector<int>& productIds, const QVector<qint32>& quantities)
+{
+    if (!isOpen()) {
+        m_lastError = "Stock history is not open";
+        return false;
+    }
+    if (productIds.size() != quantities.size()) {
+        m_lastError = "Product ids and quantities differ in size";
+        return false;
+    }
+    if (timeMs <= lastSnapshotMs()) {
+        m_lastError = "Snapshot time must grow";
+        return false;
+    }
+
+    Snapshot snapshot;
+    snapshot.timeMs = timeMs;
+    QVector<int> order(productIds.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&productIds](int a, int b) { return productIds.at(a) < productIds.at(b); });
+    snapshot.ids.reserve(order.size());
+    snapshot.quantities.reserve(order.size());
+    for (int row : order) {
+        if (snapshot.ids.isEmpty() || snapshot.ids.last() != productIds.at(row)) {
+            snapshot.ids.append(productIds.at(row));
+            snapshot.quantities.append(quantities.at(row));
+        }
+    }
+
+    QByteArray payload;
+    payload.reserve(snapshot.ids.size() * 3 + 16);
+    appendSigned(payload, timeMs);
+    appendVarint(payload, quint64(snapshot.ids.size()));
+
+    const Snapshot* previous = m_tail.isEmpty() ? nullptr : &m_tail.last();
+    int previousId = 0;
+    int previousRow = 0;
+    for (int i = 0; i < snapshot.ids.size(); ++i) {
+        const int id = snapshot.ids.at(i);
+        qint64 base = 0;
+        if (previous) {
+            while (previousRow < previous->ids.size() && previous->ids.at(previousRow) < id) {
+                ++previousRow;
+            }
+            if (previousRow < previous->ids.size() && previous->ids.at(previousRow) == id) {
+                base = previous->quantities.at(previousRow);
+            }
+        }
+        appendVarint(payload, quint64(id - previousId));
+        appendSigned(payload, snapshot.quantities.at(i) - base);
+        previousId = id;
+    }
+
+    if (!m_file.seek(m_file.size()) || !writeRecord(SnapshotRecord, payload)) {
+        return false;
+    }
+    m_tail.append(snapshot);
+
+    if (m_tail.size() >= SnapshotsPerBlock) {
+        return compact();
+    }
+    return true;
+}
+
+bool StockHistory::compact()
+{
+    // Строки каталога: непрерывные участки присутствия продукта в снимках
+    struct Run {
+        int id;
+        int first;
+        QVector<qint32> values;
+    };
+
+    // Продукты предыдущего снимка с их открытыми участками; оба снимка
+    // отсортированы по id, продолжение участка находится слиянием
+    QVector<Run> runs;
+    QVector<QPair<int, int>> openRuns;      // id -> индекс в runs
+    for (int index = 0; index < m_tail.size(); ++index) {
+        const Snapshot& snapshot = m_tail.at(index);
+        QVector<QPair<int, int>> stillOpen;
+        stillOpen.reserve(snapshot.ids.size());
+        int previous = 0;
+        for (int i = 0; i < snapshot.ids.size(); ++i) {
+            const int id = snapshot.ids.at(i);
+            while (previous < openRuns.size() && openRuns.at(previous).first < id) {
+                ++previous;
+            }
+            int run = 0;
+            if (previous < openRuns.size() && openRuns.at(previous).first == id) {
+                run = openRuns.at(previous).second;
+            }
+            else {
+                run = runs.size();
+                runs.append({ id, index, {} });
+            }
+            runs[run].values.append(snapshot.quantities.at(i));
+            stillOpen.append(qMakePair(id, run));
+        }
+        openRuns.swap(stillOpen);
+    }
+    std::sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) {
+        return a.id != b.id ? a.id < b.id : a.first < b.first;
+    });
+
+    QByteArray times;
+    qint64 previousMs = m_tail.first().timeMs;
+    for (const Snapshot& snapshot : m_tail) {
+        appendVarint(times, quint64(snapshot.timeMs - previousMs));
+        previousMs = snapshot.timeMs;
+    }
+
+    QByteArray chains;
+    QByteArray directory;
+    directory.reserve(runs.size() * DirectoryEntrySize);
+    for (const Run& run : runs) {
+        appendFixed<qint32>(directory, run.id);
+        appendFixed<quint32>(directory, quint32(chains.size()));
+        appendVarint(chains, quint64(run.first));
+        appendVarint(chains, quint64(run.values.size()));
+        qint64 previous = 0;
+        for (qint32 value : run.values) {
+            appendSigned(chains, value - previous);
+            previous = value;
+        }
+    }
+
+    QByteArray payload;
+    payload.reserve(BlockHeaderSize + times.size() + directory.size() + chains.size());
+    appendFixed<qint64>(payload, m_tail.first().timeMs);
+    appendFixed<qint64>(payload, m_tail.last().timeMs);
+    appendFixed<qint32>(payload, m_tail.size());
+    appendFixed<qint32>(payload, runs.size());
+    appendFixed<qint32>(payload, times.size());
+    appendFixed<qint32>(payload, 0);
+    payload.append(times);
+    payload.append(directory);
+    payload.append(chains);
+
+    // Блок заменяет хвост на месте, но сначала целиком ложится в файл
+    // перепаковки: хвост отрезается только когда его замена уже на диске.
+    // Если процесс упадет между этими шагами, open() доведет замену до конца.
+    QSaveFile pending(m_file.fileName() + CompactionSuffix);
+    QByteArray journal;
+    appendFixed<qint64>(journal, m_tailOffset);
+    journal.append(recordBytes(BlockRecord, payload));
+    if (!pending.open(QIODevice::WriteOnly) || pending.write(journal) != journal.size() || !pending.commit()) {
+        m_lastError = "Cannot write stock history block: " + pending.errorString();
+        return false;
+    }
+    if (!finishCompaction()) {
+        // Хвост на диске мог уже быть отрезан: дописывать дальше нельзя,
+        // замену доведет следующий open()
+        close();
+        return false;
+    }
+
+    Block block;
+    block.offset = m_tailOffset + RecordHeaderSize;
+    block.length = payload.size();
+    block.firstMs = m_tail.first().timeMs;
+    block.lastMs = m_tail.last().timeMs;
+    block.snapshots = m_tail.size();
+    block.entries = runs.size();
+    block.timesBytes = times.size();
+    m_blocks.append(block);
+
+    qDebug() << "📈 Stock history block" << m_blocks.size() << ":" << block.snapshots << "snapshots,"
+        << payload.size() << "bytes";
+    m_tail.clear();
+    m_tailOffset = m_file.size();
+    return true;
+}
+
+bool StockHistory::finishCompaction()
+{
+    QFile pending(m_file.fileName() + CompactionSuffix);
+    if (!pending.exists()) {
+        return true;
+    }
+    if (!pending.open(QIODevice::ReadOnly)) {
+        m_lastError = "Cannot read stock history block: " + pending.errorString();
+        return false;
+    }
+    const QByteArray journal = pending.readAll();
+    pending.close();
+
+    // Повторное применение безопасно: хвост снова отрезается по тому же смещению
+    const qint64 tailOffset = journal.size() >= CompactionHeaderSize + RecordHeaderSize
+        ? qFromLittleEndian<qint64>(journal.constData()) : -1;
+    const QByteArray record = journal.mid(CompactionHeaderSize);
+    const bool valid = tailOffset >= FileHeaderSize && tailOffset <= m_file.size()
+        && record.at(0) == BlockRecord
+        && qFromLittleEndian<quint32>(record.constData() + 1) == quint32(record.size() - RecordHeaderSize);
+    if (!valid) {
+        // QSaveFile не оставляет недописанных файлов; чужой файл хвост не трогает
+        qWarning() << "⚠️ Ignoring invalid stock history block" << pending.fileName();
+    }
+    else if (!m_file.resize(tailOffset) || !m_file.seek(tailOffset)
+        || m_file.write(record) != record.size() || !m_file.flush()) {
+        m_lastError = "Cannot write stock history block: " + m_file.errorString();
+        return false;
+    }
+
+    if (!pending.remove()) {
+        m_lastError = "Cannot remove " + pending.fileName() + ": " + pending.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool StockHistory::writeRecord(char type, const QByteArray& payload)
+{
+    const QByteArray record = recordBytes(type, payload);
+    if (m_file.write(record) != record.size() || !m_file.flush()) {
+        m_lastError = "Cannot write stock history: " + m_file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool StockHistory::readAt(qint64 offset, qint64 size, QByteArray& data)
+{
+    if (!m_file.seek(offset)) {
+        return false;
+    }
+    data = m_file.read(size);
+    return data.size() == size;
+}
+
+qint64 StockHistory::lastSnapshotMs() const
+{
+    if (!m_tail.isEmpty()) {
+        return m_tail.last().timeMs;
+    }
+    return m_blocks.isEmpty() ? 0 : m_blocks.last().lastMs;
+}
+
+int StockHistory::snapshotCount() const
+{
+    int count = m_tail.size();
+    for (const Block& block : m_blocks) {
+        count += block.snapshots;
+    }
+    return count;
+}
+
+QVector<StockPoint> StockHistory::history(int productId, qint64 fromMs, qint64 toMs)
+{
+    QVector<StockPoint> points;
+    if (!isOpen() || fromMs > toMs) {
+        return points;
+    }
+
+    // Первый блок, который заканчивается не раньше начала периода
+    auto block = std::lower_bound(m_blocks.cbegin(), m_blocks.cend(), fromMs,
+        [](const Block& b, qint64 ms) { return b.lastMs < ms; });
+    for (; block != m_blocks.cend() && block->firstMs <= toMs; ++block) {
+        if (!readBlock(*block, productId, fromMs, toMs, points)) {
+            qWarning() << "❌ Stock history read failed:" << m_lastError;
+            break;
+        }
+    }
+
+    for (const Snapshot& snapshot : m_tail) {
+        if (snapshot.timeMs < fromMs || snapshot.timeMs > toMs) {
+            continue;
+        }
+        auto it = std::lower_bound(snapshot.ids.cbegin(), snapshot.ids.cend(), productId);
+        if (it != snapshot.ids.cend() && *it == productId) {
+            points.append({ snapshot.timeMs, snapshot.quantities.at(int(it - snapshot.ids.cbegin())) });
+        }
+    }
+    return points;
+}
+
+bool StockHistory::readBlock(const Block& block, int productId, qint64 fromMs, qint64 toMs,
+    QVector<StockPoint>& points)
+{
+    const qint64 directoryOffset = block.offset + BlockHeaderSize + block.timesBytes;
+    const qint64 chainsOffset = directoryOffset + qint64(block.entries) * DirectoryEntrySize;
+    const qint64 chainsEnd = block.offset + block.length;
+
+    // Двоичный поиск по каталогу: строки фиксированной ширины читаются по одной
+    QByteArray entry;
+    int low = 0;
+    int high = block.entries;
+    while (low < high) {
+        const int middle = (low + high) / 2;
+        if (!readAt(directoryOffset + qint64(middle) * DirectoryEntrySize, 4, entry)) {
+            m_lastError = "Cannot read stock history directory";
+            return false;
+        }
+        if (qFromLittleEndian<qint32>(entry.constData()) < productId) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    QByteArray times;
+    bool timesRead = false;
+    for (int row = low; row < block.entries; ++row) {
+        // Текущая строка и начало следующей - границы цепочки (за последней
+        // строкой лежат цепочки, прочитанные лишние байты не используются)
+        if (!readAt(directoryOffset + qint64(row) * DirectoryEntrySize, 2 * DirectoryEntrySize, entry)) {
+            m_lastError = "Cannot read stock history directory";
+            return false;
+        }
+        if (qFromLittleEndian<qint32>(entry.constData()) != productId) {
+            break;
+        }
+        const qint64 start = chainsOffset + qFromLittleEndian<quint32>(entry.constData() + 4);
+        const qint64 end = row + 1 < block.entries
+            ? chainsOffset + qFromLittleEndian<quint32>(entry.constData() + DirectoryEntrySize + 4)
+            : chainsEnd;
+
+        if (!timesRead) {
+            if (!readAt(block.offset + BlockHeaderSize, block.timesBytes, times)) {
+                m_lastError = "Cannot read stock history times";
+                return false;
+            }
+            timesRead = true;
+        }
+
+        QByteArray chain;
+        if (end < start || !readAt(start, end - start, chain)) {
+            m_lastError = "Cannot read stock history chain";
+            return false;
+        }
+
+        // Время снимка с номером first: сумма разностей до него
+        VarintReader timeReader(times);
+        VarintReader reader(chain);
+        const int first = int(reader.next());
+        const int count = int(reader.next());
+        qint64 timeMs = block.firstMs;
+        for (int index = 0; index <= first && index < block.snapshots; ++index) {
+            timeMs += qint64(timeReader.next());
+        }
+
+        qint64 value = 0;
+        for (int i = 0; i < count && reader.ok(); ++i) {
+            if (i > 0) {
+                timeMs += qint64(timeReader.next());
+            }
+            value += reader.nextSigned();
+            if (timeMs > toMs) {
+                break;
+            }
+            if (timeMs >= fromMs) {
+                points.append({ timeMs, int(value) });
+            }
+        }
+        if (!reader.ok() || !timeReader.ok()) {
+            m_lastError = "Corrupted stock history block";
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+﻿#ifndef STOCKHISTORY_H
+#define STOCKHISTORY_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// Остаток продукта в момент снимка
+struct StockPoint {
+    qint64 timeMs;
+    int quantity;
+};
+
+// История остатков для графиков: снимки всех остатков через равные
+// интервалы в локальном файле.
+//
+// Новый снимок дописывается в хвост файла разностью с предыдущим (id и
+// остатки varint'ами). Каждые SnapshotsPerBlock снимков хвост
+// перепаковывается в блок по продуктам: в блоке каталог "id -> смещение"
+// фиксированной ширины, за ним по каждому продукту цепочка разностей во
+// времени. Индекс блоков (время -> смещение) строится при открытии по
+// заголовкам записей. История одного продукта за период читает только
+// блоки этого периода, в них - двоичный поиск по каталогу и одну цепочку;
+// остатки остальных продуктов не декодируются. Блок сначала пишется в
+// файл перепаковки рядом с историей и только потом заменяет хвост, так
+// что падение посреди перепаковки не теряет снимки.
+class StockHistory
+{
+public:
+    static const int SnapshotsPerBlock = 64;
+    static const qint64 DefaultIntervalMs = 60 * 60 * 1000;
+
+    StockHistory() = default;
+    ~StockHistory();
+
+    bool open(const QString& filePath);
+    void close();
+    bool isOpen() const { return m_file.isOpen(); }
+
+    // Снимок остатков (productIds[i] -> quantities[i]); время строго больше предыдущего
+    bool append(qint64 timeMs, const QVector<int>& productIds, const QVector<qint32>& quantities);
+
+    qint64 lastSnapshotMs() const;
+    int snapshotCount() const;
+    int blockCount() const { return m_blocks.size(); }
+
+    // Точки продукта за [fromMs, toMs] по возрастанию времени
+    QVector<StockPoint> history(int productId, qint64 fromMs, qint64 toMs);
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    // Снимок хвоста, декодированный в память: id по возрастанию
+    struct Snapshot {
+        qint64 timeMs = 0;
+        QVector<int> ids;
+        QVector<qint32> quantities;
+    };
+
+    // Блок в индексе: где лежит и какой период покрывает
+    struct Block {
+        qint64 offset;          // начало данных записи
+        qint64 length;
+        qint64 firstMs;
+        qint64 lastMs;
+        int snapshots;
+        int entries;            // строк каталога
+        int timesBytes;
+    };
+
+    bool scan();
+    bool decodeSnapshot(const QByteArray& payload, Snapshot& snapshot) const;
+    bool compact();
+    bool finishCompaction();
+    bool writeRecord(char type, const QByteArray& payload);
+    bool readAt(qint64 offset, qint64 size, QByteArray& data);
+    bool readBlock(const Block& block, int productId, qint64 fromMs, qint64 toMs, QVector<StockPoint>& points);
+
+    QFile m_file;
+    QVector<Block> m_blocks;            // по времени
+    QVector<Snapshot> m_tail;
+    qint64 m_tailOffset = 0;            // начало хвоста в файле
+    QString m_lastError;
+};
+
+#endif // STOCKHISTORY_H
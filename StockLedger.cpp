@@ -0,0 +1,379 @@
+﻿#include "StockLedger.h"
+#include <QDebug>
+#include <QHash>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+
+namespace {
+
+// Понедельник недели, к которой относится день
+QDate weekStart(const QDate& day)
+{
+    return day.addDays(1 - day.dayOfWeek());
+}
+
+QString intArrayLiteral(const QVector<int>& values)
+{
+    QStringList parts;
+    parts.reserve(values.size());
+    for (int value : values) {
+        parts << QString::number(value);
+    }
+    return "{" + parts.join(',') + "}";
+}
+
+struct RollupDelta {
+    int consumed = 0;
+    int received = 0;
+};
+
+} // namespace
+
+StockLedger::StockLedger()
+{
+}
+
+void StockLedger::attach(const QSqlDatabase& db)
+{
+    m_db = db;
+    m_partitions.clear();
+    m_ready = ensureSchema();
+}
+
+void StockLedger::detach()
+{
+    m_db = QSqlDatabase();
+    m_ready = false;
+}
+
+bool StockLedger::ensureSchema()
+{
+    QSqlQuery query(m_db);
+
+    const QString movementsSql = isPostgres()
+        ? "CREATE TABLE IF NOT EXISTS stock_movements ("
+          "id BIGSERIAL, product_id INTEGER NOT NULL, delta INTEGER NOT NULL, kind SMALLINT NOT NULL, "
+          "created_at TIMESTAMPTZ NOT NULL DEFAULT now(), PRIMARY KEY (id, created_at)"
+          ") PARTITION BY RANGE (created_at)"
+        : "CREATE TABLE IF NOT EXISTS stock_movements ("
+          "id INTEGER PRIMARY KEY AUTOINCREMENT, product_id INTEGER NOT NULL, delta INTEGER NOT NULL, "
+          "kind SMALLINT NOT NULL, created_at TIMESTAMP NOT NULL)";
+
+    const QStringList statements = {
+        movementsSql,
+        "CREATE TABLE IF NOT EXISTS stock_consumption_daily ("
+        "product_id INTEGER NOT NULL, day DATE NOT NULL, "
+        "consumed INTEGER NOT NULL DEFAULT 0, received INTEGER NOT NULL DEFAULT 0, "
+        "cumulative_consumed BIGINT NOT NULL DEFAULT 0, PRIMARY KEY (product_id, day))",
+        "CREATE TABLE IF NOT EXISTS stock_consumption_weekly ("
+        "product_id INTEGER NOT NULL, week_start DATE NOT NULL, "
+        "consumed INTEGER NOT NULL DEFAULT 0, received INTEGER NOT NULL DEFAULT 0, "
+        "PRIMARY KEY (product_id, week_start))"
+    };
+
+    for (const QString& sql : statements) {
+        if (!query.exec(sql)) {
+            m_lastError = query.lastError().text();
+            qWarning() << "❌ Failed to create ledger schema:" << m_lastError;
+            return false;
+        }
+    }
+
+    // Текущий и следующий месяц, чтобы запись на границе месяца не ждала DDL
+    const QDate today = QDateTime::currentDateTimeUtc().date();
+    return ensurePartition(today) && ensurePartition(today.addMonths(1));
+}
+
+bool StockLedger::ensurePartition(const QDate& month)
+{
+    if (!isPostgres()) {
+        return true;
+    }
+
+    const QDate from(month.year(), month.month(), 1);
+    if (m_partitions.contains(from)) {
+        return true;
+    }
+
+    // Границы - месяц по UTC с явным смещением: иначе сервер прочитал бы их
+    // в часовом поясе сессии, а месяц движения клиент берет из UTC-времени
+    const QDate to = from.addMonths(1);
+    const QString sql = QString("CREATE TABLE IF NOT EXISTS stock_movements_%1 PARTITION OF stock_movements "
+        "FOR VALUES FROM ('%2 00:00:00+00') TO ('%3 00:00:00+00')")
+        .arg(from.toString("yyyy_MM"), from.toString(Qt::ISODate), to.toString(Qt::ISODate));
+
+    QSqlQuery query(m_db);
+    if (!query.exec(sql)) {
+        m_lastError = query.lastError().text();
+        qWarning() << "❌ Failed to create ledger partition" << from.toString("yyyy-MM") << ":" << m_lastError;
+        return false;
+    }
+
+    m_partitions.insert(from);
+    qDebug() << "🗂️ Ledger partition ready:" << from.toString("yyyy-MM");
+    return true;
+}
+
+bool StockLedger::ensureCurrentPartition()
+{
+    return ensurePartition(QDateTime::currentDateTimeUtc().date());
+}
+
+bool StockLedger::record(int productId, int delta, MovementKind kind)
+{
+    if (!m_ready || (delta == 0 && kind != Correction)) {
+        return true;
+    }
+
+    // Если БД долго недоступна, буфер не должен расти бесконечно, но и
+    // терять движения нельзя: при полном буфере запись отклоняется
+    if (!hasRoom()) {
+        m_lastError = QString("Ledger buffer is full (%1 movements)").arg(m_pending.size());
+        qWarning() << "❌ Movement of product" << productId << "not recorded:" << m_lastError;
+        return false;
+    }
+    m_pending.append({ productId, delta, kind, QDateTime::currentDateTimeUtc() });
+    return true;
+}
+
+bool StockLedger::flush()
+{
+    if (!m_ready || m_pending.isEmpty()) {
+        return true;
+    }
+    m_lastError.clear();
+
+    const QVector<Movement> batch = m_pending;
+    for (const Movement& movement : batch) {
+        if (!ensurePartition(movement.createdAt.toUTC().date())) {
+            return false;
+        }
+    }
+
+    if (!m_db.transaction()) {
+        m_lastError = m_db.lastError().text();
+        qWarning() << "❌ Failed to start ledger transaction:" << m_lastError;
+        return false;
+    }
+
+    if (!insertMovements(batch) || !updateRollups(batch) || !m_db.commit()) {
+        if (m_lastError.isEmpty()) {
+            m_lastError = m_db.lastError().text();
+        }
+        qWarning() << "❌ Failed to flush ledger batch:" << m_lastError;
+        m_db.rollback();
+        return false;
+    }
+
+    // Пока шла запись, буфер мог только расти - убираем записанное
+    m_pending.remove(0, batch.size());
+    qDebug() << "🧾 Ledger flushed:" << batch.size() << "movements";
+    return true;
+}
+
+bool StockLedger::insertMovements(const QVector<Movement>& movements)
+{
+    QSqlQuery query(m_db);
+
+    if (isPostgres()) {
+        // Один INSERT на весь пакет через массивы
+        QVector<int> ids, deltas, kinds;
+        QStringList times;
+        ids.reserve(movements.size());
+        deltas.reserve(movements.size());
+        kinds.reserve(movements.size());
+        times.reserve(movements.size());
+        for (const Movement& movement : movements) {
+            ids << movement.productId;
+            deltas << movement.delta;
+            kinds << movement.kind;
+            times << "\"" + movement.createdAt.toUTC().toString(Qt::ISODateWithMs) + "\"";
+        }
+
+        query.prepare("INSERT INTO stock_movements (product_id, delta, kind, created_at) "
+            "SELECT * FROM unnest(CAST(:ids AS integer[]), CAST(:deltas AS integer[]), "
+            "CAST(:kinds AS smallint[]), CAST(:times AS timestamptz[]))");
+        query.bindValue(":ids", intArrayLiteral(ids));
+        query.bindValue(":deltas", intArrayLiteral(deltas));
+        query.bindValue(":kinds", intArrayLiteral(kinds));
+        query.bindValue(":times", "{" + times.join(',') + "}");
+
+        if (!query.exec()) {
+            m_lastError = query.lastError().text();
+            return false;
+        }
+        return true;
+    }
+
+    QVariantList ids, deltas, kinds, times;
+    for (const Movement& movement : movements) {
+        ids << movement.productId;
+        deltas << movement.delta;
+        kinds << int(movement.kind);
+        times << movement.createdAt.toUTC();
+    }
+
+    query.prepare("INSERT INTO stock_movements (product_id, delta, kind, created_at) "
+        "VALUES (?, ?, ?, ?)");
+    query.addBindValue(ids);
+    query.addBindValue(deltas);
+    query.addBindValue(kinds);
+    query.addBindValue(times);
+
+    if (!query.execBatch()) {
+        m_lastError = query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool StockLedger::updateRollups(const QVector<Movement>& movements)
+{
+    // Сначала сворачиваем пакет в памяти: обычно это единицы строк сводки
+    QHash<QPair<int, QDate>, RollupDelta> daily;
+    QHash<QPair<int, QDate>, RollupDelta> weekly;
+
+    for (const Movement& movement : movements) {
+        if (movement.kind == Correction) {
+            continue;   // инвентаризация не считается ни расходом, ни приходом
+        }
+        const QDate day = movement.createdAt.toUTC().date();
+        RollupDelta& dayDelta = daily[qMakePair(movement.productId, day)];
+        RollupDelta& weekDelta = weekly[qMakePair(movement.productId, weekStart(day))];
+        if (movement.kind == Consumption) {
+            dayDelta.consumed += -movement.delta;
+            weekDelta.consumed += -movement.delta;
+        }
+        else {
+            dayDelta.received += movement.delta;
+            weekDelta.received += movement.delta;
+        }
+    }
+
+    QSqlQuery dailyQuery(m_db);
+    dailyQuery.prepare("INSERT INTO stock_consumption_daily (product_id, day, consumed, received, cumulative_consumed) "
+        "VALUES (:id, :day, :consumed, :received, :consumed + COALESCE((SELECT cumulative_consumed "
+        "FROM stock_consumption_daily WHERE product_id = :id AND day < :day ORDER BY day DESC LIMIT 1), 0)) "
+        "ON CONFLICT (product_id, day) DO UPDATE SET "
+        "consumed = stock_consumption_daily.consumed + excluded.consumed, "
+        "received = stock_consumption_daily.received + excluded.received, "
+        "cumulative_consumed = stock_consumption_daily.cumulative_consumed + excluded.consumed");
+
+    // Запоздавшее движение (пакет через полночь) сдвигает итоги следующих дней
+    QSqlQuery laterQuery(m_db);
+    laterQuery.prepare("UPDATE stock_consumption_daily SET cumulative_consumed = cumulative_consumed + :consumed "
+        "WHERE product_id = :id AND day > :day");
+
+    for (auto it = daily.cbegin(); it != daily.cend(); ++it) {
+        dailyQuery.bindValue(":id", it.key().first);
+        dailyQuery.bindValue(":day", it.key().second);
+        dailyQuery.bindValue(":consumed", it.value().consumed);
+        dailyQuery.bindValue(":received", it.value().received);
+        if (!dailyQuery.exec()) {
+            m_lastError = dailyQuery.lastError().text();
+            return false;
+        }
+
+        if (it.value().consumed != 0) {
+            laterQuery.bindValue(":consumed", it.value().consumed);
+            laterQuery.bindValue(":id", it.key().first);
+            laterQuery.bindValue(":day", it.key().second);
+            if (!laterQuery.exec()) {
+                m_lastError = laterQuery.lastError().text();
+                return false;
+            }
+        }
+    }
+
+    QSqlQuery weeklyQuery(m_db);
+    weeklyQuery.prepare("INSERT INTO stock_consumption_weekly (product_id, week_start, consumed, received) "
+        "VALUES (:id, :week, :consumed, :received) "
+        "ON CONFLICT (product_id, week_start) DO UPDATE SET "
+        "consumed = stock_consumption_weekly.consumed + excluded.consumed, "
+        "received = stock_consumption_weekly.received + excluded.received");
+
+    for (auto it = weekly.cbegin(); it != weekly.cend(); ++it) {
+        weeklyQuery.bindValue(":id", it.key().first);
+        weeklyQuery.bindValue(":week", it.key().second);
+        weeklyQuery.bindValue(":consumed", it.value().consumed);
+        weeklyQuery.bindValue(":received", it.value().received);
+        if (!weeklyQuery.exec()) {
+            m_lastError = weeklyQuery.lastError().text();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int StockLedger::consumptionOverLastDays(int productId, int days)
+{
+    if (!m_ready) {
+        m_lastError = "Ledger is not available";
+        return -1;
+    }
+    if (!flush()) {
+        return -1;
+    }
+
+    // Разность накопленных итогов: две выборки по первичному ключу
+    const QDate today = QDateTime::currentDateTimeUtc().date();
+    QSqlQuery query(m_db);
+    query.prepare("SELECT "
+        "COALESCE((SELECT cumulative_consumed FROM stock_consumption_daily "
+        "WHERE product_id = :id AND day <= :today ORDER BY day DESC LIMIT 1), 0) - "
+        "COALESCE((SELECT cumulative_consumed FROM stock_consumption_daily "
+        "WHERE product_id = :id AND day <= :cutoff ORDER BY day DESC LIMIT 1), 0)");
+    query.bindValue(":id", productId);
+    query.bindValue(":today", today);
+    query.bindValue(":cutoff", today.addDays(-qMax(0, days)));
+
+    if (!query.exec() || !query.next()) {
+        m_lastError = query.lastError().text();
+        qWarning() << "❌ Failed to read consumption:" << m_lastError;
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+QVector<ConsumptionBucket> StockLedger::consumptionRollup(int productId, RollupPeriod period, int periods)
+{
+    QVector<ConsumptionBucket> buckets;
+    if (!m_ready || periods <= 0 || !flush()) {
+        return buckets;
+    }
+
+    const bool weeklyPeriod = period == RollupPeriod::Week;
+    const QDate today = QDateTime::currentDateTimeUtc().date();
+    const QDate first = weeklyPeriod ? weekStart(today).addDays(-7 * (periods - 1)) : today.addDays(-(periods - 1));
+
+    QSqlQuery query(m_db);
+    query.prepare(weeklyPeriod
+        ? "SELECT week_start, consumed, received FROM stock_consumption_weekly "
+          "WHERE product_id = :id AND week_start >= :first ORDER BY week_start"
+        : "SELECT day, consumed, received FROM stock_consumption_daily "
+          "WHERE product_id = :id AND day >= :first ORDER BY day");
+    query.bindValue(":id", productId);
+    query.bindValue(":first", first);
+
+    if (!query.exec()) {
+        m_lastError = query.lastError().text();
+        qWarning() << "❌ Failed to read consumption rollup:" << m_lastError;
+        return buckets;
+    }
+
+    QHash<QDate, ConsumptionBucket> rows;
+    while (query.next()) {
+        const QDate start = query.value(0).toDate();
+        rows.insert(start, ConsumptionBucket(start, query.value(1).toInt(), query.value(2).toInt()));
+    }
+
+    // Пустые периоды тоже возвращаются, с нулями
+    buckets.reserve(periods);
+    for (int i = 0; i < periods; ++i) {
+        const QDate start = weeklyPeriod ? first.addDays(7 * i) : first.addDays(i);
+        buckets.append(rows.value(start, ConsumptionBucket(start, 0, 0)));
+    }
+    return buckets;
+}
@@ -0,0 +1,76 @@
+﻿#ifndef STOCKLEDGER_H
+#define STOCKLEDGER_H
+
+#include <QDateTime>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QVector>
+#include "DatabaseManager.h"
+
+// Журнал движений остатков (append-only).
+//
+// Движения копятся в памяти и записываются пакетами: одна вставка в
+// stock_movements (в PostgreSQL - секционирована по месяцам) и
+// инкрементальное обновление дневных/недельных сводок в той же транзакции.
+// В дневной сводке хранится накопленный итог расхода, поэтому расход за
+// последние N дней - это разность двух строк, а не сканирование журнала.
+// Дни сводок и секции журнала считаются по UTC.
+//
+// Буфер ограничен MaxPending движениями. Движения не выбрасываются: если
+// буфер полон, record() отказывает, а DatabaseManager до записи остатка
+// проверяет hasRoom() и не меняет остаток, который нельзя записать в журнал.
+class StockLedger
+{
+public:
+    enum MovementKind {
+        Receipt = 1,      // приход
+        Consumption = 2,  // расход
+        Correction = 3    // установка остатка (инвентаризация)
+    };
+
+    struct Movement {
+        int productId;
+        int delta;
+        MovementKind kind;
+        QDateTime createdAt;
+    };
+
+    static const int MaxPending = 100000;
+
+    StockLedger();
+
+    void attach(const QSqlDatabase& db);
+    void detach();
+    bool isReady() const { return m_ready; }
+
+    bool ensureSchema();
+    bool record(int productId, int delta, MovementKind kind);
+    int pendingCount() const { return m_pending.size(); }
+    bool hasRoom(int count = 1) const { return m_pending.size() + count <= MaxPending; }
+
+    // Запись накопленного пакета; при ошибке движения остаются в буфере
+    bool flush();
+
+    // Секция текущего месяца - для движений, которые пишет сам запрос в
+    // базе (created_at = now()), минуя буфер
+    bool ensureCurrentPartition();
+
+    int consumptionOverLastDays(int productId, int days);
+    QVector<ConsumptionBucket> consumptionRollup(int productId, RollupPeriod period, int periods);
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    bool isPostgres() const { return m_db.driverName() == "QPSQL"; }
+    bool ensurePartition(const QDate& month);   // месяц по UTC, как created_at в базе
+    bool insertMovements(const QVector<Movement>& movements);
+    bool updateRollups(const QVector<Movement>& movements);
+
+    QSqlDatabase m_db;
+    QVector<Movement> m_pending;
+    QSet<QDate> m_partitions;
+    bool m_ready = false;
+    QString m_lastError;
+};
+
+#endif // STOCKLEDGER_H
@@ -0,0 +1,108 @@
+﻿#include "StockTake.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include "Money.h"
+#include "ProtobufSerializer.h"
+
+namespace StockTake {
+
+namespace {
+
+QString unquote(const QString& field)
+{
+    const QString trimmed = field.trimmed();
+    if (trimmed.size() >= 2 && trimmed.startsWith('"') && trimmed.endsWith('"')) {
+        return trimmed.mid(1, trimmed.size() - 2).replace("\"\"", "\"");
+    }
+    return trimmed;
+}
+
+} // namespace
+
+bool readCsv(QIODevice& input, QVector<StockCount>& counts, QString& error)
+{
+    QTextStream in(&input);
+    in.setCodec("UTF-8");
+
+    qint64 lineNumber = 0;
+    QString line;
+    while (in.readLineInto(&line)) {
+        ++lineNumber;
+        line = line.trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        // Название может содержать запятую, поэтому количество - после последнего разделителя
+        const QChar separator = line.contains(';') ? QLatin1Char(';') : QLatin1Char(',');
+        const int split = line.lastIndexOf(separator);
+        bool quantityOk = false;
+        const int counted = split > 0 ? line.mid(split + 1).trimmed().toInt(&quantityOk) : 0;
+        if (!quantityOk || counted < 0) {
+            if (counts.isEmpty() && lineNumber == 1) {
+                continue;   // заголовок
+            }
+            error = QString("Строка %1: ожидается '<продукт>;<количество>'").arg(lineNumber);
+            return false;
+        }
+
+        const QString product = unquote(line.left(split));
+        bool isId = false;
+        const int productId = product.toInt(&isId);
+        counts.append(isId && productId > 0 ? StockCount(productId, QString(), counted) : StockCount(0, product, counted));
+    }
+    return true;
+}
+
+bool readCounts(const QString& filePath, QVector<StockCount>& counts, QString& error)
+{
+    counts.clear();
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    if (suffix == "pb" || suffix == "bin") {
+        ProtobufSerializer serializer;
+        const QVector<ProductData> products = serializer.importProducts(filePath);
+        if (products.isEmpty() && !serializer.getLastError().isEmpty()) {
+            error = serializer.getLastError();
+            return false;
+        }
+        counts.reserve(products.size());
+        for (const ProductData& product : products) {
+            counts.append(StockCount(product.id, product.id > 0 ? QString() : product.name, product.currentQuantity));
+        }
+        return true;
+    }
+
+    QFile input(filePath);
+    if (!input.open(QIODevice::ReadOnly)) {
+        error = "Не удалось открыть " + filePath;
+        return false;
+    }
+    return readCsv(input, counts, error);
+}
+
+QString summary(const StockTakeResult& result)
+{
+    qint64 shortage = 0;
+    qint64 surplus = 0;
+    for (const StockVariance& variance : result.variances) {
+        if (variance.delta() < 0) {
+            shortage -= variance.costDelta();
+        }
+        else {
+            surplus += variance.costDelta();
+        }
+    }
+
+    QString text = QString("Сверено: %1 | расхождений: %2 | недостача: %3 ₽ | излишки: %4 ₽")
+        .arg(result.checked)
+        .arg(result.variances.size())
+        .arg(Money::format(shortage, ','))
+        .arg(Money::format(surplus, ','));
+    if (!result.unmatched.isEmpty()) {
+        text += QString(" | не найдено: %1").arg(result.unmatched.size());
+    }
+    return text;
+}
+
+} // namespace StockTake
@@ -0,0 +1,24 @@
+﻿#ifndef STOCKTAKE_H
+#define STOCKTAKE_H
+
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+#include "DatabaseManager.h"
+
+// Файл пересчета для инвентаризации и отчет о расхождениях.
+//
+// CSV - по строке на продукт "продукт;количество" (разделитель ';' или ',',
+// продукт - id или название, строка заголовка пропускается). Снимок
+// ProductListProto (.pb) - id или name и current_quantity каждого продукта.
+namespace StockTake {
+
+bool readCsv(QIODevice& input, QVector<StockCount>& counts, QString& error);
+bool readCounts(const QString& filePath, QVector<StockCount>& counts, QString& error);
+
+// Итоги сверки одной строкой: продукты, расхождения, недостача и излишки в рублях
+QString summary(const StockTakeResult& result);
+
+} // namespace StockTake
+
+#endif // STOCKTAKE_H
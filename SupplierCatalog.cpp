@@ -0,0 +1,123 @@
+﻿#include "SupplierCatalog.h"
+#include <QDebug>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariantList>
+#include <algorithm>
+
+void SupplierCatalog::setTerms(int productId, const Terms& terms)
+{
+    Terms normalized = terms;
+    normalized.supplier = terms.supplier.trimmed();
+    normalized.packSize = qMax(1, terms.packSize);
+    normalized.minOrder = qMax(0, terms.minOrder);
+    m_terms.insert(productId, normalized);
+}
+
+QStringList SupplierCatalog::suppliers() const
+{
+    QStringList names;
+    for (auto it = m_terms.cbegin(); it != m_terms.cend(); ++it) {
+        if (!it.value().supplier.isEmpty() && !names.contains(it.value().supplier)) {
+            names.append(it.value().supplier);
+        }
+    }
+    std::sort(names.begin(), names.end(), [](const QString& a, const QString& b) {
+        return QString::compare(a, b, Qt::CaseInsensitive) < 0;
+    });
+    return names;
+}
+
+int SupplierCatalog::roundQuantity(int quantity, const Terms& terms)
+{
+    if (quantity <= 0) {
+        return 0;
+    }
+
+    const int packSize = qMax(1, terms.packSize);
+    const int wanted = qMax(quantity, terms.minOrder);
+    return (wanted + packSize - 1) / packSize * packSize;
+}
+
+bool SupplierCatalog::load(QSqlDatabase& db)
+{
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT ps.product_id, s.name, ps.pack_size, ps.min_order "
+                    "FROM product_suppliers ps JOIN suppliers s ON s.id = ps.supplier_id")) {
+        m_lastError = query.lastError().text();
+        qWarning() << "❌ Failed to load supplier catalog:" << m_lastError;
+        return false;
+    }
+
+    m_terms.clear();
+    while (query.next()) {
+        Terms terms;
+        terms.supplier = query.value(1).toString();
+        terms.packSize = query.value(2).toInt();
+        terms.minOrder = query.value(3).toInt();
+        setTerms(query.value(0).toInt(), terms);
+    }
+
+    m_lastError.clear();
+    qDebug() << "🚚 Supplier catalog loaded:" << m_terms.size() << "products," << suppliers().size() << "suppliers";
+    return true;
+}
+
+bool SupplierCatalog::save(QSqlDatabase& db) const
+{
+    if (m_terms.isEmpty()) {
+        return true;
+    }
+
+    QVariantList productIds;
+    QVariantList names;
+    QVariantList packSizes;
+    QVariantList minOrders;
+    for (auto it = m_terms.cbegin(); it != m_terms.cend(); ++it) {
+        if (it.value().supplier.isEmpty()) {
+            continue;
+        }
+        productIds << it.key();
+        names << it.value().supplier;
+        packSizes << it.value().packSize;
+        minOrders << it.value().minOrder;
+    }
+
+    QVariantList supplierNames;
+    for (const QString& name : suppliers()) {
+        supplierNames << name;
+    }
+
+    if (!db.transaction()) {
+        m_lastError = db.lastError().text();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO suppliers (name) VALUES (?) ON CONFLICT (name) DO NOTHING");
+    query.addBindValue(supplierNames);
+    bool ok = query.execBatch();
+
+    if (ok) {
+        query.prepare("INSERT INTO product_suppliers (product_id, supplier_id, pack_size, min_order) "
+                      "SELECT ?, id, ?, ? FROM suppliers WHERE name = ? "
+                      "ON CONFLICT (product_id) DO UPDATE SET supplier_id = excluded.supplier_id, "
+                      "pack_size = excluded.pack_size, min_order = excluded.min_order");
+        query.addBindValue(productIds);
+        query.addBindValue(packSizes);
+        query.addBindValue(minOrders);
+        query.addBindValue(names);
+        ok = query.execBatch();
+    }
+
+    if (!ok || !db.commit()) {
+        m_lastError = ok ? db.lastError().text() : query.lastError().text();
+        db.rollback();
+        qWarning() << "❌ Failed to save supplier catalog:" << m_lastError;
+        return false;
+    }
+
+    qDebug() << "🚚 Supplier catalog saved:" << productIds.size() << "products";
+    return true;
+}
@@ -0,0 +1,48 @@
+﻿#ifndef SUPPLIERCATALOG_H
+#define SUPPLIERCATALOG_H
+
+#include <QHash>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Каталог поставщиков: у кого заказывается продукт, какой фасовкой и
+// от какого минимального количества. Продукты без записи заказываются
+// поштучно и попадают в общую заявку "без поставщика".
+class SupplierCatalog
+{
+public:
+    struct Terms {
+        QString supplier;             // пусто - поставщик не назначен
+        int packSize = 1;             // заказ кратен фасовке
+        int minOrder = 0;             // меньше не привезут
+    };
+
+    void setTerms(int productId, const Terms& terms);
+    Terms terms(int productId) const { return m_terms.value(productId); }
+    bool contains(int productId) const { return m_terms.contains(productId); }
+
+    int size() const { return m_terms.size(); }
+    bool isEmpty() const { return m_terms.isEmpty(); }
+    void clear() { m_terms.clear(); }
+
+    // Поставщики в порядке имени
+    QStringList suppliers() const;
+
+    // Потребность, округленная вверх до минимального заказа и фасовки
+    static int roundQuantity(int quantity, const Terms& terms);
+    int roundQuantity(int productId, int quantity) const { return roundQuantity(quantity, terms(productId)); }
+
+    // Хранение в таблицах suppliers и product_suppliers (миграция 8)
+    bool load(QSqlDatabase& db);
+    bool save(QSqlDatabase& db) const;
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    QHash<int, Terms> m_terms;
+    mutable QString m_lastError;
+};
+
+#endif // SUPPLIERCATALOG_H
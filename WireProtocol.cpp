@@ -0,0 +1,63 @@
+﻿#include "WireProtocol.h"
+#include <QtEndian>
+
+namespace WireProtocol {
+
+void appendFrame(QByteArray& buffer, const google::protobuf::MessageLite& message)
+{
+    const int size = int(message.ByteSizeLong());
+    const int offset = buffer.size();
+    buffer.resize(offset + HeaderSize + size);
+
+    uchar* data = reinterpret_cast<uchar*>(buffer.data()) + offset;
+    qToBigEndian<quint32>(quint32(size), data);
+    message.SerializeWithCachedSizesToArray(data + HeaderSize);
+}
+
+QByteArray frame(const google::protobuf::MessageLite& message)
+{
+    QByteArray buffer;
+    appendFrame(buffer, message);
+    return buffer;
+}
+
+void FrameReader::append(const QByteArray& data)
+{
+    // Разобранное начало буфера отрезаем, только когда оно стало больше остатка
+    if (m_offset > 0 && m_offset >= m_buffer.size() - m_offset) {
+        m_buffer.remove(0, m_offset);
+        m_offset = 0;
+    }
+    m_buffer.append(data);
+}
+
+bool FrameReader::next(QByteArray& payload)
+{
+    if (m_error || m_buffer.size() - m_offset < HeaderSize) {
+        return false;
+    }
+
+    const uchar* header = reinterpret_cast<const uchar*>(m_buffer.constData()) + m_offset;
+    const quint32 size = qFromBigEndian<quint32>(header);
+    if (size > quint32(MaxFrameSize)) {
+        m_error = true;
+        return false;
+    }
+
+    if (m_buffer.size() - m_offset - HeaderSize < int(size)) {
+        return false;
+    }
+
+    payload = m_buffer.mid(m_offset + HeaderSize, int(size));
+    m_offset += HeaderSize + int(size);
+    return true;
+}
+
+void FrameReader::clear()
+{
+    m_buffer.clear();
+    m_offset = 0;
+    m_error = false;
+}
+
+} // namespace WireProtocol
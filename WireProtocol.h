@@ -0,0 +1,39 @@
+﻿#ifndef WIREPROTOCOL_H
+#define WIREPROTOCOL_H
+
+#include <QByteArray>
+#include <google/protobuf/message_lite.h>
+
+// Кадры протокола сервера остатков: 4 байта длины (big-endian) и
+// сериализованное сообщение product.proto. Несколько кадров можно
+// отправить одной записью в сокет - так отвечает сервер на пачку запросов.
+namespace WireProtocol {
+
+const int HeaderSize = 4;
+const int MaxFrameSize = 16 * 1024 * 1024;
+
+void appendFrame(QByteArray& buffer, const google::protobuf::MessageLite& message);
+QByteArray frame(const google::protobuf::MessageLite& message);
+
+// Сборка кадров из потока байт: данные приходят кусками произвольной длины
+class FrameReader
+{
+public:
+    void append(const QByteArray& data);
+
+    // Следующий полный кадр; false - кадр еще не пришел целиком или поток испорчен
+    bool next(QByteArray& payload);
+
+    // Длина кадра вне допустимого диапазона - соединение нужно закрыть
+    bool hasError() const { return m_error; }
+    void clear();
+
+private:
+    QByteArray m_buffer;
+    int m_offset = 0;
+    bool m_error = false;
+};
+
+} // namespace WireProtocol
+
+#endif // WIREPROTOCOL_H
@@ -0,0 +1,708 @@
+﻿#include <benchmark/benchmark.h>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocalSocket>
+#include <QLoggingCategory>
+#include <QMap>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include "DatabaseManager.h"
+#include "ExpiryWheel.h"
+#include "InventoryServer.h"
+#include "LotTracker.h"
+#include "OrderExporter.h"
+#include "ProductFilterModel.h"
+#include "ProductStore.h"
+#include "ProtobufSerializer.h"
+#include "ReorderScan.h"
+#include "ScanIngest.h"
+#include "StockHistory.h"
+
+// Бенчмарки горячих путей: чтение/запись остатков, модель, заявка, protobuf.
+//
+// По умолчанию БД подменяется встроенной SQLite (схема products та же).
+// Для настоящего PostgreSQL задайте FRIDGE_BENCH_PG_HOST (и при необходимости
+// FRIDGE_BENCH_PG_PORT, FRIDGE_BENCH_PG_DB, FRIDGE_BENCH_PG_USER,
+// FRIDGE_BENCH_PG_PASSWORD) — таблица products в этой БД будет пересоздана.
+//
+// JSON для сравнения между релизами:
+//   fridge_bench --benchmark_out=bench.json --benchmark_out_format=json
+
+namespace {
+
+QVector<ProductData> makeProducts(int count)
+{
+    QVector<ProductData> products;
+    products.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        // Примерно треть позиций ниже нормы, как в реальном холодильнике
+        products.append(ProductData(i + 1, QString("Продукт %1").arg(i + 1), i % 30, 20));
+    }
+    return products;
+}
+
+bool usePostgres()
+{
+    return !qEnvironmentVariableIsEmpty("FRIDGE_BENCH_PG_HOST");
+}
+
+class BenchDatabase
+{
+public:
+    static BenchDatabase& instance()
+    {
+        static BenchDatabase db;
+        return db;
+    }
+
+    // Настройки подключения к БД с ровно rows продуктами
+    ConnectionSettings settingsFor(int rows)
+    {
+        ConnectionSettings settings;
+        if (usePostgres()) {
+            settings.driver = "QPSQL";
+            settings.hostName = qEnvironmentVariable("FRIDGE_BENCH_PG_HOST");
+            settings.port = qEnvironmentVariableIntValue("FRIDGE_BENCH_PG_PORT");
+            if (settings.port == 0) {
+                settings.port = 5432;
+            }
+            settings.databaseName = qEnvironmentVariable("FRIDGE_BENCH_PG_DB", "fridgemanager_bench");
+            settings.userName = qEnvironmentVariable("FRIDGE_BENCH_PG_USER", "postgres");
+            settings.password = qEnvironmentVariable("FRIDGE_BENCH_PG_PASSWORD");
+            settings.connectOptions.clear();
+
+            // В PostgreSQL одна таблица: пересеваем при смене размера
+            if (m_seededRows != rows) {
+                seed(settings, rows);
+                m_seededRows = rows;
+            }
+            return settings;
+        }
+
+        settings.driver = "QSQLITE";
+        settings.connectOptions.clear();
+        if (!m_sqliteFiles.contains(rows)) {
+            settings.databaseName = m_dir.filePath(QString("products_%1.sqlite").arg(rows));
+            seed(settings, rows);
+            m_sqliteFiles.insert(rows, settings.databaseName);
+        }
+        settings.databaseName = m_sqliteFiles.value(rows);
+        return settings;
+    }
+
+private:
+    void seed(const ConnectionSettings& settings, int rows)
+    {
+        const QString connectionName = "fridge_bench_seed";
+        {
+            QSqlDatabase db = QSqlDatabase::addDatabase(settings.driver, connectionName);
+            db.setHostName(settings.hostName);
+            db.setPort(settings.port);
+            db.setDatabaseName(settings.databaseName);
+            db.setUserName(settings.userName);
+            db.setPassword(settings.password);
+            if (!db.open()) {
+                qFatal("Cannot open benchmark database: %s", qPrintable(db.lastError().text()));
+            }
+
+            QSqlQuery query(db);
+            // Схему с индексами достроят миграции DatabaseManager при подключении
+            query.exec("DROP VIEW IF EXISTS products_to_order");
+            query.exec("DROP TABLE IF EXISTS product_quantity_deltas");
+            query.exec("DROP TABLE IF EXISTS product_suppliers");
+            query.exec("DROP TABLE IF EXISTS product_lots");
+            query.exec("DROP TABLE IF EXISTS product_barcodes");
+            query.exec("DROP TABLE IF EXISTS products");
+            query.exec("DROP TABLE IF EXISTS schema_version");
+            if (!query.exec("CREATE TABLE products (id INTEGER PRIMARY KEY, name VARCHAR(100) UNIQUE NOT NULL, "
+                "current_quantity INTEGER NOT NULL DEFAULT 0, norm_quantity INTEGER NOT NULL)")) {
+                qFatal("Cannot create products table: %s", qPrintable(query.lastError().text()));
+            }
+
+            if (settings.driver == "QPSQL") {
+                query.prepare("INSERT INTO products (id, name, current_quantity, norm_quantity) "
+                    "SELECT g, 'Продукт ' || g, g % 30, 20 FROM generate_series(1, :rows) AS g");
+                query.bindValue(":rows", rows);
+                if (!query.exec()) {
+                    qFatal("Cannot seed products: %s", qPrintable(query.lastError().text()));
+                }
+            }
+            else {
+                db.transaction();
+                query.prepare("INSERT INTO products (id, name, current_quantity, norm_quantity) "
+                    "VALUES (:id, :name, :current, :norm)");
+                for (const ProductData& product : makeProducts(rows)) {
+                    query.bindValue(":id", product.id);
+                    query.bindValue(":name", product.name);
+                    query.bindValue(":current", product.currentQuantity);
+                    query.bindValue(":norm", product.normQuantity);
+                    query.exec();
+                }
+                db.commit();
+            }
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+
+    QTemporaryDir m_dir;
+    QMap<int, QString> m_sqliteFiles;
+    int m_seededRows = -1;
+};
+
+void connectOrSkip(benchmark::State& state, DatabaseManager& dbManager, int rows)
+{
+    if (!dbManager.connectToDatabase(BenchDatabase::instance().settingsFor(rows))) {
+        state.SkipWithError(qPrintable(dbManager.getLastError()));
+    }
+}
+
+} // namespace
+
+static void BM_GetAllProducts(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    DatabaseManager dbManager;
+    connectOrSkip(state, dbManager, rows);
+
+    for (auto _ : state) {
+        QVector<ProductData> products = dbManager.getAllProducts();
+        benchmark::DoNotOptimize(products.data());
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_GetAllProducts)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+static void BM_AddProductQuantity(benchmark::State& state)
+{
+    const int rows = 1000;
+    DatabaseManager dbManager;
+    connectOrSkip(state, dbManager, rows);
+
+    int productId = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(dbManager.addProductQuantity(productId % rows + 1, 1));
+        ++productId;
+    }
+}
+BENCHMARK(BM_AddProductQuantity)->Unit(benchmark::kMicrosecond);
+
+static void BM_RemoveProductQuantity(benchmark::State& state)
+{
+    const int rows = 1000;
+    DatabaseManager dbManager;
+    connectOrSkip(state, dbManager, rows);
+
+    int productId = 0;
+    for (auto _ : state) {
+        // Приход вне замера, чтобы остатка всегда хватало
+        state.PauseTiming();
+        dbManager.addProductQuantity(productId % rows + 1, 1);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(dbManager.removeProductQuantity(productId % rows + 1, 1));
+        ++productId;
+    }
+}
+BENCHMARK(BM_RemoveProductQuantity)->Unit(benchmark::kMicrosecond);
+
+static void BM_ApplyStockOperations(benchmark::State& state)
+{
+    const int rows = 1000;
+    const int batchSize = static_cast<int>(state.range(0));
+    DatabaseManager dbManager;
+    connectOrSkip(state, dbManager, rows);
+
+    QVector<StockOperation> batch;
+    for (int i = 0; i < batchSize; ++i) {
+        batch.append(StockOperation(StockOperation::Add, i % rows + 1, 1));
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(dbManager.applyStockOperations(batch));
+    }
+    state.SetItemsProcessed(state.iterations() * batchSize);
+}
+BENCHMARK(BM_ApplyStockOperations)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond);
+
+// Цена одного нажатия "+" в модели: изменение строки и рассылка dataChanged
+static void BM_StoreUpdatePerTap(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    ProductStore store;
+    store.setProducts(makeProducts(rows));
+
+    int notifications = 0;
+    QObject::connect(&store, &QAbstractItemModel::dataChanged, [&notifications]() { ++notifications; });
+
+    int row = 0;
+    for (auto _ : state) {
+        store.addQuantity(row, 1);
+        row = (row + 1) % rows;
+    }
+    benchmark::DoNotOptimize(notifications);
+}
+BENCHMARK(BM_StoreUpdatePerTap)->Arg(1000)->Arg(100000);
+
+// Всплеск изменений между двумя кадрами: 10k обновлений и один сброс.
+// Счетчик signals - сколько dataChanged получит QML
+static void BM_StoreBurstPerFrame(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    const int burst = 10000;
+    ProductStore store;
+    store.setProducts(makeProducts(rows));
+    store.setNotificationInterval(RowChangeBatcher::FrameIntervalMs);
+
+    int notifications = 0;
+    QObject::connect(&store, &QAbstractItemModel::dataChanged, [&notifications]() { ++notifications; });
+
+    int row = 0;
+    for (auto _ : state) {
+        for (int i = 0; i < burst; ++i) {
+            store.addQuantity(row, 1);
+            row = (row + 7) % rows;
+        }
+        store.flushNotifications();
+    }
+    state.SetItemsProcessed(state.iterations() * burst);
+    state.counters["signals"] = benchmark::Counter(notifications, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_StoreBurstPerFrame)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// Поиск по мере ввода: одна итерация - набор запроса по символу и очистка.
+// Все названия вида "Продукт N" - худший случай для триграмм
+static void BM_SearchAsYouType(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    ProductStore store;
+    store.setProducts(makeProducts(rows));
+    ProductFilterModel view(&store);
+
+    const QString typed = QString::fromUtf8("продукт 777");
+    for (auto _ : state) {
+        for (int length = 1; length <= typed.size(); ++length) {
+            view.setQuery(typed.left(length));
+        }
+        benchmark::DoNotOptimize(view.count());
+        view.setQuery(QString());
+    }
+    state.SetItemsProcessed(state.iterations() * (typed.size() + 1));
+}
+BENCHMARK(BM_SearchAsYouType)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// Нажатие "+" при списке, отсортированном по нехватке: строка переставляется
+// одним beginMoveRows, без пересортировки
+static void BM_SortedViewUpdatePerTap(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    ProductStore store;
+    store.setProducts(makeProducts(rows));
+    ProductFilterModel view(&store);
+    view.setSortMode(ProductFilterModel::ByShortage);
+    while (view.isSorting()) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 10);
+    }
+
+    int moves = 0;
+    QObject::connect(&view, &QAbstractItemModel::rowsMoved, [&moves]() { ++moves; });
+
+    int row = 0;
+    for (auto _ : state) {
+        store.addQuantity(row, 1);
+        row = (row + 1) % rows;
+    }
+    state.counters["moves"] = moves;
+}
+BENCHMARK(BM_SortedViewUpdatePerTap)->Arg(1000)->Arg(100000);
+
+// Поиск продуктов ниже нормы: прежний цикл по ProductData и векторный
+// проход по массивам остатков (аргументы: строки, реализация)
+static void BM_ReorderScanProducts(benchmark::State& state)
+{
+    const QVector<ProductData> products = makeProducts(static_cast<int>(state.range(0)));
+
+    for (auto _ : state) {
+        QVector<int> rows;
+        qint64 totalPacks = 0;
+        for (int row = 0; row < products.size(); ++row) {
+            if (ProductStore::needsOrder(products.at(row))) {
+                rows.append(row);
+                totalPacks += ProductStore::orderQuantity(products.at(row));
+            }
+        }
+        benchmark::DoNotOptimize(rows.data());
+        benchmark::DoNotOptimize(totalPacks);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReorderScanProducts)->Arg(100000)->Arg(1000000)->Arg(10000000)->Unit(benchmark::kMillisecond);
+
+static void BM_ReorderScan(benchmark::State& state)
+{
+    const ReorderScan::Isa isa = static_cast<ReorderScan::Isa>(state.range(1));
+    if (!ReorderScan::isSupported(isa)) {
+        state.SkipWithError("ISA not supported by this CPU");
+        return;
+    }
+    state.SetLabel(ReorderScan::isaName(isa));
+
+    ProductStore store;
+    store.setProducts(makeProducts(static_cast<int>(state.range(0))));
+
+    for (auto _ : state) {
+        ReorderScan::Result result = ReorderScan::scanWith(isa, store.currentQuantities().constData(),
+            store.normQuantities().constData(), store.count());
+        benchmark::DoNotOptimize(result.rows.data());
+        benchmark::DoNotOptimize(result.totalPacks);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ReorderScan)
+    ->ArgsProduct({ { 100000, 1000000, 10000000 }, {
+        static_cast<int>(ReorderScan::Isa::Scalar),
+        static_cast<int>(ReorderScan::Isa::Sse41),
+        static_cast<int>(ReorderScan::Isa::Avx2) } })
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_SaveOrderToFile(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    const QVector<ProductData> products = makeProducts(rows);
+    QTemporaryDir dir;
+    const QString filePath = dir.filePath("order.txt");
+    OrderExporter exporter;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(exporter.saveOrderToFile(filePath, products));
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.SetBytesProcessed(state.iterations() * QFile(filePath).size());
+}
+BENCHMARK(BM_SaveOrderToFile)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_ProtobufSerialize(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    const QVector<ProductData> products = makeProducts(rows);
+    ProtobufSerializer serializer;
+
+    qint64 bytes = 0;
+    for (auto _ : state) {
+        QByteArray data = serializer.serializeProducts(products);
+        bytes = data.size();
+        benchmark::DoNotOptimize(data.constData());
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_ProtobufSerialize)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_ProtobufDeserialize(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    ProtobufSerializer serializer;
+    const QByteArray data = serializer.serializeProducts(makeProducts(rows));
+
+    for (auto _ : state) {
+        QVector<ProductData> products = serializer.deserializeProducts(data);
+        benchmark::DoNotOptimize(products.data());
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_ProtobufDeserialize)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// Сервер остатков: пачка запросов, отправленная одной записью, и ответы на нее.
+// Сервер и клиент в одном потоке, поэтому ответы ждем через цикл событий.
+static void BM_ServerPipelinedRequests(benchmark::State& state)
+{
+    const int pipeline = static_cast<int>(state.range(0));
+    ProductStore store;
+    store.setProducts(makeProducts(1000));
+
+    InventoryServer server(nullptr, &store);
+    const QString address = QString("fridge_bench_%1").arg(QCoreApplication::applicationPid());
+    if (!server.listen(address)) {
+        state.SkipWithError("Cannot start inventory server");
+        return;
+    }
+
+    QLocalSocket socket;
+    socket.connectToServer(address);
+    if (!socket.waitForConnected(1000)) {
+        state.SkipWithError("Cannot connect to inventory server");
+        return;
+    }
+    while (server.clientCount() == 0) {
+        QCoreApplication::processEvents();
+    }
+
+    QByteArray requests;
+    for (int i = 0; i < pipeline; ++i) {
+        fridgemanager::RequestProto request;
+        request.set_request_id(quint32(i + 1));
+        request.set_kind(fridgemanager::RequestProto::APPLY_OPERATIONS);
+        fridgemanager::StockOperationProto* operation = request.add_operations();
+        operation->set_type(fridgemanager::StockOperationProto::ADD);
+        operation->set_product_id(1 + (i * 7) % 1000);
+        operation->set_amount(1);
+        WireProtocol::appendFrame(requests, request);
+    }
+
+    WireProtocol::FrameReader reader;
+    QByteArray payload;
+    for (auto _ : state) {
+        socket.write(requests);
+        int responses = 0;
+        while (responses < pipeline) {
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+            reader.append(socket.readAll());
+            while (reader.next(payload)) {
+                ++responses;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * pipeline);
+}
+BENCHMARK(BM_ServerPipelinedRequests)->Arg(1)->Arg(64)->Arg(1024)->Unit(benchmark::kMicrosecond);
+
+// Списание FIFO по сроку: каждая итерация снимает упаковку с вершины кучи
+// продукта (аргумент - партий у продукта)
+static void BM_LotConsumeFifo(benchmark::State& state)
+{
+    const int lotCount = static_cast<int>(state.range(0));
+    const QDate today = QDate::currentDate();
+
+    LotTracker tracker;
+    qint64 nextId = 1;
+    for (auto _ : state) {
+        if (tracker.trackedQuantity(1) == 0) {
+            state.PauseTiming();
+            for (int i = 0; i < lotCount; ++i) {
+                ProductLot lot;
+                lot.id = nextId++;
+                lot.productId = 1;
+                lot.quantity = 3;
+                lot.receivedMs = i;
+                lot.expiresOn = today.addDays((i * 7919) % 365);
+                tracker.addLot(lot);
+            }
+            state.ResumeTiming();
+        }
+        benchmark::DoNotOptimize(tracker.consume(1, 1));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LotConsumeFifo)->Arg(10)->Arg(1000)->Arg(100000);
+
+// Предупреждения о сроке: продвижение колеса на час при N поставленных
+// партиях. Стоимость зависит от сработавших партий, а не от N.
+static void BM_ExpiryWheelAdvance(benchmark::State& state)
+{
+    const int lotCount = static_cast<int>(state.range(0));
+    const qint64 hourMs = ExpiryWheel::DefaultTickMs;
+
+    ExpiryWheel wheel;
+    qint64 nowMs = 0;
+    wheel.reset(nowMs);
+    for (int i = 0; i < lotCount; ++i) {
+        wheel.schedule(i, (i % (24 * 365)) * hourMs);
+    }
+
+    qint64 fired = 0;
+    for (auto _ : state) {
+        nowMs += hourMs;
+        const QVector<qint64> due = wheel.advance(nowMs);
+        fired += due.size();
+        // Сработавшие возвращаются в колесо через год, чтобы число партий не менялось
+        for (qint64 id : due) {
+            wheel.schedule(id, nowMs + 24 * 365 * hourMs);
+        }
+    }
+    state.counters["fired_per_hour"] = benchmark::Counter(double(fired) / state.iterations());
+}
+BENCHMARK(BM_ExpiryWheelAdvance)->Arg(1000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
+
+// Инвентаризация: пересчет всего каталога (аргумент - продуктов), каждый
+// двадцатый расходится с учетом; загрузка во временную таблицу и сверка
+// одним запросом, без исправления - замер повторяем
+static void BM_StockTakeReport(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    DatabaseManager dbManager;
+    connectOrSkip(state, dbManager, rows);
+
+    QVector<StockCount> counts;
+    counts.reserve(rows);
+    for (const ProductData& product : makeProducts(rows)) {
+        counts.append(StockCount(product.id, QString(), product.currentQuantity + (product.id % 20 == 0 ? 1 : 0)));
+    }
+
+    for (auto _ : state) {
+        StockTakeResult result;
+        benchmark::DoNotOptimize(dbManager.reconcileStockTake(counts, false, false, result));
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_StockTakeReport)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// Перенос каталога через COPY (аргументы: продуктов, 0 - выгрузка в снимок,
+// 1 - загрузка снимка обратно: все строки с id, обновление на месте)
+static void BM_CatalogCopy(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    const bool import = state.range(1) != 0;
+    DatabaseManager dbManager;
+    connectOrSkip(state, dbManager, rows);
+
+    QTemporaryDir dir;
+    const QString path = dir.filePath("catalog.pb");
+    if (import && !dbManager.exportCatalog(path)) {
+        state.SkipWithError(dbManager.getLastError().toUtf8().constData());
+        return;
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(import ? dbManager.importCatalog(path) : dbManager.exportCatalog(path));
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_CatalogCopy)
+    ->Args({ 100000, 0 })->Args({ 100000, 1 })
+    ->Args({ 500000, 0 })->Args({ 500000, 1 })
+    ->Unit(benchmark::kMillisecond);
+
+// Стоимость остатков при каждом нажатии "+": поправка на разницу против
+// полного пересчета по каталогу (аргументы: строки, 1 - инкрементально)
+static void BM_StoreValuationPerTap(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    const bool incremental = state.range(1) != 0;
+    QVector<ProductData> products = makeProducts(rows);
+    for (int row = 0; row < rows; ++row) {
+        products[row].unitCost = 1000 + (row * 7919) % 50000;
+    }
+    ProductStore store;
+    store.setProducts(products);
+
+    int row = 0;
+    for (auto _ : state) {
+        store.addQuantity(row, 1);
+        if (incremental) {
+            benchmark::DoNotOptimize(store.stockValue());
+        }
+        else {
+            qint64 value = 0;
+            for (const ProductData& product : store.products()) {
+                value += qint64(product.currentQuantity) * product.unitCost;
+            }
+            benchmark::DoNotOptimize(value);
+        }
+        row = (row + 1) % rows;
+    }
+}
+BENCHMARK(BM_StoreValuationPerTap)
+    ->Args({ 1000, 0 })->Args({ 1000, 1 })
+    ->Args({ 100000, 0 })->Args({ 100000, 1 });
+
+// График одного продукта по истории остатков: 90 дней почасовых снимков
+// каталога (аргумент - продуктов в снимке), чтение одного продукта за
+// последние 30 дней
+static void BM_StockHistoryRead(benchmark::State& state)
+{
+    const int rows = static_cast<int>(state.range(0));
+    const int snapshots = 90 * 24;
+    QTemporaryDir dir;
+    StockHistory history;
+    if (!history.open(dir.filePath("history.dat"))) {
+        state.SkipWithError(history.getLastError().toUtf8().constData());
+        return;
+    }
+
+    QVector<int> ids(rows);
+    QVector<qint32> quantities(rows);
+    for (int row = 0; row < rows; ++row) {
+        ids[row] = row + 1;
+        quantities[row] = 10 + row % 40;
+    }
+    for (int index = 0; index < snapshots; ++index) {
+        // За час меняется малая доля остатков
+        for (int tap = 0; tap < rows / 50 + 1; ++tap) {
+            const int row = (index * 7919 + tap * 104729) % rows;
+            quantities[row] = qMax(0, quantities[row] + (tap % 2 ? 1 : -1));
+        }
+        history.append(qint64(index + 1) * StockHistory::DefaultIntervalMs, ids, quantities);
+    }
+
+    const qint64 lastMs = qint64(snapshots) * StockHistory::DefaultIntervalMs;
+    const qint64 fromMs = lastMs - 30LL * 24 * StockHistory::DefaultIntervalMs;
+    int productId = 1;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(history.history(productId, fromMs, lastMs));
+        productId = productId % rows + 1;
+    }
+    state.counters["fileKB"] = QFileInfo(dir.filePath("history.dat")).size() / 1024.0;
+}
+BENCHMARK(BM_StockHistoryRead)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+// Разгрузка поставки: пачка сканов (аргумент) по каталогу из 10 000
+// штрихкодов - поиск кода, очередь и сложение в пакет операций
+static void BM_ScanIngestBurst(benchmark::State& state)
+{
+    const int scans = static_cast<int>(state.range(0));
+    const int products = 10000;
+    QVector<ProductBarcode> barcodes;
+    QStringList codes;
+    for (int id = 1; id <= products; ++id) {
+        const QString code = QString::number(4600000000000LL + id * 7919LL);
+        barcodes.append(ProductBarcode(code, id, 1 + id % 6));
+        codes << code;
+    }
+    BarcodeIndex index;
+    index.build(barcodes);
+
+    ScanIngest scanner;
+    scanner.setIndex(index);
+    scanner.setDebounceMs(0);
+    int batchSize = 0;
+    QObject::connect(&scanner, &ScanIngest::scansReady, [&batchSize](const QVector<StockOperation>& operations) {
+        batchSize = operations.size();
+    });
+
+    int next = 0;
+    for (auto _ : state) {
+        for (int i = 0; i < scans; ++i) {
+            scanner.submit(codes.at(next));
+            next = (next + 104729) % products;
+        }
+        scanner.drain();
+        benchmark::DoNotOptimize(batchSize);
+    }
+    state.SetItemsProcessed(state.iterations() * scans);
+}
+BENCHMARK(BM_ScanIngestBurst)->Arg(50)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    // Драйверам Qt SQL нужен экземпляр приложения для поиска плагинов
+    QCoreApplication app(argc, argv);
+
+    // Журнал по каждой строке искажает замеры
+    QLoggingCategory::setFilterRules("*.debug=false");
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
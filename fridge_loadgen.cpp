@@ -0,0 +1,363 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "DatabaseManager.h"
+
+// Генератор нагрузки: N терминалов одновременно работают с одной таблицей
+// products. Популярные позиции выбираются по закону Ципфа, поэтому
+// конкуренция за блокировки строк (молоко, яйца) видна сразу.
+
+namespace {
+
+// Распределение Ципфа по рангам 0..n-1: P(k) ~ 1 / (k + 1)^s
+class ZipfGenerator
+{
+public:
+    ZipfGenerator(int n, double s)
+    {
+        m_cdf.resize(n);
+        double sum = 0.0;
+        for (int k = 0; k < n; ++k) {
+            sum += 1.0 / std::pow(k + 1.0, s);
+            m_cdf[k] = sum;
+        }
+        for (double& value : m_cdf) {
+            value /= sum;
+        }
+    }
+
+    int next(QRandomGenerator& random) const
+    {
+        const double u = random.generateDouble();
+        auto it = std::lower_bound(m_cdf.begin(), m_cdf.end(), u);
+        return it == m_cdf.end() ? int(m_cdf.size()) - 1 : int(it - m_cdf.begin());
+    }
+
+private:
+    std::vector<double> m_cdf;
+};
+
+struct LoadMix {
+    int add = 40;
+    int remove = 50;
+    int refresh = 10;
+
+    static bool parse(const QString& text, LoadMix& mix)
+    {
+        const QStringList parts = text.split(':');
+        if (parts.size() != 3) {
+            return false;
+        }
+        bool ok1 = false, ok2 = false, ok3 = false;
+        mix.add = parts[0].toInt(&ok1);
+        mix.remove = parts[1].toInt(&ok2);
+        mix.refresh = parts[2].toInt(&ok3);
+        return ok1 && ok2 && ok3 && mix.add >= 0 && mix.remove >= 0 && mix.refresh >= 0
+            && mix.add + mix.remove + mix.refresh > 0;
+    }
+};
+
+// Результаты одного клиента; сливаются после остановки потоков
+struct ClientResult {
+    std::vector<qint64> latenciesNs;
+    qint64 adds = 0;
+    qint64 removes = 0;
+    qint64 refreshes = 0;
+    qint64 rejected = 0;          // бизнес-отказ: не хватает остатка
+    qint64 deadlocks = 0;         // SQLSTATE 40P01
+    qint64 serialization = 0;     // SQLSTATE 40001
+    qint64 otherErrors = 0;
+    QString firstError;
+    QHash<int, qint64> netDelta;  // id -> подтвержденное изменение остатка
+};
+
+struct LoadConfig {
+    ConnectionSettings settings;
+    bool explicitSettings = false;
+    int clients = 8;
+    int durationSec = 10;
+    int amount = 1;
+    int counterShards = 0;
+    double zipfS = 0.99;
+    LoadMix mix;
+};
+
+bool connectManager(DatabaseManager& dbManager, const LoadConfig& config)
+{
+    dbManager.setCounterShards(config.counterShards);
+    return config.explicitSettings
+        ? dbManager.connectToDatabase(config.settings)
+        : dbManager.connectToDatabase();
+}
+
+void classifyError(const DatabaseManager& dbManager, ClientResult& result)
+{
+    const QString code = dbManager.getLastErrorCode();
+    if (code == "40P01") {
+        ++result.deadlocks;
+    }
+    else if (code == "40001") {
+        ++result.serialization;
+    }
+    else if (code.isEmpty() && dbManager.getLastError() == "Not enough quantity available") {
+        ++result.rejected;
+    }
+    else {
+        ++result.otherErrors;
+        if (result.firstError.isEmpty()) {
+            result.firstError = dbManager.getLastError();
+        }
+    }
+}
+
+void runClient(int clientId, const LoadConfig& config, const QVector<int>& productIds,
+    const ZipfGenerator& zipf, std::atomic<bool>& start, std::atomic<bool>& stop,
+    std::atomic<int>& ready, ClientResult& result)
+{
+    DatabaseManager dbManager;
+    const bool connected = connectManager(dbManager, config);
+    ready.fetch_add(1);
+    if (!connected) {
+        result.firstError = dbManager.getLastError();
+        ++result.otherErrors;
+        return;
+    }
+
+    QRandomGenerator random(quint32(0x5eed + clientId));
+    const int total = config.mix.add + config.mix.remove + config.mix.refresh;
+    result.latenciesNs.reserve(1 << 16);
+
+    while (!start.load(std::memory_order_acquire)) {
+        QThread::yieldCurrentThread();
+    }
+
+    QElapsedTimer timer;
+    while (!stop.load(std::memory_order_relaxed)) {
+        const int dice = random.bounded(total);
+        const int productId = productIds.at(zipf.next(random));
+
+        timer.start();
+        bool ok = false;
+        if (dice < config.mix.add) {
+            ok = dbManager.addProductQuantity(productId, config.amount);
+            if (ok) {
+                ++result.adds;
+                result.netDelta[productId] += config.amount;
+            }
+        }
+        else if (dice < config.mix.add + config.mix.remove) {
+            ok = dbManager.removeProductQuantity(productId, config.amount);
+            if (ok) {
+                ++result.removes;
+                result.netDelta[productId] -= config.amount;
+            }
+        }
+        else {
+            ok = !dbManager.getAllProducts().isEmpty();
+            if (ok) {
+                ++result.refreshes;
+            }
+        }
+        result.latenciesNs.push_back(timer.nsecsElapsed());
+
+        if (!ok) {
+            classifyError(dbManager, result);
+        }
+    }
+}
+
+double percentileMs(const std::vector<qint64>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    // Ранговый метод: наименьшее значение, не меньше которого доля p выборки
+    const qint64 rank = qint64(std::ceil(p * double(sorted.size()))) - 1;
+    return sorted[size_t(qBound<qint64>(0, rank, qint64(sorted.size()) - 1))] / 1e6;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("fridge_loadgen");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Нагрузочный тест: несколько терминалов на одной таблице products");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOptions({
+        { "driver", "Драйвер Qt SQL (по умолчанию QPSQL)", "driver" },
+        { "host", "Адрес сервера PostgreSQL", "host" },
+        { "port", "Порт сервера PostgreSQL", "port" },
+        { "db", "Имя базы данных", "name" },
+        { "user", "Пользователь", "user" },
+        { "password", "Пароль", "password" },
+        { { "c", "clients" }, "Число одновременных клиентов (по умолчанию 8)", "n", "8" },
+        { { "d", "duration" }, "Длительность в секундах (по умолчанию 10)", "sec", "10" },
+        { "mix", "Доли add:remove:refresh (по умолчанию 40:50:10)", "a:r:f", "40:50:10" },
+        { "zipf", "Параметр s распределения Ципфа (по умолчанию 0.99)", "s", "0.99" },
+        { "amount", "Упаковок в одной операции (по умолчанию 1)", "n", "1" },
+        { "shards", "Шардированные счетчики: число слотов (0 - выкл.)", "n", "0" },
+        { { "v", "verbose" }, "Подробный журнал SQL" },
+    });
+    parser.process(app);
+
+    if (!parser.isSet("verbose")) {
+        QLoggingCategory::setFilterRules("*.debug=false\n*.warning=false");
+    }
+
+    QTextStream out(stdout);
+    out.setCodec("UTF-8");
+
+    LoadConfig config;
+    config.clients = qMax(1, parser.value("clients").toInt());
+    config.durationSec = qMax(1, parser.value("duration").toInt());
+    config.amount = qMax(1, parser.value("amount").toInt());
+    config.zipfS = parser.value("zipf").toDouble();
+    if (!LoadMix::parse(parser.value("mix"), config.mix)) {
+        out << "Неверный формат --mix, ожидается a:r:f" << Qt::endl;
+        return 1;
+    }
+
+    config.counterShards = qMax(0, parser.value("shards").toInt());
+    config.explicitSettings = parser.isSet("host") || parser.isSet("driver") || parser.isSet("db");
+    if (parser.isSet("driver")) config.settings.driver = parser.value("driver");
+    if (parser.isSet("host")) config.settings.hostName = parser.value("host");
+    if (parser.isSet("port")) config.settings.port = parser.value("port").toInt();
+    if (parser.isSet("db")) config.settings.databaseName = parser.value("db");
+    if (parser.isSet("user")) config.settings.userName = parser.value("user");
+    if (parser.isSet("password")) config.settings.password = parser.value("password");
+
+    // Начальные остатки для последующей проверки согласованности
+    DatabaseManager control;
+    if (!connectManager(control, config)) {
+        out << "Ошибка подключения: " << control.getLastError() << Qt::endl;
+        return 1;
+    }
+
+    const QVector<ProductData> initial = control.getAllProducts();
+    if (initial.isEmpty()) {
+        out << "Таблица products пуста или недоступна: " << control.getLastError() << Qt::endl;
+        return 1;
+    }
+
+    QVector<int> productIds;
+    productIds.reserve(initial.size());
+    for (const ProductData& product : initial) {
+        productIds.append(product.id);
+    }
+    const ZipfGenerator zipf(productIds.size(), config.zipfS);
+
+    out << "Клиентов: " << config.clients << " | продуктов: " << productIds.size()
+        << " | mix " << config.mix.add << ":" << config.mix.remove << ":" << config.mix.refresh
+        << " | zipf s=" << config.zipfS << " | слотов: " << config.counterShards
+        << " | " << config.durationSec << " с" << Qt::endl;
+
+    std::atomic<bool> start(false);
+    std::atomic<bool> stop(false);
+    std::atomic<int> ready(0);
+    std::vector<ClientResult> results(config.clients);
+    std::vector<std::unique_ptr<QThread>> threads;
+
+    for (int i = 0; i < config.clients; ++i) {
+        threads.emplace_back(QThread::create([&, i]() {
+            runClient(i, config, productIds, zipf, start, stop, ready, results[i]);
+        }));
+        threads.back()->start();
+    }
+
+    while (ready.load() < config.clients) {
+        QThread::msleep(10);
+    }
+
+    QElapsedTimer wall;
+    wall.start();
+    start.store(true, std::memory_order_release);
+    QThread::sleep(ulong(config.durationSec));
+    stop.store(true);
+    for (auto& thread : threads) {
+        thread->wait();
+    }
+    const double elapsedSec = wall.nsecsElapsed() / 1e9;
+
+    // Сводка по всем клиентам
+    ClientResult total;
+    for (ClientResult& result : results) {
+        total.latenciesNs.insert(total.latenciesNs.end(), result.latenciesNs.begin(), result.latenciesNs.end());
+        total.adds += result.adds;
+        total.removes += result.removes;
+        total.refreshes += result.refreshes;
+        total.rejected += result.rejected;
+        total.deadlocks += result.deadlocks;
+        total.serialization += result.serialization;
+        total.otherErrors += result.otherErrors;
+        if (total.firstError.isEmpty()) {
+            total.firstError = result.firstError;
+        }
+        for (auto it = result.netDelta.cbegin(); it != result.netDelta.cend(); ++it) {
+            total.netDelta[it.key()] += it.value();
+        }
+    }
+    std::sort(total.latenciesNs.begin(), total.latenciesNs.end());
+
+    const qint64 operations = qint64(total.latenciesNs.size());
+    out << "\n=== РЕЗУЛЬТАТЫ ===" << Qt::endl;
+    out << "Операций: " << operations << " | " << QString::number(operations / elapsedSec, 'f', 0) << " оп/с" << Qt::endl;
+    out << "  add: " << total.adds << " | remove: " << total.removes << " | refresh: " << total.refreshes << Qt::endl;
+    out << "Задержка, мс: p50 " << QString::number(percentileMs(total.latenciesNs, 0.50), 'f', 3)
+        << " | p99 " << QString::number(percentileMs(total.latenciesNs, 0.99), 'f', 3)
+        << " | p999 " << QString::number(percentileMs(total.latenciesNs, 0.999), 'f', 3)
+        << " | max " << QString::number(total.latenciesNs.empty() ? 0.0 : total.latenciesNs.back() / 1e6, 'f', 3) << Qt::endl;
+    out << "Отказы (нет остатка): " << total.rejected << Qt::endl;
+    out << "Deadlock (40P01): " << total.deadlocks
+        << " | serialization failure (40001): " << total.serialization
+        << " | прочие ошибки: " << total.otherErrors << Qt::endl;
+    if (!total.firstError.isEmpty()) {
+        out << "  первая ошибка: " << total.firstError << Qt::endl;
+    }
+
+    // Проверка: итог = начало + подтвержденные изменения, и без отрицательных остатков
+    const QVector<ProductData> finalProducts = control.getAllProducts();
+    QHash<int, int> initialById;
+    for (const ProductData& product : initial) {
+        initialById.insert(product.id, product.currentQuantity);
+    }
+
+    int mismatches = 0;
+    int negatives = 0;
+    for (const ProductData& product : finalProducts) {
+        const qint64 expected = initialById.value(product.id) + total.netDelta.value(product.id);
+        if (product.currentQuantity != expected) {
+            if (mismatches < 10) {
+                out << "  расхождение: " << product.name << " ожидалось " << expected
+                    << ", в БД " << product.currentQuantity << Qt::endl;
+            }
+            ++mismatches;
+        }
+        if (product.currentQuantity < 0) {
+            ++negatives;
+        }
+    }
+
+    out << "Согласованность остатков: "
+        << (mismatches == 0 && negatives == 0 ? "OK" : "НАРУШЕНА")
+        << " (расхождений: " << mismatches << ", отрицательных: " << negatives << ")" << Qt::endl;
+
+    return mismatches == 0 && negatives == 0 ? 0 : 2;
+}
@@ -0,0 +1,389 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+#include <QMap>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "DatabaseManager.h"
+#include "OperationTrace.h"
+#include "OrderConsolidator.h"
+#include "OrderExporter.h"
+#include "ProductStore.h"
+#include "SupplierCatalog.h"
+
+// Воспроизведение трассы (TraceRecorder) на любом хранилище: события идут в
+// исходном темпе или ускоренно, для каждого вида считаются задержки и
+// сравниваются с записанными. Действия терминала повторяются так же, как их
+// выполняет FridgeManager: кэш остатков, запись с версией, экспорт заявки.
+
+namespace {
+
+struct KindStats {
+    std::vector<qint64> recordedUs;
+    std::vector<qint64> replayedNs;
+    qint64 errors = 0;
+    qint64 conflicts = 0;
+    QString firstError;
+};
+
+struct ReplayConfig {
+    ConnectionSettings settings;
+    bool explicitSettings = false;
+    int counterShards = 0;
+    double speed = 1.0;             // 0 - без пауз
+    QString exportDirectory;
+};
+
+class Replayer
+{
+public:
+    static const int MaxWriteAttempts = 3;
+
+    explicit Replayer(const ReplayConfig& config) : m_config(config) {}
+
+    bool connect(QString& error) {
+        m_dbManager.setCounterShards(m_config.counterShards);
+        const bool connected = m_config.explicitSettings
+            ? m_dbManager.connectToDatabase(m_config.settings)
+            : m_dbManager.connectToDatabase();
+        if (!connected) {
+            error = m_dbManager.getLastError();
+            return false;
+        }
+
+        // Состояние терминала перед первым событием
+        m_store.setProducts(m_dbManager.getAllProducts());
+        m_dbManager.loadSupplierCatalog(m_suppliers);
+        return true;
+    }
+
+    int productCount() const { return m_store.count(); }
+
+    // Продукта из трассы нет в целевой базе - причина ошибки последнего события
+    QString takeMissing() {
+        const QString missing = m_missing;
+        m_missing.clear();
+        return missing;
+    }
+
+    // Выполняет событие; conflict - была повторная попытка из-за версии
+    bool execute(const TraceEvent& event, bool& conflict, QString& error) {
+        conflict = false;
+        bool ok = false;
+        switch (event.kind) {
+        case TraceEvent::Stock:
+            ok = event.type == StockOperation::Add ? m_dbManager.addProductQuantity(event.productId, event.amount)
+                : event.type == StockOperation::Remove ? m_dbManager.removeProductQuantity(event.productId, event.amount)
+                : m_dbManager.updateProductQuantity(event.productId, event.amount);
+            break;
+        case TraceEvent::Batch:
+            ok = m_dbManager.applyStockOperations(event.operations);
+            break;
+        case TraceEvent::Versioned:
+            ok = writeVersioned(StockOperation(event.type, event.productId, event.amount), 1, conflict);
+            break;
+        case TraceEvent::GetAllProducts:
+            ok = !m_dbManager.getAllProducts().isEmpty();
+            break;
+        case TraceEvent::GetProductsToOrder:
+            m_dbManager.getProductsToOrder();
+            ok = m_dbManager.getLastError().isEmpty();
+            break;
+        case TraceEvent::ReceiveLot:
+            ok = m_dbManager.receiveLot(event.productId, event.amount, event.expiresOn, event.value);
+            break;
+        case TraceEvent::SetLocation:
+            m_dbManager.setLocation(int(event.value));
+            ok = true;
+            break;
+        case TraceEvent::UiTap:
+            ok = writeVersioned(StockOperation(event.type, event.productId, event.amount), MaxWriteAttempts, conflict);
+            break;
+        case TraceEvent::UiSelectLocation: {
+            m_dbManager.setLocation(int(event.value));
+            const QVector<ProductData> products = m_dbManager.getAllProducts();
+            m_store.setProducts(products);
+            ok = !products.isEmpty();
+            break;
+        }
+        case TraceEvent::UiExportOrder:
+            ok = exportOrder(TraceEvent::ExportKind(event.value), error);
+            break;
+        case TraceEvent::UiReceiveLot: {
+            ProductData current;
+            ok = m_dbManager.receiveLot(event.productId, event.amount, event.expiresOn, event.value, &current);
+            if (ok) {
+                m_store.refreshProduct(current);
+            }
+            break;
+        }
+        }
+
+        if (!ok && error.isEmpty()) {
+            error = m_dbManager.getLastError();
+        }
+        return ok;
+    }
+
+private:
+    // Как FridgeManager::writeVersioned: версия из кэша, при конфликте -
+    // повтор от строки, которую вернула база
+    bool writeVersioned(const StockOperation& operation, int attempts, bool& conflict) {
+        const int row = m_store.rowForId(operation.productId);
+        if (row < 0) {
+            m_missing = QString("Product %1 is not in the target catalog").arg(operation.productId);
+            return false;
+        }
+
+        for (int attempt = 0; attempt < attempts; ++attempt) {
+            ProductData current;
+            switch (m_dbManager.applyVersioned(operation, m_store.at(row).version, current)) {
+            case DatabaseManager::WriteStatus::Applied:
+                m_store.refreshProduct(current);
+                return true;
+            case DatabaseManager::WriteStatus::Conflict:
+                m_store.refreshProduct(current);
+                conflict = true;
+                continue;
+            case DatabaseManager::WriteStatus::Rejected:
+                m_store.refreshProduct(current);
+                return false;
+            case DatabaseManager::WriteStatus::Failed:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool exportOrder(TraceEvent::ExportKind kind, QString& error) {
+        const QString directory = m_config.exportDirectory.isEmpty() ? m_directory.path() : m_config.exportDirectory;
+        if (directory.isEmpty()) {
+            error = "Temporary directory is not available";
+            return false;
+        }
+
+        OrderExporter exporter;
+        exporter.setDatabaseConnected(true);
+        exporter.setSupplierCatalog(&m_suppliers);
+        exporter.setForecaster(&m_dbManager.forecaster());
+
+        bool ok = false;
+        switch (kind) {
+        case TraceEvent::OrderExport:
+            ok = exporter.saveOrderToFile(OrderExporter::orderFileName(directory), m_store);
+            break;
+        case TraceEvent::SupplierExport:
+            ok = exporter.saveSupplierOrders(directory, m_store);
+            break;
+        case TraceEvent::ConsolidatedExport: {
+            const ConsolidatedOrder order = OrderConsolidator::fromDatabase(m_dbManager.connectionSettings(),
+                m_dbManager.getLocations(), m_dbManager.counterShards());
+            ok = exporter.saveConsolidatedOrderToFile(OrderExporter::orderFileName(directory), order);
+            break;
+        }
+        }
+
+        if (!ok) {
+            error = exporter.getLastError();
+        }
+        return ok;
+    }
+
+    ReplayConfig m_config;
+    DatabaseManager m_dbManager;
+    ProductStore m_store;
+    SupplierCatalog m_suppliers;
+    QTemporaryDir m_directory;
+    QString m_missing;
+};
+
+double percentileMs(std::vector<qint64> values, double p, double toMs)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    // Ранговый метод, как в fridge_loadgen
+    const size_t rank = size_t(qBound<qint64>(0, qint64(std::ceil(p * double(values.size()))) - 1,
+        qint64(values.size()) - 1));
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return values[rank] * toMs;
+}
+
+QString ms(double value)
+{
+    return QString::number(value, 'f', 3);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("fridge_replay");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Воспроизведение трассы операций терминала и сравнение задержек");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("trace", "Файл трассы (FRIDGE_TRACE, fridgectl --trace)");
+    parser.addOptions({
+        { "driver", "Драйвер Qt SQL (по умолчанию QPSQL)", "driver" },
+        { "host", "Адрес сервера PostgreSQL", "host" },
+        { "port", "Порт сервера PostgreSQL", "port" },
+        { "db", "Имя базы данных", "name" },
+        { "user", "Пользователь", "user" },
+        { "password", "Пароль", "password" },
+        { "shards", "Шардированные счетчики: число слотов (0 - выкл.)", "n", "0" },
+        { "speed", "Темп: 1 - как записано, 10 - в 10 раз быстрее, 0 - без пауз", "x", "1" },
+        { "export-dir", "Папка для заявок при воспроизведении (по умолчанию временная)", "dir" },
+        { "fail-above", "Код возврата 2, если p99 вида событий больше записанного в N раз", "n" },
+        { { "v", "verbose" }, "Подробный журнал SQL" },
+    });
+    parser.process(app);
+
+    if (!parser.isSet("verbose")) {
+        QLoggingCategory::setFilterRules("*.debug=false\n*.warning=false");
+    }
+
+    QTextStream out(stdout);
+    out.setCodec("UTF-8");
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    TraceReader reader;
+    if (!reader.open(parser.positionalArguments().first())) {
+        out << "Ошибка чтения трассы: " << reader.getLastError() << Qt::endl;
+        return 1;
+    }
+
+    std::vector<TraceEvent> events;
+    TraceEvent event;
+    while (reader.next(event)) {
+        events.push_back(event);
+    }
+    if (!reader.getLastError().isEmpty()) {
+        out << "Трасса оборвана, воспроизводится начало: " << reader.getLastError() << Qt::endl;
+    }
+    // Вызовы из разных потоков записаны по окончании - упорядочиваем по началу
+    std::stable_sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.startUs < b.startUs;
+    });
+
+    ReplayConfig config;
+    config.counterShards = qMax(0, parser.value("shards").toInt());
+    config.speed = qMax(0.0, parser.value("speed").toDouble());
+    config.exportDirectory = parser.value("export-dir");
+    config.explicitSettings = parser.isSet("host") || parser.isSet("driver") || parser.isSet("db");
+    if (parser.isSet("driver")) config.settings.driver = parser.value("driver");
+    if (parser.isSet("host")) config.settings.hostName = parser.value("host");
+    if (parser.isSet("port")) config.settings.port = parser.value("port").toInt();
+    if (parser.isSet("db")) config.settings.databaseName = parser.value("db");
+    if (parser.isSet("user")) config.settings.userName = parser.value("user");
+    if (parser.isSet("password")) config.settings.password = parser.value("password");
+
+    Replayer replayer(config);
+    QString error;
+    if (!replayer.connect(error)) {
+        out << "Ошибка подключения: " << error << Qt::endl;
+        return 1;
+    }
+
+    const qint64 traceUs = events.empty() ? 0 : events.back().startUs - events.front().startUs;
+    out << "Событий: " << events.size() << " | записано "
+        << QDateTime::fromMSecsSinceEpoch(reader.startedAtMs()).toString("yyyy-MM-dd HH:mm")
+        << " | длительность " << QString::number(traceUs / 1e6, 'f', 1) << " с"
+        << " | темп " << (config.speed > 0 ? QString::number(config.speed) + "x" : QString("без пауз"))
+        << " | продуктов в базе: " << replayer.productCount() << Qt::endl;
+
+    QMap<int, KindStats> stats;
+    std::vector<qint64> lagUs;
+    lagUs.reserve(events.size());
+
+    QElapsedTimer wall;
+    QElapsedTimer timer;
+    wall.start();
+    const qint64 firstUs = events.empty() ? 0 : events.front().startUs;
+    for (const TraceEvent& recorded : events) {
+        // Ожидание момента события в масштабе времени; отставание - в отчет
+        if (config.speed > 0) {
+            const qint64 dueUs = qint64((recorded.startUs - firstUs) / config.speed);
+            const qint64 nowUs = wall.nsecsElapsed() / 1000;
+            if (dueUs > nowUs) {
+                QThread::usleep(ulong(dueUs - nowUs));
+            }
+            lagUs.push_back(qMax<qint64>(0, wall.nsecsElapsed() / 1000 - dueUs));
+        }
+
+        KindStats& kind = stats[recorded.kind];
+        bool conflict = false;
+        error.clear();
+        timer.start();
+        const bool ok = replayer.execute(recorded, conflict, error);
+        kind.replayedNs.push_back(timer.nsecsElapsed());
+        kind.recordedUs.push_back(recorded.durationUs);
+        if (conflict) {
+            ++kind.conflicts;
+        }
+        // Ошибка, которая была и при записи (нет остатка), не считается
+        if (!ok && recorded.ok) {
+            ++kind.errors;
+            const QString missing = replayer.takeMissing();
+            if (kind.firstError.isEmpty()) {
+                kind.firstError = missing.isEmpty() ? error : missing;
+            }
+        }
+    }
+    const double elapsedSec = wall.nsecsElapsed() / 1e9;
+
+    out << "\n=== ЗАДЕРЖКИ, мс (записано -> воспроизведено) ===" << Qt::endl;
+    const double fail = parser.isSet("fail-above") ? parser.value("fail-above").toDouble() : 0.0;
+    bool regressed = false;
+    for (auto it = stats.cbegin(); it != stats.cend(); ++it) {
+        const KindStats& kind = it.value();
+        const double recordedP50 = percentileMs(kind.recordedUs, 0.50, 1e-3);
+        const double recordedP99 = percentileMs(kind.recordedUs, 0.99, 1e-3);
+        const double replayedP50 = percentileMs(kind.replayedNs, 0.50, 1e-6);
+        const double replayedP90 = percentileMs(kind.replayedNs, 0.90, 1e-6);
+        const double replayedP99 = percentileMs(kind.replayedNs, 0.99, 1e-6);
+        const double replayedMax = percentileMs(kind.replayedNs, 1.0, 1e-6);
+
+        out << TraceEvent::kindName(TraceEvent::Kind(it.key())) << ": " << kind.replayedNs.size()
+            << " | p50 " << ms(recordedP50) << " -> " << ms(replayedP50)
+            << " | p90 " << ms(replayedP90)
+            << " | p99 " << ms(recordedP99) << " -> " << ms(replayedP99)
+            << " | max " << ms(replayedMax);
+        if (kind.conflicts > 0) {
+            out << " | конфликтов версии: " << kind.conflicts;
+        }
+        if (kind.errors > 0) {
+            out << " | ошибок: " << kind.errors << " (" << kind.firstError << ")";
+        }
+        out << Qt::endl;
+
+        if (fail > 0 && recordedP99 > 0 && replayedP99 > fail * recordedP99) {
+            out << "  РЕГРЕССИЯ: p99 выше записанного в " << QString::number(replayedP99 / recordedP99, 'f', 1)
+                << " раз" << Qt::endl;
+            regressed = true;
+        }
+    }
+
+    out << "\nВоспроизведено за " << QString::number(elapsedSec, 'f', 1) << " с";
+    if (!lagUs.empty()) {
+        out << " | отставание от графика, мс: p99 " << ms(percentileMs(lagUs, 0.99, 1e-3))
+            << " | max " << ms(percentileMs(lagUs, 1.0, 1e-3));
+    }
+    out << Qt::endl;
+
+    return regressed ? 2 : 0;
+}
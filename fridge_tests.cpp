@@ -0,0 +1,610 @@
+﻿#include <QtTest>
+
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "ExpiryWheel.h"
+#include "Money.h"
+#include "ProductSearchIndex.h"
+#include "ReorderScan.h"
+#include "ScanQueue.h"
+#include "StockHistory.h"
+#include "WireProtocol.h"
+#include "product.pb.h"
+
+// Модульные тесты чистых структур ядра: векторный поиск ниже нормы против
+// обычного цикла, колесо сроков, очередь сканера, формат истории остатков,
+// разбор сумм, поисковый индекс и сборка кадров протокола. База данных не
+// нужна; запуск - ctest или ./fridge_tests.
+class FridgeTests : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void reorderScanMatchesScalar();
+    void reorderScanEdgeValues();
+
+    void expiryWheelRoundsUp();
+    void expiryWheelRescheduleAndCancel();
+    void expiryWheelMatchesReference();
+
+    void scanQueueCapacityAndOrder();
+    void scanQueueConcurrentProducers();
+
+    void stockHistoryRoundTrip();
+    void stockHistoryRejectsOldSnapshot();
+
+    void moneyParse_data();
+    void moneyParse();
+    void moneyFormatRoundTrip();
+
+    void searchIndexMatchesBruteForce();
+    void searchIndexRenameAndRefine();
+
+    void frameReaderSplitsChunks();
+    void frameReaderRejectsOversizedFrame();
+};
+
+namespace {
+
+// Сравнение с обычным циклом для всех реализаций, доступных процессору
+void compareScans(const QVector<qint32>& current, const QVector<qint32>& norm)
+{
+    const ReorderScan::Result expected = ReorderScan::scanWith(ReorderScan::Isa::Scalar,
+        current.constData(), norm.constData(), current.size());
+    for (ReorderScan::Isa isa : { ReorderScan::Isa::Sse41, ReorderScan::Isa::Avx2 }) {
+        if (!ReorderScan::isSupported(isa)) {
+            continue;
+        }
+        const ReorderScan::Result actual = ReorderScan::scanWith(isa,
+            current.constData(), norm.constData(), current.size());
+        QVERIFY2(actual.rows == expected.rows,
+            qPrintable(QString("%1, %2 rows").arg(ReorderScan::isaName(isa)).arg(current.size())));
+        QCOMPARE(actual.totalPacks, expected.totalPacks);
+    }
+}
+
+// Поиск без индекса: то же правило, что у ProductSearchIndex
+bool nameMatches(const QString& name, const QString& query)
+{
+    const QString normalizedName = ProductSearchIndex::normalize(name);
+    const QString normalizedQuery = ProductSearchIndex::normalize(query);
+    if (normalizedQuery.isEmpty()) {
+        return true;
+    }
+    if (normalizedQuery.size() >= 3) {
+        return normalizedName.contains(normalizedQuery);
+    }
+    QString word;
+    for (const QChar ch : normalizedName + QLatin1Char(' ')) {
+        if (ch.isLetterOrNumber()) {
+            word.append(ch);
+            continue;
+        }
+        if (word.startsWith(normalizedQuery)) {
+            return true;
+        }
+        word.clear();
+    }
+    return false;
+}
+
+QVector<int> bruteForceSearch(const QHash<int, QString>& names, const QString& query)
+{
+    QVector<int> ids;
+    for (auto it = names.cbegin(); it != names.cend(); ++it) {
+        if (nameMatches(it.value(), query)) {
+            ids.append(it.key());
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+ProductProto makeProduct(int id, const QString& name)
+{
+    ProductProto product;
+    product.set_id(id);
+    product.set_name(name.toStdString());
+    product.set_current_quantity(id * 3);
+    product.set_norm_quantity(10);
+    return product;
+}
+
+} // namespace
+
+void FridgeTests::reorderScanMatchesScalar()
+{
+    QRandomGenerator random(0x5eed);
+
+    // Длины с остатком после блоков по 4 и 8 строк и длинные массивы
+    const QVector<int> counts = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 1000, 1003, 4099 };
+    for (int count : counts) {
+        QVector<qint32> current(count);
+        QVector<qint32> norm(count);
+        for (int i = 0; i < count; ++i) {
+            current[i] = qint32(random.bounded(-100, 200));
+            norm[i] = qint32(random.bounded(0, 150));
+        }
+        compareScans(current, norm);
+        if (QTest::currentTestFailed()) {
+            return;
+        }
+    }
+}
+
+void FridgeTests::reorderScanEdgeValues()
+{
+    // Все строки ниже нормы, ни одной, равенство и крупные значения
+    for (int count : { 7, 8, 13, 64, 67 }) {
+        QVector<qint32> low(count, 0);
+        QVector<qint32> high(count, 1000000);
+        compareScans(low, high);
+        compareScans(high, low);
+        compareScans(high, high);
+
+        QVector<qint32> alternating(count);
+        for (int i = 0; i < count; ++i) {
+            alternating[i] = i % 2 ? 1000000 : -1000000;
+        }
+        compareScans(alternating, high);
+    }
+
+    const QVector<qint32> current = { 0, 5, 10 };
+    const QVector<qint32> norm = { 3, 5, 12 };
+    const ReorderScan::Result result = ReorderScan::scan(current.constData(), norm.constData(), current.size());
+    QCOMPARE(result.rows, QVector<int>({ 0, 2 }));
+    QCOMPARE(result.totalPacks, qint64(5));
+}
+
+void FridgeTests::expiryWheelRoundsUp()
+{
+    ExpiryWheel wheel(1000);
+    wheel.reset(0);
+
+    // Такт срока округляется вверх: 1500 мс срабатывает на такте 2
+    wheel.schedule(1, 1500);
+    QVERIFY(wheel.advance(1999).isEmpty());
+    QCOMPARE(wheel.advance(2000), QVector<qint64>({ 1 }));
+    QCOMPARE(wheel.size(), 0);
+
+    // Срок уже прошел - срабатывает при ближайшем продвижении
+    wheel.schedule(2, 500);
+    QCOMPARE(wheel.advance(2000), QVector<qint64>({ 2 }));
+}
+
+void FridgeTests::expiryWheelRescheduleAndCancel()
+{
+    ExpiryWheel wheel(1000);
+    wheel.reset(0);
+
+    wheel.schedule(1, 500000);
+    wheel.schedule(1, 3000);                 // перенос ближе
+    wheel.schedule(2, 3000);
+    wheel.cancel(2);
+    QVERIFY(!wheel.isScheduled(2));
+    QCOMPARE(wheel.advance(3000), QVector<qint64>({ 1 }));
+    QVERIFY(wheel.advance(1000000).isEmpty());   // старая запись id 1 не срабатывает
+
+    // Срок на старшем уровне колеса после долгого простоя
+    wheel.schedule(3, 1000000 + 5000000);
+    QVERIFY(wheel.advance(1000000 + 4999999).isEmpty());
+    QCOMPARE(wheel.advance(1000000 + 5000000), QVector<qint64>({ 3 }));
+}
+
+void FridgeTests::expiryWheelMatchesReference()
+{
+    const qint64 tickMs = 1000;
+    ExpiryWheel wheel(tickMs);
+    wheel.reset(0);
+    QHash<qint64, qint64> due;      // id -> такт срока
+    QRandomGenerator random(42);
+    qint64 nowMs = 0;
+
+    for (int step = 0; step < 5000; ++step) {
+        const int action = int(random.bounded(10));
+        const qint64 id = random.bounded(1, 400);
+        if (action < 5) {
+            // Сроки на всех трех уровнях и в прошлом
+            const qint64 span = action == 0 ? 200000000 : (action == 1 ? 3000000 : 60000);
+            const qint64 dueMs = qMax<qint64>(0, nowMs - 5000 + qint64(random.bounded(double(span))));
+            wheel.schedule(id, dueMs);
+            due.insert(id, (dueMs + tickMs - 1) / tickMs);
+        }
+        else if (action < 6) {
+            wheel.cancel(id);
+            due.remove(id);
+        }
+        else {
+            nowMs += action == 9 ? qint64(random.bounded(5000000)) : qint64(random.bounded(20000));
+            QVector<qint64> fired = wheel.advance(nowMs);
+            std::sort(fired.begin(), fired.end());
+
+            QVector<qint64> expected;
+            for (auto it = due.begin(); it != due.end();) {
+                if (it.value() <= nowMs / tickMs) {
+                    expected.append(it.key());
+                    it = due.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            QCOMPARE(fired, expected);
+        }
+        QCOMPARE(wheel.size(), due.size());
+    }
+}
+
+void FridgeTests::scanQueueCapacityAndOrder()
+{
+    QCOMPARE(ScanQueue<int>(1).capacity(), 2);
+    QCOMPARE(ScanQueue<int>(5).capacity(), 8);
+    QCOMPARE(ScanQueue<int>(8).capacity(), 8);
+
+    ScanQueue<int> queue(8);
+    int value = 0;
+    QVERIFY(!queue.tryPop(value));
+
+    // Несколько оборотов кольца: порядок сохраняется, полная очередь отказывает
+    int next = 0;
+    int expected = 0;
+    for (int round = 0; round < 50; ++round) {
+        while (queue.tryPush(next)) {
+            ++next;
+        }
+        QCOMPARE(next - expected, 8);
+        for (int i = 0; i < 5; ++i) {
+            QVERIFY(queue.tryPop(value));
+            QCOMPARE(value, expected++);
+        }
+    }
+    while (queue.tryPop(value)) {
+        QCOMPARE(value, expected++);
+    }
+    QCOMPARE(expected, next);
+}
+
+void FridgeTests::scanQueueConcurrentProducers()
+{
+    const int producers = 4;
+    const int perProducer = 20000;
+    ScanQueue<int> queue(64);
+
+    std::vector<std::thread> threads;
+    for (int producer = 0; producer < producers; ++producer) {
+        threads.emplace_back([&queue, producer]() {
+            for (int i = 0; i < perProducer; ++i) {
+                while (!queue.tryPush(producer * perProducer + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Каждое значение приходит ровно один раз, от одного писателя - по порядку
+    QVector<int> lastSeen(producers, -1);
+    qint64 sum = 0;
+    int received = 0;
+    while (received < producers * perProducer) {
+        int value = 0;
+        if (!queue.tryPop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const int producer = value / perProducer;
+        QVERIFY(value % perProducer > lastSeen.at(producer));
+        lastSeen[producer] = value % perProducer;
+        sum += value;
+        ++received;
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const qint64 total = qint64(producers) * perProducer;
+    QCOMPARE(sum, total * (total - 1) / 2);
+    int value = 0;
+    QVERIFY(!queue.tryPop(value));
+}
+
+void FridgeTests::stockHistoryRoundTrip()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString path = directory.filePath("history.bin");
+
+    // Два полных блока и хвост; продукты появляются и пропадают, остатки
+    // бывают нулевыми и отрицательными
+    const int snapshots = StockHistory::SnapshotsPerBlock * 2 + 10;
+    const int products = 40;
+    QHash<int, QVector<StockPoint>> expected;
+    QVector<qint64> times;
+    QRandomGenerator random(7);
+
+    StockHistory history;
+    QVERIFY2(history.open(path), qPrintable(history.getLastError()));
+    qint64 timeMs = 1000;
+    for (int s = 0; s < snapshots; ++s) {
+        timeMs += 1 + random.bounded(5000);
+        QVector<int> ids;
+        QVector<qint32> quantities;
+        for (int id = products; id >= 1; --id) {         // порядок id не важен
+            if ((id * 7 + s / 5) % 4 == 0) {
+                continue;
+            }
+            const qint32 quantity = qint32(random.bounded(-50, 100000));
+            ids.append(id);
+            quantities.append(quantity);
+            expected[id].append({ timeMs, quantity });
+        }
+        QVERIFY2(history.append(timeMs, ids, quantities), qPrintable(history.getLastError()));
+        times.append(timeMs);
+    }
+    QCOMPARE(history.snapshotCount(), snapshots);
+    QCOMPARE(history.blockCount(), 2);
+
+    auto check = [&](StockHistory& opened) {
+        for (int id = 1; id <= products + 1; ++id) {
+            const QVector<StockPoint> points = opened.history(id, 0, timeMs);
+            const QVector<StockPoint> wanted = expected.value(id);
+            QCOMPARE(points.size(), wanted.size());
+            for (int i = 0; i < points.size(); ++i) {
+                QCOMPARE(points.at(i).timeMs, wanted.at(i).timeMs);
+                QCOMPARE(points.at(i).quantity, wanted.at(i).quantity);
+            }
+        }
+
+        // Период через границу блоков и хвоста - только точки внутри него
+        const qint64 fromMs = times.at(StockHistory::SnapshotsPerBlock - 3);
+        const qint64 toMs = times.at(StockHistory::SnapshotsPerBlock * 2 + 4);
+        for (int id = 1; id <= products; ++id) {
+            QVector<StockPoint> wanted;
+            for (const StockPoint& point : expected.value(id)) {
+                if (point.timeMs >= fromMs && point.timeMs <= toMs) {
+                    wanted.append(point);
+                }
+            }
+            const QVector<StockPoint> points = opened.history(id, fromMs, toMs);
+            QCOMPARE(points.size(), wanted.size());
+            for (int i = 0; i < points.size(); ++i) {
+                QCOMPARE(points.at(i).timeMs, wanted.at(i).timeMs);
+                QCOMPARE(points.at(i).quantity, wanted.at(i).quantity);
+            }
+        }
+    };
+
+    check(history);
+    history.close();
+
+    // Индекс блоков и хвост восстанавливаются из файла
+    StockHistory reopened;
+    QVERIFY2(reopened.open(path), qPrintable(reopened.getLastError()));
+    QCOMPARE(reopened.snapshotCount(), snapshots);
+    QCOMPARE(reopened.lastSnapshotMs(), timeMs);
+    check(reopened);
+}
+
+void FridgeTests::stockHistoryRejectsOldSnapshot()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+
+    StockHistory history;
+    QVERIFY(history.open(directory.filePath("history.bin")));
+    QVERIFY(history.append(2000, { 1 }, { 5 }));
+    QVERIFY(!history.append(2000, { 1 }, { 6 }));
+    QVERIFY(!history.append(3000, { 1, 2 }, { 6 }));
+    QCOMPARE(history.snapshotCount(), 1);
+}
+
+void FridgeTests::moneyParse_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("ok");
+    QTest::addColumn<qint64>("kopecks");
+
+    QTest::newRow("rubles and kopecks") << "1234.56" << true << qint64(123456);
+    QTest::newRow("comma and spaces") << "1 234,5" << true << qint64(123450);
+    QTest::newRow("no-break space") << QString("1") + QChar(0x00A0) + "000" << true << qint64(100000);
+    QTest::newRow("whole rubles") << "12" << true << qint64(1200);
+    QTest::newRow("trailing point") << "5." << true << qint64(500);
+    QTest::newRow("leading point") << ".5" << true << qint64(50);
+    QTest::newRow("zero") << "0" << true << qint64(0);
+    QTest::newRow("trimmed") << "  7,05 " << true << qint64(705);
+    QTest::newRow("empty") << "" << false << qint64(0);
+    QTest::newRow("point only") << "." << false << qint64(0);
+    QTest::newRow("three decimals") << "1.234" << false << qint64(0);
+    QTest::newRow("two points") << "1.2.3" << false << qint64(0);
+    QTest::newRow("negative") << "-1" << false << qint64(0);
+    QTest::newRow("letters") << "12р" << false << qint64(0);
+    QTest::newRow("overflow") << "92233720368547758" << false << qint64(0);
+}
+
+void FridgeTests::moneyParse()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, ok);
+    QFETCH(qint64, kopecks);
+
+    qint64 parsed = -1;
+    QCOMPARE(Money::parse(text, parsed), ok);
+    if (ok) {
+        QCOMPARE(parsed, kopecks);
+    }
+    else {
+        QCOMPARE(parsed, qint64(-1));    // при ошибке значение не трогается
+    }
+}
+
+void FridgeTests::moneyFormatRoundTrip()
+{
+    QCOMPARE(Money::format(123456), QString("1234.56"));
+    QCOMPARE(Money::format(5), QString("0.05"));
+    QCOMPARE(Money::format(-5), QString("-0.05"));
+    QCOMPARE(Money::format(100, QLatin1Char(',')), QString("1,00"));
+
+    for (qint64 kopecks : { qint64(0), qint64(1), qint64(99), qint64(100), qint64(123456789) }) {
+        qint64 parsed = -1;
+        QVERIFY(Money::parse(Money::format(kopecks), parsed));
+        QCOMPARE(parsed, kopecks);
+    }
+    QCOMPARE(Money::weightedAverage(10, 100, 10, 201), qint64(151));
+    QCOMPARE(Money::weightedAverage(0, 100, 0, 250), qint64(250));
+}
+
+void FridgeTests::searchIndexMatchesBruteForce()
+{
+    const QStringList words = { "Молоко", "молочный", "Сливочное", "масло", "Ёжевика", "ежевичный",
+        "Сыр", "сырок", "Milk", "MILKY", "творог", "9%", "Кефир", "1л" };
+    QRandomGenerator random(11);
+    QHash<int, QString> names;
+    ProductSearchIndex index;
+
+    // Вставки, переименования и удаления по одному
+    for (int step = 0; step < 600; ++step) {
+        const int id = int(random.bounded(1, 120));
+        if (random.bounded(5) == 0) {
+            index.remove(id);
+            names.remove(id);
+            continue;
+        }
+        QStringList parts;
+        const int count = int(random.bounded(1, 4));
+        for (int i = 0; i < count; ++i) {
+            parts << words.at(int(random.bounded(words.size())));
+        }
+        const QString name = parts.join(' ');
+        if (random.bounded(2)) {
+            index.insert(id, name);
+        }
+        else {
+            index.update(id, name);
+        }
+        names.insert(id, name);
+    }
+    QCOMPARE(index.size(), names.size());
+
+    // Полная загрузка дает тот же индекс
+    ProductSearchIndex assigned;
+    QVector<QPair<int, QString>> products;
+    for (auto it = names.cbegin(); it != names.cend(); ++it) {
+        products.append(qMakePair(it.key(), it.value()));
+    }
+    assigned.assign(products);
+
+    const QStringList queries = { "", "м", "мо", "МОЛ", "молоко", "ё", "еж", "ежевик", "лоч", "сыр",
+        "ыр", "mil", "LK", "9", "9%", "1л", "масло сыр", "нет такого" };
+    for (const QString& query : queries) {
+        const QVector<int> expected = bruteForceSearch(names, query);
+        QVERIFY2(index.search(query) == expected, qPrintable(query));
+        QVERIFY2(assigned.search(query) == expected, qPrintable(query));
+    }
+}
+
+void FridgeTests::searchIndexRenameAndRefine()
+{
+    ProductSearchIndex index;
+    index.insert(1, "Молоко 3,2%");
+    index.insert(2, "Сливочное масло");
+    index.insert(3, "Молочный коктейль");
+
+    QCOMPARE(index.search("мол"), QVector<int>({ 1, 3 }));
+    QCOMPARE(index.search("МА"), QVector<int>({ 2 }));
+
+    index.update(1, "Кефир");
+    QCOMPARE(index.search("мол"), QVector<int>({ 3 }));
+    QCOMPARE(index.search("кеф"), QVector<int>({ 1 }));
+
+    // Проверка одного продукта совпадает с search
+    QVERIFY(index.matches(1, "кеф"));
+    QVERIFY(index.matches(1, "  "));
+    QVERIFY(!index.matches(1, "мол"));
+    QVERIFY(index.matches(2, "МА"));
+    QVERIFY(!index.matches(99, ""));
+
+    index.remove(3);
+    QVERIFY(index.search("мол").isEmpty());
+    QCOMPARE(index.search(""), QVector<int>({ 1, 2 }));
+
+    // Уточнение запроса совпадает с поиском заново
+    QVERIFY(ProductSearchIndex::canRefine("сли", "сливоч"));
+    QVERIFY(!ProductSearchIndex::canRefine("сл", "сли"));
+    QVERIFY(!ProductSearchIndex::canRefine("сли", "мас"));
+    const QVector<int> previous = index.search("сли");
+    QCOMPARE(index.refine(previous, "сливоч"), index.search("сливоч"));
+}
+
+void FridgeTests::frameReaderSplitsChunks()
+{
+    QByteArray stream;
+    QVector<QByteArray> payloads;
+    for (int i = 0; i < 20; ++i) {
+        const ProductProto product = makeProduct(i + 1, QString("Продукт %1").arg(i + 1));
+        WireProtocol::appendFrame(stream, product);
+        payloads.append(QByteArray::fromStdString(product.SerializeAsString()));
+    }
+    // Пустое сообщение - кадр нулевой длины
+    ProductProto empty;
+    WireProtocol::appendFrame(stream, empty);
+    payloads.append(QByteArray());
+    QVERIFY(stream.startsWith(WireProtocol::frame(makeProduct(1, "Продукт 1"))));
+
+    // Куски по 1, 3 и 7 байт и весь поток сразу
+    for (int chunk : { 1, 3, 7, int(stream.size()) }) {
+        WireProtocol::FrameReader reader;
+        QVector<QByteArray> received;
+        QByteArray payload;
+        for (int offset = 0; offset < stream.size(); offset += chunk) {
+            reader.append(stream.mid(offset, chunk));
+            while (reader.next(payload)) {
+                received.append(payload);
+            }
+        }
+        QVERIFY(!reader.hasError());
+        QCOMPARE(received.size(), payloads.size());
+        for (int i = 0; i < received.size(); ++i) {
+            QCOMPARE(received.at(i), payloads.at(i));
+        }
+
+        ProductProto first;
+        QVERIFY(first.ParseFromArray(received.first().constData(), received.first().size()));
+        QCOMPARE(first.id(), 1);
+        QCOMPARE(QString::fromStdString(first.name()), QString("Продукт 1"));
+    }
+}
+
+void FridgeTests::frameReaderRejectsOversizedFrame()
+{
+    WireProtocol::FrameReader reader;
+    QByteArray payload;
+
+    // Неполный заголовок - просто ждем
+    reader.append(QByteArray("\x00\x00", 2));
+    QVERIFY(!reader.next(payload));
+    QVERIFY(!reader.hasError());
+
+    // Длина больше MaxFrameSize - поток испорчен
+    reader.clear();
+    const quint32 size = quint32(WireProtocol::MaxFrameSize) + 1;
+    QByteArray header(WireProtocol::HeaderSize, '\0');
+    qToBigEndian<quint32>(size, reinterpret_cast<uchar*>(header.data()));
+    reader.append(header);
+    QVERIFY(!reader.next(payload));
+    QVERIFY(reader.hasError());
+
+    // После clear() читатель снова принимает кадры
+    reader.clear();
+    reader.append(WireProtocol::frame(makeProduct(5, "Сыр")));
+    QVERIFY(reader.next(payload));
+    QVERIFY(!reader.hasError());
+}
+
+QTEST_GUILESS_MAIN(FridgeTests)
+
+#include "fridge_tests.moc"
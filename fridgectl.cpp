@@ -0,0 +1,1055 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QTextStream>
+
+#include "ConnectionMonitor.h"
+#include "DatabaseManager.h"
+#include "InventoryServer.h"
+#include "Money.h"
+#include "OperationTrace.h"
+#include "OrderConsolidator.h"
+#include "OrderExporter.h"
+#include "ProductStore.h"
+#include "ScanIngest.h"
+#include "StockTake.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Консольный клиент: интерактивное меню и пакетный режим для накладных
+class FridgeCtl
+{
+public:
+    FridgeCtl()
+        : out(stdout)
+        , err(stderr)
+        , useDatabase(false)
+        , batchSize(1000)
+    {
+        out.setCodec("UTF-8");
+        err.setCodec("UTF-8");
+    }
+
+    bool connect(const QCommandLineParser& parser, bool loadProducts = true) {
+        if (parser.isSet("local")) {
+            err << "Используется локальное хранилище (--local)" << Qt::endl;
+            initializeDefaultProducts();
+            return true;
+        }
+
+        dbManager.setCounterShards(parser.value("shards").toInt());
+
+        bool connected = false;
+        if (parser.isSet("host") || parser.isSet("driver") || parser.isSet("db")) {
+            ConnectionSettings settings;
+            if (parser.isSet("driver")) settings.driver = parser.value("driver");
+            if (parser.isSet("host")) settings.hostName = parser.value("host");
+            if (parser.isSet("port")) settings.port = parser.value("port").toInt();
+            if (parser.isSet("db")) settings.databaseName = parser.value("db");
+            if (parser.isSet("user")) settings.userName = parser.value("user");
+            if (parser.isSet("password")) settings.password = parser.value("password");
+            connected = dbManager.connectToDatabase(settings);
+        }
+        else {
+            connected = dbManager.connectToDatabase();
+        }
+
+        if (connected) {
+            err << "Подключение к базе данных успешно!" << Qt::endl;
+            useDatabase = true;
+            dbManager.setLocation(parser.value("location").toInt());
+            if (!dbManager.loadSupplierCatalog(suppliers)) {
+                err << "Каталог поставщиков не загружен: " << dbManager.getLastError() << Qt::endl;
+            }
+            if (loadProducts) {
+                loadFromDatabase();
+            }
+            return true;
+        }
+
+        err << "Ошибка подключения к базе данных: " << dbManager.getLastError() << Qt::endl;
+        return false;
+    }
+
+    void setBatchSize(int size) { batchSize = qMax(1, size); }
+
+    // Вызовы DatabaseManager пишутся в трассу для fridge_replay
+    bool startTrace(const QString& path) {
+        if (!trace.open(path)) {
+            err << "Ошибка записи трассы: " << trace.getLastError() << Qt::endl;
+            return false;
+        }
+        dbManager.setTraceRecorder(&trace);
+        return true;
+    }
+
+    void showProducts() {
+        out << "\n=== ОСТАТКИ В ХОЛОДИЛЬНИКЕ ===" << Qt::endl;
+        for (int i = 0; i < store.count(); ++i) {
+            const ProductData& product = store.at(i);
+            out << i + 1 << ". " << product.name
+                << " | В наличии: " << product.currentQuantity
+                << " | Норма: " << product.normQuantity;
+
+            if (ProductStore::needsOrder(product)) {
+                out << " | Нужен заказ: " << ProductStore::orderQuantity(product);
+            }
+            else {
+                out << " | Достаточно";
+            }
+            if (product.nextExpiry.isValid()) {
+                out << " | Годен до: " << product.nextExpiry.toString("dd.MM.yyyy");
+            }
+            if (product.unitCost > 0) {
+                out << " | Цена: " << Money::format(product.unitCost);
+            }
+            out << Qt::endl;
+        }
+        out << "Стоимость остатков: " << Money::format(store.stockValue())
+            << " | Заявка по норме: " << Money::format(store.orderCost()) << Qt::endl;
+    }
+
+    void addProductQuantity(int index, int amount) {
+        if (!store.isValidRow(index)) {
+            out << "Ошибка: неверный индекс продукта!" << Qt::endl;
+            return;
+        }
+
+        if (useDatabase && !dbManager.addProductQuantity(store.at(index).id, amount)) {
+            out << "Ошибка при обновлении базы данных!" << Qt::endl;
+            return;
+        }
+
+        store.addQuantity(index, amount);
+        out << "Добавлено " << amount << " упаковок " << store.at(index).name << Qt::endl;
+    }
+
+    void removeProductQuantity(int index, int amount) {
+        if (!store.isValidRow(index)) {
+            out << "Ошибка: неверный индекс продукта!" << Qt::endl;
+            return;
+        }
+
+        if (store.at(index).currentQuantity < amount) {
+            out << "Ошибка: недостаточно " << store.at(index).name << " в холодильнике!" << Qt::endl;
+            return;
+        }
+
+        if (useDatabase && !dbManager.removeProductQuantity(store.at(index).id, amount)) {
+            out << "Ошибка при обновлении базы данных!" << Qt::endl;
+            return;
+        }
+
+        store.removeQuantity(index, amount);
+        if (useDatabase) {
+            store.setNextExpiry(index, dbManager.nextExpiry(store.at(index).id));
+        }
+        out << "Израсходовано " << amount << " упаковок " << store.at(index).name << Qt::endl;
+    }
+
+    void receiveLot(int index, int amount, const QString& expiresOn, const QString& price) {
+        if (!store.isValidRow(index)) {
+            out << "Ошибка: неверный индекс продукта!" << Qt::endl;
+            return;
+        }
+        if (!useDatabase) {
+            out << "Партии учитываются только с базой данных!" << Qt::endl;
+            return;
+        }
+
+        const QDate expiry = QDate::fromString(expiresOn, Qt::ISODate);
+        if (!expiry.isValid()) {
+            out << "Ошибка: дата должна быть в формате ГГГГ-ММ-ДД" << Qt::endl;
+            return;
+        }
+
+        // "-" - без цены
+        qint64 unitCost = -1;
+        if (price != "-" && !Money::parse(price, unitCost)) {
+            out << "Ошибка: цена должна быть в формате 123.45" << Qt::endl;
+            return;
+        }
+
+        ProductData current;
+        if (!dbManager.receiveLot(store.at(index).id, amount, expiry, unitCost, &current)) {
+            out << "Ошибка при приходе партии: " << dbManager.getLastError() << Qt::endl;
+            return;
+        }
+
+        store.refreshProduct(current);
+        out << "Принята партия: " << amount << " упаковок " << store.at(index).name
+            << " до " << expiry.toString("dd.MM.yyyy") << Qt::endl;
+    }
+
+    // Партии по продуктам в порядке списания и те, у которых подходит срок
+    void showLots() {
+        out << "\n=== ПАРТИИ И СРОКИ ГОДНОСТИ ===" << Qt::endl;
+        for (int i = 0; i < store.count(); ++i) {
+            const ProductData& product = store.at(i);
+            const QVector<ProductLot> lots = dbManager.getProductLots(product.id);
+            if (lots.isEmpty()) {
+                continue;
+            }
+
+            out << product.name << " (в наличии " << product.currentQuantity << "):" << Qt::endl;
+            for (const ProductLot& lot : lots) {
+                out << "   " << lot.quantity << " уп. | годен до "
+                    << (lot.expiresOn.isValid() ? lot.expiresOn.toString("dd.MM.yyyy") : QString("-"));
+                if (lot.unitCost >= 0) {
+                    out << " | цена " << Money::format(lot.unitCost);
+                }
+                out << Qt::endl;
+            }
+        }
+
+        for (const ProductLot& lot : dbManager.checkExpiringLots()) {
+            const int row = store.rowForId(lot.productId);
+            out << "Истекает срок: " << (row >= 0 ? store.at(row).name : QString::number(lot.productId))
+                << " - " << lot.quantity << " уп. до " << lot.expiresOn.toString("dd.MM.yyyy") << Qt::endl;
+        }
+    }
+
+    // Строки заявки из базы. С прогнозом нужен весь каталог: прогноз может
+    // заказать и продукт на норме или выше нее (как заявка по хранилищу в
+    // окне программы). Без прогноза хватает строк ниже нормы - их находит
+    // частичный индекс products_below_norm_idx.
+    bool loadOrderProducts(bool withForecast, QVector<ProductData>& products) {
+        products = withForecast ? dbManager.getAllProducts() : dbManager.getProductsToOrder();
+        if (products.isEmpty() && !dbManager.getLastError().isEmpty()) {
+            out << "Ошибка при получении заявки: " << dbManager.getLastError() << Qt::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool generateOrder(const QString& directoryPath) {
+        OrderExporter exporter;
+        exporter.setDatabaseConnected(useDatabase);
+        exporter.setSupplierCatalog(&suppliers);
+        const ConsumptionForecaster* forecaster = useDatabase ? &dbManager.forecaster() : nullptr;
+        exporter.setForecaster(forecaster);
+        // Для --order каталог не загружается - тогда стоимость остатков не печатается
+        if (store.count() > 0) {
+            exporter.setStockValue(store.stockValue());
+        }
+
+        QString fileName = OrderExporter::orderFileName(directoryPath);
+        bool saved = false;
+        if (useDatabase) {
+            QVector<ProductData> products;
+            if (!loadOrderProducts(forecaster != nullptr, products)) {
+                return false;
+            }
+            saved = exporter.saveOrderToFile(fileName, products);
+        }
+        else {
+            saved = exporter.saveOrderToFile(fileName, store);
+        }
+
+        if (!saved) {
+            out << "Ошибка при создании файла заявки: " << exporter.getLastError() << Qt::endl;
+            return false;
+        }
+
+        out << "Заявка сохранена в файл '" << fileName << "'" << Qt::endl;
+        return true;
+    }
+
+    // Режим сервера: процесс держит базу и каталог, терминалы подключаются
+    // по сокету. Возвращается только при ошибке запуска.
+    bool serve(QCoreApplication& app, const QString& address) {
+        InventoryServer server(useDatabase ? &dbManager : nullptr, &store);
+        if (!server.listen(address)) {
+            err << "Не удалось запустить сервер: " << server.getLastError() << Qt::endl;
+            return false;
+        }
+
+        // Сервер работает всю смену: обрыв соединения с базой не должен его останавливать
+        ConnectionMonitor monitor(&dbManager);
+        if (useDatabase) {
+            QObject::connect(&monitor, &ConnectionMonitor::connectionLost, [this](const QString& error) {
+                err << "Соединение с базой потеряно: " << error << Qt::endl;
+            });
+            QObject::connect(&monitor, &ConnectionMonitor::connectionRestored, [this]() {
+                err << "Соединение с базой восстановлено" << Qt::endl;
+            });
+            monitor.start();
+        }
+
+        err << "Сервер остатков слушает " << address << ", продуктов: " << store.count() << Qt::endl;
+        return app.exec() == 0;
+    }
+
+    // Прием сканов без окна: коды из evdev-устройства, файла или FIFO
+    // (echo 4601234567890 > scans.fifo), приход пакетами до Ctrl+C
+    bool scan(QCoreApplication& app, const QString& source) {
+        BarcodeIndex index;
+        if (useDatabase) {
+            index.build(dbManager.getBarcodes());
+        }
+        if (index.isEmpty()) {
+            err << "Штрихкоды не загружены (fridgectl --barcodes FILE)" << Qt::endl;
+            return false;
+        }
+
+        ScanIngest scanner;
+        scanner.setIndex(index);
+        QObject::connect(&scanner, &ScanIngest::unknownBarcode, [this](const QString& code) {
+            err << "Неизвестный штрихкод: " << code << Qt::endl;
+        });
+        QObject::connect(&scanner, &ScanIngest::scansReady, [this](const QVector<StockOperation>& operations) {
+            if (!dbManager.applyStockOperations(operations)) {
+                err << "Пакет не применен: " << dbManager.getLastError() << Qt::endl;
+                return;
+            }
+            for (const StockOperation& operation : operations) {
+                const int row = store.rowForId(operation.productId);
+                if (row >= 0) {
+                    store.addQuantity(row, operation.amount);
+                    out << store.at(row).name << " +" << operation.amount
+                        << " = " << store.at(row).currentQuantity << Qt::endl;
+                }
+            }
+        });
+        if (!scanner.start(source)) {
+            err << "Не удалось открыть сканер: " << scanner.getLastError() << Qt::endl;
+            return false;
+        }
+
+        err << "Прием сканов из " << source << ", штрихкодов: " << index.size() << Qt::endl;
+        return app.exec() == 0;
+    }
+
+    // Инвентаризация: сверка файла пересчета с остатками в базе, с apply -
+    // исправление остатков одним запросом
+    bool stockTake(const QString& filePath, bool apply, bool zeroMissing) {
+        if (!useDatabase) {
+            err << "Инвентаризация работает только с базой данных" << Qt::endl;
+            return false;
+        }
+
+        QVector<StockCount> counts;
+        QString error;
+        if (!StockTake::readCounts(filePath, counts, error)) {
+            err << error << Qt::endl;
+            return false;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        StockTakeResult result;
+        if (!dbManager.reconcileStockTake(counts, apply, zeroMissing, result)) {
+            err << "Ошибка инвентаризации: " << dbManager.getLastError() << Qt::endl;
+            return false;
+        }
+
+        for (const StockVariance& variance : result.variances) {
+            out << variance.productId << "\t" << variance.name << "\t" << variance.expected << " -> " << variance.counted
+                << "\t" << (variance.delta() > 0 ? "+" : "") << variance.delta()
+                << "\t" << Money::format(variance.costDelta()) << Qt::endl;
+        }
+        for (const QString& name : result.unmatched) {
+            err << "Не найден продукт: " << name << Qt::endl;
+        }
+        out << StockTake::summary(result) << Qt::endl;
+        out << (result.applied ? "Остатки исправлены" : "Только отчет (--apply для исправления)")
+            << ", " << timer.elapsed() << " мс" << Qt::endl;
+        return result.unmatched.isEmpty();
+    }
+
+    // Массовая загрузка и выгрузка каталога через COPY; загрузка идет
+    // первой, так что можно перенести каталог одной командой
+    bool copyCatalog(const QString& importPath, const QString& exportPath) {
+        if (!useDatabase) {
+            err << "Загрузка и выгрузка каталога работают только с базой данных" << Qt::endl;
+            return false;
+        }
+
+        auto report = [this](const char* action, qint64 rows, qint64 elapsedMs) {
+            out << action << ": " << rows << " продуктов за " << elapsedMs << " мс ("
+                << (elapsedMs > 0 ? rows * 1000 / elapsedMs : rows) << " в секунду)" << Qt::endl;
+        };
+
+        QElapsedTimer timer;
+        qint64 rows = 0;
+        if (!importPath.isEmpty()) {
+            timer.start();
+            if (!dbManager.importCatalog(importPath, &rows)) {
+                err << "Ошибка загрузки каталога: " << dbManager.getLastError() << Qt::endl;
+                return false;
+            }
+            report("Загружено", rows, timer.elapsed());
+        }
+        if (!exportPath.isEmpty()) {
+            timer.start();
+            if (!dbManager.exportCatalog(exportPath, &rows)) {
+                err << "Ошибка выгрузки каталога: " << dbManager.getLastError() << Qt::endl;
+                return false;
+            }
+            report("Выгружено", rows, timer.elapsed());
+        }
+        return true;
+    }
+
+    // Штрихкоды, по строке на код: штрихкод; продукт[; упаковок за скан].
+    // Общий код для строк продукта в нескольких локациях задается
+    // отдельной строкой на каждую (по id или с --location)
+    bool importBarcodes(QIODevice& input) {
+        QTextStream in(&input);
+        in.setCodec("UTF-8");
+
+        QVector<ProductBarcode> barcodes;
+        qint64 lineNumber = 0;
+        qint64 rejected = 0;
+        QString line;
+        while (in.readLineInto(&line)) {
+            ++lineNumber;
+            line = line.trimmed();
+            if (line.isEmpty() || line.startsWith('#')) {
+                continue;
+            }
+
+            const QStringList parts = line.split(';');
+            const QString code = parts.value(0).trimmed();
+            const QString product = parts.value(1).trimmed();
+            bool packOk = true;
+            const int pack = parts.size() > 2 ? parts.at(2).trimmed().toInt(&packOk) : 1;
+
+            QString error;
+            const int row = findProduct(product, error);
+            if (row == ProductStore::AmbiguousRow) {
+                err << "Строка " << lineNumber << ": " << error << Qt::endl;
+                ++rejected;
+                continue;
+            }
+            if (row < 0 || code.isEmpty() || code.size() > ScanIngest::MaxCodeLength || !packOk || pack <= 0
+                || parts.size() > 3) {
+                err << "Строка " << lineNumber << ": ожидается '<штрихкод>; <продукт>[; <упаковок>]'" << Qt::endl;
+                ++rejected;
+                continue;
+            }
+            barcodes.append(ProductBarcode(code, store.at(row).id, pack));
+        }
+
+        if (useDatabase && !dbManager.setBarcodes(barcodes)) {
+            err << "Ошибка при сохранении штрихкодов: " << dbManager.getLastError() << Qt::endl;
+            return false;
+        }
+        out << "Штрихкоды: " << barcodes.size() << " | отклонено строк: " << rejected << Qt::endl;
+        return rejected == 0;
+    }
+
+    // Отдельная заявка каждому поставщику
+    bool generateSupplierOrders(const QString& directoryPath) {
+        OrderExporter exporter;
+        exporter.setDatabaseConnected(useDatabase);
+        exporter.setSupplierCatalog(&suppliers);
+        const ConsumptionForecaster* forecaster = useDatabase ? &dbManager.forecaster() : nullptr;
+        exporter.setForecaster(forecaster);
+
+        QStringList files;
+        bool saved = false;
+        if (useDatabase) {
+            QVector<ProductData> products;
+            if (!loadOrderProducts(forecaster != nullptr, products)) {
+                return false;
+            }
+            saved = exporter.saveSupplierOrders(directoryPath, products, &files);
+        }
+        else {
+            saved = exporter.saveSupplierOrders(directoryPath, store, &files);
+        }
+
+        for (const QString& file : files) {
+            out << "Заявка сохранена в файл '" << file << "'" << Qt::endl;
+        }
+        if (!saved) {
+            out << "Ошибка при создании файлов заявки: " << exporter.getLastError() << Qt::endl;
+            return false;
+        }
+        if (files.isEmpty()) {
+            out << "Все продукты в достаточном количестве" << Qt::endl;
+        }
+        return true;
+    }
+
+    // Каталог поставщиков, по строке на продукт:
+    //   Молоко; Молочная ферма; 6; 12
+    // (продукт - id или название; фасовка и минимум необязательны)
+    bool importSuppliers(QIODevice& input) {
+        QTextStream in(&input);
+        in.setCodec("UTF-8");
+
+        SupplierCatalog imported;
+        qint64 lineNumber = 0;
+        qint64 rejected = 0;
+        QString line;
+        while (in.readLineInto(&line)) {
+            ++lineNumber;
+            line = line.trimmed();
+            if (line.isEmpty() || line.startsWith('#')) {
+                continue;
+            }
+
+            const QStringList parts = line.split(';');
+            QString error;
+            const int row = findProduct(parts.value(0).trimmed(), error);
+            if (row == ProductStore::AmbiguousRow) {
+                err << "Строка " << lineNumber << ": " << error << Qt::endl;
+                ++rejected;
+                continue;
+            }
+
+            SupplierCatalog::Terms terms;
+            terms.supplier = parts.value(1).trimmed();
+            bool packOk = true;
+            bool minOk = true;
+            if (parts.size() > 2) terms.packSize = parts.at(2).trimmed().toInt(&packOk);
+            if (parts.size() > 3) terms.minOrder = parts.at(3).trimmed().toInt(&minOk);
+
+            if (row < 0 || terms.supplier.isEmpty() || !packOk || !minOk || terms.packSize < 1 || terms.minOrder < 0) {
+                err << "Строка " << lineNumber << ": ожидается '<продукт>; <поставщик>; [фасовка]; [минимум]'" << Qt::endl;
+                ++rejected;
+                continue;
+            }
+
+            imported.setTerms(store.at(row).id, terms);
+            suppliers.setTerms(store.at(row).id, terms);
+        }
+
+        if (useDatabase && !dbManager.saveSupplierCatalog(imported)) {
+            err << "Ошибка при сохранении каталога: " << dbManager.getLastError() << Qt::endl;
+            return false;
+        }
+
+        out << "Каталог поставщиков: " << imported.size() << " продуктов, "
+            << imported.suppliers().size() << " поставщиков | отклонено строк: " << rejected << Qt::endl;
+        return rejected == 0;
+    }
+
+    // Цены упаковок, по строке на продукт (продукт - id или название):
+    //   Молоко; 89.90
+    bool importPrices(QIODevice& input) {
+        QTextStream in(&input);
+        in.setCodec("UTF-8");
+
+        QHash<int, qint64> costs;
+        qint64 lineNumber = 0;
+        qint64 rejected = 0;
+        QString line;
+        while (in.readLineInto(&line)) {
+            ++lineNumber;
+            line = line.trimmed();
+            if (line.isEmpty() || line.startsWith('#')) {
+                continue;
+            }
+
+            const QStringList parts = line.split(';');
+            QString error;
+            const int row = findProduct(parts.value(0).trimmed(), error);
+            if (row == ProductStore::AmbiguousRow) {
+                err << "Строка " << lineNumber << ": " << error << Qt::endl;
+                ++rejected;
+                continue;
+            }
+
+            qint64 cost = 0;
+            if (row < 0 || parts.size() != 2 || !Money::parse(parts.at(1), cost)) {
+                err << "Строка " << lineNumber << ": ожидается '<продукт>; <цена>'" << Qt::endl;
+                ++rejected;
+                continue;
+            }
+            costs.insert(store.at(row).id, cost);
+        }
+
+        if (useDatabase && !dbManager.setUnitCosts(costs)) {
+            err << "Ошибка при сохранении цен: " << dbManager.getLastError() << Qt::endl;
+            return false;
+        }
+        for (auto it = costs.cbegin(); it != costs.cend(); ++it) {
+            store.setUnitCost(store.rowForId(it.key()), it.value());
+        }
+
+        out << "Цены: " << costs.size() << " продуктов | отклонено строк: " << rejected << Qt::endl;
+        out << "Стоимость остатков: " << Money::format(store.stockValue()) << Qt::endl;
+        return rejected == 0;
+    }
+
+    // Сводная заявка по всем локациям: каждая считается в своем потоке
+    // со своим подключением, затем позиции складываются
+    bool generateConsolidatedOrder(const QString& directoryPath) {
+        ConsolidatedOrder order;
+        if (useDatabase) {
+            const QVector<LocationInfo> locations = dbManager.getLocations();
+            if (locations.isEmpty()) {
+                out << "Ошибка при получении локаций: " << dbManager.getLastError() << Qt::endl;
+                return false;
+            }
+            order = OrderConsolidator::fromDatabase(dbManager.connectionSettings(), locations, dbManager.counterShards());
+        }
+        else {
+            order = OrderConsolidator::fromProducts(store.products(),
+                { LocationInfo(DefaultLocationId, "Основной холодильник", "Gourmet") });
+        }
+
+        OrderExporter exporter;
+        exporter.setDatabaseConnected(useDatabase);
+        const QString fileName = OrderExporter::orderFileName(directoryPath);
+        if (!exporter.saveConsolidatedOrderToFile(fileName, order)) {
+            out << "Ошибка при создании файла заявки: " << exporter.getLastError() << Qt::endl;
+            return false;
+        }
+
+        out << "Сводная заявка сохранена в файл '" << fileName << "'" << Qt::endl;
+        return order.errors.isEmpty();
+    }
+
+    // Пакетный режим: одна операция на строку, например
+    //   add Молоко 12
+    //   remove 3 2
+    //   set Оливки 8
+    // Продукт задается id или названием, строки с '#' пропускаются.
+    bool applyManifest(QIODevice& input) {
+        QTextStream in(&input);
+        in.setCodec("UTF-8");
+
+        QVector<StockOperation> batch;
+        QVector<QPair<int, int>> undo;  // (строка, прежнее количество)
+        batch.reserve(batchSize);
+        undo.reserve(batchSize);
+
+        qint64 lineNumber = 0;
+        qint64 applied = 0;
+        qint64 rejected = 0;
+        qint64 batches = 0;
+        qint64 failedBatches = 0;
+
+        QElapsedTimer timer;
+        timer.start();
+
+        auto flush = [&]() {
+            if (batch.isEmpty()) {
+                return;
+            }
+            ++batches;
+            if (useDatabase && !dbManager.applyStockOperations(batch)) {
+                // Транзакция откатилась: возвращаем и память к прежнему состоянию
+                for (int i = undo.size() - 1; i >= 0; --i) {
+                    store.setCurrentQuantity(undo.at(i).first, undo.at(i).second);
+                }
+                err << "Пакет " << batches << " отклонен: " << dbManager.getLastError() << Qt::endl;
+                rejected += batch.size();
+                ++failedBatches;
+            }
+            else {
+                applied += batch.size();
+            }
+            batch.clear();
+            undo.clear();
+        };
+
+        QString line;
+        while (in.readLineInto(&line)) {
+            ++lineNumber;
+            line = line.trimmed();
+            if (line.isEmpty() || line.startsWith('#')) {
+                continue;
+            }
+
+            StockOperation operation;
+            int row = -1;
+            QString error;
+            if (!parseOperation(line, operation, row, error)) {
+                err << "Строка " << lineNumber << ": " << error << Qt::endl;
+                ++rejected;
+                continue;
+            }
+
+            // Проверяем по памяти, чтобы одна плохая строка не откатывала весь пакет
+            const int previous = store.at(row).currentQuantity;
+            bool ok = false;
+            switch (operation.type) {
+            case StockOperation::Add:
+                ok = store.addQuantity(row, operation.amount);
+                break;
+            case StockOperation::Remove:
+                ok = store.removeQuantity(row, operation.amount);
+                break;
+            case StockOperation::Set:
+                ok = store.setCurrentQuantity(row, operation.amount);
+                break;
+            }
+
+            if (!ok) {
+                err << "Строка " << lineNumber << ": недостаточно " << store.at(row).name << Qt::endl;
+                ++rejected;
+                continue;
+            }
+
+            undo.append(qMakePair(row, previous));
+            batch.append(operation);
+            if (batch.size() >= batchSize) {
+                flush();
+            }
+        }
+        flush();
+
+        const qint64 elapsedMs = qMax<qint64>(1, timer.elapsed());
+        out << "Обработано строк: " << lineNumber
+            << " | применено: " << applied
+            << " | отклонено: " << rejected << Qt::endl;
+        out << "Пакетов: " << batches << " (ошибок: " << failedBatches << ")"
+            << " | время: " << elapsedMs << " мс"
+            << " | " << QString::number(applied * 1000.0 / elapsedMs, 'f', 0) << " оп/с" << Qt::endl;
+
+        return failedBatches == 0 && rejected == 0;
+    }
+
+    void showMenu() {
+        out << "\n=== УЧЕТ ПРОДУКТОВ РЕСТОРАНА ===" << Qt::endl;
+        out << "1. Показать остатки" << Qt::endl;
+        out << "2. Добавить продукт (приход)" << Qt::endl;
+        out << "3. Израсходовать продукт (расход)" << Qt::endl;
+        out << "4. Сформировать заявку" << Qt::endl;
+        out << "5. Обновить данные из базы" << Qt::endl;
+        out << "6. Приход партией со сроком годности" << Qt::endl;
+        out << "7. Партии и сроки годности" << Qt::endl;
+        out << "8. Выход" << Qt::endl;
+        out << "Выберите действие: " << Qt::flush;
+    }
+
+    void run() {
+        QTextStream in(stdin);
+        in.setCodec("UTF-8");
+
+        while (true) {
+            showMenu();
+            int choice = 0;
+            in >> choice;
+            if (in.status() != QTextStream::Ok) {
+                return;
+            }
+
+            switch (choice) {
+            case 1:
+                showProducts();
+                break;
+
+            case 2: {
+                showProducts();
+                out << "Выберите продукт (номер): " << Qt::flush;
+                int index = 0;
+                in >> index;
+                out << "Количество: " << Qt::flush;
+                int amount = 0;
+                in >> amount;
+                addProductQuantity(index - 1, amount);
+                break;
+            }
+
+            case 3: {
+                showProducts();
+                out << "Выберите продукт (номер): " << Qt::flush;
+                int index = 0;
+                in >> index;
+                out << "Количество: " << Qt::flush;
+                int amount = 0;
+                in >> amount;
+                removeProductQuantity(index - 1, amount);
+                break;
+            }
+
+            case 4:
+                generateOrder(QStandardPaths::writableLocation(QStandardPaths::HomeLocation));
+                break;
+
+            case 5:
+                if (useDatabase) {
+                    loadFromDatabase();
+                    out << "Данные обновлены из базы данных!" << Qt::endl;
+                }
+                else {
+                    out << "База данных недоступна!" << Qt::endl;
+                }
+                break;
+
+            case 6: {
+                showProducts();
+                out << "Выберите продукт (номер): " << Qt::flush;
+                int index = 0;
+                in >> index;
+                out << "Количество: " << Qt::flush;
+                int amount = 0;
+                in >> amount;
+                out << "Годен до (ГГГГ-ММ-ДД): " << Qt::flush;
+                QString expiresOn;
+                in >> expiresOn;
+                out << "Цена упаковки (- без цены): " << Qt::flush;
+                QString price;
+                in >> price;
+                receiveLot(index - 1, amount, expiresOn, price);
+                break;
+            }
+
+            case 7:
+                if (useDatabase) {
+                    showLots();
+                }
+                else {
+                    out << "База данных недоступна!" << Qt::endl;
+                }
+                break;
+
+            case 8:
+                out << "Выход из программы..." << Qt::endl;
+                return;
+
+            default:
+                out << "Неверный выбор!" << Qt::endl;
+            }
+        }
+    }
+
+private:
+    // Строка продукта по id или названию. Если название есть в нескольких
+    // локациях (--location 0), строка не выбирается: AmbiguousRow и ошибка
+    int findProduct(const QString& product, QString& error) const {
+        bool isId = false;
+        const int productId = product.toInt(&isId);
+        const int row = isId ? store.rowForId(productId) : store.rowForName(product, dbManager.location());
+        if (row == ProductStore::AmbiguousRow) {
+            error = "название '" + product + "' есть в нескольких локациях, укажите --location или id";
+        }
+        else if (row < 0) {
+            error = "продукт '" + product + "' не найден";
+        }
+        return row;
+    }
+
+    bool parseOperation(const QString& line, StockOperation& operation, int& row, QString& error) {
+        QStringList parts = line.split(QRegularExpression("[\\s;,]+"), Qt::SkipEmptyParts);
+        if (parts.size() < 3) {
+            error = "ожидается '<операция> <продукт> <количество>'";
+            return false;
+        }
+
+        const QString command = parts.first().toLower();
+        if (command == "add" || command == "+" || command == "приход") {
+            operation.type = StockOperation::Add;
+        }
+        else if (command == "remove" || command == "-" || command == "расход") {
+            operation.type = StockOperation::Remove;
+        }
+        else if (command == "set" || command == "=") {
+            operation.type = StockOperation::Set;
+        }
+        else {
+            error = "неизвестная операция '" + parts.first() + "'";
+            return false;
+        }
+
+        bool amountOk = false;
+        operation.amount = parts.last().toInt(&amountOk);
+        if (!amountOk || operation.amount < 0) {
+            error = "неверное количество '" + parts.last() + "'";
+            return false;
+        }
+
+        // Название может содержать пробелы: все между операцией и количеством
+        row = findProduct(parts.mid(1, parts.size() - 2).join(' '), error);
+        if (row < 0) {
+            return false;
+        }
+
+        operation.productId = store.at(row).id;
+        return true;
+    }
+
+    void initializeDefaultProducts() {
+        QVector<ProductData> products;
+        products.append(ProductData(1, "Творог", 5, 10));
+        products.append(ProductData(2, "Сыр", 12, 15));
+        products.append(ProductData(3, "Молоко", 18, 20));
+        products.append(ProductData(4, "Яйца", 25, 30));
+        products.append(ProductData(5, "Оливки", 3, 8));
+        store.setProducts(products);
+    }
+
+    void loadFromDatabase() {
+        if (useDatabase) {
+            store.setProducts(dbManager.getAllProducts());
+        }
+    }
+
+    QTextStream out;
+    QTextStream err;
+    ProductStore store;
+    TraceRecorder trace;
+    DatabaseManager dbManager;
+    SupplierCatalog suppliers;
+    bool useDatabase;
+    int batchSize;
+};
+
+int main(int argc, char* argv[])
+{
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+    SetConsoleCP(CP_UTF8);
+#endif
+
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("fridgectl");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Учет продуктов ресторана (консольная версия)");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOptions({
+        { "local", "Работать без базы данных на тестовых данных" },
+        { "driver", "Драйвер Qt SQL (по умолчанию QPSQL)", "driver" },
+        { "host", "Адрес сервера PostgreSQL", "host" },
+        { "port", "Порт сервера PostgreSQL", "port" },
+        { "db", "Имя базы данных", "name" },
+        { "user", "Пользователь", "user" },
+        { "password", "Пароль", "password" },
+        { { "f", "file" }, "Файл операций для пакетного режима ('-' для stdin)", "path" },
+        { "batch-size", "Операций в одной транзакции (по умолчанию 1000)", "n", "1000" },
+        { "shards", "Шардированные счетчики: число слотов (0 - выкл.)", "n", "0" },
+        { "order", "Сформировать заявку в указанной папке и выйти", "dir" },
+        { "consolidated-order", "Сводная заявка по всем локациям в указанной папке", "dir" },
+        { "supplier-orders", "Отдельная заявка каждому поставщику в указанной папке", "dir" },
+        { "suppliers", "Загрузить каталог поставщиков из файла", "path" },
+        { "prices", "Загрузить цены упаковок из файла ('<продукт>; <цена>')", "path" },
+        { "barcodes", "Загрузить штрихкоды из файла ('<штрихкод>; <продукт>[; <упаковок>]')", "path" },
+        { "stock-take", "Инвентаризация: сверить файл пересчета (.csv или .pb) с остатками", "path" },
+        { "apply", "С --stock-take: исправить остатки по пересчету" },
+        { "zero-missing", "С --stock-take: продукты, которых нет в пересчете, считать нулевыми" },
+        { "import-catalog", "Загрузить каталог продуктов из файла (.pb - снимок, иначе CSV) через COPY", "path" },
+        { "export-catalog", "Выгрузить каталог продуктов в файл (.pb - снимок, иначе CSV) через COPY", "path" },
+        { "scan", "Принимать сканы штрихкодов: evdev:/dev/input/eventN, файл или FIFO", "source" },
+        { "location", "Работать с одной локацией (id, 0 - все)", "id", "0" },
+        { "server", "Режим сервера остатков: адрес host:port или имя локального сокета", "address" },
+        { "trace", "Записать вызовы базы в трассу для fridge_replay", "path" },
+        { { "v", "verbose" }, "Подробный журнал SQL" },
+    });
+    parser.process(app);
+
+    if (!parser.isSet("verbose")) {
+        // В пакетном режиме построчный журнал съедает большую часть времени
+        QLoggingCategory::setFilterRules("*.debug=false");
+    }
+
+    FridgeCtl ctl;
+    ctl.setBatchSize(parser.value("batch-size").toInt());
+    if (parser.isSet("trace") && !ctl.startTrace(parser.value("trace"))) {
+        return 1;
+    }
+
+    // Для --order каталог целиком не нужен: заявка строится на сервере
+    const bool orderOnly = (parser.isSet("order") || parser.isSet("consolidated-order") || parser.isSet("supplier-orders"))
+        && !parser.isSet("file") && !parser.isSet("suppliers") && !parser.isSet("prices") && !parser.isSet("barcodes")
+        && !parser.isSet("stock-take");
+    // Загрузка и выгрузка каталога идут мимо хранилища, в память он не нужен
+    const bool catalogCopy = parser.isSet("import-catalog") || parser.isSet("export-catalog");
+    if (!ctl.connect(parser, !orderOnly && !catalogCopy)) {
+        return 1;
+    }
+
+    if (catalogCopy) {
+        return ctl.copyCatalog(parser.value("import-catalog"), parser.value("export-catalog")) ? 0 : 2;
+    }
+
+    if (parser.isSet("suppliers")) {
+        QFile input(parser.value("suppliers"));
+        if (!input.open(QIODevice::ReadOnly)) {
+            QTextStream(stderr) << "Не удалось открыть " << input.fileName() << Qt::endl;
+            return 1;
+        }
+        if (!ctl.importSuppliers(input)) {
+            return 2;
+        }
+        if (!parser.isSet("file") && !parser.isSet("prices") && !parser.isSet("order") && !parser.isSet("supplier-orders")
+            && !parser.isSet("consolidated-order") && !parser.isSet("server")
+            && !parser.isSet("barcodes") && !parser.isSet("scan") && !parser.isSet("stock-take")) {
+            return 0;
+        }
+    }
+
+    if (parser.isSet("prices")) {
+        QFile input(parser.value("prices"));
+        if (!input.open(QIODevice::ReadOnly)) {
+            QTextStream(stderr) << "Не удалось открыть " << input.fileName() << Qt::endl;
+            return 1;
+        }
+        if (!ctl.importPrices(input)) {
+            return 2;
+        }
+        if (!parser.isSet("file") && !parser.isSet("order") && !parser.isSet("supplier-orders")
+            && !parser.isSet("consolidated-order") && !parser.isSet("server")
+            && !parser.isSet("barcodes") && !parser.isSet("scan") && !parser.isSet("stock-take")) {
+            return 0;
+        }
+    }
+
+    if (parser.isSet("barcodes")) {
+        QFile input(parser.value("barcodes"));
+        if (!input.open(QIODevice::ReadOnly)) {
+            QTextStream(stderr) << "Не удалось открыть " << input.fileName() << Qt::endl;
+            return 1;
+        }
+        if (!ctl.importBarcodes(input)) {
+            return 2;
+        }
+        if (!parser.isSet("scan") && !parser.isSet("file") && !parser.isSet("server") && !parser.isSet("stock-take")) {
+            return 0;
+        }
+    }
+
+    if (parser.isSet("stock-take")) {
+        return ctl.stockTake(parser.value("stock-take"), parser.isSet("apply"), parser.isSet("zero-missing")) ? 0 : 2;
+    }
+
+    if (parser.isSet("scan")) {
+        return ctl.scan(app, parser.value("scan")) ? 0 : 1;
+    }
+
+    if (parser.isSet("file")) {
+        const QString path = parser.value("file");
+        QFile input(path);
+        bool opened = path == "-"
+            ? input.open(stdin, QIODevice::ReadOnly)
+            : input.open(QIODevice::ReadOnly);
+        if (!opened) {
+            QTextStream(stderr) << "Не удалось открыть " << path << Qt::endl;
+            return 1;
+        }
+        return ctl.applyManifest(input) ? 0 : 2;
+    }
+
+    if (parser.isSet("order")) {
+        return ctl.generateOrder(parser.value("order")) ? 0 : 1;
+    }
+
+    if (parser.isSet("server")) {
+        return ctl.serve(app, parser.value("server")) ? 0 : 1;
+    }
+
+    if (parser.isSet("supplier-orders")) {
+        return ctl.generateSupplierOrders(parser.value("supplier-orders")) ? 0 : 1;
+    }
+
+    if (parser.isSet("consolidated-order")) {
+        return ctl.generateConsolidatedOrder(parser.value("consolidated-order")) ? 0 : 1;
+    }
+
+    ctl.run();
+    return 0;
+}
@@ -7,57 +7,39 @@
 #include <QDateTime>
 #include <QStandardPaths>
 #include <QDir>
+#include <QSettings>
+#include <QTimer>
+#include <QVariantMap>
 
 
+#include "ConnectionMonitor.h"
 #include "DatabaseManager.h"
-
-class Product : public QObject
-{
-    Q_OBJECT
-        Q_PROPERTY(int id READ id CONSTANT)
-        Q_PROPERTY(QString name READ name CONSTANT)
-        Q_PROPERTY(int currentQuantity READ currentQuantity WRITE setCurrentQuantity NOTIFY currentQuantityChanged)
-        Q_PROPERTY(int normQuantity READ normQuantity CONSTANT)
-        Q_PROPERTY(bool needsOrder READ needsOrder NOTIFY currentQuantityChanged)
-        Q_PROPERTY(int orderQuantity READ orderQuantity NOTIFY currentQuantityChanged)
-
-public:
-    Product(QObject* parent = nullptr) : QObject(parent) {}
-    Product(int id, const QString& name, int currentQty, int normQty, QObject* parent = nullptr)
-        : QObject(parent), m_id(id), m_name(name), m_currentQuantity(currentQty), m_normQuantity(normQty) {
-    }
-
-    int id() const { return m_id; }
-    QString name() const { return m_name; }
-    int currentQuantity() const { return m_currentQuantity; }
-    int normQuantity() const { return m_normQuantity; }
-    bool needsOrder() const { return m_currentQuantity < m_normQuantity; }
-    int orderQuantity() const { return qMax(0, m_normQuantity - m_currentQuantity); }
-
-    void setCurrentQuantity(int quantity) {
-        if (m_currentQuantity != quantity) {
-            m_currentQuantity = quantity;
-            emit currentQuantityChanged();
-        }
-    }
-
-signals:
-    void currentQuantityChanged();
-
-private:
-    int m_id = 0;
-    QString m_name;
-    int m_currentQuantity = 0;
-    int m_normQuantity = 0;
-};
+#include "DirectoryModel.h"
+#include "InventoryClient.h"
+#include "Money.h"
+#include "OrderConsolidator.h"
+#include "OperationTrace.h"
+#include "OrderExporter.h"
+#include "ProductFilterModel.h"
+#include "ProductStore.h"
+#include "ScanIngest.h"
+#include "StockHistory.h"
+#include "StockTake.h"
 
 class FridgeManager : public QObject
 {
     Q_OBJECT
-        Q_PROPERTY(QQmlListProperty<Product> products READ products NOTIFY productsChanged)
+        Q_PROPERTY(ProductStore* products READ products NOTIFY productsChanged)
         Q_PROPERTY(bool databaseConnected READ databaseConnected NOTIFY databaseStatusChanged)
         Q_PROPERTY(QString databaseStatus READ databaseStatus NOTIFY databaseStatusChanged)
         Q_PROPERTY(QString lastSavePath READ lastSavePath NOTIFY lastSavePathChanged)
+        Q_PROPERTY(DirectoryModel* directories READ directories CONSTANT)
+        Q_PROPERTY(ProductFilterModel* productView READ productView CONSTANT)
+        Q_PROPERTY(QStringList locationNames READ locationNames NOTIFY locationsChanged)
+        Q_PROPERTY(int currentLocationIndex READ currentLocationIndex WRITE setCurrentLocationIndex NOTIFY locationsChanged)
+        Q_PROPERTY(QStringList expiryWarnings READ expiryWarnings NOTIFY expiryWarningsChanged)
+        Q_PROPERTY(QString valuation READ valuation NOTIFY valuationChanged)
+        Q_PROPERTY(QString scanStatus READ scanStatus NOTIFY scanStatusChanged)
 
 public:
     explicit FridgeManager(QObject* parent = nullptr)
@@ -65,61 +47,160 @@ public:
         , m_databaseConnected(false)
         , m_databaseStatus("Подключение к БД...")
         , m_lastSavePath("")
+        , m_productView(&m_store)
     {
+        // Всплеск изменений (пакетный приход, синхронизация) перерисовывается раз в кадр
+        m_store.setNotificationInterval(QSettings().value("ui/notifyIntervalMs", RowChangeBatcher::FrameIntervalMs).toInt());
+        connect(&m_store, &ProductStore::valuationChanged, this, &FridgeManager::valuationChanged);
+
         
         initializeDatabase();
+        initializeDirectories();
+        initializeHistory();
+        initializeScanner();
     }
 
-    QQmlListProperty<Product> products() {
-        return QQmlListProperty<Product>(this, &m_products);
-    }
+    ProductStore* products() { return &m_store; }
 
     bool databaseConnected() const { return m_databaseConnected; }
     QString databaseStatus() const { return m_databaseStatus; }
     QString lastSavePath() const { return m_lastSavePath; }
+    DirectoryModel* directories() { return &m_directories; }
+    ProductFilterModel* productView() { return &m_productView; }
+    QStringList expiryWarnings() const { return m_expiryWarnings; }
+    QString scanStatus() const { return m_scanStatus; }
+
+    // Суммы хранилище держит инкрементально - здесь только форматирование
+    QString valuation() const {
+        return QString("💰 Остатки: %1 ₽ · Заявка: %2 ₽")
+            .arg(Money::format(m_store.stockValue(), ','))
+            .arg(Money::format(m_store.orderCost(), ','));
+    }
 
-    Q_INVOKABLE void addProductQuantity(int index, int amount) {
-        if (index >= 0 && index < m_products.size()) {
-            Product* product = m_products[index];
+    // Первый пункт - все локации сразу, дальше по одной
+    QStringList locationNames() const {
+        QStringList names;
+        names << "Все локации";
+        for (const LocationInfo& location : m_locations) {
+            names << location.name;
+        }
+        return names;
+    }
 
-            
-            if (m_databaseConnected) {
-                if (m_dbManager.addProductQuantity(product->id(), amount)) {
-                    product->setCurrentQuantity(product->currentQuantity() + amount);
+    int currentLocationIndex() const {
+        for (int i = 0; i < m_locations.size(); ++i) {
+            if (m_locations.at(i).id == m_dbManager.location()) {
+                return i + 1;
+            }
+        }
+        return 0;
+    }
+
+    void setCurrentLocationIndex(int index) {
+        const int locationId = (index > 0 && index <= m_locations.size()) ? m_locations.at(index - 1).id : 0;
+        if (locationId == m_dbManager.location()) {
+            return;
+        }
+
+        TraceEvent event(TraceEvent::UiSelectLocation);
+        event.value = locationId;
+        TraceSpan span(&m_trace, event);
+
+        m_dbManager.setLocation(locationId);
+        QSettings().setValue("storage/locationId", locationId);
+        if (m_databaseConnected) {
+            loadProductsFromDatabase(m_dbManager.getAllProducts());
+        }
+        openHistory();
+        span.done(true);
+        emit locationsChanged();
+    }
+
+    Q_INVOKABLE void addProductQuantity(int index, int amount) {
+        if (m_store.isValidRow(index)) {
+            const ProductData& product = m_store.at(index);
+            TraceSpan span(&m_trace, TraceEvent::stock(TraceEvent::UiTap, StockOperation::Add, product.id, amount));
+
+            // Через сервер: сразу в памяти, ошибку вернет сервер
+            if (m_useServer) {
+                if (span.done(m_server.applyOperations({ StockOperation(StockOperation::Add, product.id, amount) }) != 0)) {
+                    m_store.addQuantity(index, amount);
                 }
             }
+            else if (m_databaseConnected || m_dbManager.hasConnectionSettings()) {
+                span.done(writeVersioned(index, StockOperation::Add, amount));
+            }
             else {
-                product->setCurrentQuantity(product->currentQuantity() + amount);
+                span.done(m_store.addQuantity(index, amount));
             }
-            emit productsChanged();
         }
     }
 
     Q_INVOKABLE void removeProductQuantity(int index, int amount) {
-        if (index >= 0 && index < m_products.size()) {
-            Product* product = m_products[index];
-            if (product->currentQuantity() >= amount) {
-                
-                if (m_databaseConnected) {
-                    if (m_dbManager.removeProductQuantity(product->id(), amount)) {
-                        product->setCurrentQuantity(product->currentQuantity() - amount);
+        if (m_store.isValidRow(index)) {
+            const ProductData& product = m_store.at(index);
+            if (product.currentQuantity >= amount) {
+                TraceSpan span(&m_trace, TraceEvent::stock(TraceEvent::UiTap, StockOperation::Remove, product.id, amount));
+
+                if (m_useServer) {
+                    if (span.done(m_server.applyOperations({ StockOperation(StockOperation::Remove, product.id, amount) }) != 0)) {
+                        m_store.removeQuantity(index, amount);
                     }
                 }
+                else if (m_databaseConnected || m_dbManager.hasConnectionSettings()) {
+                    span.done(writeVersioned(index, StockOperation::Remove, amount));
+                }
                 else {
-                    product->setCurrentQuantity(product->currentQuantity() - amount);
+                    span.done(m_store.removeQuantity(index, amount));
                 }
-                emit productsChanged();
             }
         }
     }
 
+    // Приход партией: дата в формате ДД.ММ.ГГГГ (как в поле ввода) или ГГГГ-ММ-ДД,
+    // цена упаковки в рублях ("149,90"); пустая цена - цена продукта не меняется
+    Q_INVOKABLE bool receiveLot(int index, int amount, const QString& expiresOn, const QString& price = QString()) {
+        if (!m_store.isValidRow(index) || !m_databaseConnected) {
+            return false;
+        }
+
+        QDate expiry = QDate::fromString(expiresOn.trimmed(), "dd.MM.yyyy");
+        if (!expiry.isValid()) {
+            expiry = QDate::fromString(expiresOn.trimmed(), Qt::ISODate);
+        }
+        if (!expiry.isValid()) {
+            return false;
+        }
+
+        qint64 unitCost = -1;
+        if (!price.trimmed().isEmpty() && !Money::parse(price, unitCost)) {
+            return false;
+        }
+
+        const int productId = m_store.at(index).id;
+        TraceSpan span(&m_trace, TraceEvent::lot(TraceEvent::UiReceiveLot, productId, amount, expiry, unitCost));
+        ProductData current;
+        if (!m_dbManager.receiveLot(productId, amount, expiry, unitCost, &current)) {
+            qWarning() << "❌ Lot not received:" << m_dbManager.getLastError();
+            return false;
+        }
+        // Остаток, срок ближайшей партии и новая средняя цена - из базы
+        m_store.refreshProduct(current);
+        return span.done(true);
+    }
+
+    Q_INVOKABLE void dismissExpiryWarnings() {
+        m_expiryWarnings.clear();
+        emit expiryWarningsChanged();
+    }
+
     
     Q_INVOKABLE QString generateOrder() {
         QString defaultPath = QStandardPaths::writableLocation(QStandardPaths::HomeLocation);
-        QString defaultFileName = defaultPath + "/заявка_поставщику_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss") + ".txt";
+        QString defaultFileName = OrderExporter::orderFileName(defaultPath);
 
         QString result = saveOrderToFile(defaultFileName);
-        if (result.startsWith("Успех:")) {
+        if (result.startsWith("Success:")) {
             m_lastSavePath = defaultFileName;
             emit lastSavePathChanged();
         }
@@ -127,16 +208,73 @@ public:
     }
 
     Q_INVOKABLE QString saveOrderToPath(const QString& directoryPath) {
-        QString fileName = directoryPath + "/заявка_поставщику_" + QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss") + ".txt";
+        QString fileName = OrderExporter::orderFileName(directoryPath);
 
         QString result = saveOrderToFile(fileName);
-        if (result.startsWith("Успех:")) {
+        if (result.startsWith("Success:")) {
             m_lastSavePath = fileName;
             emit lastSavePathChanged();
         }
         return result;
     }
 
+    // Заявки по поставщикам: отдельный файл каждому
+    Q_INVOKABLE QString saveSupplierOrdersToPath(const QString& directoryPath) {
+        TraceEvent event(TraceEvent::UiExportOrder);
+        event.value = TraceEvent::SupplierExport;
+        TraceSpan span(&m_trace, event);
+
+        OrderExporter exporter;
+        exporter.setDatabaseConnected(m_databaseConnected);
+        exporter.setRestaurantName(restaurantName());
+        exporter.setSupplierCatalog(&m_suppliers);
+        if (m_databaseConnected) {
+            exporter.setForecaster(&m_dbManager.forecaster());
+        }
+
+        QStringList files;
+        if (!exporter.saveSupplierOrders(directoryPath, m_store, &files)) {
+            return "Error: " + exporter.getLastError();
+        }
+        span.done(true);
+        if (files.isEmpty()) {
+            return "Success: All products are in sufficient quantity";
+        }
+
+        m_lastSavePath = files.first();
+        emit lastSavePathChanged();
+        return "Success: " + QString::number(files.size()) + " supplier orders saved to " + directoryPath;
+    }
+
+    // Сводная заявка: по каждой локации отдельно, затем общий итог
+    Q_INVOKABLE QString saveConsolidatedOrderToPath(const QString& directoryPath) {
+        TraceEvent event(TraceEvent::UiExportOrder);
+        event.value = TraceEvent::ConsolidatedExport;
+        TraceSpan span(&m_trace, event);
+
+        QString fileName = OrderExporter::orderFileName(directoryPath);
+
+        ConsolidatedOrder order;
+        if (m_databaseConnected && m_dbManager.location() != 0) {
+            // В памяти только выбранная локация - остальные читаются из базы
+            order = OrderConsolidator::fromDatabase(m_dbManager.connectionSettings(), m_locations,
+                m_dbManager.counterShards());
+        }
+        else {
+            order = OrderConsolidator::fromProducts(m_store.products(), m_locations);
+        }
+
+        OrderExporter exporter;
+        exporter.setDatabaseConnected(m_databaseConnected);
+        if (!span.done(exporter.saveConsolidatedOrderToFile(fileName, order))) {
+            return "Error: " + exporter.getLastError();
+        }
+
+        m_lastSavePath = fileName;
+        emit lastSavePathChanged();
+        return "Success: Order saved to " + fileName;
+    }
+
     Q_INVOKABLE QString getDefaultDocumentsPath() {
         return QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
     }
@@ -162,171 +300,495 @@ public:
     }
 
     Q_INVOKABLE bool createDirectory(const QString& dirPath) {
-        return QDir().mkpath(dirPath);
+        if (!QDir().mkpath(dirPath)) {
+            return false;
+        }
+        m_directories.addDirectory(dirPath);
+        return true;
     }
 
-    Q_INVOKABLE QStringList getAvailableDirectories() {
-        QStringList dirs;
-        dirs << getDefaultHomePath() + "/Заявки";
-        dirs << getDesktopPath();
-        dirs << getDefaultDocumentsPath();
-        dirs << getDefaultDownloadsPath();
-        dirs << QDir::currentPath() + "/заявки";
+    // Код из поля сканера (сканер в режиме клавиатуры); приход применится пакетом
+    Q_INVOKABLE bool submitScan(const QString& code) {
+        return m_scanner.submit(code);
+    }
 
-        QStringList availableDirs;
-        for (const QString& dir : dirs) {
-            if (QDir(dir).exists() || QDir().mkpath(dir)) {
-                availableDirs << dir;
-            }
+    // Инвентаризация по файлу пересчета: отчет о расхождениях, с apply -
+    // исправление остатков. {ok, error, summary, rows, unmatched, applied}
+    Q_INVOKABLE QVariantMap stockTake(const QString& filePath, bool apply, bool zeroMissing) {
+        QVariantMap report;
+        QVector<StockCount> counts;
+        QString error;
+        StockTakeResult result;
+        if (!m_databaseConnected || m_useServer) {
+            error = "нужно подключение к базе данных";
+        }
+        else if (StockTake::readCounts(filePath, counts, error)
+            && !m_dbManager.reconcileStockTake(counts, apply, zeroMissing, result)) {
+            error = m_dbManager.getLastError();
+        }
+        report["ok"] = error.isEmpty();
+        report["error"] = error;
+        if (!error.isEmpty()) {
+            return report;
+        }
+
+        QVariantList rows;
+        for (const StockVariance& variance : result.variances) {
+            rows << QVariantMap{
+                { "name", variance.name },
+                { "expected", variance.expected },
+                { "counted", variance.counted },
+                { "delta", variance.delta() },
+                { "cost", Money::format(variance.costDelta(), ',') }
+            };
         }
+        report["rows"] = rows;
+        report["unmatched"] = result.unmatched;
+        report["summary"] = StockTake::summary(result);
+        report["applied"] = result.applied;
+
+        // Исправленные остатки и версии строк - одним запросом каталога
+        if (result.applied) {
+            loadProductsFromDatabase(m_dbManager.getAllProducts());
+        }
+        return report;
+    }
 
-        return availableDirs;
+    // Точки графика остатков продукта за последние days дней: [{t, q}], последняя - текущий остаток
+    Q_INVOKABLE QVariantList stockHistory(int index, int days) {
+        QVariantList points;
+        if (!m_store.isValidRow(index)) {
+            return points;
+        }
+        const ProductData& product = m_store.at(index);
+        const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+        for (const StockPoint& point : m_history.history(product.id, nowMs - qint64(days) * 24 * 60 * 60 * 1000, nowMs)) {
+            points << QVariantMap{ { "t", point.timeMs }, { "q", point.quantity } };
+        }
+        points << QVariantMap{ { "t", nowMs }, { "q", product.currentQuantity } };
+        return points;
+    }
+
+    // Берется из кэша DirectoryModel, без обращения к диску
+    Q_INVOKABLE QStringList getAvailableDirectories() {
+        return m_directories.availablePaths();
     }
 
 signals:
     void productsChanged();
     void databaseStatusChanged();
     void lastSavePathChanged();
+    void locationsChanged();
+    void expiryWarningsChanged();
+    void valuationChanged();
+    void scanStatusChanged();
 
 private:
+    // Сканер штрихкодов: источник scan/source (evdev:/dev/input/eventN, файл
+    // или FIFO) и поле ввода в окне для сканера в режиме клавиатуры
+    void initializeScanner() {
+        QSettings settings;
+        m_scanner.setDebounceMs(settings.value("scan/debounceMs", ScanIngest::DefaultDebounceMs).toInt());
+        m_scanner.setDrainInterval(settings.value("scan/batchIntervalMs", ScanIngest::DefaultDrainIntervalMs).toInt());
+        connect(&m_scanner, &ScanIngest::scansReady, this, &FridgeManager::applyScans);
+        connect(&m_scanner, &ScanIngest::unknownBarcode, this, [this](const QString& code) {
+            setScanStatus("❓ Неизвестный штрихкод " + code);
+        });
+
+        const QString source = settings.value("scan/source").toString();
+        if (!source.isEmpty() && !m_scanner.start(source)) {
+            qWarning() << "⚠️ Scanner input not started:" << m_scanner.getLastError();
+        }
+    }
+
+    // Индекс штрихкодов по строкам загруженного каталога
+    void reloadBarcodes() {
+        QSet<int> productIds;
+        for (const ProductData& product : m_store.products()) {
+            productIds.insert(product.id);
+        }
+        BarcodeIndex index;
+        index.build(m_dbManager.getBarcodes(), productIds);
+        m_scanner.setIndex(index);
+        qDebug() << "🏷️ Barcodes loaded:" << index.size();
+    }
+
+    // Пакет сканирований - одна транзакция. Версии строк в кэше после нее
+    // отстают: ближайшее нажатие "+"/"-" получит конфликт и обновит строку.
+    void applyScans(const QVector<StockOperation>& operations) {
+        bool applied = true;
+        if (m_useServer) {
+            applied = m_server.applyOperations(operations) != 0;
+        }
+        else if (m_databaseConnected || m_dbManager.hasConnectionSettings()) {
+            applied = (m_databaseConnected && m_dbManager.applyStockOperations(operations)) || queueIfOffline(operations);
+        }
+
+        if (!applied) {
+            setScanStatus("❌ Сканирования не приняты: " + m_dbManager.getLastError());
+            return;
+        }
+
+        QStringList received;
+        for (const StockOperation& operation : operations) {
+            const int row = m_store.rowForId(operation.productId);
+            if (row >= 0) {
+                m_store.addQuantity(row, operation.amount);
+                received << QString("%1 +%2").arg(m_store.at(row).name).arg(operation.amount);
+            }
+        }
+        setScanStatus("🏷️ Принято: " + received.join(", "));
+    }
+
+    void setScanStatus(const QString& status) {
+        m_scanStatus = status;
+        emit scanStatusChanged();
+    }
+
+    // Снимки остатков для графиков: раз в history/intervalMinutes, отдельный файл на локацию
+    void initializeHistory() {
+        const int minutes = QSettings().value("history/intervalMinutes", int(StockHistory::DefaultIntervalMs / 60000)).toInt();
+        if (minutes <= 0) {
+            return;
+        }
+        m_historyIntervalMs = qint64(minutes) * 60 * 1000;
+        openHistory();
+        connect(&m_historyTimer, &QTimer::timeout, this, &FridgeManager::takeStockSnapshot);
+        m_historyTimer.start(int(qMin<qint64>(m_historyIntervalMs, 60 * 1000)));
+    }
+
+    void openHistory() {
+        if (m_historyIntervalMs <= 0) {
+            return;
+        }
+        const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QDir().mkpath(directory);
+        const int locationId = m_dbManager.location();
+        const QString fileName = locationId == 0
+            ? QString("stock_history.dat")
+            : QString("stock_history_%1.dat").arg(locationId);
+        if (!m_history.open(QDir(directory).filePath(fileName))) {
+            qWarning() << "⚠️ Stock history disabled:" << m_history.getLastError();
+            return;
+        }
+        takeStockSnapshot();
+    }
+
+    // Снимок привязан к границе интервала: перезапуск терминала не плодит лишних точек
+    void takeStockSnapshot() {
+        if (!m_history.isOpen() || m_store.count() == 0) {
+            return;
+        }
+        const qint64 slotMs = QDateTime::currentMSecsSinceEpoch() / m_historyIntervalMs * m_historyIntervalMs;
+        if (slotMs <= m_history.lastSnapshotMs()) {
+            return;
+        }
+        QVector<int> ids;
+        ids.reserve(m_store.count());
+        for (const ProductData& product : m_store.products()) {
+            ids.append(product.id);
+        }
+        if (!m_history.append(slotMs, ids, m_store.currentQuantities())) {
+            qWarning() << "⚠️ Stock snapshot not saved:" << m_history.getLastError();
+        }
+    }
+
     // ДОБАВЬТЕ: метод инициализации БД
     void initializeDatabase() {
         qDebug() << "🔄 Initializing database connection...";
 
-        if (m_dbManager.connectToDatabase() && m_dbManager.isConnected()) {
-            m_databaseConnected = true;
-            m_databaseStatus = "✅ База данных PostgreSQL подключена";
-
-            // Загружаем продукты из БД
-            auto productsData = m_dbManager.getAllProducts();
-            if (!productsData.isEmpty()) {
-                loadProductsFromDatabase(productsData);
-                qDebug() << "✅ Загружено продуктов из БД:" << productsData.size();
+        // Шардированные счетчики включаются в настройках терминала
+        QSettings settings;
+
+        // Запись трассы для fridge_replay: настройка trace/file или переменная FRIDGE_TRACE
+        const QString tracePath = qEnvironmentVariable("FRIDGE_TRACE", settings.value("trace/file").toString());
+        if (!tracePath.isEmpty()) {
+            if (m_trace.open(tracePath)) {
+                m_dbManager.setTraceRecorder(&m_trace);
+                connect(&m_traceTimer, &QTimer::timeout, this, [this]() { m_trace.flush(); });
+                m_traceTimer.start(TraceRecorder::FlushIntervalMs);
             }
             else {
-                m_databaseStatus = "❌ БД подключена, но продукты не найдены";
-                initializeLocalProducts();
+                qWarning() << "⚠️ Trace not recorded:" << m_trace.getLastError();
             }
         }
+        m_dbManager.setCounterShards(settings.value("storage/counterShards", 0).toInt());
+        m_dbManager.setCounterFoldInterval(settings.value("storage/counterFoldIntervalMs", 60000).toInt());
+
+        // Прогноз расхода для рекомендуемого заказа
+        ConsumptionForecaster::Settings forecast;
+        forecast.smoothingDays = settings.value("forecast/smoothingDays", forecast.smoothingDays).toDouble();
+        forecast.leadTimeDays = settings.value("forecast/leadTimeDays", forecast.leadTimeDays).toDouble();
+        forecast.coverDays = settings.value("forecast/coverDays", forecast.coverDays).toDouble();
+        forecast.safetyFactor = settings.value("forecast/safetyFactor", forecast.safetyFactor).toDouble();
+        m_dbManager.setForecastSettings(forecast);
+
+        // Предупреждения о сроке годности приходят из колеса таймеров DatabaseManager
+        m_dbManager.setExpiryWarningHours(settings.value("lots/warningHours", LotTracker::DefaultWarningHours).toInt());
+        connect(&m_dbManager, &DatabaseManager::lotsExpiring, this, [this](const QVector<ProductLot>& lots) {
+            for (const ProductLot& lot : lots) {
+                const int row = m_store.rowForId(lot.productId);
+                if (row >= 0) {
+                    m_expiryWarnings << QString("%1: %2 уп. до %3").arg(m_store.at(row).name)
+                        .arg(lot.quantity).arg(lot.expiresOn.toString("dd.MM"));
+                }
+            }
+            emit expiryWarningsChanged();
+        });
+
+        // Терминал кухни может работать через сервер остатков без своего подключения к базе
+        const QString serverAddress = settings.value("server/address").toString();
+        if (!serverAddress.isEmpty() && connectToInventoryServer(serverAddress)) {
+            m_locations.append(LocationInfo(DefaultLocationId, "Основной холодильник", "Gourmet"));
+            emit databaseStatusChanged();
+            emit locationsChanged();
+            return;
+        }
+
+        if (m_dbManager.connectToDatabase() && m_dbManager.isConnected()) {
+            loadDatabaseState();
+        }
         else {
-            // Если БД недоступна - локальный режим
+            // Если БД недоступна - локальный режим, монитор продолжит попытки
             m_databaseConnected = false;
             m_databaseStatus = "📋 Локальный режим (БД недоступна)";
             qDebug() << "❌ PostgreSQL недоступна:" << m_dbManager.getLastError();
             initializeLocalProducts();
         }
+
+        // Проверка соединения в фоне и переподключение после обрыва
+        connect(&m_monitor, &ConnectionMonitor::connectionLost, this, [this](const QString& error) {
+            m_databaseConnected = false;
+            m_databaseStatus = "📴 Нет связи с БД, операции сохраняются локально";
+            qWarning() << "📴 Database connection lost:" << error;
+            emit databaseStatusChanged();
+        });
+        connect(&m_monitor, &ConnectionMonitor::connectionRestored, this, [this]() {
+            loadDatabaseState();
+            emit databaseStatusChanged();
+            emit locationsChanged();
+        });
+        m_monitor.start(settings.value("storage/healthIntervalMs", ConnectionMonitor::DefaultIntervalMs).toInt());
+
+        if (m_locations.isEmpty()) {
+            m_locations.append(LocationInfo(DefaultLocationId, "Основной холодильник", "Gourmet"));
+        }
         emit databaseStatusChanged();
+        emit locationsChanged();
     }
 
-    // ДОБАВЬТЕ: метод загрузки из БД
-    void loadProductsFromDatabase(const QVector<ProductData>& productsData) {
-        m_products.clear();
-        for (const auto& productData : productsData) {
-            m_products.append(new Product(
-                productData.id,
-                productData.name,
-                productData.currentQuantity,
-                productData.normQuantity,
-                this
-            ));
+    // Каталог, локации и поставщики из базы: при запуске и после переподключения
+    void loadDatabaseState() {
+        m_databaseConnected = true;
+        m_databaseStatus = "✅ База данных PostgreSQL подключена";
+
+        if (!m_dbManager.loadSupplierCatalog(m_suppliers)) {
+            qWarning() << "⚠️ Supplier catalog not loaded:" << m_dbManager.getLastError();
         }
-    }
 
-    
-    void initializeLocalProducts() {
-        m_products.clear();
+        // Выбранная на терминале локация, если она еще существует
+        m_locations = m_dbManager.getLocations();
+        const int savedLocation = QSettings().value("storage/locationId", 0).toInt();
+        for (const LocationInfo& location : m_locations) {
+            if (location.id == savedLocation) {
+                m_dbManager.setLocation(savedLocation);
+            }
+        }
 
-        m_products.append(new Product(1, "Творог", 5, 10, this));
-        m_products.append(new Product(2, "Сыр", 12, 15, this));
-        m_products.append(new Product(3, "Молоко", 18, 20, this));
-        m_products.append(new Product(4, "Яйца", 25, 30, this));
-        m_products.append(new Product(5, "Оливки", 3, 8, this));
+        // Загружаем продукты из БД
+        auto productsData = m_dbManager.getAllProducts();
+        if (!productsData.isEmpty()) {
+            loadProductsFromDatabase(productsData);
+            qDebug() << "✅ Загружено продуктов из БД:" << productsData.size();
+        }
+        else {
+            m_databaseStatus = "❌ БД подключена, но продукты не найдены";
+            initializeLocalProducts();
+        }
 
-        qDebug() << "📋 Используются локальные тестовые данные";
+        // Партии, срок которых подошел, пока терминал был выключен
+        m_dbManager.checkExpiringLots();
     }
 
-    QString saveOrderToFile(const QString& filePath) {
-        QFileInfo fileInfo(filePath);
-        QDir dir = fileInfo.dir();
-        if (!dir.exists()) {
-            if (!dir.mkpath(".")) {
-                return "Error: Cannot create directory " + dir.absolutePath();
+    // Запись с проверкой версии строки. При конфликте база возвращает
+    // текущую строку: кэш обновляется из нее, и операция повторяется уже от
+    // свежего остатка - без блокировок и без перечитывания каталога.
+    bool writeVersioned(int index, StockOperation::Type type, int amount) {
+        const int productId = m_store.at(index).id;
+        for (int attempt = 0; attempt < MaxWriteAttempts; ++attempt) {
+            const ProductData& product = m_store.at(index);
+            if (type == StockOperation::Remove && product.currentQuantity < amount) {
+                return false;
             }
-        }
 
-        QFile file(filePath);
+            const StockOperation operation(type, productId, amount);
+            ProductData current;
+            switch (m_dbManager.applyVersioned(operation, product.version, current)) {
+            case DatabaseManager::WriteStatus::Applied:
+                m_store.refreshProduct(current);
+                return true;
+            case DatabaseManager::WriteStatus::Conflict:
+                m_store.refreshProduct(current);
+                continue;
+            case DatabaseManager::WriteStatus::Rejected:
+                m_store.refreshProduct(current);
+                return false;
+            case DatabaseManager::WriteStatus::Failed:
+                if (!queueIfOffline({ operation })) {
+                    return false;
+                }
+                return type == StockOperation::Add
+                    ? m_store.addQuantity(index, amount)
+                    : m_store.removeQuantity(index, amount);
+            }
+        }
 
-        if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-            QTextStream stream(&file);
-            stream.setCodec("UTF-8"); 
+        qWarning() << "⚠️ Product" << productId << "keeps changing, write abandoned";
+        return false;
+    }
 
-            
-            stream << "=========================================\n";
-            stream << "           SUPPLIER ORDER\n";
-            stream << "=========================================\n";
-            stream << "Restaurant: 'Gourmet'\n";
-            stream << "Date: " << QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm") << "\n";
-            stream << "DB Status: " << (m_databaseConnected ? "Connected" : "Local mode") << "\n";
-            stream << "=========================================\n\n";
+    // Операция не дошла до базы. Если причина - обрыв соединения, она
+    // ставится в очередь и применяется после переподключения.
+    bool queueIfOffline(const QVector<StockOperation>& operations) {
+        if (!m_dbManager.hasConnectionSettings() || m_dbManager.ping()) {
+            return false;
+        }
 
-            bool hasOrders = false;
-            int totalPacks = 0;
+        m_dbManager.enqueueOperations(operations);
+        if (m_databaseConnected) {
+            m_databaseConnected = false;
+            m_databaseStatus = "📴 Нет связи с БД, операции сохраняются локально";
+            emit databaseStatusChanged();
+        }
+        m_monitor.checkNow();
+        return true;
+    }
 
-            stream << "PRODUCTS TO ORDER:\n";
-            stream << "-----------------------------------------\n";
+    bool connectToInventoryServer(const QString& address) {
+        QVector<ProductData> products;
+        if (!m_server.connectToServer(address) || !m_server.subscribe(products)) {
+            qWarning() << "❌ Inventory server unavailable:" << m_server.getLastError();
+            m_server.disconnectFromServer();
+            return false;
+        }
 
-            for (Product* product : m_products) {
-                if (product->needsOrder()) {
-                    int orderQty = product->orderQuantity();
-                    stream << "- " << product->name() << ": " << orderQty << " packs\n";
-                    hasOrders = true;
-                    totalPacks += orderQty;
+        // Изменения с других терминалов приходят пачкой
+        connect(&m_server, &InventoryClient::productsChanged, this, [this](const QVector<ProductData>& changed) {
+            for (const ProductData& product : changed) {
+                const int row = m_store.rowForId(product.id);
+                if (row >= 0) {
+                    m_store.setCurrentQuantity(row, product.currentQuantity);
                 }
             }
-
-            if (!hasOrders) {
-                stream << "All products are in sufficient quantity.\n";
-            }
-            else {
-                stream << "\n-----------------------------------------\n";
-                stream << "TOTAL TO ORDER: " << totalPacks << " packs\n";
+        });
+
+        // Сервер отклонил операцию - память расходится с ним, берем снимок заново
+        connect(&m_server, &InventoryClient::operationsFinished, this, [this](quint32, bool ok, const QString& error) {
+            QVector<ProductData> products;
+            if (!ok && m_server.subscribe(products)) {
+                qWarning() << "⚠️ Operation rejected by server:" << error;
+                loadProductsFromDatabase(products);
             }
+        });
 
-            // Current stock
-            stream << "\n=========================================\n";
-            stream << "           CURRENT STOCK\n";
-            stream << "=========================================\n";
+        connect(&m_server, &InventoryClient::disconnected, this, [this]() {
+            m_databaseStatus = "❌ Соединение с сервером остатков потеряно";
+            emit databaseStatusChanged();
+        });
 
-            for (Product* product : m_products) {
-                stream << "- " << product->name() << ": " << product->currentQuantity()
-                    << " / " << product->normQuantity() << " packs";
-                if (product->needsOrder()) {
-                    stream << " (NEED " << product->orderQuantity() << ")";
-                }
-                stream << "\n";
-            }
+        m_useServer = true;
+        m_databaseStatus = "🛰️ Подключено к серверу остатков " + address;
+        loadProductsFromDatabase(products);
+        return true;
+    }
 
-            file.close();
+    void initializeDirectories() {
+        QStringList dirs;
+        dirs << getDefaultHomePath() + "/Заявки";
+        dirs << getDesktopPath();
+        dirs << getDefaultDocumentsPath();
+        dirs << getDefaultDownloadsPath();
+        dirs << QDir::currentPath() + "/заявки";
 
-            if (QFile::exists(filePath) && QFileInfo(filePath).size() > 0) {
-                qDebug() << "File saved:" << filePath;
-                return "Success: Order saved to " + filePath;
-            }
-            else {
-                return "Error: File created but empty";
-            }
+        // Папки создаются и проверяются один раз в фоне
+        m_directories.setCandidates(dirs);
+    }
+
+    // ДОБАВЬТЕ: метод загрузки из БД
+    void loadProductsFromDatabase(const QVector<ProductData>& productsData) {
+        m_store.setProducts(productsData);
+        reloadBarcodes();
+        emit productsChanged();
+    }
+
+    
+    void initializeLocalProducts() {
+        QVector<ProductData> products;
+
+        products.append(ProductData(1, "Творог", 5, 10));
+        products.append(ProductData(2, "Сыр", 12, 15));
+        products.append(ProductData(3, "Молоко", 18, 20));
+        products.append(ProductData(4, "Яйца", 25, 30));
+        products.append(ProductData(5, "Оливки", 3, 8));
+
+        m_store.setProducts(products);
+        emit productsChanged();
+
+        qDebug() << "📋 Используются локальные тестовые данные";
+    }
+
+    QString saveOrderToFile(const QString& filePath) {
+        TraceEvent event(TraceEvent::UiExportOrder);
+        event.value = TraceEvent::OrderExport;
+        TraceSpan span(&m_trace, event);
+
+        OrderExporter exporter;
+        exporter.setDatabaseConnected(m_databaseConnected);
+        exporter.setRestaurantName(restaurantName());
+        exporter.setSupplierCatalog(&m_suppliers);
+        if (m_databaseConnected) {
+            exporter.setForecaster(&m_dbManager.forecaster());
         }
-        else {
-            return "Error: Cannot create file " + filePath;
+
+        if (span.done(exporter.saveOrderToFile(filePath, m_store))) {
+            return "Success: Order saved to " + filePath;
         }
+        return "Error: " + exporter.getLastError();
     }
 
-    QList<Product*> m_products;
-    
+    // Ресторан выбранной локации; для всех локаций - перечень через запятую
+    QString restaurantName() const {
+        QStringList restaurants;
+        for (const LocationInfo& location : m_locations) {
+            if ((m_dbManager.location() == 0 || location.id == m_dbManager.location())
+                && !restaurants.contains(location.restaurant)) {
+                restaurants << location.restaurant;
+            }
+        }
+        return restaurants.join(", ");
+    }
+
+    ProductStore m_store;
+    TraceRecorder m_trace;              // до m_dbManager: живет дольше него
+    QTimer m_traceTimer;
     DatabaseManager m_dbManager;
+    ConnectionMonitor m_monitor { &m_dbManager };
+    static const int MaxWriteAttempts = 3;
+    InventoryClient m_server;
+    bool m_useServer = false;
+    QVector<LocationInfo> m_locations;
+    SupplierCatalog m_suppliers;
+    DirectoryModel m_directories;
     bool m_databaseConnected;
     QString m_databaseStatus;
     QString m_lastSavePath;
+    QStringList m_expiryWarnings;
+    StockHistory m_history;
+    QTimer m_historyTimer;
+    qint64 m_historyIntervalMs = 0;
+    ScanIngest m_scanner;
+    QString m_scanStatus;
+    ProductFilterModel m_productView;    // список с поиском поверх m_store
 };
 
 
@@ -374,19 +836,20 @@ int main(int argc, char* argv[])
     app.setApplicationVersion("1.0.0");
     app.setOrganizationName("Restaurant");
 
-    qmlRegisterType<Product>("FridgeManager", 1, 0, "Product");
+    qmlRegisterUncreatableType<ProductStore>("FridgeManager", 1, 0, "ProductStore", "Provided by FridgeManager");
+    qmlRegisterUncreatableType<DirectoryModel>("FridgeManager", 1, 0, "DirectoryModel", "Provided by FridgeManager");
+    qmlRegisterUncreatableType<ProductFilterModel>("FridgeManager", 1, 0, "ProductFilterModel", "Provided by FridgeManager");
 
+    // Объявлен до engine: удаляется после QML, деструктор дописывает трассу
+    FridgeManager manager;
     QQmlApplicationEngine engine;
-
-    FridgeManager* manager = new FridgeManager();
-    engine.rootContext()->setContextProperty("fridgeManager", manager);
+    engine.rootContext()->setContextProperty("fridgeManager", &manager);
 
     qDebug() << "Loading QML...";
 
     if (!loadQml(engine)) {
         qDebug() << "❌ FAILED TO LOAD QML!";
         qDebug() << "Please ensure Main.qml exists in one of the standard locations";
-        delete manager;
         return -1;
     }
 